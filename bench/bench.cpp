@@ -0,0 +1,511 @@
+// postgirl-bench: micro and macro benchmarks of the code paths the UI leans
+// on, printed as JSON so runs can be diffed over time.
+//
+//   postgirl-bench [--filter TEXT] [--max-entries N] [--samples N] [--port N] [--out FILE]
+//
+// Every benchmark is calibrated to run batches of at least BATCH_MS, then
+// timed over --samples batches; the median and the best ns/op are reported.
+// Synthetic data comes from a fixed seed, so two runs work on the same bytes.
+// Collections are generated with 1k entries and every power of ten up to
+// --max-entries (10k by default, 1M for the full suite), and written to
+// bench_tmp/. The request benchmarks talk to an in-process server on --port.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <chrono>
+#include <sys/stat.h>
+#ifdef _WINDOWS
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#endif
+#include "pgstring.h"
+#include "pgvector.h"
+#include "requests.h"
+#include "utils.h"
+#include "httpserver.h"
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/filewritestream.h"
+
+#define BATCH_MS 20
+#define BENCH_DIR "bench_tmp"
+
+typedef struct BenchResult {
+    pg::String group;
+    pg::String name;
+    int64_t n;                  // size parameter (entries, bytes), 0 if none
+    int64_t iterations;         // per sample
+    int samples;
+    double ns_median;           // per op
+    double ns_min;
+    double bytes_per_op;        // 0 when the op has no meaningful size
+} BenchResult;
+
+typedef struct BenchOptions {
+    const char* filter;
+    int64_t max_entries;
+    int samples;
+    int port;
+    const char* out;
+} BenchOptions;
+
+static BenchOptions options;
+static pg::Vector<BenchResult> results;
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+// Keeps the optimizer from dropping the measured work
+static volatile uint64_t sink;
+
+
+static uint64_t nextRandom()
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool selected(const char* group, const char* name)
+{
+    if (options.filter == NULL) return true;
+    pg::String full(group);
+    full.append("/");
+    full.append(name);
+    return strstr(full.buf_, options.filter) != NULL;
+}
+
+static int compareDouble(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y;
+}
+
+// fn(iterations) runs the measured operation that many times
+template<typename Fn>
+static void bench(const char* group, const char* name, int64_t n, double bytes_per_op, Fn fn)
+{
+    if (!selected(group, name)) return;
+    fprintf(stderr, "%s/%s", group, name);
+    if (n) fprintf(stderr, " n=%lld", (long long)n);
+    fflush(stderr);
+
+    // grow the batch until it takes long enough for the clock
+    int64_t iterations = 1;
+    int64_t elapsed;
+    while (true) {
+        int64_t start = nowNs();
+        fn(iterations);
+        elapsed = nowNs() - start;
+        if (elapsed >= BATCH_MS * 1000000LL || iterations >= (1LL << 40)) break;
+        int64_t target = elapsed > 0 ? iterations * BATCH_MS * 1000000LL / elapsed + 1 : iterations * 16;
+        iterations = target > iterations * 16 ? iterations * 16 : target > iterations ? target : iterations * 2;
+    }
+
+    // a single slow op (big collections) is sampled fewer times
+    int samples = options.samples;
+    if (elapsed > 2000000000LL && samples > 3) samples = 3;
+    double* per_op = new double[samples];
+    for (int i=0; i<samples; i++) {
+        int64_t start = nowNs();
+        fn(iterations);
+        per_op[i] = (double)(nowNs() - start) / (double)iterations;
+    }
+    qsort(per_op, (size_t)samples, sizeof(double), compareDouble);
+
+    BenchResult r;
+    r.group.set(group);
+    r.name.set(name);
+    r.n = n;
+    r.iterations = iterations;
+    r.samples = samples;
+    r.ns_median = per_op[samples / 2];
+    r.ns_min = per_op[0];
+    r.bytes_per_op = bytes_per_op;
+    results.push_back(r);
+    delete [] per_op;
+    fprintf(stderr, ": %.1f ns/op\n", r.ns_median);
+}
+
+
+// Synthetic data ////////////////////////////////////////////////////////////
+
+static const char* words[] = { "users", "orders", "items", "search", "accounts", "sessions", "Invoices", "reports" };
+
+static pg::String makeUrl(int i)
+{
+    char buf[128];
+    snprintf(buf, sizeof(buf), "https://api.example.com/v%d/%s/%d?page=%d",
+             (int)(nextRandom() % 3) + 1, words[nextRandom() % 8], i, (int)(nextRandom() % 50));
+    return pg::String(buf);
+}
+
+static pg::String makeJson(int num_items)
+{
+    pg::String json("{\"items\": [");
+    char buf[192];
+    for (int i=0; i<num_items; i++) {
+        snprintf(buf, sizeof(buf), "%s{\"id\": %d, \"name\": \"%s %llu\", \"active\": %s, \"score\": %d.%02d}",
+                 i ? ", " : "", i, words[nextRandom() % 8], (unsigned long long)(nextRandom() % 100000),
+                 nextRandom() % 2 ? "true" : "false", (int)(nextRandom() % 1000), (int)(nextRandom() % 100));
+        json.append(buf);
+    }
+    json.append("], \"total\": 0}");
+    return json;
+}
+
+static Argument makeArgument(const char* name, const char* value, int type)
+{
+    Argument arg;
+    arg.name = pg::String(name);
+    arg.value = pg::String(value);
+    arg.arg_type = type;
+    return arg;
+}
+
+static HistoryArgument makeHistoryArgument(const char* name, const char* value, int type)
+{
+    HistoryArgument arg;
+    arg.name = pg::Atom(name);
+    arg.value = pg::Atom(value);
+    arg.arg_type = type;
+    return arg;
+}
+
+static History makeHistory(int i)
+{
+    History hist;
+    hist.url = pg::Atom(makeUrl(i));
+    hist.req_type = (RequestType)(nextRandom() % 5);
+    hist.content_type = APPLICATION_JSON;
+    hist.args.push_back(makeHistoryArgument("limit", "20", 0));
+    hist.headers.push_back(makeHistoryArgument("Authorization", "Bearer 3f9a1c2b7d", 0));
+    hist.headers.push_back(makeHistoryArgument("Accept", "application/json", 0));
+    if (hist.req_type == POST || hist.req_type == PUT || hist.req_type == PATCH)
+        hist.input_json = pg::Body("{\"name\": \"bench\", \"tags\": [\"a\", \"b\"]}");
+    hist.result = pg::Body(makeJson(1 + (int)(nextRandom() % 3)));
+    hist.process_time = pg::Atom("2024-01-01 12:00:00");
+    hist.timestamp = 1704110400 + i;
+    hist.response_code = nextRandom() % 10 ? 200 : 404;
+    hist.duration_us = 2000 + (int64_t)(nextRandom() % 250000);
+    hist.http_version = HTTP_DEFAULT;
+    hist.response_version = 11;
+    return hist;
+}
+
+
+// Benchmarks ////////////////////////////////////////////////////////////////
+
+static void benchString()
+{
+    bench("string", "construct_short", 0, 0, [](int64_t iterations) {
+        for (int64_t i=0; i<iterations; i++) {
+            pg::String s("/v1/users/42?page=3");
+            sink += (uint64_t)s.buf_[1];
+        }
+    });
+    bench("string", "construct_default", 0, 0, [](int64_t iterations) {
+        for (int64_t i=0; i<iterations; i++) {
+            pg::String s;
+            sink += (uint64_t)s.capacity();
+        }
+    });
+    pg::String url = makeUrl(1);
+    bench("string", "copy", url.length(), 0, [&](int64_t iterations) {
+        for (int64_t i=0; i<iterations; i++) {
+            pg::String s(url);
+            sink += (uint64_t)s.buf_[0];
+        }
+    });
+    bench("string", "append_16", 0, 16, [](int64_t iterations) {
+        pg::String s;
+        for (int64_t i=0; i<iterations; i++) {
+            if ((i & 255) == 0) s.set("");
+            s.append("0123456789abcdef");
+        }
+        sink += (uint64_t)s.length();
+    });
+    bench("string", "set", url.length(), 0, [&](int64_t iterations) {
+        pg::String s;
+        for (int64_t i=0; i<iterations; i++)
+            s.set(url.buf_);
+        sink += (uint64_t)s.buf_[0];
+    });
+    // what every History field costs now, the string is already in the table
+    bench("string", "intern_hit", url.length(), 0, [&](int64_t iterations) {
+        for (int64_t i=0; i<iterations; i++) {
+            pg::Atom a(url);
+            sink += a.id();
+        }
+    });
+}
+
+static void benchVector()
+{
+    const int n = 1000;
+    bench("vector", "push_back_int", n, 0, [](int64_t iterations) {
+        for (int64_t i=0; i<iterations; i++) {
+            pg::Vector<int> v;
+            for (int j=0; j<n; j++) v.push_back(j);
+            sink += (uint64_t)v.size();
+        }
+    });
+    Argument arg = makeArgument("Authorization", "Bearer 3f9a1c2b7d", 0);
+    bench("vector", "push_back_argument", 100, 0, [&](int64_t iterations) {
+        for (int64_t i=0; i<iterations; i++) {
+            pg::Vector<Argument> v;
+            for (int j=0; j<100; j++) v.push_back(arg);
+            sink += (uint64_t)v.size();
+        }
+    });
+    pg::Vector<History> hist;
+    for (int i=0; i<n; i++) hist.push_back(makeHistory(i));
+    bench("vector", "copy_history", n, 0, [&](int64_t iterations) {
+        for (int64_t i=0; i<iterations; i++) {
+            pg::Vector<History> copy(hist);
+            sink += (uint64_t)copy.size();
+        }
+    });
+    bench("vector", "erase_front_history", n, 0, [&](int64_t iterations) {
+        pg::Vector<History> copy(hist);
+        for (int64_t i=0; i<iterations; i++) {
+            if (copy.size() == 0) copy = hist;
+            copy.erase(copy.begin());
+        }
+        sink += (uint64_t)copy.size();
+    });
+}
+
+static void benchStristr()
+{
+    const int n = 10000;
+    pg::Vector<pg::String> urls;
+    int64_t total_bytes = 0;
+    for (int i=0; i<n; i++) {
+        urls.push_back(makeUrl(i));
+        total_bytes += urls.back().length();
+    }
+    // the history search box: one needle against every URL
+    bench("stristr", "urls_miss", n, (double)total_bytes, [&](int64_t iterations) {
+        for (int64_t i=0; i<iterations; i++)
+            for (int j=0; j<n; j++)
+                sink += Stristr(urls[j].buf_, NULL, "CUSTOMERS", NULL) != NULL;
+    });
+    bench("stristr", "urls_hit", n, (double)total_bytes, [&](int64_t iterations) {
+        for (int64_t i=0; i<iterations; i++)
+            for (int j=0; j<n; j++)
+                sink += Stristr(urls[j].buf_, NULL, "invoices", NULL) != NULL;
+    });
+    pg::String body = makeJson(10000);
+    int len = body.length();
+    bench("stristr", "body_miss", len, (double)len, [&](int64_t iterations) {
+        for (int64_t i=0; i<iterations; i++)
+            sink += Stristr(body.buf_, body.buf_ + len, "\"missing_key\"", NULL) != NULL;
+    });
+}
+
+static void benchPrettify()
+{
+    int sizes[] = { 10, 1000, 10000 };
+    for (int s=0; s<3; s++) {
+        pg::String json = makeJson(sizes[s]);
+        int len = json.length();
+        bench("prettify", "json", len, (double)len, [&](int64_t iterations) {
+            for (int64_t i=0; i<iterations; i++) {
+                pg::String pretty = prettify(json);
+                sink += (uint64_t)pretty.buf_[0];
+            }
+        });
+    }
+}
+
+static int64_t fileSize(const char* path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (int64_t)st.st_size : 0;
+}
+
+static void benchCollections()
+{
+    if (!selected("collection", "save") && !selected("collection", "load")) return;
+    mkdir(BENCH_DIR, 0755);
+    pg::String path(BENCH_DIR "/collections.json");
+    for (int64_t n = 1000; n <= options.max_entries; n *= 10) {
+        pg::Vector<Collection> collections;
+        {
+            Collection collection;
+            collection.name = pg::String("bench");
+            collections.push_back(collection);
+        }
+        collections[0].hist.reserve((int)n);
+        for (int64_t i=0; i<n; i++) collections[0].hist.push_back(makeHistory((int)i));
+
+        saveCollection(collections, path);
+        double bytes = (double)fileSize(path.buf_);
+        bench("collection", "save", n, bytes, [&](int64_t iterations) {
+            for (int64_t i=0; i<iterations; i++)
+                sink += saveCollection(collections, path);
+        });
+        bench("collection", "load", n, bytes, [&](int64_t iterations) {
+            for (int64_t i=0; i<iterations; i++) {
+                pg::Vector<Collection> loaded = loadCollection(path);
+                sink += (uint64_t)(loaded.size() ? loaded[0].hist.size() : 0);
+            }
+        });
+    }
+    remove(path.buf_);
+}
+
+static void okHandler(const HttpRequest&, HttpResponse& resp, void*)
+{
+    static const char body[] = "{\"ok\": true}";
+    resp.body = body;
+    resp.body_len = sizeof(body) - 1;
+}
+
+static void benchRequests()
+{
+    if (!selected("request", "prepare") && !selected("request", "keepalive") && !selected("request", "new_connection"))
+        return;
+    HttpServerStats stats;
+    pg::String error;
+    HttpServer* server = httpServerStart("127.0.0.1", options.port, 1, okHandler, NULL, &stats, &error);
+    if (server == NULL) {
+        fprintf(stderr, "request benchmarks skipped: %s\n", error.buf_);
+        return;
+    }
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/bench", options.port);
+    Request hist;
+    hist.url = pg::String(url);
+    hist.http_version = HTTP_1_1;
+    hist.req_type = GET;
+    hist.content_type = APPLICATION_JSON;
+    hist.args.push_back(makeArgument("q", "hello world", 0));
+    hist.headers.push_back(makeArgument("Accept", "application/json", 0));
+
+    // building the curl handle, what a changed request costs before sending
+    bench("request", "prepare", 0, 0, [&](int64_t iterations) {
+        PreparedRequest req;
+        for (int64_t i=0; i<iterations; i++) {
+            hist.args[0].arg_type = (int)(i & 1) * 2;   // changes the signature, not the URL
+            sink += prepareRequest(req, hist);
+        }
+    });
+    hist.args[0].arg_type = 0;
+    // end to end round trip on a reused connection
+    bench("request", "keepalive", 0, 0, [&](int64_t iterations) {
+        PreparedRequest req;
+        prepareRequest(req, hist);
+        int code;
+        for (int64_t i=0; i<iterations; i++) {
+            performPreparedRequest(req, code);
+            sink += (uint64_t)code;
+        }
+    });
+    bench("request", "new_connection", 0, 0, [&](int64_t iterations) {
+        for (int64_t i=0; i<iterations; i++) {
+            PreparedRequest req;
+            prepareRequest(req, hist);
+            int code;
+            performPreparedRequest(req, code);
+            sink += (uint64_t)code;
+        }
+    });
+    httpServerStop(server);
+}
+
+
+// Output ////////////////////////////////////////////////////////////////////
+
+static void writeResults(FILE* fp)
+{
+    char buffer[65536];
+    rapidjson::FileWriteStream stream(fp, buffer, sizeof(buffer));
+    rapidjson::PrettyWriter<rapidjson::FileWriteStream> writer(stream);
+    writer.StartObject();
+    writer.Key("benchmark");
+    writer.String("postgirl-bench");
+    writer.Key("timestamp");
+    writer.Int64((int64_t)time(NULL));
+    writer.Key("max_entries");
+    writer.Int64(options.max_entries);
+    writer.Key("results");
+    writer.StartArray();
+    for (int i=0; i<results.size(); i++) {
+        const BenchResult& r = results[i];
+        writer.StartObject();
+        writer.Key("group");
+        writer.String(r.group.buf_);
+        writer.Key("name");
+        writer.String(r.name.buf_);
+        writer.Key("n");
+        writer.Int64(r.n);
+        writer.Key("iterations");
+        writer.Int64(r.iterations);
+        writer.Key("samples");
+        writer.Int(r.samples);
+        writer.Key("ns_per_op");
+        writer.Double(r.ns_median);
+        writer.Key("ns_per_op_min");
+        writer.Double(r.ns_min);
+        if (r.bytes_per_op > 0) {
+            writer.Key("mb_per_sec");
+            writer.Double(r.bytes_per_op / r.ns_median * 1e9 / 1048576.0);
+        }
+        writer.EndObject();
+    }
+    writer.EndArray();
+    writer.EndObject();
+    stream.Put('\n');
+    stream.Flush();
+}
+
+static void usage(const char* program)
+{
+    fprintf(stderr, "usage: %s [--filter TEXT] [--max-entries N] [--samples N] [--port N] [--out FILE]\n", program);
+}
+
+int main(int argc, char** argv)
+{
+    options.filter = NULL;
+    options.max_entries = 10000;
+    options.samples = 5;
+    options.port = 18080;
+    options.out = NULL;
+    for (int i=1; i<argc; i++) {
+        if (i + 1 >= argc) { usage(argv[0]); return 1; }
+        const char* arg = argv[i];
+        const char* value = argv[++i];
+        if      (strcmp(arg, "--filter") == 0)      options.filter = value;
+        else if (strcmp(arg, "--max-entries") == 0) options.max_entries = atoll(value);
+        else if (strcmp(arg, "--samples") == 0)     options.samples = atoi(value);
+        else if (strcmp(arg, "--port") == 0)        options.port = atoi(value);
+        else if (strcmp(arg, "--out") == 0)         options.out = value;
+        else { usage(argv[0]); return 1; }
+    }
+    if (options.samples < 1) options.samples = 1;
+
+    curl_global_init(CURL_GLOBAL_ALL);
+    benchString();
+    benchVector();
+    benchStristr();
+    benchPrettify();
+    benchCollections();
+    benchRequests();
+    curl_global_cleanup();
+
+    FILE* fp = options.out ? fopen(options.out, "wb") : stdout;
+    if (fp == NULL) {
+        fprintf(stderr, "Could not write %s\n", options.out);
+        return 1;
+    }
+    writeResults(fp);
+    if (fp != stdout) fclose(fp);
+    return 0;
+}
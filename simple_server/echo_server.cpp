@@ -0,0 +1,418 @@
+// postgirl-echo: native stand-in for the old Flask test server. Same routes:
+//
+//   /test_route  GET, POST, PATCH, PUT, DELETE: answers with the request as
+//                {"json", "headers", "args", "files", "form"}, multipart files
+//                are saved to data/
+//   /version     "1.0"
+//
+// It runs on the epoll server core (src/httpserver.h) with one loop per
+// thread, so it stays out of the way when measuring Postgirl itself. A few
+// knobs make client side benchmarks reproducible:
+//
+//   --port N            listen port (5000)
+//   --threads N         event loops (one per core)
+//   --latency MS        delay every response, without blocking the loop
+//   --jitter MS         plus a uniform random 0..MS
+//   --error-rate F      fraction of requests answered with --error-status (500)
+//   --response-size N   pad responses to at least N bytes
+//   --verbose           print every response
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "httpserver.h"
+#include "rapidjson/document.h"
+#include "rapidjson/writer.h"
+#include "rapidjson/stringbuffer.h"
+
+#define DATA_DIR "data"
+
+typedef rapidjson::Writer<rapidjson::StringBuffer> JsonWriter;
+
+typedef struct EchoOptions {
+    int port;
+    int threads;
+    int latency_ms;
+    int jitter_ms;
+    double error_rate;
+    int error_status;
+    int response_size;
+    bool verbose;
+} EchoOptions;
+
+static EchoOptions options;
+static volatile sig_atomic_t stop_requested = 0;
+
+
+static uint64_t nextRandom()
+{
+    static thread_local uint64_t state = 0;
+    if (state == 0) state = (uint64_t)(uintptr_t)&state * 2654435761ULL | 1;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+static int hexValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Decodes %XX and '+' into out, the way Flask reads query strings and forms
+static void urlDecode(const char* s, int len, pg::String& out)
+{
+    if (out.capacity() < len + 1) out.realloc(len + 1);
+    int n = 0;
+    for (int i=0; i<len; i++) {
+        if (s[i] == '+') {
+            out.buf_[n++] = ' ';
+        } else if (s[i] == '%' && i + 2 < len && hexValue(s[i+1]) >= 0 && hexValue(s[i+2]) >= 0) {
+            out.buf_[n++] = (char)(hexValue(s[i+1]) * 16 + hexValue(s[i+2]));
+            i += 2;
+        } else {
+            out.buf_[n++] = s[i];
+        }
+    }
+    out.buf_[n] = '\0';
+}
+
+// "a=1&b=2" as JSON object members
+static void writeUrlEncoded(JsonWriter& writer, const char* s, int len)
+{
+    pg::String key, value;
+    const char* end = s + len;
+    while (s < end) {
+        const char* amp = (const char*)memchr(s, '&', (size_t)(end - s));
+        if (amp == NULL) amp = end;
+        if (amp > s) {
+            const char* eq = (const char*)memchr(s, '=', (size_t)(amp - s));
+            const char* key_end = eq ? eq : amp;
+            urlDecode(s, (int)(key_end - s), key);
+            if (eq) urlDecode(eq + 1, (int)(amp - eq - 1), value);
+            else value.set("");
+            writer.Key(key.buf_);
+            writer.String(value.buf_);
+        }
+        s = amp + 1;
+    }
+}
+
+static bool startsWith(const char* s, int len, const char* prefix)
+{
+    int n = (int)strlen(prefix);
+    return len >= n && strncasecmp(s, prefix, (size_t)n) == 0;
+}
+
+// Value of param in a header like 'form-data; name="a"; filename="b"'
+static bool headerParam(const char* s, int len, const char* param, pg::String& out)
+{
+    int param_len = (int)strlen(param);
+    const char* end = s + len;
+    const char* p = (const char*)memchr(s, ';', (size_t)len);
+    while (p && p < end) {
+        p++;
+        while (p < end && *p == ' ') p++;
+        if (end - p > param_len && strncasecmp(p, param, (size_t)param_len) == 0 && p[param_len] == '=') {
+            const char* v = p + param_len + 1;
+            const char* v_end;
+            if (v < end && *v == '"') {
+                v++;
+                v_end = (const char*)memchr(v, '"', (size_t)(end - v));
+                if (v_end == NULL) v_end = end;
+            } else {
+                v_end = (const char*)memchr(v, ';', (size_t)(end - v));
+                if (v_end == NULL) v_end = end;
+            }
+            out.set("");
+            out.append(v, (int)(v_end - v));
+            return true;
+        }
+        p = (const char*)memchr(p, ';', (size_t)(end - p));
+    }
+    return false;
+}
+
+// Same rules as werkzeug's secure_filename: ASCII letters, digits, '.', '_'
+// and '-', spaces become '_', no leading dots
+static void secureFilename(const char* name, pg::String& out)
+{
+    out.set("");
+    const char* base = strrchr(name, '/');
+    base = base ? base + 1 : name;
+    const char* back = strrchr(base, '\\');
+    base = back ? back + 1 : base;
+    while (*base == '.' || *base == '_') base++;
+    for (const char* c = base; *c; c++) {
+        char ch = *c == ' ' ? '_' : *c;
+        if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') ||
+            ch == '.' || ch == '_' || ch == '-')
+            out.append(&ch, 1);
+    }
+}
+
+static void saveFile(const char* filename, const char* data, int len)
+{
+    pg::String name, path(DATA_DIR "/");
+    secureFilename(filename, name);
+    if (name.buf_[0] == '\0') return;
+    path.append(name);
+    FILE* fp = fopen(path.buf_, "wb");
+    if (fp == NULL) return;
+    fwrite(data, 1, (size_t)len, fp);
+    fclose(fp);
+}
+
+typedef struct MultipartPart {
+    const char* headers;
+    int headers_len;
+    const char* data;
+    int data_len;
+} MultipartPart;
+
+// Calls fn for every part of a multipart/form-data body
+template<typename Fn>
+static void forEachPart(const char* body, int body_len, const pg::String& boundary, Fn fn)
+{
+    pg::String delim("--");
+    delim.append(boundary);
+    int delim_len = delim.length();
+    const char* end = body + body_len;
+    const char* p = (const char*)memmem(body, (size_t)body_len, delim.buf_, (size_t)delim_len);
+    while (p) {
+        p += delim_len;
+        if (end - p < 2 || (p[0] == '-' && p[1] == '-')) return;
+        if (p[0] == '\r' && p[1] == '\n') p += 2;
+        const char* head_end = (const char*)memmem(p, (size_t)(end - p), "\r\n\r\n", 4);
+        if (head_end == NULL) return;
+        const char* data = head_end + 4;
+        const char* next = (const char*)memmem(data, (size_t)(end - data), delim.buf_, (size_t)delim_len);
+        if (next == NULL) return;
+        const char* data_end = next;
+        if (data_end - data >= 2 && data_end[-2] == '\r' && data_end[-1] == '\n') data_end -= 2;
+        MultipartPart part = { p, (int)(head_end + 2 - p), data, (int)(data_end - data) };
+        fn(part);
+        p = next;
+    }
+}
+
+static const char* partHeader(const MultipartPart& part, const char* name, int* len)
+{
+    HttpRequest fake;
+    memset(&fake, 0, sizeof(fake));
+    fake.headers = part.headers;
+    fake.headers_len = part.headers_len;
+    return httpFindHeader(fake, name, len);
+}
+
+static void writeEcho(JsonWriter& writer, const HttpRequest& req)
+{
+    int content_type_len = 0;
+    const char* content_type = httpFindHeader(req, "Content-Type", &content_type_len);
+    if (content_type == NULL) content_type = "";
+    bool is_multipart = startsWith(content_type, content_type_len, "multipart/form-data");
+    bool is_form = startsWith(content_type, content_type_len, "application/x-www-form-urlencoded");
+
+    writer.Key("json");
+    rapidjson::Document json;
+    if (startsWith(content_type, content_type_len, "application/json") &&
+        !json.Parse(req.body, (size_t)req.body_len).HasParseError())
+        json.Accept(writer);
+    else
+        writer.Null();
+
+    writer.Key("headers");
+    writer.StartObject();
+    const char* p = req.headers;
+    const char* end = req.headers + req.headers_len;
+    while (p < end) {
+        const char* line_end = (const char*)memchr(p, '\r', (size_t)(end - p));
+        if (line_end == NULL) line_end = end;
+        const char* colon = (const char*)memchr(p, ':', (size_t)(line_end - p));
+        if (colon) {
+            const char* v = colon + 1;
+            while (v < line_end && *v == ' ') v++;
+            writer.Key(p, (rapidjson::SizeType)(colon - p));
+            writer.String(v, (rapidjson::SizeType)(line_end - v));
+        }
+        p = line_end + 2;
+    }
+    writer.EndObject();
+
+    writer.Key("args");
+    writer.StartObject();
+    const char* query = (const char*)memchr(req.target, '?', (size_t)req.target_len);
+    if (query) writeUrlEncoded(writer, query + 1, (int)(req.target + req.target_len - query - 1));
+    writer.EndObject();
+
+    pg::String boundary, name, filename;
+    bool has_boundary = is_multipart && headerParam(content_type, content_type_len, "boundary", boundary);
+
+    writer.Key("files");
+    writer.StartArray();
+    if (has_boundary) {
+        forEachPart(req.body, req.body_len, boundary, [&](const MultipartPart& part) {
+            int len;
+            const char* disposition = partHeader(part, "Content-Disposition", &len);
+            if (disposition == NULL || !headerParam(disposition, len, "filename", filename)) return;
+            headerParam(disposition, len, "name", name);
+            saveFile(filename.buf_, part.data, part.data_len);
+            writer.String(name.buf_);
+        });
+    }
+    writer.EndArray();
+
+    writer.Key("form");
+    writer.StartObject();
+    if (has_boundary) {
+        forEachPart(req.body, req.body_len, boundary, [&](const MultipartPart& part) {
+            int len;
+            const char* disposition = partHeader(part, "Content-Disposition", &len);
+            if (disposition == NULL || headerParam(disposition, len, "filename", filename)) return;
+            if (!headerParam(disposition, len, "name", name)) return;
+            writer.Key(name.buf_);
+            writer.String(part.data, (rapidjson::SizeType)part.data_len);
+        });
+    } else if (is_form) {
+        writeUrlEncoded(writer, req.body, req.body_len);
+    }
+    writer.EndObject();
+}
+
+static bool methodIs(const HttpRequest& req, const char* method)
+{
+    return req.method_len == (int)strlen(method) && strncmp(req.method, method, (size_t)req.method_len) == 0;
+}
+
+static void setBody(HttpResponse& resp, const char* content_type, const char* body, int status)
+{
+    resp.status = status;
+    resp.content_type = content_type;
+    resp.scratch->set(body);
+    resp.body = resp.scratch->buf_;
+    resp.body_len = (size_t)resp.scratch->length();
+}
+
+static void echoHandler(const HttpRequest& req, HttpResponse& resp, void*)
+{
+    if (options.latency_ms > 0 || options.jitter_ms > 0) {
+        int64_t jitter = options.jitter_ms > 0 ? (int64_t)(nextRandom() % (uint64_t)(options.jitter_ms * 1000 + 1)) : 0;
+        resp.delay_us = (int64_t)options.latency_ms * 1000 + jitter;
+    }
+
+    const char* query = (const char*)memchr(req.target, '?', (size_t)req.target_len);
+    int path_len = query ? (int)(query - req.target) : req.target_len;
+    bool test_route = path_len == 11 && strncmp(req.target, "/test_route", 11) == 0;
+    bool version = path_len == 8 && strncmp(req.target, "/version", 8) == 0;
+
+    if (version) {
+        setBody(resp, "text/html; charset=utf-8", "1.0", 200);
+        return;
+    }
+    if (!test_route) {
+        setBody(resp, "application/json", "{\"error\": \"Not Found\"}", 404);
+        return;
+    }
+    if (!methodIs(req, "GET") && !methodIs(req, "POST") && !methodIs(req, "PATCH") &&
+        !methodIs(req, "PUT") && !methodIs(req, "DELETE")) {
+        setBody(resp, "application/json", "{\"error\": \"Method Not Allowed\"}", 405);
+        return;
+    }
+    if (options.error_rate > 0.0 && (double)(nextRandom() % 1000000) < options.error_rate * 1000000.0) {
+        setBody(resp, "application/json", "{\"error\": \"Injected error\"}", options.error_status);
+        return;
+    }
+
+    static thread_local rapidjson::StringBuffer buffer;
+    buffer.Clear();
+    JsonWriter writer(buffer);
+    writer.StartObject();
+    writeEcho(writer, req);
+    int missing = options.response_size - (int)buffer.GetSize() - (int)sizeof(",\"padding\":\"\"}") + 1;
+    if (missing > 0) {
+        writer.Key("padding");
+        char* pad = (char*)malloc((size_t)missing);
+        memset(pad, 'x', (size_t)missing);
+        writer.String(pad, (rapidjson::SizeType)missing);
+        free(pad);
+    }
+    writer.EndObject();
+
+    if (options.verbose) {
+        buffer.Put('\n');
+        fwrite(buffer.GetString(), 1, buffer.GetSize(), stdout);
+        buffer.Pop(1);
+    }
+    resp.status = 200;
+    resp.content_type = "application/json";
+    if (resp.scratch->capacity() < (int)buffer.GetSize() + 1) resp.scratch->realloc((int)buffer.GetSize() + 1);
+    memcpy(resp.scratch->buf_, buffer.GetString(), buffer.GetSize() + 1);
+    resp.body = resp.scratch->buf_;
+    resp.body_len = buffer.GetSize();
+}
+
+static void onSignal(int)
+{
+    stop_requested = 1;
+}
+
+static void usage(const char* program)
+{
+    fprintf(stderr, "usage: %s [--port N] [--threads N] [--latency MS] [--jitter MS] [--error-rate F]\n"
+                    "       [--error-status N] [--response-size BYTES] [--verbose]\n", program);
+}
+
+int main(int argc, char** argv)
+{
+    options.port = 5000;
+    options.threads = (int)std::thread::hardware_concurrency();
+    if (options.threads < 1) options.threads = 1;
+    options.latency_ms = 0;
+    options.jitter_ms = 0;
+    options.error_rate = 0.0;
+    options.error_status = 500;
+    options.response_size = 0;
+    options.verbose = false;
+
+    for (int i=1; i<argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i+1] : NULL;
+        if (strcmp(arg, "--verbose") == 0) { options.verbose = true; continue; }
+        if (value == NULL) { usage(argv[0]); return 1; }
+        if      (strcmp(arg, "--port") == 0)            options.port = atoi(value);
+        else if (strcmp(arg, "--threads") == 0)         options.threads = atoi(value);
+        else if (strcmp(arg, "--latency") == 0)         options.latency_ms = atoi(value);
+        else if (strcmp(arg, "--jitter") == 0)          options.jitter_ms = atoi(value);
+        else if (strcmp(arg, "--error-rate") == 0)      options.error_rate = atof(value);
+        else if (strcmp(arg, "--error-status") == 0)    options.error_status = atoi(value);
+        else if (strcmp(arg, "--response-size") == 0)   options.response_size = atoi(value);
+        else { usage(argv[0]); return 1; }
+        i++;
+    }
+
+    mkdir(DATA_DIR, 0755);
+    HttpServerStats stats;
+    pg::String error;
+    HttpServer* server = httpServerStart("0.0.0.0", options.port, options.threads, echoHandler, NULL, &stats, &error);
+    if (server == NULL) {
+        fprintf(stderr, "%s\n", error.buf_);
+        return 1;
+    }
+    printf("Running app on port %d (%d threads)\n", options.port, options.threads);
+    fflush(stdout);
+
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    while (!stop_requested)
+        usleep(100000);
+
+    httpServerStop(server);
+    printf("\n%lld requests, %.2f MB sent\n", (long long)stats.requests, stats.bytes_sent / 1048576.0);
+    return 0;
+}
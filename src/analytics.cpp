@@ -0,0 +1,513 @@
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include "analytics.h"
+#include "profiler.h"
+#include "pghash.h"
+#include "utils.h"
+#include "imgui.h"
+
+#define ANALYTICS_BUCKETS 60
+#define ANALYTICS_SLOWEST 10
+
+static const char* methodName(RequestType method)
+{
+    switch(method) {
+        case GET:       return "GET";
+        case POST:      return "POST";
+        case DELETE:    return "DELETE";
+        case PATCH:     return "PATCH";
+        case PUT:       return "PUT";
+        case WEBSOCKET: return "WS";
+    }
+    return "?";
+}
+
+static bool isHex(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+// Numbers, UUIDs and hex strings of 8+ characters with at least one digit
+// (object ids, hashes). Words made of hex letters ("facade") are kept.
+static bool isIdSegment(const char* s, int len)
+{
+    if (len == 0) return false;
+    bool digits = true, hex = true, has_digit = false;
+    for (int i=0; i<len; i++) {
+        if (s[i] < '0' || s[i] > '9') digits = false;
+        else has_digit = true;
+        if (!isHex(s[i])) hex = false;
+    }
+    if (digits || (hex && has_digit && len >= 8)) return true;
+    if (len != 36) return false;
+    for (int i=0; i<len; i++) {
+        bool dash = i == 8 || i == 13 || i == 18 || i == 23;
+        if (dash ? s[i] != '-' : !isHex(s[i])) return false;
+    }
+    return true;
+}
+
+int endpointKey(RequestType method, const char* url, char* out, int out_size)
+{
+    int len = 0;
+    #define KEY_PUT(c) do { if (len < out_size-1) out[len++] = (c); } while (0)
+    for (const char* m = methodName(method); *m; m++) KEY_PUT(*m);
+    KEY_PUT(' ');
+
+    const char* p = strstr(url, "://");
+    p = p ? p + 3 : url;
+    while (*p && *p != '/' && *p != '?' && *p != '#') { KEY_PUT(*p); p++; }
+    if (*p != '/') KEY_PUT('/');
+    while (*p == '/') {
+        KEY_PUT('/');
+        p++;
+        const char* seg = p;
+        while (*p && *p != '/' && *p != '?' && *p != '#') p++;
+        if (isIdSegment(seg, (int)(p - seg))) {
+            KEY_PUT(':'); KEY_PUT('i'); KEY_PUT('d');
+        } else {
+            for (const char* c = seg; c < p; c++) KEY_PUT(*c);
+        }
+    }
+    #undef KEY_PUT
+    out[len] = '\0';
+    return len;
+}
+
+const char* endpointName(const EndpointIndex& index, int endpoint)
+{
+    return &index.keys[index.key_offset[endpoint]];
+}
+
+static void growTable(EndpointIndex& index)
+{
+    int size = index.table.size() ? index.table.size() * 2 : 64;
+    index.table.resize(0);
+    index.table.resize(size, 0);
+    uint32_t mask = (uint32_t)size - 1;
+    for (int i=0; i<index.key_hash.size(); i++) {
+        uint32_t slot = (uint32_t)index.key_hash[i] & mask;
+        while (index.table[slot] != 0) slot = (slot + 1) & mask;
+        index.table[slot] = i + 1;
+    }
+}
+
+static int findOrAddEndpoint(EndpointIndex& index, const char* key, int len)
+{
+    if ((index.key_hash.size() + 1) * 2 > index.table.size())
+        growTable(index);
+    uint64_t hash = pg::hash64(key, (size_t)len);
+    uint32_t mask = (uint32_t)index.table.size() - 1;
+    uint32_t slot = (uint32_t)hash & mask;
+    while (index.table[slot] != 0) {
+        int e = index.table[slot] - 1;
+        if (index.key_hash[e] == hash && strcmp(endpointName(index, e), key) == 0)
+            return e;
+        slot = (slot + 1) & mask;
+    }
+    int e = index.key_hash.size();
+    index.key_hash.push_back(hash);
+    index.key_offset.push_back(index.keys.size());
+    for (int i=0; i<=len; i++) index.keys.push_back(key[i]);
+    index.table[slot] = e + 1;
+    return e;
+}
+
+static uint32_t clampDuration(int64_t us)
+{
+    return us <= 0 ? 0 : us > 0xffffffffLL ? 0xffffffffu : (uint32_t)us;
+}
+
+static bool rowMatches(const EndpointIndex& index, int row, const History& hist)
+{
+    return index.timestamp[row] == (int64_t)hist.timestamp && index.status[row] == hist.response_code &&
+           index.duration_us[row] == clampDuration(hist.duration_us);
+}
+
+void syncEndpointIndex(EndpointIndex& index, const Collection& collection, bool last_pending)
+{
+    const pg::Vector<History>& hist = collection.hist;
+    int rows = index.timestamp.size();
+    // retention drops entries from the front: the rows no longer line up
+    bool stale = strcmp(index.collection.buf_, collection.name.buf_) != 0 || rows > hist.size();
+    if (!stale && rows > 0)
+        stale = !rowMatches(index, 0, hist[0]) || !rowMatches(index, rows-1, hist[rows-1]);
+    if (stale) {
+        index.timestamp.resize(0);
+        index.status.resize(0);
+        index.duration_us.resize(0);
+        index.endpoint.resize(0);
+        index.keys.resize(0);
+        index.key_offset.resize(0);
+        index.key_hash.resize(0);
+        index.table.resize(0);
+        index.collection = collection.name;
+        index.generation++;
+        rows = 0;
+    }
+
+    int limit = hist.size();
+    if (last_pending && limit > 0) limit--;
+    if (rows >= limit) return;
+
+    index.timestamp.reserve(limit);
+    index.status.reserve(limit);
+    index.duration_us.reserve(limit);
+    index.endpoint.reserve(limit);
+    char key[1024];
+    for (int i=rows; i<limit; i++) {
+        int len = endpointKey(hist[i].req_type, hist[i].url.buf(), key, (int)sizeof(key));
+        index.timestamp.push_back((int64_t)hist[i].timestamp);
+        index.status.push_back(hist[i].response_code);
+        index.duration_us.push_back(clampDuration(hist[i].duration_us));
+        index.endpoint.push_back(findOrAddEndpoint(index, key, len));
+    }
+    index.generation++;
+}
+
+
+// View //////////////////////////////////////////////////////////////////////
+
+typedef enum StatusFilter {
+    STATUS_ALL = 0,
+    STATUS_2XX,
+    STATUS_3XX,
+    STATUS_4XX,
+    STATUS_5XX,
+    STATUS_FAILED       // no response
+} StatusFilter;
+
+typedef struct EndpointStats {
+    int endpoint;
+    int first;          // into the sorted rows
+    int count;
+    int unknown;        // rows without a duration, sorted first
+    int classes[6];     // failed, 1xx ... 5xx
+    uint32_t p50, p95, p99, max;
+} EndpointStats;
+
+typedef enum StatsColumn {
+    COLUMN_ENDPOINT = 0,
+    COLUMN_COUNT,
+    COLUMN_2XX,
+    COLUMN_4XX,
+    COLUMN_5XX,
+    COLUMN_FAILED,
+    COLUMN_P50,
+    COLUMN_P95,
+    COLUMN_P99,
+    COLUMN_MAX
+} StatsColumn;
+
+// Filtered rows sorted by (endpoint, duration), recomputed when the index or
+// the filters change. Keeps its buffers between recomputations.
+typedef struct EndpointView {
+    EndpointView() { generation = -1; range = 0; status = STATUS_ALL; min_ms = 0; selected = -1; compute_ms = 0.0; }
+
+    int generation;
+    int range;
+    int status;
+    int min_ms;
+    int selected;       // endpoint id, -1 for none
+    double compute_ms;
+
+    pg::Vector<uint64_t> sort_keys;     // endpoint << 32 | duration
+    pg::Vector<int> rows;
+    pg::Vector<uint64_t> tmp_keys;
+    pg::Vector<int> tmp_rows;
+    pg::Vector<EndpointStats> stats;
+} EndpointView;
+
+static EndpointView view;
+
+static const char* range_names[] = { "All time", "Last hour", "Last 24 hours", "Last 7 days", "Last 30 days" };
+static const int64_t range_seconds[] = { 0, 3600, 86400, 7 * 86400, 30 * 86400 };
+static const char* status_names[] = { "Any status", "2xx", "3xx", "4xx", "5xx", "No response" };
+
+static int statusClass(int status)
+{
+    return status >= 100 && status < 600 ? status / 100 : 0;
+}
+
+// LSD radix sort by bytes, passes where every key has the same byte are skipped
+// (the high bytes of the endpoint and duration usually are)
+static void radixSort(pg::Vector<uint64_t>& keys, pg::Vector<int>& rows,
+                      pg::Vector<uint64_t>& tmp_keys, pg::Vector<int>& tmp_rows)
+{
+    int n = keys.size();
+    tmp_keys.resize(n);
+    tmp_rows.resize(n);
+    for (int shift=0; shift<64; shift+=8) {
+        int count[256];
+        memset(count, 0, sizeof(count));
+        for (int i=0; i<n; i++) count[(keys[i] >> shift) & 0xff]++;
+        if (n == 0 || count[(keys[0] >> shift) & 0xff] == n) continue;
+        int offset = 0;
+        for (int b=0; b<256; b++) { int c = count[b]; count[b] = offset; offset += c; }
+        for (int i=0; i<n; i++) {
+            int dst = count[(keys[i] >> shift) & 0xff]++;
+            tmp_keys[dst] = keys[i];
+            tmp_rows[dst] = rows[i];
+        }
+        keys.swap(tmp_keys);
+        rows.swap(tmp_rows);
+    }
+}
+
+// Nearest rank over the sorted durations of one endpoint, unknown ones excluded
+static uint32_t percentile(const EndpointStats& s, float p)
+{
+    int known = s.count - s.unknown;
+    if (known == 0) return 0;
+    int rank = (int)(p * (float)known + 0.999f);
+    if (rank < 1) rank = 1;
+    return (uint32_t)view.sort_keys[s.first + s.unknown + rank - 1];
+}
+
+static void computeView(const EndpointIndex& index)
+{
+    int64_t start = profileNowUs();
+    int64_t since = range_seconds[view.range] ? (int64_t)time(NULL) - range_seconds[view.range] : 0;
+    uint32_t min_us = (uint32_t)view.min_ms * 1000;
+
+    view.sort_keys.resize(0);
+    view.rows.resize(0);
+    int n = index.timestamp.size();
+    view.sort_keys.reserve(n);
+    view.rows.reserve(n);
+    for (int i=0; i<n; i++) {
+        if (since && index.timestamp[i] < since) continue;
+        if (min_us && index.duration_us[i] < min_us) continue;
+        int cls = statusClass(index.status[i]);
+        if (view.status != STATUS_ALL && (view.status == STATUS_FAILED ? cls != 0 : cls != view.status + 1)) continue;
+        view.sort_keys.push_back((uint64_t)index.endpoint[i] << 32 | index.duration_us[i]);
+        view.rows.push_back(i);
+    }
+    radixSort(view.sort_keys, view.rows, view.tmp_keys, view.tmp_rows);
+
+    view.stats.resize(0);
+    for (int i=0; i<view.sort_keys.size(); ) {
+        EndpointStats s;
+        memset(&s, 0, sizeof(s));
+        s.endpoint = (int)(view.sort_keys[i] >> 32);
+        s.first = i;
+        while (i < view.sort_keys.size() && (int)(view.sort_keys[i] >> 32) == s.endpoint) {
+            if ((uint32_t)view.sort_keys[i] == 0) s.unknown++;
+            s.classes[statusClass(index.status[view.rows[i]])]++;
+            i++;
+        }
+        s.count = i - s.first;
+        s.p50 = percentile(s, 0.50f);
+        s.p95 = percentile(s, 0.95f);
+        s.p99 = percentile(s, 0.99f);
+        s.max = (uint32_t)view.sort_keys[i-1];
+        view.stats.push_back(s);
+    }
+    view.compute_ms = (profileNowUs() - start) / 1000.0;
+}
+
+// qsort has no context argument
+static const EndpointIndex* sort_index = NULL;
+static int sort_column = COLUMN_COUNT;
+static bool sort_descending = true;
+
+static int compareStats(const void* lhs, const void* rhs)
+{
+    const EndpointStats& a = *(const EndpointStats*)lhs;
+    const EndpointStats& b = *(const EndpointStats*)rhs;
+    int64_t d = 0;
+    switch (sort_column) {
+        case COLUMN_ENDPOINT: d = strcmp(endpointName(*sort_index, a.endpoint), endpointName(*sort_index, b.endpoint)); break;
+        case COLUMN_COUNT:    d = a.count - b.count; break;
+        case COLUMN_2XX:      d = a.classes[2] - b.classes[2]; break;
+        case COLUMN_4XX:      d = a.classes[4] - b.classes[4]; break;
+        case COLUMN_5XX:      d = a.classes[5] - b.classes[5]; break;
+        case COLUMN_FAILED:   d = a.classes[0] - b.classes[0]; break;
+        case COLUMN_P50:      d = (int64_t)a.p50 - b.p50; break;
+        case COLUMN_P95:      d = (int64_t)a.p95 - b.p95; break;
+        case COLUMN_P99:      d = (int64_t)a.p99 - b.p99; break;
+        case COLUMN_MAX:      d = (int64_t)a.max - b.max; break;
+    }
+    if (d == 0) d = a.endpoint - b.endpoint;
+    if (sort_descending) d = -d;
+    return d < 0 ? -1 : d > 0 ? 1 : 0;
+}
+
+static void sortStats(const EndpointIndex& index)
+{
+    sort_index = &index;
+    if (view.stats.size() > 1)
+        qsort(view.stats.Data, view.stats.size(), sizeof(EndpointStats), compareStats);
+}
+
+// p50 and p95 per time bucket for one endpoint. Its rows are already sorted by
+// duration: walking them in order, a bucket's percentile is reached when its
+// running count crosses the rank, no per bucket sort needed.
+static void timeSeries(const EndpointIndex& index, const EndpointStats& s,
+                       float* p50, float* p95, float* counts, int64_t& t0, int64_t& t1)
+{
+    int bucket_count[ANALYTICS_BUCKETS], seen[ANALYTICS_BUCKETS];
+    memset(bucket_count, 0, sizeof(bucket_count));
+    memset(seen, 0, sizeof(seen));
+    t0 = INT64_MAX; t1 = 0;
+    int begin = s.first + s.unknown, end = s.first + s.count;
+    for (int i=begin; i<end; i++) {
+        int64_t t = index.timestamp[view.rows[i]];
+        if (t <= 0) continue;
+        if (t < t0) t0 = t;
+        if (t > t1) t1 = t;
+    }
+    for (int b=0; b<ANALYTICS_BUCKETS; b++) p50[b] = p95[b] = counts[b] = 0.0f;
+    if (t1 == 0) { t0 = 0; return; }
+    int64_t span = t1 - t0 + 1;
+    for (int pass=0; pass<2; pass++) {
+        for (int i=begin; i<end; i++) {
+            int64_t t = index.timestamp[view.rows[i]];
+            if (t <= 0) continue;
+            int b = (int)((t - t0) * ANALYTICS_BUCKETS / span);
+            if (pass == 0) { bucket_count[b]++; continue; }
+            seen[b]++;
+            float ms = (uint32_t)view.sort_keys[i] / 1000.0f;
+            if (seen[b] == (bucket_count[b] + 1) / 2) p50[b] = ms;
+            if (seen[b] == (int)(0.95f * bucket_count[b] + 0.999f)) p95[b] = ms;
+        }
+    }
+    for (int b=0; b<ANALYTICS_BUCKETS; b++) counts[b] = (float)bucket_count[b];
+}
+
+static void formatTime(int64_t t, char* buf, size_t size)
+{
+    time_t tt = (time_t)t;
+    struct tm* ptm = gmtime(&tt);
+    if (!ptm || strftime(buf, size, "%Y-%m-%d %H:%M:%S", ptm) == 0)
+        snprintf(buf, size, "-");
+}
+
+static void endpointDetails(const EndpointIndex& index, const Collection& collection, const EndpointStats& s)
+{
+    ImGui::Text("%s", endpointName(index, s.endpoint));
+    float p50[ANALYTICS_BUCKETS], p95[ANALYTICS_BUCKETS], counts[ANALYTICS_BUCKETS];
+    int64_t t0, t1;
+    timeSeries(index, s, p50, p95, counts, t0, t1);
+    if (t1 == 0) {
+        ImGui::TextDisabled("No timed requests");
+    } else {
+        char from[32], to[32], overlay[128];
+        formatTime(t0, from, sizeof(from));
+        formatTime(t1, to, sizeof(to));
+        ImGui::Text("%s to %s (UTC)", from, to);
+        snprintf(overlay, sizeof(overlay), "p50 (ms), overall %.1f", s.p50 / 1000.0f);
+        ImGui::PlotLines("##p50", p50, ANALYTICS_BUCKETS, 0, overlay, 0.0f, FLT_MAX, ImVec2(-1.0f, 60.0f));
+        snprintf(overlay, sizeof(overlay), "p95 (ms), overall %.1f", s.p95 / 1000.0f);
+        ImGui::PlotLines("##p95", p95, ANALYTICS_BUCKETS, 0, overlay, 0.0f, FLT_MAX, ImVec2(-1.0f, 60.0f));
+        ImGui::PlotHistogram("##count", counts, ANALYTICS_BUCKETS, 0, "requests", 0.0f, FLT_MAX, ImVec2(-1.0f, 40.0f));
+    }
+
+    ImGui::Text("Slowest requests");
+    if (ImGui::BeginTable("##slowest", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Time (UTC)", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("Status", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("ms", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("URL");
+        ImGui::TableHeadersRow();
+        int begin = s.first + s.unknown;
+        for (int i=s.first+s.count-1; i>=begin && i>=s.first+s.count-ANALYTICS_SLOWEST; i--) {
+            int row = view.rows[i];
+            char when[32];
+            formatTime(index.timestamp[row], when, sizeof(when));
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn(); ImGui::TextUnformatted(when);
+            ImGui::TableNextColumn(); ImGui::Text("%d", index.status[row]);
+            ImGui::TableNextColumn(); ImGui::Text("%.1f", (uint32_t)view.sort_keys[i] / 1000.0f);
+            ImGui::TableNextColumn(); ImGui::TextUnformatted(row < collection.hist.size() ? collection.hist[row].url.buf() : "");
+        }
+        ImGui::EndTable();
+    }
+}
+
+void endpointAnalyticsWindow(bool* open, EndpointIndex& index, const Collection& collection, bool last_pending)
+{
+    syncEndpointIndex(index, collection, last_pending);
+    ImGui::Begin("Endpoint Analytics", open);
+
+    bool changed = view.generation != index.generation;
+    ImGui::PushItemWidth(ImGui::GetFontSize() * 9);
+    changed |= ImGui::Combo("##range", &view.range, range_names, IM_ARRAYSIZE(range_names));
+    ImGui::SameLine();
+    changed |= ImGui::Combo("##status", &view.status, status_names, IM_ARRAYSIZE(status_names));
+    ImGui::SameLine();
+    changed |= ImGui::InputInt("Slower than (ms)", &view.min_ms);
+    if (view.min_ms < 0) view.min_ms = 0;
+    ImGui::PopItemWidth();
+
+    bool resort = false;
+    if (changed) {
+        computeView(index);
+        view.generation = index.generation;
+        resort = true;
+    }
+    ImGui::Text("%d requests, %d endpoints in \"%s\", %d matching (%.2f ms)",
+                index.timestamp.size(), index.key_hash.size(), index.collection.buf_,
+                view.rows.size(), view.compute_ms);
+    ImGui::SameLine(); Help("Requests are grouped by method, host and path, numeric, UUID and hex path segments become :id. Latencies are curl total times, requests saved before they were recorded count but have no latency.");
+
+    const EndpointStats* selected = NULL;
+    ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY |
+                            ImGuiTableFlags_Resizable | ImGuiTableFlags_Sortable;
+    if (ImGui::BeginTable("##endpoints", 10, flags, ImVec2(0.0f, ImGui::GetContentRegionAvail().y * 0.45f))) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("Endpoint", ImGuiTableColumnFlags_WidthStretch, 0.0f, COLUMN_ENDPOINT);
+        ImGui::TableSetupColumn("Count", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_PreferSortDescending, 0.0f, COLUMN_COUNT);
+        ImGui::TableSetupColumn("2xx", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_PreferSortDescending, 0.0f, COLUMN_2XX);
+        ImGui::TableSetupColumn("4xx", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_PreferSortDescending, 0.0f, COLUMN_4XX);
+        ImGui::TableSetupColumn("5xx", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_PreferSortDescending, 0.0f, COLUMN_5XX);
+        ImGui::TableSetupColumn("Failed", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_PreferSortDescending, 0.0f, COLUMN_FAILED);
+        ImGui::TableSetupColumn("p50 ms", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_PreferSortDescending, 0.0f, COLUMN_P50);
+        ImGui::TableSetupColumn("p95 ms", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_PreferSortDescending, 0.0f, COLUMN_P95);
+        ImGui::TableSetupColumn("p99 ms", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_PreferSortDescending, 0.0f, COLUMN_P99);
+        ImGui::TableSetupColumn("Max ms", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_PreferSortDescending, 0.0f, COLUMN_MAX);
+        ImGui::TableHeadersRow();
+
+        ImGuiTableSortSpecs* specs = ImGui::TableGetSortSpecs();
+        if (specs && specs->SpecsCount > 0 && (specs->SpecsDirty || resort)) {
+            sort_column = (int)specs->Specs[0].ColumnUserID;
+            sort_descending = specs->Specs[0].SortDirection == ImGuiSortDirection_Descending;
+            sortStats(index);
+            specs->SpecsDirty = false;
+        }
+
+        ImGuiListClipper clipper;
+        clipper.Begin(view.stats.size());
+        while (clipper.Step()) {
+            for (int i=clipper.DisplayStart; i<clipper.DisplayEnd; i++) {
+                const EndpointStats& s = view.stats[i];
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn();
+                ImGui::PushID(s.endpoint);
+                if (ImGui::Selectable(endpointName(index, s.endpoint), view.selected == s.endpoint, ImGuiSelectableFlags_SpanAllColumns))
+                    view.selected = s.endpoint;
+                ImGui::PopID();
+                ImGui::TableNextColumn(); ImGui::Text("%d", s.count);
+                ImGui::TableNextColumn(); ImGui::Text("%d", s.classes[2]);
+                ImGui::TableNextColumn(); ImGui::Text("%d", s.classes[4]);
+                ImGui::TableNextColumn(); ImGui::Text("%d", s.classes[5]);
+                ImGui::TableNextColumn(); ImGui::Text("%d", s.classes[0]);
+                ImGui::TableNextColumn(); ImGui::Text("%.1f", s.p50 / 1000.0f);
+                ImGui::TableNextColumn(); ImGui::Text("%.1f", s.p95 / 1000.0f);
+                ImGui::TableNextColumn(); ImGui::Text("%.1f", s.p99 / 1000.0f);
+                ImGui::TableNextColumn(); ImGui::Text("%.1f", s.max / 1000.0f);
+            }
+        }
+        ImGui::EndTable();
+    }
+    for (int i=0; i<view.stats.size(); i++)
+        if (view.stats[i].endpoint == view.selected) selected = &view.stats[i];
+
+    ImGui::Separator();
+    if (selected)
+        endpointDetails(index, collection, *selected);
+    else
+        ImGui::TextDisabled("Select an endpoint for its latency over time");
+    ImGui::End();
+}
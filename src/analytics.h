@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include "requests.h"
+
+// Per endpoint latency analytics over a collection's history. Requests are
+// grouped by method, host and path, with id-like path segments (numbers, UUIDs,
+// long hex strings) collapsed to ":id": GET /users/42 and GET /users/7 are the
+// same endpoint.
+//
+// The history is mirrored in a columnar side index, row i holding History i in
+// parallel arrays. Rows are appended as requests finish, the index is only
+// rebuilt when entries disappear from the history (retention, clearing it, a
+// different collection). Filtering, sorting and percentiles only read the
+// columns, never the History entries or their bodies.
+
+typedef struct EndpointIndex {
+    EndpointIndex() { generation = 0; }
+
+    // columns, one row per History
+    pg::Vector<int64_t> timestamp;
+    pg::Vector<int> status;
+    pg::Vector<uint32_t> duration_us;   // 0 when unknown (saved before it was recorded)
+    pg::Vector<int> endpoint;
+
+    // endpoint table, "METHOD host/path" keys stored back to back in one buffer
+    pg::Vector<char> keys;
+    pg::Vector<int> key_offset;
+    pg::Vector<uint64_t> key_hash;
+    pg::Vector<int> table;              // endpoint + 1, 0 for an empty slot
+
+    pg::String collection;              // name of the indexed collection
+    int generation;                     // bumped on every change
+} EndpointIndex;
+
+// Writes the endpoint key of a request ("GET api.example.com/users/:id") into out,
+// returns its length
+int endpointKey(RequestType method, const char* url, char* out, int out_size);
+
+const char* endpointName(const EndpointIndex& index, int endpoint);
+
+// Brings the index up to date with the collection. The last entry is skipped
+// while last_pending, its request has not finished yet.
+void syncEndpointIndex(EndpointIndex& index, const Collection& collection, bool last_pending);
+
+// Draws the endpoint analytics window for the collection
+void endpointAnalyticsWindow(bool* open, EndpointIndex& index, const Collection& collection, bool last_pending);
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include "assertions.h"
+#include "rapidjson/document.h"
+#include "rapidjson/pointer.h"
+#include "rapidjson/internal/regex.h"
+#include "imgui.h"
+
+
+typedef struct CompiledAssertion {
+    CompiledAssertion() { regex = NULL; valid = true; }
+    ~CompiledAssertion() { delete regex; }
+
+    int type;
+    bool valid;
+    int status;                     // exact code, or class * 100 with status_class set
+    bool status_class;
+    int64_t max_latency_us;
+    rapidjson::Pointer pointer;
+    rapidjson::Document expected;   // kNullType with expected_string when not JSON
+    pg::String expected_string;
+    bool expected_json;
+    rapidjson::internal::Regex* regex;
+} CompiledAssertion;
+
+struct AssertionSet {
+    CompiledAssertion* items;
+    int num;
+    bool needs_json;                // some check reads the body as JSON
+};
+
+
+const char* AssertionTypeToString(int type)
+{
+    switch (type) {
+        case ASSERT_STATUS:         return "Status";
+        case ASSERT_JSON_EQUALS:    return "JSON equals";
+        case ASSERT_JSON_EXISTS:    return "JSON exists";
+        case ASSERT_BODY_REGEX:     return "Body regex";
+        case ASSERT_LATENCY:        return "Latency (ms)";
+    }
+    return "<NONE>";
+}
+
+bool regexGroupsBalanced(const char* pattern)
+{
+    int open = 0;
+    bool in_class = false;
+    for (const char* p = pattern; *p; p++) {
+        if (*p == '\\' && p[1]) { p++; continue; }
+        if (in_class) { in_class = *p != ']'; continue; }
+        if (*p == '[') in_class = true;
+        else if (*p == '(') open++;
+        else if (*p == ')' && --open < 0) return false;
+    }
+    return open == 0;
+}
+
+static void compileOne(CompiledAssertion& item, const HistoryArgument& arg, pg::String* error)
+{
+    item.type = arg.arg_type;
+    switch (arg.arg_type) {
+        case ASSERT_STATUS: {
+            const char* v = arg.value.buf();
+            item.status_class = strlen(v) == 3 && (v[1] == 'x' || v[1] == 'X');
+            item.status = item.status_class ? (v[0] - '0') * 100 : atoi(v);
+            item.valid = item.status > 0;
+            break;
+        }
+        case ASSERT_JSON_EQUALS:
+            item.expected_json = !item.expected.Parse(arg.value.buf()).HasParseError();
+            item.expected_string.set(arg.value.buf());
+            // fall through
+        case ASSERT_JSON_EXISTS:
+            item.pointer = rapidjson::Pointer(arg.name.buf());
+            item.valid = item.pointer.IsValid();
+            break;
+        case ASSERT_BODY_REGEX:
+            item.valid = regexGroupsBalanced(arg.value.buf());
+            if (item.valid) {
+                item.regex = new rapidjson::internal::Regex(arg.value.buf());
+                item.valid = item.regex->IsValid();
+            }
+            break;
+        case ASSERT_LATENCY:
+            item.max_latency_us = (int64_t)(atof(arg.value.buf()) * 1000.0);
+            break;
+        default:
+            item.valid = false;
+    }
+    if (!item.valid && error && error->buf_[0] == '\0') {
+        error->set("Invalid check: ");
+        error->append(AssertionTypeToString(arg.arg_type));
+    }
+}
+
+AssertionSet* compileAssertions(const pg::Vector<HistoryArgument>& assertions, pg::String* error)
+{
+    if (error) error->set("");
+    int num = assertions.size() < MAX_ASSERTIONS ? assertions.size() : MAX_ASSERTIONS;
+    if (num == 0) return NULL;
+
+    AssertionSet* set = new AssertionSet;
+    set->items = new CompiledAssertion[num];
+    set->num = num;
+    set->needs_json = false;
+    for (int i=0; i<num; i++) {
+        compileOne(set->items[i], assertions[i], error);
+        if (assertions[i].arg_type == ASSERT_JSON_EQUALS || assertions[i].arg_type == ASSERT_JSON_EXISTS)
+            set->needs_json = true;
+    }
+    return set;
+}
+
+void freeAssertions(AssertionSet* set)
+{
+    if (set == NULL) return;
+    delete [] set->items;
+    delete set;
+}
+
+int numAssertions(const AssertionSet* set)
+{
+    return set ? set->num : 0;
+}
+
+static bool checkOne(const CompiledAssertion& item, int response_code, const char* body,
+                     const rapidjson::Document* json, int64_t latency_us, char* why, int why_size)
+{
+    if (!item.valid) {
+        snprintf(why, why_size, "%s: invalid check", AssertionTypeToString(item.type));
+        return false;
+    }
+    switch (item.type) {
+        case ASSERT_STATUS: {
+            bool ok = item.status_class ? response_code / 100 == item.status / 100 : response_code == item.status;
+            if (!ok) snprintf(why, why_size, "Status %d", response_code);
+            return ok;
+        }
+        case ASSERT_JSON_EXISTS:
+        case ASSERT_JSON_EQUALS: {
+            const rapidjson::Value* value = json ? item.pointer.Get(*json) : NULL;
+            if (value == NULL) {
+                snprintf(why, why_size, "%s", json ? "JSON Pointer not found" : "Body is not JSON");
+                return false;
+            }
+            if (item.type == ASSERT_JSON_EXISTS) return true;
+            bool ok = item.expected_json ? *value == item.expected
+                                         : value->IsString() && strcmp(value->GetString(), item.expected_string.buf_) == 0;
+            if (!ok) snprintf(why, why_size, "JSON value differs");
+            return ok;
+        }
+        case ASSERT_BODY_REGEX: {
+            rapidjson::internal::RegexSearch search(*item.regex);
+            bool ok = search.Search(body);
+            if (!ok) snprintf(why, why_size, "Body does not match");
+            return ok;
+        }
+        case ASSERT_LATENCY: {
+            bool ok = latency_us <= item.max_latency_us;
+            if (!ok) snprintf(why, why_size, "Took %.1f ms", latency_us / 1000.0);
+            return ok;
+        }
+    }
+    return false;
+}
+
+int checkAssertions(const AssertionSet* set, int response_code, const char* body, size_t body_len,
+                    int64_t latency_us, AssertionStats* stats, pg::String* failure)
+{
+    if (set == NULL) return 0;
+
+    rapidjson::Document document;
+    bool has_json = set->needs_json && !document.Parse(body, body_len).HasParseError();
+
+    int failed = 0;
+    char why[128];
+    for (int i=0; i<set->num; i++) {
+        if (checkOne(set->items[i], response_code, body, has_json ? &document : NULL, latency_us, why, sizeof(why)))
+            continue;
+        if (failed == 0 && failure) failure->set(why);
+        failed++;
+        if (stats) stats->failures[i]++;
+    }
+    if (stats) {
+        if (failed) stats->failed++;
+        else stats->passed++;
+    }
+    return failed;
+}
+
+void drawAssertionStats(AssertionStats& stats, const pg::Vector<HistoryArgument>& assertions)
+{
+    int passed = stats.passed;
+    int failed = stats.failed;
+    if (passed + failed == 0) return;
+    ImGui::Text("Checks: %d passed, %d failed", passed, failed);
+    for (int i=0; i<assertions.size() && i<MAX_ASSERTIONS; i++) {
+        int failures = stats.failures[i];
+        if (failures == 0) continue;
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "  %s %s %s: %d failures",
+                           AssertionTypeToString(assertions[i].arg_type), assertions[i].name.buf(),
+                           assertions[i].value.buf(), failures);
+    }
+}
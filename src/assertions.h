@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include "requests.h"
+
+// Response checks for batch runs (collection runner, load test). They are
+// stored in History::assertions as Arguments, arg_type being the AssertionType:
+//
+//   ASSERT_STATUS       value: expected code, "200" or a class like "2xx"
+//   ASSERT_JSON_EQUALS  name: JSON Pointer, value: expected JSON (or a bare string)
+//   ASSERT_JSON_EXISTS  name: JSON Pointer
+//   ASSERT_BODY_REGEX   value: pattern searched in the body (rapidjson regex syntax)
+//   ASSERT_LATENCY      value: ceiling in milliseconds
+//
+// A set is compiled once per run (pointers, expected values, regexes) and then
+// checked on whichever worker thread received the response, only the counters
+// travel back to the UI.
+
+#define MAX_ASSERTIONS 16
+
+typedef enum AssertionType {
+    ASSERT_STATUS = 0,
+    ASSERT_JSON_EQUALS,
+    ASSERT_JSON_EXISTS,
+    ASSERT_BODY_REGEX,
+    ASSERT_LATENCY,
+    ASSERT_COUNT
+} AssertionType;
+
+typedef struct AssertionSet AssertionSet;
+
+// Pass/fail counters filled from worker threads
+typedef struct AssertionStats {
+    AssertionStats() { reset(); }
+    void reset() {
+        passed = 0; failed = 0;
+        for (int i=0; i<MAX_ASSERTIONS; i++) failures[i] = 0;
+    }
+    std::atomic<int> passed;                    // responses passing every check
+    std::atomic<int> failed;                    // responses failing at least one
+    std::atomic<int> failures[MAX_ASSERTIONS];  // per check
+} AssertionStats;
+
+const char* AssertionTypeToString(int type);
+
+// rapidjson's regex parser asserts on an unclosed group instead of failing,
+// patterns must pass this before being compiled
+bool regexGroupsBalanced(const char* pattern);
+
+// Returns NULL when there is nothing to check; a check that does not compile
+// (bad pointer or regex) is reported in error and always fails.
+AssertionSet* compileAssertions(const pg::Vector<HistoryArgument>& assertions, pg::String* error=NULL);
+
+void freeAssertions(AssertionSet* set);
+
+int numAssertions(const AssertionSet* set);
+
+// Thread safe, the set is only read. Returns the number of failed checks,
+// counts them in stats and describes the first one in failure, if given.
+int checkAssertions(const AssertionSet* set, int response_code, const char* body, size_t body_len,
+                    int64_t latency_us, AssertionStats* stats, pg::String* failure=NULL);
+
+// Counters of a run, with the checks they belong to
+void drawAssertionStats(AssertionStats& stats, const pg::Vector<HistoryArgument>& assertions);
@@ -0,0 +1,345 @@
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include "bodystore.h"
+#include "pghash.h"
+#include "dirent_portable.h"
+
+#ifdef _WINDOWS
+#include <direct.h>
+#define mkdir(path, mode) _mkdir(path)
+#endif
+
+
+// Chained hash table of every live body. Lookups and the final release of an
+// entry happen under store_mutex; copying a handle only touches the refcount.
+static std::mutex store_mutex;
+static BodyEntry** buckets = NULL;
+static int num_buckets = 0;
+static int num_entries = 0;
+static int num_cold = 0;
+static int num_missing = 0;
+static size_t num_bytes = 0;
+
+
+void bodyColdPath(uint64_t hash, char* path, int path_size)
+{
+    snprintf(path, path_size, "%s/%016llx.body", BODY_COLD_DIR, (unsigned long long)hash);
+}
+
+// Reads a cold body back into memory. Must be called with store_mutex held.
+static void makeResident(BodyEntry* e)
+{
+    if (e->data != NULL || e->missing) return;
+    char path[256];
+    bodyColdPath(e->hash, path, sizeof(path));
+    char* data = (char*)malloc((size_t)e->size + 1);
+    FILE* fid = fopen(path, "rb");
+    int read_size = 0;
+    if (fid) {
+        read_size = (int)fread(data, 1, (size_t)e->size, fid);
+        fclose(fid);
+    }
+    if (read_size != e->size) {
+        // whatever is left is not the content of this hash, never keep it as such
+        fprintf(stderr, "Cold body %s is missing or short (%d of %d bytes)\n", path, read_size, e->size);
+        free(data);
+        e->missing = true;
+        num_missing++;
+        return;
+    }
+    data[e->size] = '\0';
+    e->data = data;
+    num_bytes += (size_t)e->size;
+    num_cold--;
+}
+
+
+static void growBuckets()
+{
+    int new_num = num_buckets ? num_buckets * 2 : 1024;
+    BodyEntry** new_buckets = (BodyEntry**)calloc((size_t)new_num, sizeof(BodyEntry*));
+    for (int i=0; i<num_buckets; i++) {
+        BodyEntry* e = buckets[i];
+        while (e) {
+            BodyEntry* next = e->next;
+            int idx = (int)(e->hash & (uint64_t)(new_num-1));
+            e->next = new_buckets[idx];
+            new_buckets[idx] = e;
+            e = next;
+        }
+    }
+    if (buckets) free(buckets);
+    buckets = new_buckets;
+    num_buckets = new_num;
+}
+
+static BodyEntry* acquire(const char* str, int size)
+{
+    if (size <= 0) return NULL;
+    uint64_t hash = pg::hash64(str, (size_t)size);
+
+    std::lock_guard<std::mutex> lock(store_mutex);
+    if (num_entries >= num_buckets - num_buckets/4) growBuckets();
+
+    int idx = (int)(hash & (uint64_t)(num_buckets-1));
+    for (BodyEntry* e = buckets[idx]; e; e = e->next) {
+        if (e->hash == hash && e->size == size) {
+            makeResident(e);
+            if (e->missing) {
+                // the same content again, it replaces what the cold store lost
+                e->data = (char*)malloc((size_t)size + 1);
+                memcpy(e->data, str, (size_t)size);
+                e->data[size] = '\0';
+                e->missing = false;
+                num_missing--;
+                num_cold--;
+                num_bytes += (size_t)size;
+            } else if (memcmp(e->data, str, (size_t)size) != 0) {
+                continue;
+            }
+            e->refcount++;
+            return e;
+        }
+    }
+
+    BodyEntry* e = new BodyEntry;
+    e->hash = hash;
+    e->refcount = 1;
+    e->pins = 0;
+    e->size = size;
+    e->missing = false;
+    e->data = (char*)malloc((size_t)size + 1);
+    memcpy(e->data, str, (size_t)size);
+    e->data[size] = '\0';
+    e->next = buckets[idx];
+    buckets[idx] = e;
+    num_entries++;
+    num_bytes += (size_t)size;
+    return e;
+}
+
+static void release(BodyEntry* e)
+{
+    if (e == NULL) return;
+    // Fast path: we are not the last owner, nobody can free it under us
+    int old = e->refcount.load();
+    while (old > 1) {
+        if (e->refcount.compare_exchange_weak(old, old-1))
+            return;
+    }
+
+    std::lock_guard<std::mutex> lock(store_mutex);
+    if (--e->refcount > 0) return;
+
+    int idx = (int)(e->hash & (uint64_t)(num_buckets-1));
+    BodyEntry** link = &buckets[idx];
+    while (*link != e) link = &(*link)->next;
+    *link = e->next;
+    num_entries--;
+    if (e->data) {
+        num_bytes -= (size_t)e->size;
+        free(e->data);
+    } else {
+        num_cold--;
+        if (e->missing) num_missing--;
+    }
+    delete e;
+}
+
+
+namespace pg {
+
+Body::Body()                                : entry_(NULL) {}
+Body::Body(const char* str)                 : entry_(acquire(str, (int)strlen(str))) {}
+Body::Body(const char* str, int size)       : entry_(acquire(str, size)) {}
+Body::Body(const String& str)               : entry_(acquire(str.buf_, str.length())) {}
+Body::Body(const Body& src)                 : entry_(src.entry_) { if (entry_) entry_->refcount++; }
+Body::~Body()                               { release(entry_); }
+
+const char* Body::buf() const
+{
+    if (entry_ == NULL) return "";
+    if (entry_->data == NULL) {
+        std::lock_guard<std::mutex> lock(store_mutex);
+        makeResident(entry_);
+    }
+    return entry_->data ? entry_->data : "";
+}
+
+const char* Body::pin() const
+{
+    if (entry_ == NULL) return "";
+    entry_->pins++;
+    std::lock_guard<std::mutex> lock(store_mutex);
+    makeResident(entry_);
+    return entry_->data ? entry_->data : "";
+}
+
+void Body::unpin() const
+{
+    if (entry_) entry_->pins--;
+}
+
+Body& Body::operator=(const Body& src)
+{
+    if (src.entry_ == entry_) return *this;
+    if (src.entry_) src.entry_->refcount++;
+    release(entry_);
+    entry_ = src.entry_;
+    return *this;
+}
+
+}
+
+
+pg::Body bodyFindByHash(uint64_t hash)
+{
+    pg::Body body;
+    std::lock_guard<std::mutex> lock(store_mutex);
+    if (num_buckets == 0) return body;
+    int idx = (int)(hash & (uint64_t)(num_buckets-1));
+    for (BodyEntry* e = buckets[idx]; e; e = e->next) {
+        if (e->hash == hash) {
+            e->refcount++;
+            body.entry_ = e;
+            break;
+        }
+    }
+    return body;
+}
+
+pg::Body bodyFromColdStore(uint64_t hash, int size)
+{
+    pg::Body body = bodyFindByHash(hash);
+    if (body.entry_ || size <= 0) return body;
+
+    std::lock_guard<std::mutex> lock(store_mutex);
+    if (num_entries >= num_buckets - num_buckets/4) growBuckets();
+    int idx = (int)(hash & (uint64_t)(num_buckets-1));
+    BodyEntry* e = new BodyEntry;
+    e->hash = hash;
+    e->refcount = 1;
+    e->pins = 0;
+    e->size = size;
+    e->data = NULL;
+    e->missing = false;
+    e->next = buckets[idx];
+    buckets[idx] = e;
+    num_entries++;
+    num_cold++;
+    body.entry_ = e;
+    return body;
+}
+
+bool bodyEvict(const pg::Body& body)
+{
+    BodyEntry* e = body.entry_;
+    if (e == NULL) return false;
+
+    std::lock_guard<std::mutex> lock(store_mutex);
+    if (e->data == NULL) return true;
+    if (e->pins > 0) return false;
+
+    char path[256];
+    bodyColdPath(e->hash, path, sizeof(path));
+    FILE* fid = fopen(path, "rb");
+    if (fid) {
+        // content addressed, an existing file already holds these bytes
+        fclose(fid);
+    } else {
+        mkdir(BODY_COLD_DIR, 0755);
+        fid = fopen(path, "wb");
+        if (fid == NULL) return false;
+        size_t written = fwrite(e->data, 1, (size_t)e->size, fid);
+        fclose(fid);
+        if (written != (size_t)e->size) {
+            remove(path);
+            return false;
+        }
+    }
+
+    free(e->data);
+    e->data = NULL;
+    num_bytes -= (size_t)e->size;
+    num_cold++;
+    return true;
+}
+
+int bodySweepColdStore()
+{
+    DIR* dir = opendir(BODY_COLD_DIR);
+    if (dir == NULL) return 0;
+    int removed = 0;
+    struct dirent* ent;
+    while ((ent = readdir(dir)) != NULL) {
+        // only our own <16 hex digits>.body names
+        const char* name = ent->d_name;
+        char* end = NULL;
+        uint64_t hash = strtoull(name, &end, 16);
+        if (end != name + 16 || strcmp(end, ".body") != 0) continue;
+
+        // under the lock, bodyEvict cannot write the file of a new entry meanwhile
+        std::lock_guard<std::mutex> lock(store_mutex);
+        bool live = false;
+        if (num_buckets > 0) {
+            for (BodyEntry* e = buckets[hash & (uint64_t)(num_buckets-1)]; e && !live; e = e->next)
+                live = e->hash == hash;
+        }
+        if (live) continue;
+        char path[256];
+        bodyColdPath(hash, path, sizeof(path));
+        if (remove(path) == 0) removed++;
+    }
+    closedir(dir);
+    return removed;
+}
+
+int bodyStoreCount()
+{
+    std::lock_guard<std::mutex> lock(store_mutex);
+    return num_entries;
+}
+
+int bodyStoreColdCount()
+{
+    std::lock_guard<std::mutex> lock(store_mutex);
+    return num_cold;
+}
+
+int bodyStoreMissingCount()
+{
+    std::lock_guard<std::mutex> lock(store_mutex);
+    return num_missing;
+}
+
+size_t bodyStoreBytes()
+{
+    std::lock_guard<std::mutex> lock(store_mutex);
+    return num_bytes;
+}
+
+bool bodyIsBinary(const char* data, int size)
+{
+    const unsigned char* p = (const unsigned char*)data;
+    int n = size < BODY_SNIFF_BYTES ? size : BODY_SNIFF_BYTES;
+    for (int i=0; i<n; i++) {
+        unsigned char c = p[i];
+        if (c < 0x20) {
+            if (c != '\t' && c != '\n' && c != '\r' && c != '\f') return true;
+        } else if (c == 0x7f) {
+            return true;
+        } else if (c >= 0x80) {
+            int follow = c >= 0xf0 ? 3 : (c >= 0xe0 ? 2 : (c >= 0xc2 ? 1 : -1));
+            if (follow < 0 || c > 0xf4) return true;
+            for (int k=1; k<=follow; k++) {
+                if (i + k >= size) return true;
+                if (i + k >= n) break;  // sequence cut by the sniff window
+                if ((p[i+k] & 0xc0) != 0x80) return true;
+            }
+            i += follow;
+        }
+    }
+    return false;
+}
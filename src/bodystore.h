@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include "pgstring.h"
+
+// Request and response bodies are content addressed: every distinct payload is
+// stored once in a global table keyed by its 64-bit hash, and a History only
+// holds a refcounted pg::Body handle to it. Repeated calls to the same endpoint
+// then cost one pointer per entry instead of a full copy of the response.
+//
+// Bodies can also be evicted to a cold store on disk (BODY_COLD_DIR): the entry
+// keeps its hash and size but drops its data, which is read back on first access.
+// A cold file that is gone or short marks the body missing: it reads as empty
+// but keeps its size, and is still saved as cold under its hash. Storing the
+// same bytes again brings it back.
+
+#define BODY_COLD_DIR "cold_bodies"
+
+typedef struct BodyEntry {
+    uint64_t hash;
+    std::atomic<int> refcount;
+    std::atomic<int> pins;  // readers on other threads, a pinned body is never evicted
+    int size;               // of the content hashed, even when missing
+    char* data;             // NULL while the body lives in the cold store
+    bool missing;           // the cold file could not be read back
+    BodyEntry* next;        // bucket chain
+} BodyEntry;
+
+namespace pg {
+
+class Body {
+public:
+    Body();
+    Body(const char* str);
+    Body(const char* str, int size);
+    Body(const String& str);
+    Body(const Body& src);
+    ~Body();
+    Body& operator=(const Body& src);
+
+    // buf() reloads a cold body from disk; use resident() first to avoid that
+    const char*         buf() const;
+    inline const char*  end() const                     { return buf() + length(); }
+    inline int          length() const                  { return entry_ && !entry_->missing ? entry_->size : 0; }
+    inline uint64_t     hash() const                    { return entry_ ? entry_->hash : 0; }
+    inline bool         resident() const                { return entry_ == NULL || entry_->data != NULL; }
+    inline bool         missing() const                 { return entry_ && entry_->missing; }
+    inline bool         operator==(const Body& b) const { return entry_ == b.entry_; }
+
+    // Readers outside the UI thread must pin the body while using its data
+    const char*         pin() const;
+    void                unpin() const;
+
+    BodyEntry* entry_;  // NULL for the empty body
+};
+
+}
+
+// Returns a handle to an already stored body, or an empty body if the hash is unknown.
+pg::Body bodyFindByHash(uint64_t hash);
+
+// File of the body with this hash in the cold store, readers that only scan a
+// cold body can map it instead of making the body resident again
+void bodyColdPath(uint64_t hash, char* path, int path_size);
+
+// Registers a body that is only present in the cold store (used when loading).
+pg::Body bodyFromColdStore(uint64_t hash, int size);
+
+// Writes the body to the cold store and frees its memory. Returns false if it
+// could not be evicted (empty, pinned or the file could not be written).
+bool bodyEvict(const pg::Body& body);
+
+// Deletes the cold files no live body uses. Call right after saving, while the
+// saved collections still hold their bodies: the file just written references
+// none of the deleted ones. Returns the number of files removed.
+int bodySweepColdStore();
+
+// Number of distinct bodies and the resident bytes they hold, for the stats display.
+int bodyStoreCount();
+int bodyStoreColdCount();
+int bodyStoreMissingCount();
+size_t bodyStoreBytes();
+
+// True if the data does not look like UTF-8 text: a NUL, a control character
+// other than tab, newline, carriage return or form feed, or an invalid UTF-8
+// sequence in the first BODY_SNIFF_BYTES. Binary bodies are never prettified,
+// are saved as base64 and are shown in the hex viewer.
+#define BODY_SNIFF_BYTES 4096
+bool bodyIsBinary(const char* data, int size);
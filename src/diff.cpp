@@ -0,0 +1,613 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include "diff.h"
+#include "jobs.h"
+#include "pghash.h"
+#include "profiler.h"
+#include "rapidjson/writer.h"
+#include "imgui.h"
+
+typedef rapidjson::Value JsonValue;
+
+
+static int64_t nowUs()
+{
+    struct timeval timecheck;
+    gettimeofday(&timecheck, NULL);
+    return (int64_t)timecheck.tv_sec * 1000000 + (int64_t)timecheck.tv_usec;
+}
+
+static int appendText(Diff& diff, const char* str, int len)
+{
+    int offset = diff.text.size();
+    diff.text.resize(offset + len);
+    memcpy(diff.text.begin() + offset, str, (size_t)len);
+    return offset;
+}
+
+static DiffRow makeRow(int kind)
+{
+    DiffRow row;
+    memset(&row, 0, sizeof(row));
+    row.kind = kind;
+    return row;
+}
+
+
+// Shortest edit script between two hash sequences (Myers, forward greedy with
+// the V arrays of every step kept for the backtrack). ops gets one
+// DIFF_SAME, DIFF_REMOVED (a) or DIFF_ADDED (b) per step, in order. Returns
+// false without touching ops after DIFF_MAX_EDITS edits.
+static bool myers(const uint64_t* a, int n, const uint64_t* b, int m, pg::Vector<char>& ops)
+{
+    int max = n + m < DIFF_MAX_EDITS ? n + m : DIFF_MAX_EDITS;
+    int o = max + 1;
+    pg::Vector<int> v;
+    v.resize(2*max + 3, 0);
+    pg::Vector<int> trace;      // V after step d for k in [-d, d] starts at d*d
+    int end_d = -1;
+    for (int d=0; d<=max && end_d < 0; d++) {
+        for (int k=-d; k<=d; k+=2) {
+            int x = (k == -d || (k != d && v[o+k-1] < v[o+k+1])) ? v[o+k+1] : v[o+k-1] + 1;
+            int y = x - k;
+            while (x < n && y < m && a[x] == b[y]) { x++; y++; }
+            v[o+k] = x;
+            if (x >= n && y >= m) end_d = d;
+        }
+        int base = trace.size();
+        trace.resize(base + 2*d + 1);
+        memcpy(trace.begin() + base, v.begin() + o - d, sizeof(int) * (size_t)(2*d + 1));
+    }
+    if (end_d < 0) return false;
+
+    pg::Vector<char> reversed;
+    int x = n, y = m;
+    for (int d=end_d; d>0; d--) {
+        const int* prev = trace.begin() + (d-1)*(d-1) + (d-1);  // V of step d-1, indexed by k
+        int k = x - y;
+        int prev_k = (k == -d || (k != d && prev[k-1] < prev[k+1])) ? k+1 : k-1;
+        int prev_x = prev[prev_k];
+        int prev_y = prev_x - prev_k;
+        while (x > prev_x && y > prev_y) { reversed.push_back(DIFF_SAME); x--; y--; }
+        reversed.push_back(x == prev_x ? DIFF_ADDED : DIFF_REMOVED);
+        x = prev_x;
+        y = prev_y;
+    }
+    while (x > 0 && y > 0) { reversed.push_back(DIFF_SAME); x--; y--; }
+
+    for (int i=reversed.size()-1; i>=0; i--) ops.push_back(reversed[i]);
+    return true;
+}
+
+// Common prefix and suffix are matched directly, Myers only runs on the middle.
+// When it gives up the middle is removed then added as a whole.
+static void editScript(Diff& diff, const uint64_t* a, int n, const uint64_t* b, int m, pg::Vector<char>& ops)
+{
+    int prefix = 0;
+    while (prefix < n && prefix < m && a[prefix] == b[prefix]) prefix++;
+    int suffix = 0;
+    while (suffix < n - prefix && suffix < m - prefix && a[n-1-suffix] == b[m-1-suffix]) suffix++;
+
+    for (int i=0; i<prefix; i++) ops.push_back(DIFF_SAME);
+    if (!myers(a + prefix, n - prefix - suffix, b + prefix, m - prefix - suffix, ops)) {
+        diff.approximate = true;
+        for (int i=prefix; i<n-suffix; i++) ops.push_back(DIFF_REMOVED);
+        for (int i=prefix; i<m-suffix; i++) ops.push_back(DIFF_ADDED);
+    }
+    for (int i=0; i<suffix; i++) ops.push_back(DIFF_SAME);
+}
+
+
+// Line diff
+
+typedef struct Lines {
+    pg::Vector<int> start;
+    pg::Vector<int> length;
+    pg::Vector<uint64_t> hash;
+} Lines;
+
+static void splitLines(const char* text, int size, Lines& lines)
+{
+    const char* p = text;
+    const char* end = text + size;
+    while (p < end) {
+        const char* eol = (const char*)memchr(p, '\n', (size_t)(end - p));
+        int len = eol ? (int)(eol - p) : (int)(end - p);
+        int trimmed = len > 0 && p[len-1] == '\r' ? len - 1 : len;
+        lines.start.push_back((int)(p - text));
+        lines.length.push_back(trimmed);
+        lines.hash.push_back(pg::hash64(p, (size_t)trimmed));
+        p += len + 1;
+    }
+}
+
+static void lineDiff(Diff& diff, const char* a, int a_size, const char* b, int b_size)
+{
+    Lines left, right;
+    splitLines(a, a_size, left);
+    splitLines(b, b_size, right);
+    pg::Vector<char> ops;
+    editScript(diff, left.hash.begin(), left.hash.size(), right.hash.begin(), right.hash.size(), ops);
+
+    // distance to the closest change, to keep DIFF_CONTEXT lines around each
+    int num_ops = ops.size();
+    pg::Vector<int> near;
+    near.resize(num_ops, DIFF_CONTEXT + 1);
+    int dist = DIFF_CONTEXT + 1;
+    for (int i=0; i<num_ops; i++) {
+        dist = ops[i] != DIFF_SAME ? 0 : dist + 1;
+        near[i] = dist;
+    }
+    dist = DIFF_CONTEXT + 1;
+    for (int i=num_ops-1; i>=0; i--) {
+        dist = ops[i] != DIFF_SAME ? 0 : dist + 1;
+        if (dist < near[i]) near[i] = dist;
+    }
+
+    int x = 0, y = 0, skipped = 0;
+    for (int i=0; i<num_ops; i++) {
+        if (near[i] > DIFF_CONTEXT) {
+            skipped++;
+            x++; y++;
+            continue;
+        }
+        if (skipped > 0) {
+            char note[64];
+            int len = snprintf(note, sizeof(note), "%d unchanged lines", skipped);
+            DiffRow gap = makeRow(DIFF_SKIPPED);
+            gap.left = appendText(diff, note, len);
+            gap.left_len = len;
+            diff.rows.push_back(gap);
+            skipped = 0;
+        }
+        DiffRow row = makeRow(ops[i]);
+        if (ops[i] == DIFF_SAME || ops[i] == DIFF_REMOVED) {
+            row.left_line = x + 1;
+            row.left = appendText(diff, a + left.start[x], left.length[x]);
+            row.left_len = left.length[x];
+            x++;
+        }
+        if (ops[i] == DIFF_SAME || ops[i] == DIFF_ADDED) {
+            row.right_line = y + 1;
+            if (ops[i] == DIFF_ADDED) {
+                row.right = appendText(diff, b + right.start[y], right.length[y]);
+                row.right_len = right.length[y];
+            }
+            y++;
+        }
+        if (ops[i] == DIFF_ADDED) diff.added++;
+        if (ops[i] == DIFF_REMOVED) diff.removed++;
+        diff.rows.push_back(row);
+    }
+    if (skipped > 0 && diff.rows.size() > 0) {
+        char note[64];
+        int len = snprintf(note, sizeof(note), "%d unchanged lines", skipped);
+        DiffRow gap = makeRow(DIFF_SKIPPED);
+        gap.left = appendText(diff, note, len);
+        gap.left_len = len;
+        diff.rows.push_back(gap);
+    }
+}
+
+
+// Structural diff
+
+static uint64_t hashValue(const JsonValue& value)
+{
+    switch (value.GetType()) {
+        case rapidjson::kNullType:      return 0x6e756c6cULL;
+        case rapidjson::kFalseType:     return 0x66616c73ULL;
+        case rapidjson::kTrueType:      return 0x74727565ULL;
+        case rapidjson::kNumberType: {
+            double d = value.GetDouble();   // 1 and 1.0 are the same value
+            return pg::hash64(&d, sizeof(d), 1);
+        }
+        case rapidjson::kStringType:    return pg::hash64(value.GetString(), value.GetStringLength(), 2);
+        case rapidjson::kArrayType: {
+            uint64_t h = 3;
+            for (rapidjson::SizeType i=0; i<value.Size(); i++) {
+                uint64_t e = hashValue(value[i]);
+                h = pg::hash64(&e, sizeof(e), h);
+            }
+            return h;
+        }
+        case rapidjson::kObjectType: {
+            // member order does not matter
+            uint64_t h = 4;
+            for (JsonValue::ConstMemberIterator it = value.MemberBegin(); it != value.MemberEnd(); ++it) {
+                uint64_t e = hashValue(it->value);
+                h += pg::hash64(it->name.GetString(), it->name.GetStringLength(), e);
+            }
+            return h;
+        }
+    }
+    return 0;
+}
+
+// Open addressing table of indices into hashes, power of two size
+static void buildTable(pg::Vector<int>& table, const uint64_t* hashes, int n)
+{
+    int size = 16;
+    while (size < n*2) size *= 2;
+    table.resize(size, 0);
+    for (int i=0; i<n; i++) {
+        int slot = (int)(hashes[i] & (uint64_t)(size-1));
+        while (table[slot] != 0) slot = (slot + 1) & (size-1);
+        table[slot] = i + 1;
+    }
+}
+
+typedef struct JsonDiffer {
+    Diff* diff;
+    pg::Vector<char> path;
+    rapidjson::StringBuffer buffer;
+} JsonDiffer;
+
+static int appendValue(JsonDiffer& d, const JsonValue& value, int* len)
+{
+    d.buffer.Clear();
+    rapidjson::Writer<rapidjson::StringBuffer> writer(d.buffer);
+    value.Accept(writer);
+    *len = (int)d.buffer.GetSize() < DIFF_MAX_VALUE ? (int)d.buffer.GetSize() : DIFF_MAX_VALUE;
+    return appendText(*d.diff, d.buffer.GetString(), *len);
+}
+
+static void addRow(JsonDiffer& d, int kind, const JsonValue* left, const JsonValue* right)
+{
+    DiffRow row = makeRow(kind);
+    row.path = appendText(*d.diff, d.path.begin(), d.path.size());
+    row.path_len = d.path.size();
+    if (left) row.left = appendValue(d, *left, &row.left_len);
+    if (right) row.right = appendValue(d, *right, &row.right_len);
+    d.diff->rows.push_back(row);
+    if (kind == DIFF_ADDED) d.diff->added++;
+    else if (kind == DIFF_REMOVED) d.diff->removed++;
+    else d.diff->changed++;
+}
+
+// Appends "/token" with JSON Pointer escaping, returns the length to go back to
+static int pushPath(JsonDiffer& d, const char* token, int len)
+{
+    int mark = d.path.size();
+    d.path.push_back('/');
+    for (int i=0; i<len; i++) {
+        if (token[i] == '~') { d.path.push_back('~'); d.path.push_back('0'); }
+        else if (token[i] == '/') { d.path.push_back('~'); d.path.push_back('1'); }
+        else d.path.push_back(token[i]);
+    }
+    return mark;
+}
+
+static int pushIndex(JsonDiffer& d, int index)
+{
+    char token[16];
+    int len = snprintf(token, sizeof(token), "%d", index);
+    return pushPath(d, token, len);
+}
+
+static void diffValues(JsonDiffer& d, const JsonValue& a, const JsonValue& b);
+
+static void diffObjects(JsonDiffer& d, const JsonValue& a, const JsonValue& b)
+{
+    int nb = (int)b.MemberCount();
+    pg::Vector<uint64_t> name_hash;
+    pg::Vector<char> matched;
+    pg::Vector<int> table;
+    name_hash.resize(nb);
+    matched.resize(nb, 0);
+    JsonValue::ConstMemberIterator b_begin = b.MemberBegin();
+    for (int i=0; i<nb; i++)
+        name_hash[i] = pg::hash64(b_begin[i].name.GetString(), b_begin[i].name.GetStringLength());
+    buildTable(table, name_hash.begin(), nb);
+    int mask = table.size() - 1;
+
+    for (JsonValue::ConstMemberIterator it = a.MemberBegin(); it != a.MemberEnd(); ++it) {
+        const char* name = it->name.GetString();
+        rapidjson::SizeType len = it->name.GetStringLength();
+        uint64_t h = pg::hash64(name, len);
+        int found = -1;
+        for (int slot = (int)(h & (uint64_t)mask); table[slot] != 0; slot = (slot + 1) & mask) {
+            int j = table[slot] - 1;
+            if (name_hash[j] == h && !matched[j] && b_begin[j].name.GetStringLength() == len &&
+                memcmp(b_begin[j].name.GetString(), name, len) == 0) {
+                found = j;
+                break;
+            }
+        }
+        int mark = pushPath(d, name, (int)len);
+        if (found < 0) {
+            addRow(d, DIFF_REMOVED, &it->value, NULL);
+        } else {
+            matched[found] = 1;
+            diffValues(d, it->value, b_begin[found].value);
+        }
+        d.path.resize(mark);
+    }
+    for (int j=0; j<nb; j++) {
+        if (matched[j]) continue;
+        int mark = pushPath(d, b_begin[j].name.GetString(), (int)b_begin[j].name.GetStringLength());
+        addRow(d, DIFF_ADDED, NULL, &b_begin[j].value);
+        d.path.resize(mark);
+    }
+}
+
+// Name of a member every element of both arrays has with a scalar value, NULL if none
+static const char* arrayKey(const JsonValue& a, const JsonValue& b)
+{
+    static const char* keys[] = {"id", "_id", "uuid"};
+    if (a.Size() == 0 || b.Size() == 0) return NULL;
+    for (int k=0; k<3; k++) {
+        bool all = true;
+        for (int side=0; side<2 && all; side++) {
+            const JsonValue& array = side == 0 ? a : b;
+            for (rapidjson::SizeType i=0; i<array.Size() && all; i++) {
+                if (!array[i].IsObject()) return NULL;
+                JsonValue::ConstMemberIterator it = array[i].FindMember(keys[k]);
+                all = it != array[i].MemberEnd() && (it->value.IsString() || it->value.IsNumber());
+            }
+        }
+        if (all) return keys[k];
+    }
+    return NULL;
+}
+
+// Elements matched by their key member. False if a key repeats, then nothing was added.
+static bool diffKeyedArrays(JsonDiffer& d, const JsonValue& a, const JsonValue& b, const char* key)
+{
+    int na = (int)a.Size(), nb = (int)b.Size();
+    pg::Vector<uint64_t> a_keys, b_keys;
+    a_keys.resize(na);
+    b_keys.resize(nb);
+    for (int i=0; i<na; i++) a_keys[i] = hashValue(a[i][key]);
+    for (int j=0; j<nb; j++) b_keys[j] = hashValue(b[j][key]);
+    pg::Vector<int> table;
+    buildTable(table, b_keys.begin(), nb);
+    int mask = table.size() - 1;
+
+    pg::Vector<int> match;      // element of b for each element of a, -1 for none
+    pg::Vector<char> matched;
+    match.resize(na, -1);
+    matched.resize(nb, 0);
+    for (int i=0; i<na; i++) {
+        for (int slot = (int)(a_keys[i] & (uint64_t)mask); table[slot] != 0; slot = (slot + 1) & mask) {
+            int j = table[slot] - 1;
+            if (b_keys[j] != a_keys[i]) continue;
+            if (matched[j]) return false;
+            match[i] = j;
+            matched[j] = 1;
+            break;
+        }
+    }
+    for (int i=0; i<na; i++) {
+        int mark = pushIndex(d, i);
+        if (match[i] < 0) addRow(d, DIFF_REMOVED, &a[i], NULL);
+        else diffValues(d, a[i], b[match[i]]);
+        d.path.resize(mark);
+    }
+    for (int j=0; j<nb; j++) {
+        if (matched[j]) continue;
+        int mark = pushIndex(d, j);
+        addRow(d, DIFF_ADDED, NULL, &b[j]);
+        d.path.resize(mark);
+    }
+    return true;
+}
+
+static void diffArrays(JsonDiffer& d, const JsonValue& a, const JsonValue& b)
+{
+    const char* key = arrayKey(a, b);
+    if (key && diffKeyedArrays(d, a, b, key)) return;
+
+    int na = (int)a.Size(), nb = (int)b.Size();
+    if (na == nb) {
+        for (int i=0; i<na; i++) {
+            int mark = pushIndex(d, i);
+            diffValues(d, a[i], b[i]);
+            d.path.resize(mark);
+        }
+        return;
+    }
+
+    // align on whole element hashes, then compare the unmatched runs pairwise
+    pg::Vector<uint64_t> ha, hb;
+    ha.resize(na);
+    hb.resize(nb);
+    for (int i=0; i<na; i++) ha[i] = hashValue(a[i]);
+    for (int j=0; j<nb; j++) hb[j] = hashValue(b[j]);
+    pg::Vector<char> ops;
+    editScript(*d.diff, ha.begin(), na, hb.begin(), nb, ops);
+
+    int x = 0, y = 0, k = 0;
+    while (k < ops.size()) {
+        if (ops[k] == DIFF_SAME) { x++; y++; k++; continue; }
+        int removed = 0, added = 0;
+        while (k < ops.size() && ops[k] != DIFF_SAME) {
+            if (ops[k] == DIFF_REMOVED) removed++; else added++;
+            k++;
+        }
+        int pairs = removed < added ? removed : added;
+        for (int p=0; p<pairs; p++) {
+            int mark = pushIndex(d, x + p);
+            diffValues(d, a[x + p], b[y + p]);
+            d.path.resize(mark);
+        }
+        for (int p=pairs; p<removed; p++) {
+            int mark = pushIndex(d, x + p);
+            addRow(d, DIFF_REMOVED, &a[x + p], NULL);
+            d.path.resize(mark);
+        }
+        for (int p=pairs; p<added; p++) {
+            int mark = pushIndex(d, y + p);
+            addRow(d, DIFF_ADDED, NULL, &b[y + p]);
+            d.path.resize(mark);
+        }
+        x += removed;
+        y += added;
+    }
+}
+
+static void diffValues(JsonDiffer& d, const JsonValue& a, const JsonValue& b)
+{
+    if (a.IsObject() && b.IsObject()) diffObjects(d, a, b);
+    else if (a.IsArray() && b.IsArray()) diffArrays(d, a, b);
+    else if (a.IsObject() || a.IsArray() || b.IsObject() || b.IsArray() || !(a == b))
+        addRow(d, DIFF_CHANGED, &a, &b);
+}
+
+
+static void diffJob(void* data)
+{
+    Diff& diff = *(Diff*)data;
+    TRACE_SCOPE("diff");
+    int64_t start = nowUs();
+    const char* a = diff.left_body.pin();
+    const char* b = diff.right_body.pin();
+    int a_size = diff.left_body.length();
+    int b_size = diff.right_body.length();
+
+    if (diff.left_body == diff.right_body) {
+        snprintf(diff.message, sizeof(diff.message), "The bodies are identical");
+    } else if (bodyIsBinary(a, a_size) || bodyIsBinary(b, b_size)) {
+        snprintf(diff.message, sizeof(diff.message), "Binary bodies differ (%d and %d bytes)", a_size, b_size);
+    } else {
+        rapidjson::Document left, right;
+        diff.structural = !left.Parse(a, (size_t)a_size).HasParseError() &&
+                          !right.Parse(b, (size_t)b_size).HasParseError();
+        if (diff.structural) {
+            JsonDiffer differ;
+            differ.diff = &diff;
+            diffValues(differ, left, right);
+        } else {
+            lineDiff(diff, a, a_size, b, b_size);
+        }
+        if (diff.rows.size() == 0)
+            snprintf(diff.message, sizeof(diff.message), "No differences");
+    }
+    diff.left_body.unpin();
+    diff.right_body.unpin();
+    diff.elapsed_us = nowUs() - start;
+    diff.status = FINISHED;
+}
+
+void startDiff(Diff& diff, const pg::Body& left, const pg::Body& right)
+{
+    diff.reset();
+    diff.left_body = left;
+    diff.right_body = right;
+    diff.structural = false;
+    diff.status = RUNNING;
+    jobsSubmit(diffJob, &diff);
+}
+
+
+static void historyLabel(const Collection& collection, int i, char* out, int size)
+{
+    const History& hist = collection.hist[i];
+    snprintf(out, (size_t)size, "#%d %s %s (%d)", i, RequestTypeToString(hist.req_type).buf_, hist.url.buf(), hist.response_code);
+}
+
+void diffWindow(bool* open, Diff& diff, const Collection& collection)
+{
+    ImGui::Begin("Diff", open);
+    int count = collection.hist.size();
+    bool running = diff.status == RUNNING;
+    if (count == 0) {
+        ImGui::TextDisabled("No history to compare");
+        ImGui::End();
+        return;
+    }
+    if (diff.left >= count) diff.left = count - 1;
+    if (diff.right >= count) diff.right = count - 1;
+
+    char label[512];
+    ImGui::PushItemWidth(ImGui::GetFontSize() * 7);
+    ImGui::InputInt("##left", &diff.left);
+    ImGui::SameLine();
+    historyLabel(collection, diff.left < 0 ? 0 : diff.left, label, sizeof(label));
+    ImGui::TextUnformatted(label);
+    ImGui::InputInt("##right", &diff.right);
+    ImGui::SameLine();
+    historyLabel(collection, diff.right < 0 ? 0 : diff.right, label, sizeof(label));
+    ImGui::TextUnformatted(label);
+    ImGui::PopItemWidth();
+    if (diff.left < 0) diff.left = 0;
+    if (diff.right < 0) diff.right = 0;
+
+    if (running) {
+        ImGui::TextDisabled("Comparing...");
+    } else if (ImGui::Button("Compare")) {
+        startDiff(diff, collection.hist[diff.left].result, collection.hist[diff.right].result);
+        running = true;
+    }
+    if (running || diff.status == IDLE) {
+        ImGui::End();
+        return;
+    }
+
+    ImGui::SameLine();
+    ImGui::Text("%s diff: %d added, %d removed, %d changed in %.1f ms", diff.structural ? "Structural" : "Line",
+                diff.added, diff.removed, diff.changed, diff.elapsed_us / 1000.0);
+    if (diff.approximate) {
+        ImGui::SameLine();
+        ImGui::TextDisabled("(approximate)");
+    }
+    if (diff.rows.size() == 0) {
+        ImGui::TextUnformatted(diff.message);
+        ImGui::End();
+        return;
+    }
+
+    const ImVec4 colors[] = {
+        ImGui::GetStyleColorVec4(ImGuiCol_Text),    // same
+        ImVec4(0.4f, 0.9f, 0.4f, 1.0f),             // added
+        ImVec4(1.0f, 0.45f, 0.45f, 1.0f),           // removed
+        ImVec4(1.0f, 0.85f, 0.3f, 1.0f),            // changed
+        ImGui::GetStyleColorVec4(ImGuiCol_TextDisabled),
+    };
+    ImGuiTableFlags flags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable;
+    if (ImGui::BeginTable("##diff", 3, flags)) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        if (diff.structural) {
+            ImGui::TableSetupColumn("Path");
+            ImGui::TableSetupColumn("Left");
+            ImGui::TableSetupColumn("Right");
+        } else {
+            ImGui::TableSetupColumn("Left", ImGuiTableColumnFlags_WidthFixed, ImGui::GetFontSize() * 4);
+            ImGui::TableSetupColumn("Right", ImGuiTableColumnFlags_WidthFixed, ImGui::GetFontSize() * 4);
+            ImGui::TableSetupColumn("Line");
+        }
+        ImGui::TableHeadersRow();
+        const char* text = diff.text.begin();
+        ImGuiListClipper clipper;
+        clipper.Begin(diff.rows.size());
+        while (clipper.Step()) {
+            for (int r=clipper.DisplayStart; r<clipper.DisplayEnd; r++) {
+                const DiffRow& row = diff.rows[r];
+                ImGui::TableNextRow();
+                ImGui::PushStyleColor(ImGuiCol_Text, colors[row.kind]);
+                if (diff.structural) {
+                    ImGui::TableNextColumn(); ImGui::TextUnformatted(text + row.path, text + row.path + row.path_len);
+                    ImGui::TableNextColumn(); ImGui::TextUnformatted(text + row.left, text + row.left + row.left_len);
+                    ImGui::TableNextColumn(); ImGui::TextUnformatted(text + row.right, text + row.right + row.right_len);
+                } else if (row.kind == DIFF_SKIPPED) {
+                    ImGui::TableNextColumn(); ImGui::TextUnformatted("...");
+                    ImGui::TableNextColumn(); ImGui::TextUnformatted("...");
+                    ImGui::TableNextColumn(); ImGui::TextUnformatted(text + row.left, text + row.left + row.left_len);
+                } else {
+                    ImGui::TableNextColumn(); if (row.left_line) ImGui::Text("%d", row.left_line);
+                    ImGui::TableNextColumn(); if (row.right_line) ImGui::Text("%d", row.right_line);
+                    ImGui::TableNextColumn();
+                    const char sign = row.kind == DIFF_ADDED ? '+' : (row.kind == DIFF_REMOVED ? '-' : ' ');
+                    ImGui::Text("%c", sign);
+                    ImGui::SameLine();
+                    if (row.kind == DIFF_ADDED) ImGui::TextUnformatted(text + row.right, text + row.right + row.right_len);
+                    else ImGui::TextUnformatted(text + row.left, text + row.left + row.left_len);
+                }
+                ImGui::PopStyleColor();
+            }
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include "requests.h"
+
+// Differences between the result bodies of two History entries, computed on
+// the job pool. When both bodies parse as JSON the diff is structural: object
+// members are matched by name whatever their order, arrays of objects sharing
+// an "id" (or "_id", "uuid") member are matched by it, other arrays are
+// aligned on subtree hashes with a Myers diff and the unmatched elements are
+// compared pairwise. Every difference is one row with its JSON Pointer path.
+// Otherwise the bodies are compared line by line (Myers on line hashes) and
+// the rows are hunks with DIFF_CONTEXT lines of context.
+//
+// The Myers searches stop after DIFF_MAX_EDITS edits; what is left of that
+// region is then reported as removed and added as a whole, so inputs that
+// share nothing still take linear time.
+
+#define DIFF_CONTEXT 3
+#define DIFF_MAX_EDITS 2048
+#define DIFF_MAX_VALUE 256          // longest value shown in a structural row
+
+typedef enum DiffKind {
+    DIFF_SAME = 0,      // context line
+    DIFF_ADDED,
+    DIFF_REMOVED,
+    DIFF_CHANGED,       // structural only, value differs
+    DIFF_SKIPPED,       // unchanged lines between two hunks
+} DiffKind;
+
+// Strings are ranges of Diff::text
+typedef struct DiffRow {
+    int kind;           // DiffKind
+    int left_line;      // line diff, 1 based, 0 when the side has no line
+    int right_line;
+    int path, path_len; // structural, JSON Pointer
+    int left, left_len;
+    int right, right_len;
+} DiffRow;
+
+typedef struct Diff {
+    Diff() { status = IDLE; left = 0; right = 0; structural = false; reset(); }
+    void reset() {
+        rows.clear(); text.clear(); added = 0; removed = 0; changed = 0;
+        approximate = false; elapsed_us = 0; message[0] = '\0';
+    }
+
+    int left, right;                // history entries picked in the window
+    pg::Body left_body, right_body; // held while the job runs
+    std::atomic<ThreadStatus> status;
+
+    // written by the job, read once status is FINISHED
+    bool structural;
+    bool approximate;               // a Myers search gave up, see DIFF_MAX_EDITS
+    pg::Vector<DiffRow> rows;
+    pg::Vector<char> text;
+    int added, removed, changed;
+    int64_t elapsed_us;
+    char message[128];              // why there are no rows, when there are none
+} Diff;
+
+// Starts diffing two bodies on the job pool, diff.status must not be RUNNING
+void startDiff(Diff& diff, const pg::Body& left, const pg::Body& right);
+
+// Draws the diff window for two entries of the collection's history. Starts a
+// diff when the user asks for one.
+void diffWindow(bool* open, Diff& diff, const Collection& collection);
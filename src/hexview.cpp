@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include "hexview.h"
+
+static const char hex_digits[] = "0123456789abcdef";
+
+// "00000000  7b 22 69 64 ...  |{"id...|", always terminated
+static void formatRow(const unsigned char* row, int count, int offset, char* out)
+{
+    char* o = out + sprintf(out, "%08x  ", offset);
+    for (int i=0; i<HEX_VIEW_COLUMNS; i++) {
+        if (i < count) {
+            *o++ = hex_digits[row[i] >> 4];
+            *o++ = hex_digits[row[i] & 15];
+        } else {
+            *o++ = ' ';
+            *o++ = ' ';
+        }
+        *o++ = ' ';
+        if (i == HEX_VIEW_COLUMNS/2 - 1) *o++ = ' ';
+    }
+    *o++ = ' ';
+    *o++ = '|';
+    for (int i=0; i<count; i++)
+        *o++ = row[i] >= 0x20 && row[i] < 0x7f ? (char)row[i] : '.';
+    *o++ = '|';
+    *o = '\0';
+}
+
+void hexView(const char* id, const char* data, int size, const ImVec2& view_size)
+{
+    ImGui::BeginChild(id, view_size, true, ImGuiWindowFlags_HorizontalScrollbar);
+    const unsigned char* bytes = (const unsigned char*)data;
+    int rows = (size + HEX_VIEW_COLUMNS - 1) / HEX_VIEW_COLUMNS;
+    char line[16 + HEX_VIEW_COLUMNS*4 + 8];
+
+    ImGuiListClipper clipper;
+    clipper.Begin(rows);
+    while (clipper.Step()) {
+        for (int r=clipper.DisplayStart; r<clipper.DisplayEnd; r++) {
+            int offset = r * HEX_VIEW_COLUMNS;
+            int count = size - offset < HEX_VIEW_COLUMNS ? size - offset : HEX_VIEW_COLUMNS;
+            formatRow(bytes + offset, count, offset, line);
+            ImGui::TextUnformatted(line);
+        }
+    }
+    ImGui::EndChild();
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "imgui.h"
+
+// Read-only hex dump of a binary body, 16 bytes per row: offset, the bytes in
+// hex and their printable ASCII. Rows are clipped, only the visible ones are
+// formatted, so multi megabyte bodies scroll as cheaply as small ones.
+#define HEX_VIEW_COLUMNS 16
+
+void hexView(const char* id, const char* data, int size, const ImVec2& view_size);
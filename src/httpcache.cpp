@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "httpcache.h"
+#include "pghash.h"
+#include "imgui.h"
+
+
+static uint64_t requestKey(const Request& hist)
+{
+    uint64_t h = pg::hash64(hist.url.buf_, hist.url.length(), (uint64_t)hist.req_type);
+    for (int i=0; i<hist.args.size(); i++) {
+        h = pg::hash64(hist.args[i].name.buf_, hist.args[i].name.length(), h);
+        h = pg::hash64(hist.args[i].value.buf_, hist.args[i].value.length(), h);
+    }
+    return h;
+}
+
+static const Argument* findHeader(const Request& hist, const char* name, size_t len)
+{
+    for (int i=0; i<hist.headers.size(); i++) {
+        const pg::String& header = hist.headers[i].name;
+        if ((size_t)header.length() == len && curl_strnequal(header.buf_, name, len))
+            return &hist.headers[i];
+    }
+    return NULL;
+}
+
+// Hash of the request header values named in a Vary list ("Accept, Accept-Encoding")
+static uint64_t varyHash(const Request& hist, const char* vary)
+{
+    uint64_t h = 0;
+    const char* p = vary;
+    while (*p) {
+        while (*p == ' ' || *p == ',') p++;
+        const char* name = p;
+        while (*p && *p != ',' && *p != ' ') p++;
+        if (p == name) break;
+        const Argument* header = findHeader(hist, name, (size_t)(p - name));
+        if (header) h = pg::hash64(header->value.buf_, header->value.length(), h + 1);
+        else h = pg::hash64("", 0, h + 2);
+    }
+    return h;
+}
+
+static bool hasDirective(const char* cache_control, const char* directive)
+{
+    size_t len = strlen(directive);
+    for (const char* p = cache_control; *p; p++) {
+        if ((p == cache_control || p[-1] == ' ' || p[-1] == ',') && curl_strnequal(p, directive, len) &&
+            (p[len] == '\0' || p[len] == ',' || p[len] == ' ' || p[len] == '='))
+            return true;
+    }
+    return false;
+}
+
+// Cache-Control max-age wins over Expires, no-cache always revalidates
+static time_t freshUntil(const ResponseHeaders& headers, time_t now)
+{
+    if (hasDirective(headers.cache_control, "no-cache"))
+        return 0;
+    const char* max_age = strstr(headers.cache_control, "max-age=");
+    if (max_age) {
+        long seconds = strtol(max_age + 8, NULL, 10);
+        return seconds > 0 ? now + seconds : 0;
+    }
+    if (headers.expires[0] != '\0') {
+        time_t expires = curl_getdate(headers.expires, NULL);
+        return expires > now ? expires : 0;
+    }
+    return 0;
+}
+
+static void copyString(char* out, size_t out_size, const char* src)
+{
+    snprintf(out, out_size, "%s", src);
+}
+
+// Must be called with cache.mutex held
+static int findEntry(const HttpCache& cache, uint64_t key)
+{
+    for (int i=0; i<cache.entries.size(); i++)
+        if (cache.entries[i].key == key) return i;
+    return -1;
+}
+
+bool httpCacheLookup(HttpCache& cache, const Request& hist, HttpCacheEntry& out)
+{
+    if (hist.req_type != GET) return false;
+    uint64_t key = requestKey(hist);
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    int i = findEntry(cache, key);
+    if (i < 0 || cache.entries[i].vary_hash != varyHash(hist, cache.entries[i].vary))
+        return false;
+    cache.entries[i].last_used = time(NULL);
+    out = cache.entries[i];
+    return true;
+}
+
+void httpCacheAddValidators(const HttpCacheEntry& entry, Request& hist)
+{
+    Argument header;
+    header.arg_type = 0;
+    if (entry.etag[0] != '\0' && !findHeader(hist, "If-None-Match", 13)) {
+        header.name = pg::String("If-None-Match");
+        header.value = pg::String(entry.etag);
+        hist.headers.push_back(header);
+    }
+    if (entry.last_modified[0] != '\0' && !findHeader(hist, "If-Modified-Since", 17)) {
+        header.name = pg::String("If-Modified-Since");
+        header.value = pg::String(entry.last_modified);
+        hist.headers.push_back(header);
+    }
+}
+
+void httpCacheStore(HttpCache& cache, const Request& hist, int status,
+                    const ResponseHeaders& headers, const pg::Body& body)
+{
+    if (hist.req_type != GET || status != 200) return;
+    if (hasDirective(headers.cache_control, "no-store") || strchr(headers.vary, '*')) return;
+    time_t now = time(NULL);
+    time_t fresh_until = freshUntil(headers, now);
+    if (headers.etag[0] == '\0' && headers.last_modified[0] == '\0' && fresh_until == 0)
+        return; // nothing to revalidate with, never reusable
+
+    HttpCacheEntry entry;
+    entry.key = requestKey(hist);
+    copyString(entry.vary, sizeof(entry.vary), headers.vary);
+    entry.vary_hash = varyHash(hist, entry.vary);
+    copyString(entry.url, sizeof(entry.url), hist.url.buf_);
+    copyString(entry.etag, sizeof(entry.etag), headers.etag);
+    copyString(entry.last_modified, sizeof(entry.last_modified), headers.last_modified);
+    entry.fresh_until = fresh_until;
+    entry.last_used = now;
+    entry.status = status;
+    entry.body = body;
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    int i = findEntry(cache, entry.key);
+    if (i < 0 && cache.entries.size() >= HTTP_CACHE_MAX_ENTRIES) {
+        i = 0;
+        for (int k=1; k<cache.entries.size(); k++)
+            if (cache.entries[k].last_used < cache.entries[i].last_used) i = k;
+    }
+    if (i < 0) cache.entries.push_back(entry);
+    else cache.entries[i] = entry;
+}
+
+void httpCacheRefresh(HttpCache& cache, const HttpCacheEntry& entry, const ResponseHeaders& headers)
+{
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    int i = findEntry(cache, entry.key);
+    if (i < 0) return;
+    cache.entries[i].fresh_until = freshUntil(headers, time(NULL));
+    if (headers.etag[0] != '\0')
+        copyString(cache.entries[i].etag, sizeof(cache.entries[i].etag), headers.etag);
+    if (headers.last_modified[0] != '\0')
+        copyString(cache.entries[i].last_modified, sizeof(cache.entries[i].last_modified), headers.last_modified);
+}
+
+void httpCacheClear(HttpCache& cache)
+{
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    cache.entries.clear();
+}
+
+void httpCacheWindow(bool* open, HttpCache& cache)
+{
+    ImGui::Begin("HTTP Cache", open);
+    ImGui::Checkbox("Cache GET responses sent from the editor", &cache.enabled);
+    ImGui::Text("Hits: %d  Revalidated: %d  Misses: %d  Saved: %.2f MB",
+                (int)cache.hits, (int)cache.revalidated, (int)cache.misses, cache.bytes_saved / 1048576.0);
+    if (ImGui::Button("Clear")) {
+        httpCacheClear(cache);
+        cache.hits = cache.revalidated = cache.misses = 0;
+        cache.bytes_saved = 0;
+    }
+
+    std::lock_guard<std::mutex> lock(cache.mutex);
+    if (ImGui::BeginTable("##entries", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable)) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("URL");
+        ImGui::TableSetupColumn("Validator");
+        ImGui::TableSetupColumn("Fresh for", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableSetupColumn("KB", ImGuiTableColumnFlags_WidthFixed);
+        ImGui::TableHeadersRow();
+        time_t now = time(NULL);
+        for (int i=0; i<cache.entries.size(); i++) {
+            const HttpCacheEntry& entry = cache.entries[i];
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn(); ImGui::TextUnformatted(entry.url);
+            ImGui::TableNextColumn(); ImGui::TextUnformatted(entry.etag[0] != '\0' ? entry.etag : entry.last_modified);
+            ImGui::TableNextColumn();
+            if (entry.fresh_until > now) ImGui::Text("%lds", (long)(entry.fresh_until - now));
+            else ImGui::TextDisabled("revalidate");
+            ImGui::TableNextColumn(); ImGui::Text("%.1f", entry.body.length() / 1024.0);
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
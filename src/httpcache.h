@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <time.h>
+#include "requests.h"
+
+// Optional client side cache for GET requests sent from the editor. Responses
+// with an ETag or Last-Modified validator are kept, keyed by method and URL
+// (with the query arguments) plus the values of the request headers the
+// response Vary's on. Re-sending the request adds If-None-Match and
+// If-Modified-Since, and a 304 is answered with the stored body instead of
+// downloading it again. Within Cache-Control max-age (or Expires) the request
+// is not sent at all.
+//
+// Bodies are pg::Body handles, so a cached body and the History results holding
+// it share one copy. Entries live for the session only.
+
+#define HTTP_CACHE_MAX_ENTRIES 256
+
+typedef struct HttpCacheEntry {
+    uint64_t key;               // method, url and arguments
+    uint64_t vary_hash;         // values of the request headers named in vary
+    char url[256];              // for display, truncated
+    char vary[256];
+    char etag[256];
+    char last_modified[64];
+    time_t fresh_until;         // 0: revalidate every time
+    time_t last_used;
+    int status;
+    pg::Body body;              // prettified, as stored in History::result
+} HttpCacheEntry;
+
+typedef struct HttpCache {
+    HttpCache() { enabled = false; hits = 0; revalidated = 0; misses = 0; bytes_saved = 0; }
+
+    bool enabled;
+    std::mutex mutex;           // entries, the request thread stores while the UI lists
+    pg::Vector<HttpCacheEntry> entries;
+
+    std::atomic<int> hits;          // fresh, not sent at all
+    std::atomic<int> revalidated;   // 304, body served from the cache
+    std::atomic<int> misses;        // downloaded
+    std::atomic<int64_t> bytes_saved;
+} HttpCache;
+
+// Copies the entry matching the request into out, false if there is none
+bool httpCacheLookup(HttpCache& cache, const Request& hist, HttpCacheEntry& out);
+
+// Adds the validators of a looked up entry to the request headers
+void httpCacheAddValidators(const HttpCacheEntry& entry, Request& hist);
+
+// Stores (or refreshes) the response to hist if its headers allow it
+void httpCacheStore(HttpCache& cache, const Request& hist, int status,
+                    const ResponseHeaders& headers, const pg::Body& body);
+
+// Freshness of an entry revalidated with a 304, from the new response headers
+void httpCacheRefresh(HttpCache& cache, const HttpCacheEntry& entry, const ResponseHeaders& headers);
+
+void httpCacheClear(HttpCache& cache);
+
+// Draws the cache window: enable switch, counters and entries
+void httpCacheWindow(bool* open, HttpCache& cache);
@@ -0,0 +1,555 @@
+#include <stdio.h>
+#include <thread>
+#include "httpserver.h"
+#include "pgvector.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#endif
+
+#define HTTP_MAX_REQUEST (64*1024*1024)
+#define HTTP_READ_CHUNK (64*1024)
+#define HTTP_MAX_EVENTS 256
+
+
+const char* httpReasonPhrase(int status)
+{
+    switch (status) {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 411: return "Length Required";
+        case 413: return "Payload Too Large";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+    }
+    return "Unknown";
+}
+
+static bool nameEquals(const char* a, int a_len, const char* b)
+{
+    int i = 0;
+    for (; i < a_len && b[i]; i++) {
+        char ca = a[i], cb = b[i];
+        if (ca >= 'A' && ca <= 'Z') ca += 'a' - 'A';
+        if (cb >= 'A' && cb <= 'Z') cb += 'a' - 'A';
+        if (ca != cb) return false;
+    }
+    return i == a_len && b[i] == '\0';
+}
+
+const char* httpFindHeader(const HttpRequest& req, const char* name, int* value_len)
+{
+    const char* p = req.headers;
+    const char* end = req.headers + req.headers_len;
+    while (p < end) {
+        const char* line_end = (const char*)memchr(p, '\n', (size_t)(end - p));
+        if (line_end == NULL) line_end = end;
+        const char* colon = (const char*)memchr(p, ':', (size_t)(line_end - p));
+        if (colon && nameEquals(p, (int)(colon - p), name)) {
+            const char* v = colon + 1;
+            while (v < line_end && (*v == ' ' || *v == '\t')) v++;
+            const char* v_end = line_end;
+            while (v_end > v && (v_end[-1] == '\r' || v_end[-1] == ' ')) v_end--;
+            *value_len = (int)(v_end - v);
+            return v;
+        }
+        p = line_end + 1;
+    }
+    return NULL;
+}
+
+
+#ifdef __linux__
+
+typedef struct HttpConnection {
+    int fd;
+    char* in;
+    int in_len;
+    int in_cap;
+    int request_len;        // bytes of the request being answered
+    bool writing;
+    bool close_after;
+    char head[512];
+    int head_len;
+    int head_sent;
+    const char* body;
+    size_t body_len;
+    size_t body_sent;
+    int body_fd;
+    off_t body_offset;
+    pg::String scratch;
+    int64_t due_us;         // when a delayed response is sent
+    int pending_index;      // slot in HttpLoop::pending, -1 if not delayed
+    HttpConnection* prev;
+    HttpConnection* next;
+} HttpConnection;
+
+typedef struct HttpLoop {
+    HttpServer* server;
+    int listen_fd;
+    int epoll_fd;
+    int wake_fd;
+    HttpConnection* conns;  // every open connection, closed on stop
+    pg::Vector<HttpConnection*> pending;   // responses waiting for their delay
+    std::thread thread;
+} HttpLoop;
+
+struct HttpServer {
+    HttpLoop* loops;
+    int num_loops;
+    HttpHandler handler;
+    void* user;
+    HttpServerStats* stats;
+    std::atomic<bool> stop;
+};
+
+static int64_t monotonicUs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Markers for the epoll data of the listening socket and the wake eventfd
+static char listen_marker;
+static char wake_marker;
+
+
+static void removePending(HttpLoop& loop, HttpConnection* conn)
+{
+    int i = conn->pending_index;
+    loop.pending[i] = loop.pending.back();
+    loop.pending[i]->pending_index = i;
+    loop.pending.pop_back();
+    conn->pending_index = -1;
+}
+
+static void closeConnection(HttpLoop& loop, HttpConnection* conn)
+{
+    if (conn->pending_index >= 0) removePending(loop, conn);
+    epoll_ctl(loop.epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    if (conn->prev) conn->prev->next = conn->next;
+    else loop.conns = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    free(conn->in);
+    loop.server->stats->connections--;
+    delete conn;
+}
+
+static void watch(HttpLoop& loop, HttpConnection* conn, bool want_write)
+{
+    struct epoll_event ev;
+    ev.events = want_write ? EPOLLOUT : EPOLLIN;
+    ev.data.ptr = conn;
+    epoll_ctl(loop.epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+// Returns true once everything was sent (or the connection broke), false on EAGAIN
+static bool flushResponse(HttpLoop& loop, HttpConnection* conn)
+{
+    while (conn->head_sent < conn->head_len || conn->body_sent < conn->body_len) {
+        ssize_t n;
+        if (conn->body_fd < 0) {
+            struct iovec iov[2];
+            int num_iov = 0;
+            if (conn->head_sent < conn->head_len) {
+                iov[num_iov].iov_base = conn->head + conn->head_sent;
+                iov[num_iov].iov_len = (size_t)(conn->head_len - conn->head_sent);
+                num_iov++;
+            }
+            if (conn->body_sent < conn->body_len) {
+                iov[num_iov].iov_base = (void*)(conn->body + conn->body_sent);
+                iov[num_iov].iov_len = conn->body_len - conn->body_sent;
+                num_iov++;
+            }
+            n = writev(conn->fd, iov, num_iov);
+        } else if (conn->head_sent < conn->head_len) {
+            n = send(conn->fd, conn->head + conn->head_sent, (size_t)(conn->head_len - conn->head_sent), MSG_MORE);
+        } else {
+            off_t offset = conn->body_offset + (off_t)conn->body_sent;
+            n = sendfile(conn->fd, conn->body_fd, &offset, conn->body_len - conn->body_sent);
+            if (n == 0) n = -1, errno = EIO;   // file shorter than announced
+        }
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return false;
+            if (errno == EINTR) continue;
+            conn->close_after = true;
+            return true;
+        }
+        loop.server->stats->bytes_sent += n;
+        int head_left = conn->head_len - conn->head_sent;
+        if (n <= head_left) {
+            conn->head_sent += (int)n;
+        } else {
+            conn->head_sent = conn->head_len;
+            conn->body_sent += (size_t)(n - head_left);
+        }
+    }
+    return true;
+}
+
+static void startResponse(HttpConnection* conn, const HttpResponse& resp, bool keep_alive)
+{
+    size_t body_len = resp.body_len;
+    conn->close_after = resp.close || !keep_alive;
+    conn->head_len = snprintf(conn->head, sizeof(conn->head),
+                              "HTTP/1.1 %d %s\r\nServer: postgirl\r\nContent-Type: %s\r\nContent-Length: %llu\r\n%s\r\n",
+                              resp.status, httpReasonPhrase(resp.status),
+                              resp.content_type ? resp.content_type : "text/plain",
+                              (unsigned long long)body_len,
+                              conn->close_after ? "Connection: close\r\n" : "");
+    conn->head_sent = 0;
+    conn->body = resp.body;
+    conn->body_len = body_len;
+    conn->body_sent = 0;
+    conn->body_fd = resp.body_fd;
+    conn->body_offset = (off_t)resp.body_offset;
+    conn->writing = true;
+}
+
+static void errorResponse(HttpConnection* conn, int status)
+{
+    HttpResponse resp;
+    memset(&resp, 0, sizeof(resp));
+    resp.status = status;
+    resp.body_fd = -1;
+    resp.close = true;
+    startResponse(conn, resp, false);
+}
+
+// Parses one request out of the input buffer. Returns 1 when complete, 0 when
+// more bytes are needed and an HTTP status to answer with on errors.
+static int parseRequest(HttpConnection* conn, HttpRequest& req, bool& keep_alive)
+{
+    const char* in = conn->in;
+    const char* head_end = (const char*)memmem(in, (size_t)conn->in_len, "\r\n\r\n", 4);
+    if (head_end == NULL)
+        return conn->in_len > 64*1024 ? 413 : 0;
+
+    const char* line_end = (const char*)memchr(in, '\r', (size_t)(head_end - in) + 1);
+    const char* sp1 = (const char*)memchr(in, ' ', (size_t)(line_end - in));
+    if (sp1 == NULL) return 400;
+    const char* sp2 = (const char*)memchr(sp1 + 1, ' ', (size_t)(line_end - sp1 - 1));
+    if (sp2 == NULL) return 400;
+    req.method = in;
+    req.method_len = (int)(sp1 - in);
+    req.target = sp1 + 1;
+    req.target_len = (int)(sp2 - sp1 - 1);
+    req.headers = line_end + 2;
+    req.headers_len = (int)(head_end + 2 - req.headers);
+    keep_alive = strncmp(sp2 + 1, "HTTP/1.0", 8) != 0;
+
+    int len;
+    const char* value = httpFindHeader(req, "Connection", &len);
+    if (value && len == 5 && strncasecmp(value, "close", 5) == 0) keep_alive = false;
+    if (value && len == 10 && strncasecmp(value, "keep-alive", 10) == 0) keep_alive = true;
+    if (httpFindHeader(req, "Transfer-Encoding", &len))
+        return 411;
+
+    long long body_len = 0;
+    value = httpFindHeader(req, "Content-Length", &len);
+    if (value) body_len = atoll(value);
+    if (body_len < 0 || body_len > HTTP_MAX_REQUEST) return 413;
+    int header_bytes = (int)(head_end + 4 - in);
+    if (conn->in_len < header_bytes + body_len)
+        return 0;
+    req.body = head_end + 4;
+    req.body_len = (int)body_len;
+    conn->request_len = header_bytes + (int)body_len;
+    return 1;
+}
+
+// Drops the request that was just answered. Returns false if the connection was closed.
+static bool finishResponse(HttpLoop& loop, HttpConnection* conn)
+{
+    conn->writing = false;
+    if (conn->close_after) {
+        closeConnection(loop, conn);
+        return false;
+    }
+    memmove(conn->in, conn->in + conn->request_len, (size_t)(conn->in_len - conn->request_len));
+    conn->in_len -= conn->request_len;
+    conn->request_len = 0;
+    return true;
+}
+
+static void serveRequests(HttpLoop& loop, HttpConnection* conn)
+{
+    HttpServer* server = loop.server;
+    while (!conn->writing && conn->in_len > 0) {
+        HttpRequest req;
+        bool keep_alive = true;
+        int parsed = parseRequest(conn, req, keep_alive);
+        if (parsed == 0) break;
+        int64_t delay_us = 0;
+        if (parsed != 1) {
+            errorResponse(conn, parsed);
+        } else {
+            HttpResponse resp;
+            resp.status = 200;
+            resp.content_type = "application/json";
+            resp.body = NULL;
+            resp.body_len = 0;
+            resp.body_fd = -1;
+            resp.body_offset = 0;
+            resp.scratch = &conn->scratch;
+            resp.close = false;
+            resp.delay_us = 0;
+            server->handler(req, resp, server->user);
+            server->stats->requests++;
+            startResponse(conn, resp, keep_alive);
+            delay_us = resp.delay_us;
+        }
+        if (delay_us > 0) {
+            // reading goes on meanwhile, pipelined requests wait in the buffer
+            conn->due_us = monotonicUs() + delay_us;
+            conn->pending_index = loop.pending.size();
+            loop.pending.push_back(conn);
+            return;
+        }
+        if (!flushResponse(loop, conn)) {
+            watch(loop, conn, true);
+            return;
+        }
+        // sent right away, look for a pipelined request
+        if (!finishResponse(loop, conn))
+            return;
+    }
+}
+
+static void onReadable(HttpLoop& loop, HttpConnection* conn)
+{
+    while (true) {
+        if (conn->in_cap - conn->in_len < HTTP_READ_CHUNK) {
+            if (conn->in_cap >= HTTP_MAX_REQUEST + 64*1024) {
+                closeConnection(loop, conn);
+                return;
+            }
+            conn->in_cap = conn->in_cap ? conn->in_cap * 2 : HTTP_READ_CHUNK * 2;
+            conn->in = (char*)realloc(conn->in, (size_t)conn->in_cap);
+        }
+        ssize_t n = recv(conn->fd, conn->in + conn->in_len, (size_t)(conn->in_cap - conn->in_len), 0);
+        if (n > 0) {
+            conn->in_len += (int)n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        closeConnection(loop, conn);    // peer closed or error
+        return;
+    }
+    if (!conn->writing)
+        serveRequests(loop, conn);
+}
+
+static void onWritable(HttpLoop& loop, HttpConnection* conn)
+{
+    if (!flushResponse(loop, conn))
+        return;
+    if (!finishResponse(loop, conn))
+        return;
+    watch(loop, conn, false);
+    serveRequests(loop, conn);
+}
+
+// Sends the delayed responses that are due, returns the epoll_wait timeout
+// until the next one (-1 if none is left)
+static int sendDueResponses(HttpLoop& loop)
+{
+    int64_t now = monotonicUs();
+    int64_t next_due = -1;
+    for (int i=0; i<loop.pending.size(); ) {
+        HttpConnection* conn = loop.pending[i];
+        if (conn->due_us > now) {
+            if (next_due < 0 || conn->due_us < next_due) next_due = conn->due_us;
+            i++;
+            continue;
+        }
+        removePending(loop, conn);      // the last one moved into slot i
+        if (!flushResponse(loop, conn)) {
+            watch(loop, conn, true);
+            continue;
+        }
+        if (finishResponse(loop, conn))
+            serveRequests(loop, conn);
+        // serving may have queued more delayed responses, rescan from the start
+        i = 0;
+        now = monotonicUs();
+        next_due = -1;
+    }
+    return next_due < 0 ? -1 : (int)((next_due - now + 999) / 1000);
+}
+
+static void acceptConnections(HttpLoop& loop)
+{
+    while (true) {
+        int fd = accept4(loop.listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        HttpConnection* conn = new HttpConnection;
+        conn->fd = fd;
+        conn->in = NULL;
+        conn->in_len = conn->in_cap = 0;
+        conn->request_len = 0;
+        conn->writing = false;
+        conn->close_after = false;
+        conn->pending_index = -1;
+        conn->prev = NULL;
+        conn->next = loop.conns;
+        if (loop.conns) loop.conns->prev = conn;
+        loop.conns = conn;
+        loop.server->stats->connections++;
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+static void runLoop(HttpLoop* loop)
+{
+    struct epoll_event events[HTTP_MAX_EVENTS];
+    int timeout = -1;
+    while (!loop->server->stop) {
+        int n = epoll_wait(loop->epoll_fd, events, HTTP_MAX_EVENTS, timeout);
+        for (int i=0; i<n; i++) {
+            void* ptr = events[i].data.ptr;
+            if (ptr == &listen_marker) {
+                acceptConnections(*loop);
+            } else if (ptr != &wake_marker) {
+                HttpConnection* conn = (HttpConnection*)ptr;
+                if (events[i].events & EPOLLOUT) onWritable(*loop, conn);
+                else onReadable(*loop, conn);
+            }
+        }
+        timeout = loop->pending.empty() ? -1 : sendDueResponses(*loop);
+    }
+    while (loop->conns)
+        closeConnection(*loop, loop->conns);
+}
+
+static int listenSocket(const char* host, int port, pg::String* error)
+{
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1 ||
+        bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 1024) != 0) {
+        if (error) {
+            char msg[128];
+            snprintf(msg, sizeof(msg), "Could not listen on %s:%d: %s", host, port, strerror(errno));
+            error->set(msg);
+        }
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+HttpServer* httpServerStart(const char* host, int port, int num_threads, HttpHandler handler,
+                            void* user, HttpServerStats* stats, pg::String* error)
+{
+    signal(SIGPIPE, SIG_IGN);
+    if (num_threads < 1) num_threads = 1;
+    HttpServer* server = new HttpServer;
+    server->loops = new HttpLoop[num_threads];
+    server->num_loops = 0;
+    server->handler = handler;
+    server->user = user;
+    server->stats = stats;
+    server->stop = false;
+
+    for (int i=0; i<num_threads; i++) {
+        HttpLoop& loop = server->loops[i];
+        loop.server = server;
+        loop.conns = NULL;
+        loop.listen_fd = listenSocket(host, port, error);
+        if (loop.listen_fd < 0) {
+            httpServerStop(server);
+            return NULL;
+        }
+        loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        loop.wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = &listen_marker;
+        epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, loop.listen_fd, &ev);
+        ev.data.ptr = &wake_marker;
+        epoll_ctl(loop.epoll_fd, EPOLL_CTL_ADD, loop.wake_fd, &ev);
+        loop.thread = std::thread(runLoop, &loop);
+        server->num_loops++;
+    }
+    return server;
+}
+
+void httpServerStop(HttpServer* server)
+{
+    if (server == NULL) return;
+    server->stop = true;
+    for (int i=0; i<server->num_loops; i++) {
+        uint64_t one = 1;
+        if (write(server->loops[i].wake_fd, &one, sizeof(one)) < 0) {}
+    }
+    for (int i=0; i<server->num_loops; i++) {
+        HttpLoop& loop = server->loops[i];
+        loop.thread.join();
+        close(loop.listen_fd);
+        close(loop.epoll_fd);
+        close(loop.wake_fd);
+    }
+    delete [] server->loops;
+    delete server;
+}
+
+#else
+
+struct HttpServer {
+    int unused;
+};
+
+HttpServer* httpServerStart(const char*, int, int, HttpHandler, void*, HttpServerStats*, pg::String* error)
+{
+    if (error) error->set("The HTTP server needs Linux (epoll/sendfile)");
+    return NULL;
+}
+
+void httpServerStop(HttpServer*)
+{
+}
+
+#endif
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include "pgstring.h"
+
+// Minimal HTTP/1.1 server core: one epoll loop per thread, each with its own
+// SO_REUSEPORT listening socket, non-blocking keep-alive connections and
+// pipelining. Responses are sent without copying: headers and a memory body go
+// out in one writev, a file body goes out with sendfile.
+//
+// Linux only for now (epoll/sendfile), httpServerStart fails elsewhere.
+
+typedef struct HttpRequest {
+    const char* method;
+    int method_len;
+    const char* target;         // path and query, as sent
+    int target_len;
+    const char* headers;        // raw header lines, "Name: value\r\n" each
+    int headers_len;
+    const char* body;
+    int body_len;
+} HttpRequest;
+
+typedef struct HttpResponse {
+    int status;
+    const char* content_type;
+    // Memory body, not copied: it must stay valid until the response is sent.
+    // Point it at scratch for generated content.
+    const char* body;
+    size_t body_len;
+    // File body, sent with sendfile when body_fd >= 0. The fd is not closed.
+    int body_fd;
+    int64_t body_offset;
+    pg::String* scratch;        // per connection buffer, reused between requests
+    bool close;                 // close the connection once sent
+    int64_t delay_us;           // hold the response this long, without blocking the loop
+} HttpResponse;
+
+typedef void (*HttpHandler)(const HttpRequest& req, HttpResponse& resp, void* user);
+
+typedef struct HttpServerStats {
+    HttpServerStats() { requests = 0; bytes_sent = 0; connections = 0; }
+    std::atomic<int64_t> requests;
+    std::atomic<int64_t> bytes_sent;
+    std::atomic<int> connections;       // currently open
+} HttpServerStats;
+
+typedef struct HttpServer HttpServer;
+
+// Returns NULL and fills error if the port could not be bound. handler is
+// called on the loop threads, concurrently when num_threads > 1.
+HttpServer* httpServerStart(const char* host, int port, int num_threads, HttpHandler handler,
+                            void* user, HttpServerStats* stats, pg::String* error);
+
+// Closes every connection and joins the loops
+void httpServerStop(HttpServer* server);
+
+// Value of a request header (case insensitive name), NULL if absent
+const char* httpFindHeader(const HttpRequest& req, const char* name, int* value_len);
+
+const char* httpReasonPhrase(int status);
@@ -0,0 +1,188 @@
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "jobs.h"
+#include "pgvector.h"
+#include "profiler.h"
+
+
+typedef struct Job {
+    JobFunc func;
+    void* data;
+    JobGroup* group;
+} Job;
+
+// Ring buffer deque, the owner works at the bottom and thieves at the top
+typedef struct JobDeque {
+    JobDeque() { top = 0; count = 0; }
+
+    std::mutex mutex;
+    pg::Vector<Job> ring;
+    int top;
+    int count;
+} JobDeque;
+
+struct JobPool {
+    JobDeque* deques;
+    int num_workers;
+    pg::Vector<std::thread*> workers;
+    std::atomic<int> next_deque;    // round robin for jobs submitted from outside
+
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    std::atomic<int> queued;
+    bool quitting;
+};
+
+// Lets a worker find its own deque when it submits
+static thread_local JobPool* tls_pool = NULL;
+static thread_local int tls_index = -1;
+
+static JobPool* default_pool = NULL;
+
+
+static void pushBottom(JobDeque& d, const Job& job)
+{
+    std::lock_guard<std::mutex> lock(d.mutex);
+    if (d.count == d.ring.size()) {
+        // unroll the ring into a bigger one
+        pg::Vector<Job> bigger;
+        bigger.resize(d.ring.size() ? d.ring.size()*2 : 64);
+        for (int i=0; i<d.count; i++)
+            bigger[i] = d.ring[(d.top + i) % d.ring.size()];
+        d.ring.swap(bigger);
+        d.top = 0;
+    }
+    d.ring[(d.top + d.count) % d.ring.size()] = job;
+    d.count++;
+}
+
+static bool popBottom(JobDeque& d, Job& job)
+{
+    std::lock_guard<std::mutex> lock(d.mutex);
+    if (d.count == 0) return false;
+    d.count--;
+    job = d.ring[(d.top + d.count) % d.ring.size()];
+    return true;
+}
+
+static bool stealTop(JobDeque& d, Job& job)
+{
+    std::lock_guard<std::mutex> lock(d.mutex);
+    if (d.count == 0) return false;
+    job = d.ring[d.top];
+    d.top = (d.top + 1) % d.ring.size();
+    d.count--;
+    return true;
+}
+
+static bool findJob(JobPool* pool, int index, Job& job)
+{
+    if (index >= 0 && popBottom(pool->deques[index], job))
+        return true;
+    int start = index >= 0 ? index + 1 : 0;
+    for (int i=0; i<pool->num_workers; i++) {
+        if (stealTop(pool->deques[(start + i) % pool->num_workers], job))
+            return true;
+    }
+    return false;
+}
+
+static void runJob(JobPool* pool, const Job& job)
+{
+    pool->queued--;
+    job.func(job.data);
+    if (job.group) job.group->pending--;
+}
+
+static void workerLoop(JobPool* pool, int index)
+{
+    tls_pool = pool;
+    tls_index = index;
+    traceSetThreadName("job worker");
+    for (;;) {
+        Job job;
+        if (findJob(pool, index, job)) {
+            runJob(pool, job);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(pool->sleep_mutex);
+        if (pool->queued > 0) continue;
+        if (pool->quitting) return;
+        pool->sleep_cv.wait(lock);
+    }
+}
+
+JobPool* jobPoolCreate(int num_threads)
+{
+    if (num_threads <= 0) {
+        num_threads = (int)std::thread::hardware_concurrency() - 1;
+        if (num_threads < 1) num_threads = 1;
+    }
+    JobPool* pool = new JobPool;
+    pool->deques = new JobDeque[num_threads];
+    pool->num_workers = num_threads;
+    pool->next_deque = 0;
+    pool->queued = 0;
+    pool->quitting = false;
+    for (int i=0; i<num_threads; i++)
+        pool->workers.push_back(new std::thread(workerLoop, pool, i));
+    return pool;
+}
+
+void jobPoolDestroy(JobPool* pool)
+{
+    if (pool == NULL) return;
+    {
+        std::lock_guard<std::mutex> lock(pool->sleep_mutex);
+        pool->quitting = true;
+    }
+    pool->sleep_cv.notify_all();
+    for (int i=0; i<pool->workers.size(); i++) {
+        pool->workers[i]->join();
+        delete pool->workers[i];
+    }
+    delete [] pool->deques;
+    delete pool;
+}
+
+void jobPoolSubmit(JobPool* pool, JobFunc func, void* data, JobGroup* group)
+{
+    Job job;
+    job.func = func;
+    job.data = data;
+    job.group = group;
+    if (group) group->pending++;
+
+    int index = tls_pool == pool ? tls_index : (pool->next_deque++ % pool->num_workers);
+    if (index < 0) index = 0;
+    pool->queued++;
+    pushBottom(pool->deques[index], job);
+    {
+        // taking the lock orders this with a worker about to sleep
+        std::lock_guard<std::mutex> lock(pool->sleep_mutex);
+    }
+    pool->sleep_cv.notify_one();
+}
+
+void jobPoolWait(JobPool* pool, JobGroup* group)
+{
+    int index = tls_pool == pool ? tls_index : -1;
+    while (group->pending > 0) {
+        Job job;
+        if (findJob(pool, index, job)) runJob(pool, job);
+        else std::this_thread::yield();
+    }
+}
+
+int jobPoolNumThreads(JobPool* pool)
+{
+    return pool ? pool->num_workers : 0;
+}
+
+
+void jobsInit(int num_threads)                              { default_pool = jobPoolCreate(num_threads); }
+void jobsShutdown()                                         { jobPoolDestroy(default_pool); default_pool = NULL; }
+void jobsSubmit(JobFunc func, void* data, JobGroup* group)  { jobPoolSubmit(default_pool, func, data, group); }
+void jobsWait(JobGroup* group)                              { jobPoolWait(default_pool, group); }
+int jobsNumThreads()                                        { return jobPoolNumThreads(default_pool); }
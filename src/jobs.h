@@ -0,0 +1,43 @@
+#pragma once
+
+#include <atomic>
+
+// Work-stealing worker pools. Each worker owns a deque: jobs submitted from a
+// worker go to the bottom of its own deque and are popped LIFO, idle workers
+// steal FIFO from the top of the others. Jobs are plain function pointers with
+// a user pointer, the caller owns whatever the pointer refers to.
+//
+// The default pool (jobsInit/jobsSubmit/...) is for CPU work that must stay off
+// the UI thread (loading, searching). Code doing blocking I/O in jobs creates
+// its own pool so it never starves the default one.
+
+typedef void (*JobFunc)(void* data);
+
+typedef struct JobPool JobPool;
+
+// Counts unfinished jobs so a caller can wait for a batch of them
+typedef struct JobGroup {
+    JobGroup() { pending = 0; }
+    std::atomic<int> pending;
+} JobGroup;
+
+// num_threads <= 0 uses one thread per core, minus the UI thread
+JobPool* jobPoolCreate(int num_threads);
+
+// Runs every queued job, then joins the workers
+void jobPoolDestroy(JobPool* pool);
+
+void jobPoolSubmit(JobPool* pool, JobFunc func, void* data, JobGroup* group=NULL);
+
+// Blocks until every job of the group finished, running queued jobs meanwhile,
+// so it is safe to call from inside a job.
+void jobPoolWait(JobPool* pool, JobGroup* group);
+
+int jobPoolNumThreads(JobPool* pool);
+
+// Default pool
+void jobsInit(int num_threads);
+void jobsShutdown();
+void jobsSubmit(JobFunc func, void* data, JobGroup* group=NULL);
+void jobsWait(JobGroup* group);
+int jobsNumThreads();
@@ -0,0 +1,219 @@
+#include "loader.h"
+#include "utils.h"
+#include "jobs.h"
+
+
+typedef struct LoadSlice {
+    int collection;
+    int first;
+    int last;
+    const rapidjson::Value* histories;
+    pg::Vector<History> hist;
+    std::atomic<bool> done;
+} LoadSlice;
+
+typedef struct BodySlice {
+    int first;
+    int last;
+} BodySlice;
+
+// Everything the loader shares with the UI thread. The worker side only
+// publishes through the atomics, the UI side only reads slices marked done.
+static pg::String load_filename;
+static char* load_json = NULL;
+static rapidjson::Document* load_document = NULL;
+static pg::Vector<pg::Body> load_bodies;
+static pg::Vector<pg::Atom> load_strings;
+
+static Collection* load_headers = NULL;
+static int load_num_collections = 0;
+static LoadSlice* load_slices = NULL;
+static int load_num_slices = 0;
+static std::atomic<bool> load_headers_ready(false);
+static std::atomic<bool> load_finished(true);
+static std::atomic<int> load_total(0);
+static std::atomic<int> load_done(0);
+
+// UI side merge state
+static int merged_slices = 0;
+static pg::Vector<int> merged_count;
+
+
+static void loadBodySlice(void* data)
+{
+    BodySlice* slice = (BodySlice*)data;
+    const rapidjson::Value& body_array = (*load_document)["bodies"];
+    for (int i=slice->first; i<slice->last; i++)
+        load_bodies[i] = parseBody(body_array[i]);
+}
+
+static void loadHistorySlice(void* data)
+{
+    LoadSlice* slice = (LoadSlice*)data;
+    slice->hist.reserve(slice->last - slice->first);
+    for (int i=slice->first; i<slice->last; i++) {
+        slice->hist.push_back(parseHistory((*slice->histories)[i], &load_strings));
+        load_done++;
+    }
+    slice->done = true;
+}
+
+static void loadCoordinator(void*)
+{
+    load_json = readFile(load_filename.buf_);
+    load_document = new rapidjson::Document();
+    if (load_json == NULL || load_document->ParseInsitu(load_json).HasParseError() ||
+        load_document->HasMember("collections") == false) {
+        delete load_document;
+        load_document = NULL;
+        if (load_json) free(load_json);
+        load_json = NULL;
+        load_headers_ready = true;
+        load_finished = true;
+        return;
+    }
+
+    // Bodies first, histories look them up by hash
+    if (load_document->HasMember("bodies")) {
+        const rapidjson::Value& body_array = (*load_document)["bodies"];
+        int num_bodies = (int)body_array.Size();
+        load_bodies.resize(num_bodies);
+        int num_body_slices = (num_bodies + LOAD_SLICE_SIZE - 1) / LOAD_SLICE_SIZE;
+        BodySlice* body_slices = new BodySlice[num_body_slices];
+        JobGroup body_group;
+        for (int i=0; i<num_body_slices; i++) {
+            body_slices[i].first = i * LOAD_SLICE_SIZE;
+            body_slices[i].last = body_slices[i].first + LOAD_SLICE_SIZE;
+            if (body_slices[i].last > num_bodies) body_slices[i].last = num_bodies;
+            jobsSubmit(loadBodySlice, &body_slices[i], &body_group);
+        }
+        jobsWait(&body_group);
+        delete [] body_slices;
+    }
+
+    // interning takes a lock, do it once here rather than from every slice
+    parseStrings(*load_document, load_strings);
+
+    const rapidjson::Value& collections = (*load_document)["collections"];
+    load_num_collections = (int)collections.Size();
+    load_headers = new Collection[load_num_collections > 0 ? load_num_collections : 1];
+    int num_slices = 0;
+    for (int i=0; i<load_num_collections; i++) {
+        parseCollectionHeader(collections[i], load_headers[i]);
+        int num_hist = (int)collections[i]["histories"].Size();
+        num_slices += (num_hist + LOAD_SLICE_SIZE - 1) / LOAD_SLICE_SIZE;
+        load_total += num_hist;
+    }
+
+    load_slices = new LoadSlice[num_slices > 0 ? num_slices : 1];
+    load_num_slices = num_slices;
+    int s = 0;
+    for (int i=0; i<load_num_collections; i++) {
+        const rapidjson::Value& histories = collections[i]["histories"];
+        int num_hist = (int)histories.Size();
+        for (int first=0; first<num_hist; first+=LOAD_SLICE_SIZE, s++) {
+            load_slices[s].collection = i;
+            load_slices[s].first = first;
+            load_slices[s].last = first + LOAD_SLICE_SIZE < num_hist ? first + LOAD_SLICE_SIZE : num_hist;
+            load_slices[s].histories = &histories;
+            load_slices[s].done = false;
+        }
+    }
+    load_headers_ready = true;
+
+    JobGroup hist_group;
+    for (int i=0; i<load_num_slices; i++)
+        jobsSubmit(loadHistorySlice, &load_slices[i], &hist_group);
+    jobsWait(&hist_group);
+
+    // every History holds its own body handles by now
+    load_bodies.clear();
+    load_strings.clear();
+    delete load_document;
+    load_document = NULL;
+    free(load_json);
+    load_json = NULL;
+    load_finished = true;
+}
+
+void loadCollectionAsync(const pg::String& filename)
+{
+    if (!load_finished) return;
+    load_filename = filename;
+    load_headers_ready = false;
+    load_finished = false;
+    load_total = 0;
+    load_done = 0;
+    merged_slices = 0;
+    merged_count.clear();
+    jobsSubmit(loadCoordinator, NULL);
+}
+
+static void mergeSlice(pg::Vector<Collection>& collection, LoadSlice& slice)
+{
+    pg::Vector<History>& hist = collection[slice.collection].hist;
+    int& merged = merged_count[slice.collection];
+
+    // entries created during loading move behind the loaded ones
+    pg::Vector<History> session;
+    for (int i=merged; i<hist.size(); i++)
+        session.push_back(hist[i]);
+    if (session.size() > 0)
+        hist.erase(hist.begin() + merged, hist.end());
+
+    hist.reserve(hist.size() + slice.hist.size() + session.size());
+    for (int i=0; i<slice.hist.size(); i++)
+        hist.push_back(slice.hist[i]);
+    for (int i=0; i<session.size(); i++)
+        hist.push_back(session[i]);
+    merged += slice.hist.size();
+    slice.hist.clear();
+}
+
+int pollCollectionLoad(pg::Vector<Collection>& collection)
+{
+    if (!load_headers_ready || load_headers == NULL)
+        return 0;
+
+    if (merged_count.size() < load_num_collections) {
+        merged_count.resize(load_num_collections, 0);
+        for (int i=0; i<load_num_collections; i++) {
+            if (i >= collection.size()) {
+                collection.push_back(load_headers[i]);
+            } else {
+                collection[i].name = load_headers[i].name;
+                collection[i].retention = load_headers[i].retention;
+                collection[i].environment = load_headers[i].environment;
+            }
+        }
+    }
+
+    int merged = 0;
+    while (merged_slices < load_num_slices && load_slices[merged_slices].done) {
+        merged += load_slices[merged_slices].hist.size();
+        mergeSlice(collection, load_slices[merged_slices]);
+        merged_slices++;
+    }
+
+    if (load_finished && merged_slices == load_num_slices) {
+        delete [] load_slices;
+        load_slices = NULL;
+        load_num_slices = 0;
+        if (load_headers) delete [] load_headers;
+        load_headers = NULL;
+        load_num_collections = 0;
+    }
+    return merged;
+}
+
+bool collectionLoading()
+{
+    return !load_finished || load_headers != NULL;
+}
+
+float collectionLoadProgress()
+{
+    int total = load_total;
+    if (total == 0) return load_finished ? 1.0f : 0.0f;
+    return (float)load_done / (float)total;
+}
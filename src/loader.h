@@ -0,0 +1,23 @@
+#pragma once
+
+#include "requests.h"
+
+// Asynchronous collections.json loading, so the first frame does not wait for
+// the whole file. The file is parsed in place once, then bodies and slices of
+// LOAD_SLICE_SIZE histories are turned into History entries on the job pool.
+
+#define LOAD_SLICE_SIZE 1024
+
+// Starts loading filename on the job pool and returns right away.
+void loadCollectionAsync(const pg::String& filename);
+
+// Moves every slice that finished since the last call into collection, in file
+// order and ahead of the entries created while loading. Returns how many
+// history entries were merged.
+int pollCollectionLoad(pg::Vector<Collection>& collection);
+
+// True until the whole file has been merged by pollCollectionLoad
+bool collectionLoading();
+
+// 0..1, for the loading indicator
+float collectionLoadProgress();
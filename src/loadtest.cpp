@@ -0,0 +1,221 @@
+#include <sys/time.h>
+#include "loadtest.h"
+#include "loadworkers.h"
+#include "profiler.h"
+#include "imgui.h"
+
+
+static int64_t nowUs()
+{
+    struct timeval timecheck;
+    gettimeofday(&timecheck, NULL);
+    return (int64_t)timecheck.tv_sec * 1000000 + (int64_t)timecheck.tv_usec;
+}
+
+int latencyBucket(int64_t us)
+{
+    if (us < 128) return us < 0 ? 0 : (int)us;
+    int shift = 1;
+    while ((us >> shift) >= 128) shift++;
+    int bucket = shift*64 + (int)(us >> shift);
+    return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS-1;
+}
+
+int64_t latencyBucketValue(int bucket)
+{
+    if (bucket < 128) return bucket;
+    int shift = bucket/64 - 1;
+    return ((int64_t)(bucket - shift*64 + 1) << shift) - 1;
+}
+
+int64_t latencyPercentile(const LatencyHistogram& histogram, double percentile)
+{
+    int64_t total = 0;
+    for (int i=0; i<LATENCY_BUCKETS; i++) total += histogram.counts[i];
+    if (total == 0) return 0;
+    int64_t rank = (int64_t)(percentile / 100.0 * (double)total + 0.999999);
+    if (rank < 1) rank = 1;
+    int64_t seen = 0;
+    for (int i=0; i<LATENCY_BUCKETS; i++) {
+        seen += histogram.counts[i];
+        if (seen >= rank) return latencyBucketValue(i);
+    }
+    return latencyBucketValue(LATENCY_BUCKETS-1);
+}
+
+void recordLatency(LoadTestStats& stats, int64_t us)
+{
+    stats.latency.counts[latencyBucket(us)].fetch_add(1, std::memory_order_relaxed);
+    stats.total_us += us;
+    int64_t curr = stats.min_us;
+    while (us < curr && !stats.min_us.compare_exchange_weak(curr, us)) {}
+    curr = stats.max_us;
+    while (us > curr && !stats.max_us.compare_exchange_weak(curr, us)) {}
+}
+
+void recordTransfer(LoadTestStats& stats, CURL* curl, CURLcode result)
+{
+    traceTransfer(curl, "transfer", result);
+    long new_connections = 0;
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &new_connections);
+    stats.connections += (int)new_connections;
+    if (result != CURLE_OK) {
+        stats.failed++;
+    } else {
+        long code = 0;
+        curl_off_t total_us = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+        curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total_us);
+        int status_class = (int)(code / 100);
+        if (status_class < 0 || status_class > 5) status_class = 0;
+        stats.status_class[status_class]++;
+        if (negotiatedHttpVersion(curl) >= 20) stats.multiplexed++;
+        recordLatency(stats, (int64_t)total_us);
+    }
+    stats.completed++;
+}
+
+void threadLoadTest(LoadTest& test)
+{
+    traceSetThreadName("load test");
+    if (test.processes > 1)
+        runLoadWorkers(test);
+    else
+        runLoadTest(test, test.stats, test.checks, test.cancel);
+    test.status = FINISHED;
+}
+
+void runLoadTest(const LoadTest& test, LoadTestStats& stats, AssertionStats& checks_stats, const std::atomic<bool>& cancel)
+{
+    int64_t start = nowUs();
+    int num_slots = test.concurrency < test.total_requests ? test.concurrency : test.total_requests;
+    if (num_slots < 1) num_slots = 1;
+
+    RequestTemplate tpl;
+    compileRequestTemplate(tpl, test.hist, &test.environment, test.data);
+    AssertionSet* checks = compileAssertions(test.hist.assertions);
+    TemplateContext ctx;
+    ctx.environment = &test.environment;
+    ctx.data = test.data;
+    ctx.random_state ^= (uint64_t)start ^ ((uint64_t)test.first_sequence << 32);
+
+    CURLM* multi = curl_multi_init();
+    enableMultiplexing(multi);
+    PreparedRequest* slots = new PreparedRequest[num_slots];
+    RenderedRequest* rendered = new RenderedRequest[num_slots];
+    Request request;
+    historyRequest(request, test.hist);
+    int in_flight = 0;
+    for (int i=0; i<num_slots; i++) {
+        prepareRequest(slots[i], request);
+        if (!slots[i].valid) continue;
+        waitForMultiplexing(slots[i], request);
+        resetPreparedRequest(slots[i]);
+        if (tpl.dynamic) {
+            ctx.sequence = test.first_sequence + stats.started;
+            applyRequestTemplate(tpl, ctx, rendered[i], slots[i]);
+        }
+        curl_easy_setopt(slots[i].curl, CURLOPT_PRIVATE, (void*)&slots[i]);
+        curl_multi_add_handle(multi, slots[i].curl);
+        stats.started++;
+        in_flight++;
+    }
+
+    while (in_flight > 0) {
+        int running;
+        curl_multi_perform(multi, &running);
+
+        CURLMsg* msg;
+        int msgs_left;
+        while ((msg = curl_multi_info_read(multi, &msgs_left))) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            CURL* curl = msg->easy_handle;
+            CURLcode result = msg->data.result;     // msg is gone once the handle is removed
+            recordTransfer(stats, curl, result);
+            curl_multi_remove_handle(multi, curl);
+
+            PreparedRequest* req;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**)&req);
+            if (checks && result == CURLE_OK) {
+                long code = 0;
+                curl_off_t latency_us = 0;
+                curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+                curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &latency_us);
+                checkAssertions(checks, (int)code, req->response.memory, req->response.size,
+                                (int64_t)latency_us, &checks_stats);
+            }
+            if (stats.started < test.total_requests && !cancel) {
+                resetPreparedRequest(*req);
+                if (tpl.dynamic) {
+                    ctx.sequence = test.first_sequence + stats.started;
+                    applyRequestTemplate(tpl, ctx, rendered[req - slots], *req);
+                }
+                curl_multi_add_handle(multi, curl);
+                stats.started++;
+            } else {
+                in_flight--;
+            }
+        }
+        stats.elapsed_us = nowUs() - start;
+        if (in_flight > 0)
+            curl_multi_poll(multi, NULL, 0, 100, NULL);
+    }
+
+    delete [] slots;
+    delete [] rendered;
+    freeAssertions(checks);
+    curl_multi_cleanup(multi);
+    stats.elapsed_us = nowUs() - start;
+}
+
+bool loadTestWindow(bool* open, LoadTest& test)
+{
+    bool start = false;
+    ImGui::Begin("Load Test", open);
+    bool running = test.status == RUNNING;
+
+    ImGui::PushItemWidth(ImGui::GetFontSize() * 8);
+    ImGui::InputInt("Requests", &test.total_requests, 100, 1000);
+    ImGui::InputInt("Concurrency", &test.concurrency);
+    ImGui::InputInt("Processes", &test.processes);
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    if (ImGui::SmallButton("One per core")) test.processes = loadWorkerDefaultCount();
+    if (test.total_requests < 1) test.total_requests = 1;
+    if (test.concurrency < 1) test.concurrency = 1;
+    if (test.processes < 1) test.processes = 1;
+    if (test.processes > LOAD_MAX_WORKERS) test.processes = LOAD_MAX_WORKERS;
+
+    if (running) {
+        if (ImGui::Button("Stop")) test.cancel = true;
+    } else if (ImGui::Button("Start with current request")) {
+        start = true;
+    }
+
+    int completed = test.stats.completed;
+    ImGui::ProgressBar((float)completed / (float)test.total_requests, ImVec2(-1.0f, 0.0f));
+    drawLoadTestStats(test.stats);
+    drawAssertionStats(test.checks, test.hist.assertions);
+    ImGui::End();
+    return start;
+}
+
+void drawLoadTestStats(LoadTestStats& stats)
+{
+    int completed = stats.completed;
+    double elapsed = stats.elapsed_us / 1e6;
+    int responses = completed - stats.failed;
+    ImGui::Text("Completed: %d  Failed: %d  Elapsed: %.2fs  Rate: %.0f req/s",
+                completed, (int)stats.failed, elapsed, elapsed > 0 ? completed / elapsed : 0.0);
+    if (responses > 0) {
+        ImGui::Text("Latency (ms)  min %.2f  avg %.2f  max %.2f",
+                    stats.min_us / 1000.0, stats.total_us / 1000.0 / responses, stats.max_us / 1000.0);
+        ImGui::Text("              p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f",
+                    latencyPercentile(stats.latency, 50.0) / 1000.0, latencyPercentile(stats.latency, 90.0) / 1000.0,
+                    latencyPercentile(stats.latency, 99.0) / 1000.0, latencyPercentile(stats.latency, 99.9) / 1000.0);
+    }
+    ImGui::Text("1xx %d  2xx %d  3xx %d  4xx %d  5xx %d",
+                (int)stats.status_class[1], (int)stats.status_class[2], (int)stats.status_class[3],
+                (int)stats.status_class[4], (int)stats.status_class[5]);
+    ImGui::Text("Connections opened: %d  HTTP/2 responses: %d", (int)stats.connections, (int)stats.multiplexed);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include "requests.h"
+#include "template.h"
+#include "assertions.h"
+
+// Built-in load test: sends the same History total_requests times with up to
+// concurrency transfers in flight on one curl multi handle. Every in-flight
+// slot owns a PreparedRequest compiled once up front, so the send loop itself
+// does no allocation on our side. {{variables}} are compiled once as well and
+// rendered into per-slot buffers before each send. Unless the History asks for
+// HTTP/1.1, slots to the same origin share one multiplexed HTTP/2 connection
+// when the server supports it.
+
+// Latencies in microseconds, HDR style: exact below 128us, then 64 log-linear
+// buckets per power of two (under 1.6% error) up to about 12 days. A single
+// writer per histogram, readers merge histograms by adding up the buckets.
+#define LATENCY_BUCKETS 2240
+
+typedef struct LatencyHistogram {
+    LatencyHistogram() { reset(); }
+    void reset() { for (int i=0; i<LATENCY_BUCKETS; i++) counts[i] = 0; }
+
+    std::atomic<int64_t> counts[LATENCY_BUCKETS];
+} LatencyHistogram;
+
+int latencyBucket(int64_t us);
+
+// Highest latency counted in the bucket
+int64_t latencyBucketValue(int bucket);
+
+// Nearest rank percentile (0-100), 0 for an empty histogram
+int64_t latencyPercentile(const LatencyHistogram& histogram, double percentile);
+
+// Fixed size and only made of lock-free atomics, so it can live in shared
+// memory, see loadworkers.h
+typedef struct LoadTestStats {
+    LoadTestStats() { reset(); }
+    void reset() {
+        started = 0; completed = 0; failed = 0; connections = 0; multiplexed = 0;
+        for (int i=0; i<6; i++) status_class[i] = 0;
+        total_us = 0; min_us = INT64_MAX; max_us = 0; elapsed_us = 0;
+        latency.reset();
+    }
+
+    std::atomic<int> started;
+    std::atomic<int> completed;
+    std::atomic<int> failed;            // transport errors, no HTTP response
+    std::atomic<int> status_class[6];   // responses by code/100
+    std::atomic<int> connections;       // new connections opened
+    std::atomic<int> multiplexed;       // responses over HTTP/2 or later
+    std::atomic<int64_t> total_us;
+    std::atomic<int64_t> min_us;
+    std::atomic<int64_t> max_us;
+    std::atomic<int64_t> elapsed_us;
+    LatencyHistogram latency;
+} LoadTestStats;
+
+typedef struct LoadTest {
+    LoadTest() { total_requests = 1000; concurrency = 16; processes = 1; first_sequence = 0; cancel = false; status = IDLE; data = NULL; }
+
+    History hist;
+    pg::Vector<Argument> environment;   // copy of the collection environment
+    const DataFile* data;               // must not change while running
+    int total_requests;
+    int concurrency;                    // per process
+    int processes;                      // more than 1 runs worker processes, see loadworkers.h
+    int64_t first_sequence;             // {{$seq}} of the first request sent
+    std::atomic<bool> cancel;
+    std::atomic<ThreadStatus> status;
+    LoadTestStats stats;
+    AssertionStats checks;              // hist.assertions, checked on the load test thread
+} LoadTest;
+
+void threadLoadTest(LoadTest& test);
+
+// The send loop of a load test: test.total_requests sends of test.hist on one
+// curl multi handle, counted in stats and checks, until cancel is set. Returns
+// when every transfer has finished.
+void runLoadTest(const LoadTest& test, LoadTestStats& stats, AssertionStats& checks, const std::atomic<bool>& cancel);
+
+void recordLatency(LoadTestStats& stats, int64_t us);
+
+// Counts a finished transfer of a multi handle: status class and latency, or a failure
+void recordTransfer(LoadTestStats& stats, CURL* curl, CURLcode result);
+
+// Draws the load test window, returns true when the user asked to start a run
+// with the request currently in the editor.
+bool loadTestWindow(bool* open, LoadTest& test);
+
+// Rate, latency and status lines, shared by the windows driving a LoadTestStats
+void drawLoadTestStats(LoadTestStats& stats);
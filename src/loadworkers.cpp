@@ -0,0 +1,353 @@
+#include <new>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <sys/time.h>
+#include "loadworkers.h"
+#include "profiler.h"
+#include "utils.h"
+
+#ifdef _WINDOWS
+#include <windows.h>
+typedef HANDLE WorkerProcess;
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+typedef pid_t WorkerProcess;
+extern char** environ;
+#endif
+
+#define LOAD_WORKER_MAGIC 0x50474c57    // "PGLW"
+#define LOAD_WORKER_POLL_MS 50
+
+
+static int64_t nowUs()
+{
+    struct timeval timecheck;
+    gettimeofday(&timecheck, NULL);
+    return (int64_t)timecheck.tv_sec * 1000000 + (int64_t)timecheck.tv_usec;
+}
+
+int loadWorkerDefaultCount()
+{
+    int cores = (int)std::thread::hardware_concurrency();
+    if (cores < 1) cores = 1;
+    return cores < LOAD_MAX_WORKERS ? cores : LOAD_MAX_WORKERS;
+}
+
+
+#ifdef _WINDOWS
+
+static int currentProcessId() { return (int)GetCurrentProcessId(); }
+
+static LoadWorkerShared* createSegment(const char* name, void** handle)
+{
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(LoadWorkerShared), name);
+    if (mapping == NULL) return NULL;
+    void* data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(LoadWorkerShared));
+    if (data == NULL) {
+        CloseHandle(mapping);
+        return NULL;
+    }
+    *handle = mapping;
+    return new (data) LoadWorkerShared;
+}
+
+static LoadWorkerShared* attachSegment(const char* name, void** handle)
+{
+    HANDLE mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+    if (mapping == NULL) return NULL;
+    void* data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(LoadWorkerShared));
+    if (data == NULL) {
+        CloseHandle(mapping);
+        return NULL;
+    }
+    *handle = mapping;
+    return (LoadWorkerShared*)data;
+}
+
+static void releaseSegment(LoadWorkerShared* shared, const char* name, void* handle, bool owner)
+{
+    UnmapViewOfFile(shared);
+    CloseHandle((HANDLE)handle);   // the mapping goes away with its last handle
+}
+
+static bool spawnWorker(const char* segment, int index, WorkerProcess* process)
+{
+    char exe[MAX_PATH];
+    if (GetModuleFileNameA(NULL, exe, sizeof(exe)) == 0) return false;
+    char command[MAX_PATH + 128];
+    snprintf(command, sizeof(command), "\"%s\" %s %s %d", exe, LOAD_WORKER_FLAG, segment, index);
+    STARTUPINFOA startup;
+    PROCESS_INFORMATION info;
+    memset(&startup, 0, sizeof(startup));
+    startup.cb = sizeof(startup);
+    if (!CreateProcessA(exe, command, NULL, NULL, FALSE, CREATE_NO_WINDOW, NULL, NULL, &startup, &info))
+        return false;
+    CloseHandle(info.hThread);
+    *process = info.hProcess;
+    return true;
+}
+
+static bool workerExited(WorkerProcess process)
+{
+    if (WaitForSingleObject(process, 0) != WAIT_OBJECT_0) return false;
+    CloseHandle(process);
+    return true;
+}
+
+static void killWorker(WorkerProcess process)
+{
+    TerminateProcess(process, 1);
+    WaitForSingleObject(process, INFINITE);
+    CloseHandle(process);
+}
+
+#else
+
+static int currentProcessId() { return (int)getpid(); }
+
+static LoadWorkerShared* createSegment(const char* name, void** handle)
+{
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) return NULL;
+    if (ftruncate(fd, sizeof(LoadWorkerShared)) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    void* data = mmap(NULL, sizeof(LoadWorkerShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        shm_unlink(name);
+        return NULL;
+    }
+    *handle = NULL;
+    return new (data) LoadWorkerShared;
+}
+
+static LoadWorkerShared* attachSegment(const char* name, void** handle)
+{
+    int fd = shm_open(name, O_RDWR, 0600);
+    if (fd < 0) return NULL;
+    void* data = mmap(NULL, sizeof(LoadWorkerShared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    *handle = NULL;
+    return data == MAP_FAILED ? NULL : (LoadWorkerShared*)data;
+}
+
+static void releaseSegment(LoadWorkerShared* shared, const char* name, void*, bool owner)
+{
+    munmap(shared, sizeof(LoadWorkerShared));
+    if (owner) shm_unlink(name);
+}
+
+static bool executablePath(char* path, size_t size)
+{
+#ifdef __APPLE__
+    uint32_t len = (uint32_t)size;
+    return _NSGetExecutablePath(path, &len) == 0;
+#else
+    ssize_t len = readlink("/proc/self/exe", path, size - 1);
+    if (len <= 0) return false;
+    path[len] = '\0';
+    return true;
+#endif
+}
+
+static bool spawnWorker(const char* segment, int index, WorkerProcess* process)
+{
+    char exe[1024];
+    if (!executablePath(exe, sizeof(exe))) return false;
+    char index_arg[16];
+    snprintf(index_arg, sizeof(index_arg), "%d", index);
+    char* argv[] = { exe, (char*)LOAD_WORKER_FLAG, (char*)segment, index_arg, NULL };
+    return posix_spawn(process, exe, NULL, NULL, argv, environ) == 0;
+}
+
+static bool workerExited(WorkerProcess process)
+{
+    int status;
+    return waitpid(process, &status, WNOHANG) != 0;
+}
+
+static void killWorker(WorkerProcess process)
+{
+    int status;
+    kill(process, SIGKILL);
+    waitpid(process, &status, 0);
+}
+
+#endif
+
+
+// Requests sent by worker index and the {{$seq}} of its first one
+static void workerShare(int total_requests, int num_workers, int index, int* count, int64_t* first_sequence)
+{
+    int base = total_requests / num_workers;
+    int extra = total_requests % num_workers;
+    *count = base + (index < extra ? 1 : 0);
+    *first_sequence = (int64_t)index * base + (index < extra ? index : extra);
+}
+
+// Adds up the worker slots into stats and checks, which the UI reads
+static void mergeWorkers(LoadWorkerShared* shared, LoadTestStats& stats, AssertionStats& checks)
+{
+    int started = 0, completed = 0, failed = 0, connections = 0, multiplexed = 0;
+    int status_class[6] = {0};
+    int64_t total_us = 0, min_us = INT64_MAX, max_us = 0;
+    int passed = 0, checks_failed = 0;
+    int failures[MAX_ASSERTIONS] = {0};
+    for (int w=0; w<shared->num_workers; w++) {
+        LoadWorkerSlot& slot = shared->slots[w];
+        started += slot.stats.started;
+        completed += slot.stats.completed;
+        failed += slot.stats.failed;
+        connections += slot.stats.connections;
+        multiplexed += slot.stats.multiplexed;
+        for (int i=0; i<6; i++) status_class[i] += slot.stats.status_class[i];
+        total_us += slot.stats.total_us;
+        // a worker that has not finished a request yet has no minimum, its slot reads 0
+        if (slot.stats.completed > 0 && slot.stats.min_us < min_us) min_us = slot.stats.min_us;
+        if (slot.stats.max_us > max_us) max_us = slot.stats.max_us;
+        passed += slot.checks.passed;
+        checks_failed += slot.checks.failed;
+        for (int i=0; i<MAX_ASSERTIONS; i++) failures[i] += slot.checks.failures[i];
+    }
+    for (int b=0; b<LATENCY_BUCKETS; b++) {
+        int64_t count = 0;
+        for (int w=0; w<shared->num_workers; w++)
+            count += shared->slots[w].stats.latency.counts[b].load(std::memory_order_relaxed);
+        stats.latency.counts[b].store(count, std::memory_order_relaxed);
+    }
+    stats.started = started;
+    stats.failed = failed;
+    stats.connections = connections;
+    stats.multiplexed = multiplexed;
+    for (int i=0; i<6; i++) stats.status_class[i] = status_class[i];
+    stats.total_us = total_us;
+    stats.min_us = min_us;
+    stats.max_us = max_us;
+    stats.completed = completed;    // last, the window divides by it
+    checks.passed = passed;
+    checks.failed = checks_failed;
+    for (int i=0; i<MAX_ASSERTIONS; i++) checks.failures[i] = failures[i];
+}
+
+void runLoadWorkers(LoadTest& test)
+{
+    TRACE_SCOPE("load workers");
+    int64_t start = nowUs();
+    int num_workers = test.processes < LOAD_MAX_WORKERS ? test.processes : LOAD_MAX_WORKERS;
+    if (num_workers > test.total_requests) num_workers = test.total_requests;
+
+    char segment[64];
+    char request_file[64];
+#ifdef _WINDOWS
+    snprintf(segment, sizeof(segment), "Local\\postgirl-load-%d", currentProcessId());
+#else
+    snprintf(segment, sizeof(segment), "/postgirl-load-%d", currentProcessId());
+#endif
+    snprintf(request_file, sizeof(request_file), "postgirl-load-%d.json", currentProcessId());
+
+    // the workers read the request the way collections.json is read
+    pg::Vector<Collection> request;
+    request.push_back(Collection());
+    request[0].name = pg::String("load test");
+    request[0].hist.push_back(test.hist);
+    request[0].environment = test.environment;
+    void* handle = NULL;
+    LoadWorkerShared* shared = saveCollection(request, pg::String(request_file)) ? createSegment(segment, &handle) : NULL;
+    if (shared == NULL) {
+        // no shared memory or no writable working directory: send from here
+        remove(request_file);
+        runLoadTest(test, test.stats, test.checks, test.cancel);
+        return;
+    }
+    shared->magic = LOAD_WORKER_MAGIC;
+    shared->num_workers = num_workers;
+    shared->total_requests = test.total_requests;
+    shared->concurrency = test.concurrency;
+    snprintf(shared->request_file, sizeof(shared->request_file), "%s", request_file);
+    snprintf(shared->data_file, sizeof(shared->data_file), "%s", test.data ? test.data->path.buf_ : "");
+    shared->cancel = false;
+
+    WorkerProcess processes[LOAD_MAX_WORKERS];
+    bool running[LOAD_MAX_WORKERS];
+    int num_running = 0;
+    for (int w=0; w<num_workers; w++) {
+        running[w] = spawnWorker(segment, w, &processes[w]);
+        if (running[w]) num_running++;
+    }
+    if (num_running == 0) {
+        releaseSegment(shared, segment, handle, true);
+        remove(request_file);
+        runLoadTest(test, test.stats, test.checks, test.cancel);
+        return;
+    }
+
+    while (num_running > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(LOAD_WORKER_POLL_MS));
+        if (test.cancel) shared->cancel = true;
+        for (int w=0; w<num_workers; w++) {
+            if (running[w] && workerExited(processes[w])) {
+                running[w] = false;
+                num_running--;
+            }
+        }
+        mergeWorkers(shared, test.stats, test.checks);
+        test.stats.elapsed_us = nowUs() - start;
+    }
+    for (int w=0; w<num_workers; w++)
+        if (running[w]) killWorker(processes[w]);
+
+    mergeWorkers(shared, test.stats, test.checks);
+    test.stats.elapsed_us = nowUs() - start;
+    releaseSegment(shared, segment, handle, true);
+    remove(request_file);
+}
+
+int loadWorkerMain(const char* segment, int index)
+{
+    void* handle = NULL;
+    LoadWorkerShared* shared = attachSegment(segment, &handle);
+    if (shared == NULL) {
+        fprintf(stderr, "load worker: no shared memory segment %s\n", segment);
+        return 1;
+    }
+    if (shared->magic != LOAD_WORKER_MAGIC || index < 0 || index >= shared->num_workers) {
+        releaseSegment(shared, segment, handle, false);
+        return 1;
+    }
+    LoadWorkerSlot& slot = shared->slots[index];
+    slot.status = RUNNING;
+
+    curl_global_init(CURL_GLOBAL_ALL);
+    pg::Vector<Collection> request = loadCollection(pg::String(shared->request_file));
+    int exit_code = 1;
+    if (request.size() > 0 && request[0].hist.size() > 0) {
+        LoadTest test;
+        test.hist = request[0].hist[0];
+        test.environment = request[0].environment;
+        DataFile data;
+        if (shared->data_file[0] != '\0' && loadDataFile(data, shared->data_file))
+            test.data = &data;
+        test.concurrency = shared->concurrency;
+        workerShare(shared->total_requests, shared->num_workers, index, &test.total_requests, &test.first_sequence);
+        if (test.total_requests > 0)
+            runLoadTest(test, slot.stats, slot.checks, shared->cancel);
+        exit_code = 0;
+    }
+    curl_global_cleanup();
+
+    slot.status = FINISHED;
+    releaseSegment(shared, segment, handle, false);
+    return exit_code;
+}
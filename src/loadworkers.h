@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include "loadtest.h"
+
+// Multi-process load test. One curl multi loop tops out at what a single core
+// can drive, so with LoadTest::processes > 1 the load test thread starts that
+// many copies of the executable in worker mode (LOAD_WORKER_FLAG) instead of
+// sending itself. Each worker loads the request from a temporary collections
+// file, sends its share of total_requests with the load test loop and counts
+// them in its own slot of a shared memory segment. The slots are only made of
+// lock-free atomics with a single writer each, the load test thread adds them
+// up into LoadTest::stats and checks while the workers run, so the window
+// shows the run live as if it was one process.
+
+#define LOAD_WORKER_FLAG "--load-worker"
+#define LOAD_MAX_WORKERS 64
+
+typedef struct LoadWorkerSlot {
+    LoadTestStats stats;
+    AssertionStats checks;
+    std::atomic<int> status;        // ThreadStatus, FINISHED once the worker is done
+} LoadWorkerSlot;
+
+typedef struct LoadWorkerShared {
+    uint32_t magic;
+    int num_workers;
+    int total_requests;
+    int concurrency;                // per worker
+    char request_file[512];         // collections file holding the History and environment
+    char data_file[512];            // DataFile::path, empty for none
+    std::atomic<bool> cancel;
+    LoadWorkerSlot slots[LOAD_MAX_WORKERS];
+} LoadWorkerShared;
+
+// Number of cores
+int loadWorkerDefaultCount();
+
+// Runs test with test.processes workers, merging their counters into
+// test.stats and test.checks until all of them have exited
+void runLoadWorkers(LoadTest& test);
+
+// Entry point of a worker process: postgirl --load-worker <segment> <index>.
+// Returns the process exit code.
+int loadWorkerMain(const char* segment, int index);
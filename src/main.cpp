@@ -14,6 +14,24 @@
 #include "dirent_portable.h"
 #include "requests.h"
 #include "utils.h"
+#include "retention.h"
+#include "loader.h"
+#include "jobs.h"
+#include "saver.h"
+#include "loadtest.h"
+#include "runner.h"
+#include "template.h"
+#include "replay.h"
+#include "assertions.h"
+#include "mockserver.h"
+#include "profiler.h"
+#include "analytics.h"
+#include "httpcache.h"
+#include "hexview.h"
+#include "loadworkers.h"
+#include "websocket.h"
+#include "diff.h"
+#include "search.h"
 
 #ifdef _WINDOWS
 #include <windows.h>
@@ -27,50 +45,119 @@
 // Defines the current selected request. It may the current one or
 // another, from the history list.
 int selected  = 0;
-
-void processRequest(std::thread& thread, const char* buf, 
-                    pg::Vector<History>& history, const pg::Vector<Argument>& args, 
-                    const pg::Vector<Argument>& headers, int request_type, 
-                    ContentType contentType, const pg::String& inputJson,
-                    std::atomic<ThreadStatus>& thread_status)
+#define BODY_FILE_PICK -2   // curr_arg_file while picking the body file
+
+// The worker thread writes its result here instead of into the History itself,
+// the UI thread stores it in the body table once the request is FINISHED.
+pg::Body thread_result;
+int thread_response_code = 0;
+int64_t thread_duration_us = 0;
+int thread_response_version = 0;
+int request_collection = 0;
+
+// Compiled form of the last request sent, reused as long as it does not change
+PreparedRequest prepared_request;
+
+// Optional cache of the GET responses sent from the editor, off by default
+HttpCache http_cache;
+
+// Messages of the WebSocket session sent from the editor, its window opens with it
+WebSocketSession ws_session;
+bool show_websocket = false;
+
+// Rows for {{column}} variables, and the {{$seq}} of the next request sent from the UI
+DataFile data_file;
+int64_t send_sequence = 0;
+
+History makeHistory(const char* buf, const pg::Vector<Argument>& args, 
+                    const pg::Vector<Argument>& headers, const pg::Vector<Argument>& extract, 
+                    const pg::Vector<Argument>& assertions, int request_type, 
+                    ContentType contentType, HttpVersion http_version, const pg::String& inputJson,
+                    const char* body_file)
 {
-    if (thread_status != IDLE)
-        return;
     History hist;
-    hist.url = pg::String(buf);
-    hist.args = args;
-    hist.headers = headers;
-    hist.input_json = inputJson;
-    if (request_type == GET || request_type == DELETE || contentType != APPLICATION_JSON)
-        hist.input_json = pg::String("");
-    hist.result = pg::String("Processing");
+    hist.url = pg::Atom(buf);
+    internArguments(hist.args, args);
+    internArguments(hist.headers, headers);
+    internArguments(hist.extract, extract);
+    internArguments(hist.assertions, assertions);
+    bool has_body = request_type == POST || request_type == PUT || request_type == PATCH;
+    // a body file is kept by path, its content is streamed on send and never stored
+    if (has_body && contentType != MULTIPART_FORMDATA && body_file[0] != '\0')
+        hist.body_file = pg::Body(body_file);
+    else if ((has_body && contentType == APPLICATION_JSON) || request_type == WEBSOCKET)
+        hist.input_json = inputJson;    // a WebSocket session sends it as its first message
+    hist.body_file_hash = 0;
+    hist.body_file_size = 0;
+    hist.result = pg::Body("Processing");
+    hist.response_code = 0;
+    hist.duration_us = 0;
+    hist.response_version = 0;
     hist.content_type = contentType;
+    hist.http_version = http_version;
     hist.req_type = (RequestType)request_type;
     time_t t = time(NULL);
+    hist.timestamp = t;
     struct tm* ptm = gmtime(&t);
     char date_buf[128];
     if (strftime(date_buf, 128, "%B %d, %Y; %H:%M:%S\n", ptm) != 0)
-        hist.process_time = pg::String(date_buf);
+        hist.process_time = pg::Atom(date_buf);
     else
-        hist.process_time = pg::String("");
-    history.push_back(hist);
+        hist.process_time = pg::Atom();
+    return hist;
+}
+
+void processRequest(std::thread& thread, const char* buf, 
+                    pg::Vector<Collection>& collection, int collection_idx, const pg::Vector<Argument>& args, 
+                    const pg::Vector<Argument>& headers, const pg::Vector<Argument>& extract, 
+                    const pg::Vector<Argument>& assertions, int request_type, 
+                    ContentType contentType, HttpVersion http_version, const pg::String& inputJson,
+                    const char* body_file, std::atomic<ThreadStatus>& thread_status)
+{
+    if (thread_status != IDLE)
+        return;
+    pg::Vector<History>& history = collection[collection_idx].hist;
+    request_collection = collection_idx;
+    history.push_back(makeHistory(buf, args, headers, extract, assertions, request_type, contentType, http_version, inputJson, body_file));
     // points to the current (and unfinished) request
     selected = (int)history.size()-1;
     
     thread_status = RUNNING;
+    thread_response_code = 0;
+    thread_duration_us = 0;
+    thread_response_version = 0;
 
     switch(request_type) { 
         case GET:
         case DELETE:
-            thread = std::thread(threadRequestGetDelete, std::ref(thread_status), (RequestType)request_type, history.back().url, history.back().args, history.back().headers, contentType, std::ref(history.back().result), std::ref(history.back().response_code));
-            break;
         case POST:
         case PATCH:
         case PUT:
-            thread = std::thread(threadRequestPostPatchPut, std::ref(thread_status), (RequestType)request_type, history.back().url, history.back().args, history.back().headers, contentType, history.back().input_json, std::ref(history.back().result), std::ref(history.back().response_code));
+        {
+            // the history keeps the templates, the request sends their values
+            TemplateContext ctx;
+            ctx.environment = &collection[collection_idx].environment;
+            ctx.data = &data_file;
+            ctx.sequence = send_sequence++;
+            ctx.random_state ^= (uint64_t)time(NULL);
+            thread = std::thread(threadRequest, std::ref(thread_status), std::ref(prepared_request), renderRequest(history.back(), ctx), std::ref(thread_result), std::ref(thread_response_code), std::ref(thread_duration_us), std::ref(thread_response_version), &http_cache);
             break;
+        }
+        case WEBSOCKET:
+        {
+            TemplateContext ctx;
+            ctx.environment = &collection[collection_idx].environment;
+            ctx.data = &data_file;
+            ctx.sequence = send_sequence++;
+            ctx.random_state ^= (uint64_t)time(NULL);
+            ws_session.reset();
+            ws_session.cancel = false;
+            show_websocket = true;
+            thread = std::thread(threadWebSocket, std::ref(thread_status), std::ref(ws_session), renderRequest(history.back(), ctx), std::ref(thread_result), std::ref(thread_response_code), std::ref(thread_duration_us));
+            break;
+        }
         default:
-            history.back().result = pg::String("Invalid request type selected!");
+            thread_result = pg::Body("Invalid request type selected!");
             thread_status = FINISHED;
     }
 }
@@ -94,6 +181,10 @@ static inline float GetWindowContentRegionWidth()
 
 int main(int argc, char* argv[])
 {
+    // started by a multi-process load test, no window
+    if (argc == 4 && strcmp(argv[1], LOAD_WORKER_FLAG) == 0)
+        return loadWorkerMain(argv[2], atoi(argv[3]));
+
     glfwSetErrorCallback(glfw_error_callback);
     if (!glfwInit())
         return 1;
@@ -132,6 +223,7 @@ int main(int argc, char* argv[])
 
     // Setup Dear ImGui context
     IMGUI_CHECKVERSION();
+    ImGui::SetAllocatorFunctions(pg::imguiAlloc, pg::imguiFree);
     ImGui::CreateContext();
     ImGuiIO& io = ImGui::GetIO(); (void)io;
     ImGui::StyleColorsDark();
@@ -152,41 +244,58 @@ int main(int argc, char* argv[])
     const char* delete_types[] = {"Text"};
     const char* patch_types[] = {"Text", "File"};
     const char* put_types[] = {"Text", "File"};
+    const char* ws_types[] = {"Text"};
     arg_types.push_back(get_types);
     arg_types.push_back(post_types);
     arg_types.push_back(delete_types);
     arg_types.push_back(patch_types);
     arg_types.push_back(put_types);
+    arg_types.push_back(ws_types);
     pg::Vector<int> num_arg_types;
     num_arg_types.push_back(1);
     num_arg_types.push_back(2);
     num_arg_types.push_back(1);
     num_arg_types.push_back(2);
     num_arg_types.push_back(2);
+    num_arg_types.push_back(1);
 
     bool picking_file = false;
+    bool show_load_test = false;
+    LoadTest load_test;
+    std::thread load_test_thread;
+    bool show_runner = false;
+    bool show_environment = false;
+    bool show_replay = false;
+    Replay replay;
+    std::thread replay_thread;
+    bool show_mock_server = false;
+    bool show_profiler = false;
+    bool show_analytics = false;
+    bool show_http_cache = false;
+    EndpointIndex endpoint_index;
+    bool show_diff = false;
+    Diff diff;
+    HistorySearch history_search;
+    MockServer mock_server;
+    CollectionRun collection_run;
     bool show_history = true;
     int curr_arg_file = 0;
     
 
-    pg::Vector<Collection> collection = loadCollection("collections.json");
-    if (collection.size() == 0) {
-        Collection temp_col;
-        collection.push_back(temp_col);
-    }
+    // The window shows up right away, collections.json is merged in as it loads.
+    // Collection 0 always exists so requests can be made while loading.
+    jobsInit(0);
+    saverInit("collections.json");
+    pg::Vector<Collection> collection;
+    collection.push_back(Collection());
+    loadCollectionAsync("collections.json");
+    bool save_pending = false; // a save requested while loading, it would lose the unloaded part
     int curr_history = 0;
     int curr_collection = 0;
     bool update_hist_search = true; // used to init stuff on first run
     curl_global_init(CURL_GLOBAL_ALL);
 
-    pg::Vector<pg::String> content_type_str;
-    content_type_str.push_back(ContentTypeToString(MULTIPART_FORMDATA));
-    content_type_str.push_back(ContentTypeToString(APPLICATION_JSON));
-    
-    pg::Vector<pg::String> request_type_str;
-    for (int i=0; i<5; i++) {
-        request_type_str.push_back(RequestTypeToString((RequestType)i));
-    }
+    traceSetThreadName("UI");
 
     // Main loop
     while (!glfwWindowShouldClose(window))
@@ -196,33 +305,108 @@ int main(int argc, char* argv[])
 
         gettimeofday(&timecheck, NULL);
         start = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec / 1000;
+        profileFrameBegin();
 
+        profileBegin(PHASE_POLL);
         glfwPollEvents();
 
+        if (collectionLoading()) {
+            if (pollCollectionLoad(collection) > 0) {
+                clearHistorySearchCache(history_search);
+                update_hist_search = true;
+            }
+            if (!collectionLoading() && thread_status == IDLE) {
+                for (int i=0; i<collection.size(); i++)
+                    applyRetention(collection[i], time(NULL));
+                if (save_pending) saveCollectionAsync(collection, -1);
+                save_pending = false;
+            }
+        }
+        profileEnd(PHASE_POLL);
+
         // Start the Dear ImGui frame
         ImGui_ImplOpenGL3_NewFrame();
         ImGui_ImplGlfw_NewFrame();
         ImGui::NewFrame();
 
-        static const char* items[] = {"GET", "POST", "DELETE", "PATCH", "PUT"};
+        static const char* items[] = {"GET", "POST", "DELETE", "PATCH", "PUT", "WS"};
         static const char* ct_post[] = {"multipart/form-data", "application/json", "<NONE>"};
         static int request_type = 0;
         static ContentType content_type = (ContentType)0;
+        static HttpVersion http_version = HTTP_DEFAULT;
         static pg::Vector<Argument> headers;
-        static pg::String result;
+        static pg::Vector<Argument> extract;
+        static pg::Vector<Argument> assertions;
+        static pg::Body result;
         static pg::Vector<Argument> args;
         static pg::String input_json(1024*3200); // 32KB static string should be reasonable
+        static bool input_json_changed = true;
+        static bool input_json_error = false;
         static char url_buf[4098] = "http://localhost:5000/test_route";
+        static bool body_from_file = false;
+        static char body_file_buf[2048] = "";
+        const char* body_file = body_from_file ? body_file_buf : "";
 
         ImGui::SetNextWindowPos(ImVec2(0,0));
         ImGui::SetNextWindowSize(ImVec2(io.DisplaySize.x, io.DisplaySize.y));
         ImGui::Begin("Postgirl", NULL, ImGuiWindowFlags_MenuBar | ImGuiWindowFlags_NoResize | ImGuiWindowFlags_NoMove | ImGuiWindowFlags_NoBackground | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_HorizontalScrollbar);
 
+        if (ImGui::BeginMenuBar()) {
+            if (ImGui::BeginMenu("Settings")) {
+                RetentionPolicy& retention = collection[curr_collection].retention;
+                ImGui::Text("History retention (0 disables a rule)");
+                ImGui::PushItemWidth(ImGui::GetFontSize() * 8);
+                bool changed = false;
+                changed |= ImGui::InputInt("Max entries", &retention.max_entries);
+                changed |= ImGui::InputInt("Max age (days)", &retention.max_age_days);
+                changed |= ImGui::InputInt("Max body size (KB)", &retention.max_body_kb);
+                changed |= ImGui::InputInt("Memory budget (MB)", &retention.memory_budget_mb);
+                ImGui::PopItemWidth();
+                if (changed) {
+                    if (retention.max_entries < 0) retention.max_entries = 0;
+                    if (retention.max_age_days < 0) retention.max_age_days = 0;
+                    if (retention.max_body_kb < 0) retention.max_body_kb = 0;
+                    if (retention.memory_budget_mb < 0) retention.memory_budget_mb = 0;
+                }
+                if (ImGui::Button("Apply now") && thread_status == IDLE && !collectionLoading()) {
+                    applyRetention(collection[curr_collection], time(NULL));
+                    saveCollectionAsync(collection, curr_collection);
+                    update_hist_search = true;
+                }
+                ImGui::Separator();
+                ImGui::Text("Bodies: %d distinct, %d cold", bodyStoreCount(), bodyStoreColdCount());
+                if (bodyStoreMissingCount() > 0)
+                    ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%d cold bodies missing from %s/", bodyStoreMissingCount(), BODY_COLD_DIR);
+                ImGui::Text("Resident: %.1f KB total, %.1f KB in this collection",
+                            bodyStoreBytes()/1024.0, collectionResidentBytes(collection[curr_collection])/1024.0);
+                ImGui::Text("Strings: %d interned, %.1f KB", strTableCount(), strTableBytes()/1024.0);
+                ImGui::EndMenu();
+            }
+            if (ImGui::BeginMenu("Tools")) {
+                ImGui::MenuItem("Load test", NULL, &show_load_test);
+                ImGui::MenuItem("Collection runner", NULL, &show_runner);
+                ImGui::MenuItem("Environment", NULL, &show_environment);
+                ImGui::MenuItem("Replay capture", NULL, &show_replay);
+                ImGui::MenuItem("Mock server", NULL, &show_mock_server);
+                ImGui::MenuItem("Endpoint analytics", NULL, &show_analytics);
+                ImGui::MenuItem("HTTP cache", NULL, &show_http_cache);
+                ImGui::MenuItem("WebSocket", NULL, &show_websocket);
+                ImGui::MenuItem("Diff", NULL, &show_diff);
+                ImGui::MenuItem("Frame profiler", NULL, &show_profiler);
+                ImGui::EndMenu();
+            }
+            ImGui::EndMenuBar();
+        }
+
         {
+            PROFILE_SCOPE(PHASE_SIDEBAR);
             ImGuiWindowFlags window_flags = ImGuiWindowFlags_HorizontalScrollbar;
             ImGui::BeginChild("History", ImVec2(GetWindowContentRegionWidth() * 0.2f, 0), false, window_flags);
 
             ImGui::Text("History Search");
+            if (collectionLoading()) {
+                ImGui::ProgressBar(collectionLoadProgress(), ImVec2(-1.0f, 0.0f), "Loading collections...");
+            }
             if (ImGui::BeginMenuBar()) {
                 for (int i=(int)collection.size()-1; i>=0; i--) {
                     if (ImGui::BeginMenu(collection[i].name.buf_)) {
@@ -234,33 +418,31 @@ int main(int argc, char* argv[])
             }
 
             static pg::String hist_search;
-            static pg::Vector<int> search_result;
             static bool live_search = true;
+            static bool search_all = false;
+            static bool search_regex = false;
+            static int search_collection = -1;
             static ImGuiInputTextFlags search_flags = 0; 
 
             ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x*0.95);
+            if (!search_all && search_collection != curr_collection)
+                update_hist_search = true;
             if (ImGui::InputText("##Search", hist_search.buf_, hist_search.capacity(), search_flags) || update_hist_search)
             {
                 update_hist_search = false;
-                search_result.clear();
+                search_collection = curr_collection;
                 if (hist_search.length() > 0) {
-                    char *fb = hist_search.buf_, *fe = hist_search.end();
-                    for (int i=(int)collection[curr_collection].hist.size()-1; i>=0; i--) {
-                        if (hist_search.length() == 0 || (hist_search.length() > 0 &&
-                            (Stristr(collection[curr_collection].hist[i].url.buf_, collection[curr_collection].hist[i].url.end(), fb, fe) ||
-                            Stristr(collection[curr_collection].hist[i].input_json.buf_, collection[curr_collection].hist[i].input_json.end(), fb, fe) ||
-                            Stristr(collection[curr_collection].hist[i].result.buf_, collection[curr_collection].hist[i].result.end(), fb, fe))))
-                        {
-                            search_result.push_back(i);
-                        }
-                    }
+                    startHistorySearch(history_search, collection, search_all ? -1 : curr_collection, hist_search.buf_, search_regex);
                 }
                 else {
+                    cancelHistorySearch(history_search);
                     for (int i=(int)collection[curr_collection].hist.size()-1; i>=0; i--) {
-                        search_result.push_back(i);
+                        SearchHit hit = {curr_collection, i};
+                        history_search.hits.push_back(hit);
                     }
                 }
             }
+            bool searching = updateHistorySearch(history_search);
             if (ImGui::Checkbox("Live Search", &live_search)) {
                 if (search_flags) {
                     search_flags = 0;
@@ -269,23 +451,68 @@ int main(int argc, char* argv[])
                     search_flags = ImGuiInputTextFlags_EnterReturnsTrue;
                 }
             }
-            ImGui::SameLine(); Help("Live Search can be slow depending on your history size!");
+            ImGui::SameLine();
+            if (ImGui::Checkbox("All", &search_all)) update_hist_search = true;
+            ImGui::SameLine();
+            if (ImGui::Checkbox("Regex", &search_regex)) update_hist_search = true;
+            ImGui::SameLine(); Help("Searches URLs and bodies on every core, hits show up as they are found. All searches every collection. Regex uses rapidjson's syntax and is case sensitive. Bodies moved to disk by the retention rules are read from there without loading them back.");
+            if (history_search.error[0])
+                ImGui::TextColored(ImVec4(1.0f, 0.45f, 0.45f, 1.0f), "%s", history_search.error);
+            else if (searching)
+                ImGui::TextDisabled("Searching... %d found", history_search.hits.size());
+            else if (hist_search.length() > 0)
+                ImGui::TextDisabled("%d found in %.1f ms, %d entries tested", history_search.hits.size(), history_search.elapsed_us / 1000.0, history_search.tested);
+            if (!searching && history_search.not_searched > 0)
+                ImGui::TextColored(ImVec4(1.0f, 0.45f, 0.45f, 1.0f), "%d cold bodies not searched, missing from %s/", history_search.not_searched, BODY_COLD_DIR);
 
             ImGui::BeginChild("HistoryList", ImVec2(GetWindowContentRegionWidth(), 0), false, window_flags);
-            char *fb = hist_search.buf_, *fe = hist_search.end();
-            for (int sr=0; sr<search_result.size(); sr++) {
-                int i = search_result[sr];
-                char select_name[2048];
-                sprintf(select_name, "(%s) %s##%d", request_type_str[(int)collection[curr_collection].hist[i].req_type].buf_, collection[curr_collection].hist[i].url.buf_, i);
-                if (ImGui::Selectable(select_name, selected==i)) {
-                    selected = i;
-                    request_type = collection[curr_collection].hist[i].req_type;
-                    content_type = collection[curr_collection].hist[i].content_type;
-                    headers = collection[curr_collection].hist[i].headers;
-                    result = collection[curr_collection].hist[i].result;
-                    args = collection[curr_collection].hist[i].args;
-                    input_json = collection[curr_collection].hist[i].input_json;
-                    strcpy(url_buf, collection[curr_collection].hist[i].url.buf_);
+            // only the visible rows are formatted and submitted
+            ImGuiListClipper clipper;
+            clipper.Begin(history_search.hits.size());
+            while (clipper.Step()) {
+                for (int sr=clipper.DisplayStart; sr<clipper.DisplayEnd; sr++) {
+                    const SearchHit hit = history_search.hits[sr];
+                    // hits of a search started before retention or a load changed the history
+                    if (hit.collection >= collection.size() || hit.index >= collection[hit.collection].hist.size())
+                        continue;
+                    int i = hit.index;
+                    const History& hit_hist = collection[hit.collection].hist[i];
+                    char select_name[2048];
+                    if (hit.collection == curr_collection)
+                        snprintf(select_name, sizeof(select_name), "(%s) %s##%d", items[(int)hit_hist.req_type], hit_hist.url.buf(), i);
+                    else
+                        snprintf(select_name, sizeof(select_name), "(%s) %s [%s]##%d_%d", items[(int)hit_hist.req_type], hit_hist.url.buf(),
+                                 collection[hit.collection].name.buf_, hit.collection, i);
+                    if (ImGui::Selectable(select_name, selected==i && hit.collection == curr_collection)) {
+                        if (hit.collection != curr_collection) {
+                            curr_collection = hit.collection;
+                            search_collection = curr_collection;
+                        }
+                        selected = i;
+                        request_type = collection[curr_collection].hist[i].req_type;
+                        content_type = collection[curr_collection].hist[i].content_type;
+                        http_version = collection[curr_collection].hist[i].http_version;
+                        copyArguments(headers, collection[curr_collection].hist[i].headers);
+                        copyArguments(extract, collection[curr_collection].hist[i].extract);
+                        copyArguments(assertions, collection[curr_collection].hist[i].assertions);
+                        result = collection[curr_collection].hist[i].result;
+                        copyArguments(args, collection[curr_collection].hist[i].args);
+                        input_json.set(collection[curr_collection].hist[i].input_json.buf());
+                        input_json_changed = true;
+                        body_from_file = collection[curr_collection].hist[i].body_file.length() > 0;
+                        if (body_from_file)
+                            snprintf(body_file_buf, sizeof(body_file_buf), "%s", collection[curr_collection].hist[i].body_file.buf());
+                        strcpy(url_buf, collection[curr_collection].hist[i].url.buf());
+                    }
+                    if (ImGui::BeginPopupContextItem()) {
+                        if (ImGui::MenuItem("Diff with selected", NULL, false, hit.collection == curr_collection && i != selected && selected < collection[curr_collection].hist.size() && diff.status != RUNNING)) {
+                            diff.left = selected;
+                            diff.right = i;
+                            show_diff = true;
+                            startDiff(diff, collection[curr_collection].hist[selected].result, collection[curr_collection].hist[i].result);
+                        }
+                        ImGui::EndPopup();
+                    }
                 }
             }
             ImGui::EndChild();
@@ -313,7 +540,8 @@ int main(int argc, char* argv[])
 
             switch (request_type) {
                 case GET:
-                case DELETE: break;
+                case DELETE:
+                case WEBSOCKET: break;
                 case POST:
                 case PATCH:
                 case PUT:
@@ -329,11 +557,21 @@ int main(int argc, char* argv[])
                     ImGui::SameLine();
                     break;
             }
+            ImGui::PushItemWidth(ImGui::GetFontSize() * 7);
+            if (ImGui::BeginCombo("##http_version", HttpVersionToString(http_version))) {
+                for (int n = HTTP_DEFAULT; n <= HTTP_2_PRIOR_KNOWLEDGE; n++) {
+                    if (ImGui::Selectable(HttpVersionToString((HttpVersion)n), http_version == n))
+                        http_version = (HttpVersion)n;
+                }
+                ImGui::EndCombo();
+            }
+            ImGui::PopItemWidth();
+            ImGui::SameLine();
             
             ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x);
             if (ImGui::InputText("##URL", url_buf, IM_ARRAYSIZE(url_buf), ImGuiInputTextFlags_EnterReturnsTrue) ) {
                 ImGui::SetKeyboardFocusHere(-1); // Auto focus previous widget
-                processRequest(thread, url_buf, collection[curr_collection].hist, args, headers, request_type, content_type, input_json, thread_status);
+                processRequest(thread, url_buf, collection, curr_collection, args, headers, extract, assertions, request_type, content_type, http_version, input_json, body_file, thread_status);
             }
 
 
@@ -343,12 +581,12 @@ int main(int argc, char* argv[])
                 char arg_name[32];
                 sprintf(arg_name, "Name##header arg name%d", i);
                 if (ImGui::InputText(arg_name, &headers[i].name[0], headers[i].name.capacity(), ImGuiInputTextFlags_EnterReturnsTrue))
-                    processRequest(thread, url_buf, collection[curr_collection].hist, args, headers, request_type, content_type, input_json, thread_status);
+                    processRequest(thread, url_buf, collection, curr_collection, args, headers, extract, assertions, request_type, content_type, http_version, input_json, body_file, thread_status);
                 ImGui::SameLine();
                 ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x*0.4);
                 sprintf(arg_name, "Value##header arg value%d", i);
                 if (ImGui::InputText(arg_name, &headers[i].value[0], headers[i].value.capacity(), ImGuiInputTextFlags_EnterReturnsTrue))
-                    processRequest(thread, url_buf, collection[curr_collection].hist, args, headers, request_type, content_type, input_json, thread_status);
+                    processRequest(thread, url_buf, collection, curr_collection, args, headers, extract, assertions, request_type, content_type, http_version, input_json, body_file, thread_status);
                 ImGui::SameLine();
                 char btn_name[32];
                 sprintf(btn_name, "Delete##header arg delete%d", i);
@@ -377,12 +615,12 @@ int main(int argc, char* argv[])
                 char arg_name[32];
                 sprintf(arg_name, "Name##arg name%d", i);
                 if (ImGui::InputText(arg_name, &args[i].name[0], args[i].name.capacity(), ImGuiInputTextFlags_EnterReturnsTrue))
-                    processRequest(thread, url_buf, collection[curr_collection].hist, args, headers, request_type, content_type, input_json, thread_status);
+                    processRequest(thread, url_buf, collection, curr_collection, args, headers, extract, assertions, request_type, content_type, http_version, input_json, body_file, thread_status);
                 ImGui::SameLine();
                 ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x*0.6);
                 sprintf(arg_name, "Value##arg name%d", i);
                 if (ImGui::InputText(arg_name, &args[i].value[0], args[i].value.capacity(), ImGuiInputTextFlags_EnterReturnsTrue))
-                    processRequest(thread, url_buf, collection[curr_collection].hist, args, headers, request_type, content_type, input_json, thread_status);
+                    processRequest(thread, url_buf, collection, curr_collection, args, headers, extract, assertions, request_type, content_type, http_version, input_json, body_file, thread_status);
                 ImGui::SameLine();
                 if (args[i].arg_type == 1) {
                     sprintf(arg_name, "File##arg name%d", i);
@@ -421,42 +659,223 @@ int main(int argc, char* argv[])
                 args.clear();
             }
 
+            // Variables pulled out of the response, used by the collection runner
+            // to feed {{name}} placeholders of the requests that come after
+            for (int i=0; i<(int)extract.size(); i++) {
+                ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x*0.2);
+                char arg_name[64];
+                snprintf(arg_name, sizeof(arg_name), "Variable##extract name%d", i);
+                ImGui::InputText(arg_name, &extract[i].name[0], extract[i].name.capacity());
+                ImGui::SameLine();
+                ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x*0.4);
+                snprintf(arg_name, sizeof(arg_name), "JSON Pointer##extract value%d", i);
+                ImGui::InputText(arg_name, &extract[i].value[0], extract[i].value.capacity());
+                ImGui::SameLine();
+                char btn_name[64];
+                snprintf(btn_name, sizeof(btn_name), "Delete##extract delete%d", i);
+                if (ImGui::Button(btn_name)) {
+                    delete_arg_btn.push_back(i);
+                }
+            }
+            for (int i=(int)delete_arg_btn.size(); i>0; i--) {
+                extract.erase(extract.begin()+delete_arg_btn[i-1]);
+            }
+            delete_arg_btn.clear();
+            if (ImGui::Button("Add Extraction")) {
+                Argument var;
+                var.arg_type = 0;
+                extract.push_back(var);
+            }
+            ImGui::SameLine(); Help("Stores the value at a JSON Pointer (e.g. /data/token) of the response as {{Variable}} for the following requests of a collection run");
+
+            // Checks run on every response of a collection run or load test
+            const char* assertion_types[ASSERT_COUNT];
+            for (int i=0; i<ASSERT_COUNT; i++) assertion_types[i] = AssertionTypeToString(i);
+            for (int i=0; i<(int)assertions.size(); i++) {
+                char arg_name[64];
+                ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x*0.15);
+                snprintf(arg_name, sizeof(arg_name), "##assert type%d", i);
+                ImGui::Combo(arg_name, &assertions[i].arg_type, assertion_types, ASSERT_COUNT);
+                ImGui::SameLine();
+                bool has_pointer = assertions[i].arg_type == ASSERT_JSON_EQUALS || assertions[i].arg_type == ASSERT_JSON_EXISTS;
+                if (has_pointer) {
+                    ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x*0.3);
+                    snprintf(arg_name, sizeof(arg_name), "JSON Pointer##assert name%d", i);
+                    ImGui::InputText(arg_name, &assertions[i].name[0], assertions[i].name.capacity());
+                    ImGui::PopItemWidth();
+                    ImGui::SameLine();
+                }
+                if (assertions[i].arg_type != ASSERT_JSON_EXISTS) {
+                    ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x*0.4);
+                    snprintf(arg_name, sizeof(arg_name), "Expected##assert value%d", i);
+                    ImGui::InputText(arg_name, &assertions[i].value[0], assertions[i].value.capacity());
+                    ImGui::PopItemWidth();
+                    ImGui::SameLine();
+                }
+                ImGui::PopItemWidth();
+                char btn_name[64];
+                snprintf(btn_name, sizeof(btn_name), "Delete##assert delete%d", i);
+                if (ImGui::Button(btn_name)) {
+                    delete_arg_btn.push_back(i);
+                }
+            }
+            for (int i=(int)delete_arg_btn.size(); i>0; i--) {
+                assertions.erase(assertions.begin()+delete_arg_btn[i-1]);
+            }
+            delete_arg_btn.clear();
+            if (ImGui::Button("Add Check") && assertions.size() < MAX_ASSERTIONS) {
+                Argument check;
+                check.arg_type = ASSERT_STATUS;
+                check.value = pg::String("200");
+                assertions.push_back(check);
+            }
+            ImGui::SameLine(); Help("Response checks evaluated by the collection runner and the load test: status code (200 or 2xx), JSON Pointer equals/exists, body regex, latency ceiling in ms");
+
             if (thread_status == FINISHED) {
                 thread.join();
                 thread_status = IDLE;
+                collection[request_collection].hist.back().result = thread_result;
+                collection[request_collection].hist.back().response_code = thread_response_code;
+                collection[request_collection].hist.back().duration_us = thread_duration_us;
+                collection[request_collection].hist.back().response_version = thread_response_version;
+                if (collection[request_collection].hist.back().body_file.length() > 0) {
+                    collection[request_collection].hist.back().body_file_hash = prepared_request.body_file_hash;
+                    collection[request_collection].hist.back().body_file_size = (int64_t)prepared_request.body_map.size;
+                }
+                if (collectionLoading()) {
+                    save_pending = true;
+                } else {
+                    PROFILE_SCOPE(PHASE_SAVE);
+                    applyRetention(collection[request_collection], time(NULL));
+                    saveCollectionAsync(collection, request_collection);
+                }
                 selected = (int)collection[curr_collection].hist.size()-1;
-                saveCollection(collection, "collections.json");
                 update_hist_search = true;
             }
             
-            if ((request_type == POST || request_type == PUT || request_type == PATCH) && content_type == 1) {
-                ImGui::Text("Input JSON");
-                rapidjson::Document d;
-                // TODO: only check for JSON errors on changes instead of every frame
-                if (d.Parse(input_json.buf_).HasParseError() && input_json.length() > 0) {
+            if ((request_type == POST || request_type == PUT || request_type == PATCH) && content_type != MULTIPART_FORMDATA) {
+                ImGui::Checkbox("Body from file", &body_from_file);
+                ImGui::SameLine(); Help("Streams the file as the request body without loading it, for payloads too big for the editor. The history keeps the path, size and hash, not the content.");
+                if (body_from_file) {
+                    ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x*0.6);
+                    ImGui::InputText("##body_file", body_file_buf, IM_ARRAYSIZE(body_file_buf));
+                    ImGui::PopItemWidth();
+                    ImGui::SameLine();
+                    if (ImGui::Button("File##body file")) {
+                        picking_file = true;
+                        curr_arg_file = BODY_FILE_PICK;
+                    }
+                    const History* sent = selected < collection[curr_collection].hist.size() ? &collection[curr_collection].hist[selected] : NULL;
+                    if (sent && sent->body_file.length() > 0 && sent->body_file_hash != 0)
+                        ImGui::TextDisabled("Sent %.2f MB, hash %016llx", sent->body_file_size / 1048576.0, (unsigned long long)sent->body_file_hash);
+                }
+            }
+
+            bool ws_message = request_type == WEBSOCKET;
+            if (((request_type == POST || request_type == PUT || request_type == PATCH) && content_type == 1 && !body_from_file) || ws_message) {
+                ImGui::Text(ws_message ? "First message" : "Input JSON");
+                // validated on changes only, with the SAX reader: no DOM to allocate
+                if (input_json_changed) {
+                    PROFILE_SCOPE(PHASE_JSON_CHECK);
+                    rapidjson::Reader reader;
+                    rapidjson::BaseReaderHandler<> handler;
+                    rapidjson::StringStream stream(input_json.buf_);
+                    input_json_error = input_json.buf_[0] != '\0' && reader.Parse(stream, handler).IsError();
+                    input_json_changed = false;
+                }
+                if (input_json_error && !ws_message) {
                     ImGui::SameLine();
                     ImGui::Text("Problems with JSON");
                 }
                 int block_height = ImGui::GetContentRegionAvail()[1];
                 block_height /= 2;
-                ImGui::InputTextMultiline("##input_json", &input_json[0], input_json.capacity(), ImVec2(-1.0f, block_height), ImGuiInputTextFlags_AllowTabInput);
+                if (ImGui::InputTextMultiline("##input_json", &input_json[0], input_json.capacity(), ImVec2(-1.0f, block_height), ImGuiInputTextFlags_AllowTabInput))
+                    input_json_changed = true;
             }
 
+            static bool result_hex = false;
             ImGui::Text("Result");
+            ImGui::SameLine(); ImGui::Checkbox("Hex", &result_hex);
+            profileBegin(PHASE_RESULT);
             if (collection[curr_collection].hist.size() > 0) {
                 if (selected >= collection[curr_collection].hist.size()) {
                     selected = (int)collection[curr_collection].hist.size()-1;
                 }
-                ImGui::InputTextMultiline("##source", &collection[curr_collection].hist[selected].result[0], collection[curr_collection].hist[selected].result.capacity(), ImVec2(-1.0f, ImGui::GetContentRegionAvail()[1]), ImGuiInputTextFlags_AllowTabInput | ImGuiInputTextFlags_ReadOnly);
+                const History& selected_hist = collection[curr_collection].hist[selected];
+                if (selected_hist.response_code != 0) {
+                    ImGui::SameLine();
+                    ImGui::TextDisabled("%s %d, %.1f ms", ResponseVersionToString(selected_hist.response_version),
+                                        selected_hist.response_code, selected_hist.duration_us / 1000.0);
+                }
+                const pg::Body& selected_result = collection[curr_collection].hist[selected].result;
+                const char* result_data = selected_result.buf();
+                if (selected_result.missing()) {
+                    ImGui::SameLine();
+                    ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "missing from the cold store");
+                }
+                if (result_hex || bodyIsBinary(result_data, selected_result.length())) {
+                    ImGui::SameLine();
+                    ImGui::TextDisabled("%d bytes", selected_result.length());
+                    hexView("##source_hex", result_data, selected_result.length(), ImVec2(-1.0f, ImGui::GetContentRegionAvail()[1]));
+                } else {
+                    ImGui::InputTextMultiline("##source", (char*)result_data, selected_result.length()+1, ImVec2(-1.0f, ImGui::GetContentRegionAvail()[1]), ImGuiInputTextFlags_AllowTabInput | ImGuiInputTextFlags_ReadOnly);
+                }
             }
             else {
                 char blank[] = "";
                 ImGui::InputTextMultiline("##source", blank, 0, ImVec2(-1.0f, ImGui::GetContentRegionAvail()[1]), ImGuiInputTextFlags_AllowTabInput | ImGuiInputTextFlags_ReadOnly);
             }
+            profileEnd(PHASE_RESULT);
 
 
             ImGui::EndChild();
         }
+        if (load_test.status == FINISHED) {
+            load_test_thread.join();
+            load_test.status = IDLE;
+        }
+        if (show_load_test && loadTestWindow(&show_load_test, load_test) && load_test.status == IDLE) {
+            load_test.hist = makeHistory(url_buf, args, headers, extract, assertions, request_type, content_type, http_version, input_json, body_file);
+            load_test.environment = collection[curr_collection].environment;
+            load_test.data = &data_file;
+            load_test.stats.reset();
+            load_test.checks.reset();
+            load_test.cancel = false;
+            load_test.status = RUNNING;
+            load_test_thread = std::thread(threadLoadTest, std::ref(load_test));
+        }
+        if (replay.status == FINISHED) {
+            replay_thread.join();
+            replay.status = IDLE;
+        }
+        if (show_replay && replayWindow(&show_replay, replay) && replay.status == IDLE) {
+            replay.reset();
+            replay.cancel = false;
+            replay.status = RUNNING;
+            replay_thread = std::thread(threadReplay, std::ref(replay));
+        }
+        if (show_environment && environmentWindow(&show_environment, collection[curr_collection], data_file, load_test.status != IDLE)) {
+            if (collectionLoading()) save_pending = true;
+            else saveCollectionAsync(collection, curr_collection);
+        }
+        if (show_mock_server && mockServerWindow(&show_mock_server, mock_server) && curr_collection < collection.size())
+            startMockServer(mock_server, collection[curr_collection]);
+        updateCollectionRun(collection_run);
+        if (show_runner && collectionRunWindow(&show_runner, collection_run) && curr_collection < collection.size())
+            startCollectionRun(collection_run, collection[curr_collection]);
+
+        if (show_analytics && curr_collection < collection.size())
+            endpointAnalyticsWindow(&show_analytics, endpoint_index, collection[curr_collection],
+                                    thread_status != IDLE && request_collection == curr_collection);
+        if (show_http_cache)
+            httpCacheWindow(&show_http_cache, http_cache);
+        if (show_websocket)
+            webSocketWindow(&show_websocket, ws_session);
+        if (show_diff && curr_collection < collection.size())
+            diffWindow(&show_diff, diff, collection[curr_collection]);
+        if (show_profiler)
+            profilerWindow(&show_profiler);
+
         if (picking_file) {
             ImGui::Begin("File Selector", &picking_file);
             static pg::Vector<pg::String> curr_files;
@@ -499,12 +918,13 @@ int main(int argc, char* argv[])
                 ImVec2 pos = ImGui::GetCursorScreenPos();
                 ImGui::GetWindowDrawList()->AddRectFilled(ImVec2(pos.x, pos.y), ImVec2(pos.x + ImGui::GetContentRegionAvail()[0], pos.y + ImGui::GetTextLineHeight()), IM_COL32(100,100,0,50));
                 if (ImGui::MenuItem(curr_files[i].buf_, NULL)) {
-                    if (curr_arg_file >= 0 && curr_arg_file < args.size()) {
-                        pg::String filename = curr_dir;
-                        filename.append("/");
-                        filename.append(curr_files[i]);
+                    pg::String filename = curr_dir;
+                    filename.append("/");
+                    filename.append(curr_files[i]);
+                    if (curr_arg_file >= 0 && curr_arg_file < args.size())
                         args[curr_arg_file].value = filename;
-                    }                    
+                    else if (curr_arg_file == BODY_FILE_PICK)
+                        snprintf(body_file_buf, sizeof(body_file_buf), "%s", filename.buf_);
 
                     picking_file = false;
                     curr_arg_file = -1;
@@ -515,6 +935,7 @@ int main(int argc, char* argv[])
 
         ImGui::End();
         // Rendering
+        profileBegin(PHASE_RENDER);
         ImGui::Render();
         int display_w, display_h;
         glfwGetFramebufferSize(window, &display_w, &display_h);
@@ -522,8 +943,12 @@ int main(int argc, char* argv[])
         glClearColor(clear_color.x, clear_color.y, clear_color.z, clear_color.w);
         glClear(GL_COLOR_BUFFER_BIT);
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        profileEnd(PHASE_RENDER);
 
+        profileBegin(PHASE_SWAP);
         glfwSwapBuffers(window);
+        profileEnd(PHASE_SWAP);
+        profileFrameEnd();
         gettimeofday(&timecheck, NULL);
         end = (long)timecheck.tv_sec * 1000 + (long)timecheck.tv_usec / 1000;
         long sleep_time = 1000/60-(end-start);
@@ -533,6 +958,26 @@ int main(int argc, char* argv[])
     }
 
     // Cleanup
+    if (load_test_thread.joinable()) {
+        load_test.cancel = true;
+        load_test_thread.join();
+    }
+    if (replay_thread.joinable()) {
+        replay.cancel = true;
+        replay_thread.join();
+    }
+    stopMockServer(mock_server);
+    if (collection_run.pool) {
+        collection_run.cancel = true;
+        jobPoolDestroy(collection_run.pool);
+    }
+    if (thread.joinable()) {
+        ws_session.cancel = true;   // an open session would never finish
+        thread.join();
+    }
+    stopHistorySearch(history_search);
+    saverShutdown();
+    jobsShutdown();
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -0,0 +1,89 @@
+#include "mmapfile.h"
+
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WINDOWS
+
+bool mapFile(MappedFile& file, const char* filename, bool sequential)
+{
+    file = MappedFile();
+    HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                                sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(handle, &size)) {
+        CloseHandle(handle);
+        return false;
+    }
+    file.handle = handle;
+    file.size = (size_t)size.QuadPart;
+    if (file.size == 0)
+        return true;
+
+    HANDLE mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        unmapFile(file);
+        return false;
+    }
+    file.mapping = mapping;
+    file.data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (file.data == NULL) {
+        unmapFile(file);
+        return false;
+    }
+    return true;
+}
+
+void unmapFile(MappedFile& file)
+{
+    if (file.data) UnmapViewOfFile(file.data);
+    if (file.mapping) CloseHandle((HANDLE)file.mapping);
+    if (file.handle) CloseHandle((HANDLE)file.handle);
+    file = MappedFile();
+}
+
+#else
+
+bool mapFile(MappedFile& file, const char* filename, bool sequential)
+{
+    file = MappedFile();
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    file.size = (size_t)st.st_size;
+    if (file.size > 0) {
+        void* data = mmap(NULL, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            file = MappedFile();
+            return false;
+        }
+        if (sequential) madvise(data, file.size, MADV_SEQUENTIAL);
+        file.data = (const char*)data;
+    }
+    // the mapping stays valid after closing the descriptor
+    close(fd);
+    return true;
+}
+
+void unmapFile(MappedFile& file)
+{
+    if (file.data) munmap((void*)file.data, file.size);
+    file = MappedFile();
+}
+
+#endif
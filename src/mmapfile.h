@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+
+// Read-only memory mapping of a whole file, for inputs too big to read into a
+// buffer (traffic captures, large request bodies). Pages are loaded by the OS
+// as they are touched and can be dropped again under memory pressure.
+
+typedef struct MappedFile {
+    MappedFile() { data = NULL; size = 0; handle = NULL; mapping = NULL; }
+    const char* data;   // NULL for an empty or unmapped file
+    size_t size;
+    void* handle;       // platform file and mapping handles
+    void* mapping;
+} MappedFile;
+
+// sequential hints the OS to read ahead aggressively and drop pages behind us
+bool mapFile(MappedFile& file, const char* filename, bool sequential=false);
+
+void unmapFile(MappedFile& file);
@@ -0,0 +1,257 @@
+#include <stdio.h>
+#include <fcntl.h>
+#ifndef _WINDOWS
+#include <unistd.h>
+#endif
+#include "mockserver.h"
+#include "pghash.h"
+#include "imgui.h"
+
+
+// "http://host:port/path?q" -> "/path?q"
+static const char* urlTarget(const char* url)
+{
+    const char* p = strstr(url, "://");
+    p = p ? p + 3 : url;
+    const char* slash = strchr(p, '/');
+    return slash;
+}
+
+// Same query string as prepareRequest, so the key matches what was sent
+static void appendTarget(CURL* curl, pg::String& key, const History& hist)
+{
+    const char* target = urlTarget(hist.url.buf());
+    key.append(target ? target : "/");
+    bool has_body = hist.req_type == POST || hist.req_type == PATCH || hist.req_type == PUT;
+    int num_query = 0;
+    for (int i=0; i<hist.args.size(); i++) {
+        if (has_body && hist.args[i].arg_type == 1) continue;
+        key.append(num_query == 0 ? "?" : "&");
+        char* name = curl_easy_escape(curl, hist.args[i].name.buf(), hist.args[i].name.length());
+        char* value = curl_easy_escape(curl, hist.args[i].value.buf(), hist.args[i].value.length());
+        if (name) key.append(name);
+        key.append("=");
+        if (value) key.append(value);
+        curl_free(name);
+        curl_free(value);
+        num_query++;
+    }
+}
+
+static int pathLength(const char* key, int key_len)
+{
+    const char* query = (const char*)memchr(key, '?', (size_t)key_len);
+    return query ? (int)(query - key) : key_len;
+}
+
+static const char* guessContentType(const char* data, int len)
+{
+    while (len > 0 && (*data == ' ' || *data == '\n' || *data == '\r' || *data == '\t')) data++, len--;
+    return len > 0 && (*data == '{' || *data == '[') ? "application/json" : "text/plain";
+}
+
+// Index in table of the entry matching the key, -1 if none
+static int findEntry(const MockServer& mock, const int* table, uint64_t hash, bool by_path,
+                     const char* key, int key_len)
+{
+    uint32_t slot = (uint32_t)hash & mock.table_mask;
+    while (table[slot] != 0) {
+        const MockEntry& e = mock.entries[table[slot] - 1];
+        int len = by_path ? e.path_len : e.key_len;
+        if ((by_path ? e.path_hash : e.key_hash) == hash && len == key_len &&
+            memcmp(&mock.keys[e.key_offset], key, (size_t)key_len) == 0)
+            return table[slot] - 1;
+        slot = (slot + 1) & mock.table_mask;
+    }
+    return -1;
+}
+
+static void insertEntry(MockServer& mock, int* table, uint64_t hash, int index)
+{
+    uint32_t slot = (uint32_t)hash & mock.table_mask;
+    while (table[slot] != 0) slot = (slot + 1) & mock.table_mask;
+    table[slot] = index + 1;
+}
+
+static void freeIndex(MockServer& mock)
+{
+    for (int i=0; i<mock.num_entries; i++) {
+        MockEntry& e = mock.entries[i];
+        if (e.data) e.body.unpin();
+#ifndef _WINDOWS
+        if (e.fd >= 0) close(e.fd);
+#endif
+    }
+    delete [] mock.entries;
+    delete [] mock.by_key;
+    delete [] mock.by_path;
+    mock.entries = NULL;
+    mock.by_key = mock.by_path = NULL;
+    mock.num_entries = 0;
+    mock.keys.clear();
+}
+
+static void buildIndex(MockServer& mock, const Collection& collection)
+{
+    freeIndex(mock);
+    uint32_t table_size = 16;
+    while (table_size < (uint32_t)collection.hist.size() * 2) table_size *= 2;
+    mock.table_mask = table_size - 1;
+    mock.entries = new MockEntry[collection.hist.size() > 0 ? collection.hist.size() : 1];
+    mock.by_key = new int[table_size];
+    mock.by_path = new int[table_size];
+    memset(mock.by_key, 0, table_size * sizeof(int));
+    memset(mock.by_path, 0, table_size * sizeof(int));
+
+    CURL* curl = curl_easy_init();
+    pg::String key;
+    // newest first, so the latest response of an endpoint is the one served
+    for (int i=collection.hist.size()-1; i>=0; i--) {
+        const History& hist = collection.hist[i];
+        if (hist.response_code == 0) continue;
+        key.set(RequestTypeToString(hist.req_type).buf_);
+        key.append(" ");
+        appendTarget(curl, key, hist);
+        int key_len = key.length();
+        uint64_t key_hash = pg::hash64(key.buf_, (size_t)key_len);
+        if (findEntry(mock, mock.by_key, key_hash, false, key.buf_, key_len) >= 0) continue;
+
+        int index = mock.num_entries++;
+        MockEntry& e = mock.entries[index];
+        e.key_hash = key_hash;
+        e.key_offset = mock.keys.size();
+        e.key_len = key_len;
+        e.path_len = pathLength(key.buf_, key_len);
+        e.path_hash = pg::hash64(key.buf_, (size_t)e.path_len);
+        e.status = hist.response_code;
+        e.body = hist.result;
+        e.data = NULL;
+        e.fd = -1;
+        mock.keys.resize(e.key_offset + key_len);
+        memcpy(&mock.keys[e.key_offset], key.buf_, (size_t)key_len);
+
+#ifndef _WINDOWS
+        if (!e.body.resident()) {
+            char path[64];
+            snprintf(path, sizeof(path), "%s/%016llx.body", BODY_COLD_DIR, (unsigned long long)e.body.hash());
+            e.fd = open(path, O_RDONLY | O_CLOEXEC);
+        }
+#endif
+        if (e.fd < 0) e.data = e.body.pin();
+        // sniff the type from the first bytes, reading them from disk if needed
+        char head[64];
+        int head_len = e.body.length() < (int)sizeof(head) ? e.body.length() : (int)sizeof(head);
+        if (e.data) {
+            memcpy(head, e.data, (size_t)head_len);
+        }
+#ifndef _WINDOWS
+        else {
+            ssize_t n = pread(e.fd, head, (size_t)head_len, 0);
+            head_len = n > 0 ? (int)n : 0;
+        }
+#endif
+        e.content_type = guessContentType(head, head_len);
+
+        insertEntry(mock, mock.by_key, key_hash, index);
+        if (findEntry(mock, mock.by_path, e.path_hash, true, key.buf_, e.path_len) < 0)
+            insertEntry(mock, mock.by_path, e.path_hash, index);
+    }
+    curl_easy_cleanup(curl);
+}
+
+static void mockHandler(const HttpRequest& req, HttpResponse& resp, void* user)
+{
+    MockServer& mock = *(MockServer*)user;
+
+    // "METHOD target" is contiguous in the request line
+    const char* key = req.method;
+    int key_len = (int)(req.target + req.target_len - req.method);
+    int index = findEntry(mock, mock.by_key, pg::hash64(key, (size_t)key_len), false, key, key_len);
+    if (index >= 0) {
+        mock.hits++;
+    } else {
+        int path_len = pathLength(key, key_len);
+        index = findEntry(mock, mock.by_path, pg::hash64(key, (size_t)path_len), true, key, path_len);
+        if (index >= 0) mock.path_hits++;
+    }
+    if (index < 0) {
+        mock.misses++;
+        pg::String& out = *resp.scratch;
+        out.set("{\"error\": \"No recorded response for ");
+        out.append(key, key_len);
+        out.append("\"}");
+        resp.status = 404;
+        resp.content_type = "application/json";
+        resp.body = out.buf_;
+        resp.body_len = (size_t)out.length();
+        return;
+    }
+
+    const MockEntry& e = mock.entries[index];
+    resp.status = e.status;
+    resp.content_type = e.content_type;
+    resp.body = e.data;
+    resp.body_len = (size_t)e.body.length();
+    resp.body_fd = e.fd;
+    resp.body_offset = 0;
+}
+
+bool startMockServer(MockServer& mock, const Collection& collection)
+{
+    stopMockServer(mock);
+    buildIndex(mock, collection);
+    mock.collection = collection.name;
+    mock.hits = 0;
+    mock.path_hits = 0;
+    mock.misses = 0;
+    mock.stats.requests = 0;
+    mock.stats.bytes_sent = 0;
+    mock.error.set("");
+    mock.server = httpServerStart("0.0.0.0", mock.port, mock.threads, mockHandler, &mock, &mock.stats, &mock.error);
+    if (mock.server == NULL) {
+        freeIndex(mock);
+        return false;
+    }
+    return true;
+}
+
+void stopMockServer(MockServer& mock)
+{
+    if (mock.server) httpServerStop(mock.server);
+    mock.server = NULL;
+    freeIndex(mock);
+}
+
+bool mockServerWindow(bool* open, MockServer& mock)
+{
+    bool start = false;
+    ImGui::Begin("Mock Server", open);
+    bool running = mock.server != NULL;
+
+    ImGui::PushItemWidth(ImGui::GetFontSize() * 8);
+    if (running) {
+        ImGui::Text("Serving \"%s\" on port %d (%d endpoints)", mock.collection.buf_, mock.port, mock.num_entries);
+    } else {
+        ImGui::InputInt("Port", &mock.port);
+        ImGui::InputInt("Threads", &mock.threads);
+        if (mock.port < 1) mock.port = 1;
+        if (mock.port > 65535) mock.port = 65535;
+        if (mock.threads < 1) mock.threads = 1;
+    }
+    ImGui::PopItemWidth();
+
+    if (running) {
+        if (ImGui::Button("Stop")) stopMockServer(mock);
+    } else if (ImGui::Button("Start serving current collection")) {
+        start = true;
+    }
+
+    ImGui::Text("Requests: %lld  Connections: %d  Sent: %.2f MB",
+                (long long)mock.stats.requests, (int)mock.stats.connections, mock.stats.bytes_sent / 1048576.0);
+    ImGui::Text("Hits: %lld  Path only: %lld  Misses: %lld",
+                (long long)mock.hits, (long long)mock.path_hits, (long long)mock.misses);
+    if (!running && mock.error.buf_[0] != '\0')
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", mock.error.buf_);
+    ImGui::End();
+    return start;
+}
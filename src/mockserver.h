@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include "requests.h"
+#include "httpserver.h"
+
+// Serves a collection's recorded responses over HTTP. Every History with a
+// response becomes an entry keyed by "METHOD /path?query" (the query built the
+// same way prepareRequest builds it), the most recent entry winning. Requests
+// are looked up in an open addressing table by hash, falling back to the path
+// alone when the query differs, and answered with the stored body and code.
+//
+// The index is built once on start and only read by the server threads. Bodies
+// are pinned and sent straight from the body store; bodies in the cold store
+// are sent from their file with sendfile, without being loaded.
+
+typedef struct MockEntry {
+    uint64_t key_hash;
+    uint64_t path_hash;
+    int key_offset;         // into MockServer::keys, "METHOD target"
+    int key_len;
+    int path_len;           // "METHOD path", prefix of the key
+    int status;
+    const char* content_type;
+    pg::Body body;
+    const char* data;       // pinned body data, NULL when sent from fd
+    int fd;
+} MockEntry;
+
+typedef struct MockServer {
+    MockServer() {
+        port = 8089; threads = 2; server = NULL; entries = NULL; num_entries = 0;
+        by_key = NULL; by_path = NULL; table_mask = 0; hits = 0; path_hits = 0; misses = 0;
+    }
+
+    int port;
+    int threads;
+    HttpServer* server;
+    HttpServerStats stats;
+    pg::String error;
+    pg::String collection;  // name of the collection being served
+
+    MockEntry* entries;
+    int num_entries;
+    pg::Vector<char> keys;
+    int* by_key;            // entry index + 1, 0 for an empty slot
+    int* by_path;
+    uint32_t table_mask;
+
+    std::atomic<int64_t> hits;
+    std::atomic<int64_t> path_hits;     // answered by the path fallback
+    std::atomic<int64_t> misses;
+} MockServer;
+
+// Builds the index from the collection and starts listening, false on error
+bool startMockServer(MockServer& mock, const Collection& collection);
+
+void stopMockServer(MockServer& mock);
+
+// Draws the mock server window, returns true when the user asked to start
+bool mockServerWindow(bool* open, MockServer& mock);
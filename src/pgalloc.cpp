@@ -0,0 +1,63 @@
+#include <new>
+#include "pgalloc.h"
+
+namespace pg {
+
+thread_local AllocCounters alloc_counters = { 0, 0 };
+
+void* imguiAlloc(size_t size, void*)
+{
+    return countedMalloc(size);
+}
+
+void imguiFree(void* ptr, void*)
+{
+    free(ptr);
+}
+
+}
+
+// Replacing the global operators counts every new/new[] of the program
+void* operator new(size_t size)
+{
+    void* ptr = pg::countedMalloc(size ? size : 1);
+    if (ptr == NULL) throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new[](size_t size)
+{
+    void* ptr = pg::countedMalloc(size ? size : 1);
+    if (ptr == NULL) throw std::bad_alloc();
+    return ptr;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+    return pg::countedMalloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+    return pg::countedMalloc(size ? size : 1);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+
+// Heap allocation counters, per thread. Everything allocated through operator
+// new (pg::Vector, rapidjson documents, std containers), pg::String and ImGui
+// goes through here, so the frame profiler can show what a frame allocates.
+// Counting is a thread local increment, cheap enough to stay on in release.
+
+namespace pg {
+
+typedef struct AllocCounters {
+    int64_t count;
+    int64_t bytes;
+} AllocCounters;
+
+extern thread_local AllocCounters alloc_counters;
+
+inline void* countedMalloc(size_t size)
+{
+    alloc_counters.count++;
+    alloc_counters.bytes += (int64_t)size;
+    return ::malloc(size);
+}
+
+inline void* countedRealloc(void* ptr, size_t size)
+{
+    alloc_counters.count++;
+    alloc_counters.bytes += (int64_t)size;
+    return ::realloc(ptr, size);
+}
+
+// For ImGui::SetAllocatorFunctions
+void* imguiAlloc(size_t size, void* user_data);
+void imguiFree(void* ptr, void* user_data);
+
+}
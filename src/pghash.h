@@ -0,0 +1,89 @@
+// 64-bit non-cryptographic hash, following the public XXH64 algorithm from
+// Yann Collet's xxHash (https://github.com/Cyan4973/xxHash). Used to key
+// content-addressed data (bodies, cache entries), so it must be fast on big
+// inputs and stable across runs: the values end up in collections.json.
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+
+namespace pg {
+
+static const uint64_t HASH_PRIME1 = 11400714785074694791ULL;
+static const uint64_t HASH_PRIME2 = 14029467366897019727ULL;
+static const uint64_t HASH_PRIME3 =  1609587929392839161ULL;
+static const uint64_t HASH_PRIME4 =  9650029242287828579ULL;
+static const uint64_t HASH_PRIME5 =  2870177450012600261ULL;
+
+inline uint64_t _hashRotl(uint64_t x, int r)   { return (x << r) | (x >> (64 - r)); }
+inline uint64_t _hashRead64(const uint8_t* p)  { uint64_t v; memcpy(&v, p, sizeof(v)); return v; }
+inline uint32_t _hashRead32(const uint8_t* p)  { uint32_t v; memcpy(&v, p, sizeof(v)); return v; }
+
+inline uint64_t _hashRound(uint64_t acc, uint64_t input)
+{
+    acc += input * HASH_PRIME2;
+    acc = _hashRotl(acc, 31);
+    return acc * HASH_PRIME1;
+}
+
+inline uint64_t _hashMerge(uint64_t acc, uint64_t val)
+{
+    acc ^= _hashRound(0, val);
+    return acc * HASH_PRIME1 + HASH_PRIME4;
+}
+
+inline uint64_t hash64(const void* data, size_t len, uint64_t seed=0)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    const uint8_t* end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        const uint8_t* limit = end - 32;
+        uint64_t v1 = seed + HASH_PRIME1 + HASH_PRIME2;
+        uint64_t v2 = seed + HASH_PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - HASH_PRIME1;
+        do {
+            v1 = _hashRound(v1, _hashRead64(p));      p += 8;
+            v2 = _hashRound(v2, _hashRead64(p));      p += 8;
+            v3 = _hashRound(v3, _hashRead64(p));      p += 8;
+            v4 = _hashRound(v4, _hashRead64(p));      p += 8;
+        } while (p <= limit);
+        h = _hashRotl(v1, 1) + _hashRotl(v2, 7) + _hashRotl(v3, 12) + _hashRotl(v4, 18);
+        h = _hashMerge(h, v1);
+        h = _hashMerge(h, v2);
+        h = _hashMerge(h, v3);
+        h = _hashMerge(h, v4);
+    } else {
+        h = seed + HASH_PRIME5;
+    }
+    h += (uint64_t)len;
+
+    while (p + 8 <= end) {
+        h ^= _hashRound(0, _hashRead64(p));
+        h = _hashRotl(h, 27) * HASH_PRIME1 + HASH_PRIME4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)_hashRead32(p) * HASH_PRIME1;
+        h = _hashRotl(h, 23) * HASH_PRIME2 + HASH_PRIME3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p) * HASH_PRIME5;
+        h = _hashRotl(h, 11) * HASH_PRIME1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= HASH_PRIME2;
+    h ^= h >> 29;
+    h *= HASH_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+}
@@ -3,6 +3,7 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include "pgalloc.h"
 
 
 #define DEFAULT_STRING_SIZE 4098
@@ -14,13 +15,13 @@ public:
     inline String() 
     { 
         capacity_ = DEFAULT_STRING_SIZE; 
-        buf_ = (char*)malloc((size_t)DEFAULT_STRING_SIZE * sizeof(char));
+        buf_ = (char*)countedMalloc((size_t)DEFAULT_STRING_SIZE * sizeof(char));
         buf_[0] = '\0';
     }
     inline String(int capacity) 
     { 
         capacity_ = capacity; 
-        buf_ = (char*)malloc((size_t)capacity_ * sizeof(char));
+        buf_ = (char*)countedMalloc((size_t)capacity_ * sizeof(char));
         buf_[0] = '\0';
     }
 
@@ -29,7 +30,7 @@ public:
         int cap = DEFAULT_STRING_SIZE;
         if (size > cap) cap = size;
         capacity_ = cap;
-        buf_ = (char*)malloc((size_t)capacity_ * sizeof(char));
+        buf_ = (char*)countedMalloc((size_t)capacity_ * sizeof(char));
         memcpy(buf_, str, (size_t)size * sizeof(char)); 
     }
 
@@ -37,7 +38,7 @@ public:
         int cap = DEFAULT_STRING_SIZE;
         if (size + 1 > cap) cap = size + 1;
         capacity_ = cap;
-        buf_ = (char*)malloc((size_t)capacity_ * sizeof(char));
+        buf_ = (char*)countedMalloc((size_t)capacity_ * sizeof(char));
         memcpy(buf_, str, (size_t)size * sizeof(char)); 
         buf_[size] = '\0';
     }
@@ -46,7 +47,7 @@ public:
     inline String(const String& src) 
     { 
         capacity_ = DEFAULT_STRING_SIZE; 
-        buf_ = (char*)malloc((size_t)capacity_ * sizeof(char));
+        buf_ = (char*)countedMalloc((size_t)capacity_ * sizeof(char));
         operator=(src);
     }
 
@@ -56,7 +57,7 @@ public:
         if (size >= capacity_) {
             capacity_ = src.capacity_;
             if (buf_) free(buf_);
-            buf_ = (char*)malloc((size_t)capacity_ * sizeof(char));
+            buf_ = (char*)countedMalloc((size_t)capacity_ * sizeof(char));
         }
         memcpy(buf_, src.buf_, (size_t)size * sizeof(char));
         return *this;
@@ -71,13 +72,15 @@ public:
         memcpy(buf_, str, (size_t)size * sizeof(char));
     }
 
+    // size is the number of chars to copy from str, the result is always terminated
     inline void append(const char* str, int size=-1)
     {
-        if (size<0) size = strlen(str)+1;
+        if (size<0) size = strlen(str);
         int curr_len = strlen(buf_);
 
-        if (curr_len + size > capacity_) realloc(curr_len+size+1);
+        if (curr_len + size + 1 > capacity_) realloc(curr_len+size+1);
         memcpy(buf_+curr_len, str, size);
+        buf_[curr_len+size] = '\0';
     }
 
     inline void append(String str)
@@ -85,11 +88,12 @@ public:
         append(str.buf_);
     }
 
+    // keeps the current content (truncated if it does not fit anymore)
     inline void realloc(int size)
     {
-        if (buf_) free(buf_);
         capacity_ = size;
-        buf_ = (char*)malloc((size_t)capacity_ * sizeof(char));
+        buf_ = (char*)countedRealloc(buf_, (size_t)capacity_ * sizeof(char));
+        buf_[capacity_-1] = '\0';
     }
 
     inline char* end()
@@ -27,7 +27,8 @@ public:
     inline Vector()           { Size = Capacity = 0; Data = NULL; }
     inline ~Vector()          { if (Data) delete [] Data; }
     inline Vector(const Vector<T>& src)                     { Size = Capacity = 0; Data = NULL; operator=(src); }
-    inline Vector& operator=(const Vector<T>& src)          { clear(); resize(src.Size); for (int i=0; i<src.Size; i++) Data[i] = src.Data[i]; return *this; }
+    // Reuses the storage when it is big enough: element assignment (pg::String) then reuses theirs too
+    inline Vector& operator=(const Vector<T>& src)          { if (&src == this) return *this; if (src.Size > Capacity) clear(); const int old_size = Size; resize(src.Size); for (int i=0; i<src.Size; i++) Data[i] = src.Data[i]; for (int i=src.Size; i<old_size; i++) Data[i] = value_type(); return *this; }
 
     inline bool                 empty() const                   { return Size == 0; }
     inline int                  size() const                    { return Size; }
@@ -36,6 +37,7 @@ public:
     inline const value_type&    operator[](int i) const         { assert(i < Size); return Data[i]; }
 
     inline void                 clear()                         { if (Data) { Size = Capacity = 0; delete [] Data; Data = NULL; } }
+    inline void                 swap(Vector<T>& rhs)            { int rhs_size = rhs.Size; rhs.Size = Size; Size = rhs_size; int rhs_cap = rhs.Capacity; rhs.Capacity = Capacity; Capacity = rhs_cap; value_type* rhs_data = rhs.Data; rhs.Data = Data; Data = rhs_data; }
     inline iterator             begin()                         { return Data; }
     inline const_iterator       begin() const                   { return Data; }
     inline iterator             end()                           { return Data + Size; }
@@ -66,8 +68,10 @@ public:
     // NB: It is forbidden to call push_back/push_front/insert with a reference pointing inside the Vector data itself! e.g. v.push_back(v[10]) is forbidden.
     inline void         push_back(const value_type& v)                  { if (Size == Capacity) reserve(_grow_capacity(Size + 1)); Data[Size] = v; Size++;}
     inline void         pop_back()                                      { assert(Size > 0); Size--; }
-    inline iterator     erase(const_iterator it)                        { assert(it >= Data && it < Data+Size); const ptrdiff_t off = it - Data; memmove(Data + off, Data + off + 1, ((size_t)Size - (size_t)off - 1) * sizeof(value_type)); Size--; return Data + off; }
-    inline iterator     erase(const_iterator it, const_iterator it_last){ assert(it >= Data && it < Data+Size && it_last > it && it_last <= Data+Size); const ptrdiff_t count = it_last - it; const ptrdiff_t off = it - Data; memmove(Data + off, Data + off + count, ((size_t)Size - (size_t)off - count) * sizeof(value_type)); Size -= (int)count; return Data + off; }
+    // Elements are shifted by assignment (not memmove) and the vacated slots reset, so types
+    // owning memory or refcounts (pg::String, pg::Body) release what was erased right away.
+    inline iterator     erase(const_iterator it)                        { assert(it >= Data && it < Data+Size); return erase(it, it+1); }
+    inline iterator     erase(const_iterator it, const_iterator it_last){ assert(it >= Data && it < Data+Size && it_last > it && it_last <= Data+Size); const int count = (int)(it_last - it); const int off = (int)(it - Data); for (int i=off; i+count<Size; i++) Data[i] = Data[i+count]; for (int i=Size-count; i<Size; i++) Data[i] = value_type(); Size -= count; return Data + off; }
     inline bool         contains(const value_type& v) const             { const T* data = Data;  const T* data_end = Data + Size; while (data < data_end) if (*data++ == v) return true; return false; }
 };
 
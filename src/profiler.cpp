@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include <atomic>
+#include <chrono>
+#include "profiler.h"
+#include "pgalloc.h"
+#include "rapidjson/writer.h"
+#include "rapidjson/filewritestream.h"
+#include "imgui.h"
+
+#define TRACE_MAX_THREADS 64
+
+typedef struct TraceEvent {
+    const char* name;
+    int64_t ts_us;
+    int64_t dur_us;
+    int tid;
+    int status;
+    int async_id;               // transfers overlap on one thread, they get async events
+    std::atomic<bool> ready;    // fully written, safe to export
+} TraceEvent;
+
+static const std::chrono::steady_clock::time_point clock_origin = std::chrono::steady_clock::now();
+
+// Frame history, UI thread only
+static float phase_ms[PHASE_COUNT][PROFILE_FRAMES];    // -1 when the phase did not run
+static float frame_ms[PROFILE_FRAMES];
+static int frame_index = 0;
+static int64_t frame_start_us = 0;
+static int64_t phase_start_us[PHASE_COUNT];
+static int64_t phase_total_us[PHASE_COUNT];
+static bool phase_ran[PHASE_COUNT];
+static float frame_allocs[PROFILE_FRAMES];              // UI thread heap allocations
+static int64_t frame_alloc_bytes[PROFILE_FRAMES];
+static pg::AllocCounters frame_start_allocs;
+
+static TraceEvent* events = NULL;
+static std::atomic<int> num_events(0);
+static std::atomic<bool> recording(false);
+static std::atomic<int> next_tid(1);
+static std::atomic<int> next_async_id(1);
+static const char* thread_names[TRACE_MAX_THREADS];
+static thread_local int thread_id = 0;
+
+
+const char* ProfilePhaseToString(int phase)
+{
+    switch (phase) {
+        case PHASE_POLL:        return "poll events";
+        case PHASE_SIDEBAR:     return "sidebar";
+        case PHASE_SEARCH:      return "history search";
+        case PHASE_JSON_CHECK:  return "JSON validation";
+        case PHASE_RESULT:      return "result";
+        case PHASE_RENDER:      return "render";
+        case PHASE_SWAP:        return "swap";
+        case PHASE_SAVE:        return "save collection";
+    }
+    return "<NONE>";
+}
+
+int64_t profileNowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - clock_origin).count();
+}
+
+static int threadId()
+{
+    if (thread_id == 0) thread_id = next_tid++;
+    return thread_id;
+}
+
+bool traceRecording()
+{
+    return recording;
+}
+
+void traceSetThreadName(const char* name)
+{
+    int tid = threadId();
+    if (tid < TRACE_MAX_THREADS) thread_names[tid] = name;
+}
+
+static void addEvent(const char* name, int64_t start_us, int64_t end_us, int status, int async_id)
+{
+    int i = num_events++;
+    if (i >= TRACE_MAX_EVENTS) {
+        recording = false;      // buffer full, keep what was recorded
+        return;
+    }
+    TraceEvent& e = events[i];
+    e.name = name;
+    e.ts_us = start_us;
+    e.dur_us = end_us - start_us;
+    e.tid = threadId();
+    e.status = status;
+    e.async_id = async_id;
+    e.ready = true;
+}
+
+void traceSpan(const char* name, int64_t start_us, int64_t end_us, int status)
+{
+    if (recording) addEvent(name, start_us, end_us, status, 0);
+}
+
+void traceTransfer(CURL* curl, const char* name, CURLcode result)
+{
+    if (!recording) return;
+    int64_t end = profileNowUs();
+    curl_off_t dns = 0, connect = 0, tls = 0, first_byte = 0, total = 0;
+    long code = 0;
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &tls);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &first_byte);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+
+    // curl times are offsets from the start of the transfer
+    int64_t start = end - (int64_t)total;
+    int id = next_async_id++;
+    addEvent(name, start, end, result == CURLE_OK ? (int)code : -(int)result, id);
+    if (dns > 0) addEvent("dns", start, start + dns, -1, id);
+    if (connect > dns) addEvent("connect", start + dns, start + connect, -1, id);
+    if (tls > connect) addEvent("tls", start + connect, start + tls, -1, id);
+    int64_t sent = tls > connect ? tls : connect;
+    if (first_byte > sent) addEvent("wait", start + sent, start + first_byte, -1, id);
+    if (total > first_byte && first_byte > 0) addEvent("download", start + first_byte, start + total, -1, id);
+}
+
+void traceStart()
+{
+    if (events == NULL) events = new TraceEvent[TRACE_MAX_EVENTS];
+    recording = false;
+    int n = num_events < TRACE_MAX_EVENTS ? (int)num_events : TRACE_MAX_EVENTS;
+    for (int i=0; i<n; i++) events[i].ready = false;
+    num_events = 0;
+    recording = true;
+}
+
+void traceStop()
+{
+    recording = false;
+}
+
+bool traceExport(const char* filename, pg::String* error)
+{
+    FILE* fp = fopen(filename, "wb");
+    if (fp == NULL) {
+        if (error) {
+            error->set("Could not write ");
+            error->append(filename);
+        }
+        return false;
+    }
+    char buffer[65536];
+    rapidjson::FileWriteStream stream(fp, buffer, sizeof(buffer));
+    rapidjson::Writer<rapidjson::FileWriteStream> writer(stream);
+    writer.StartObject();
+    writer.Key("displayTimeUnit");
+    writer.String("ms");
+    writer.Key("traceEvents");
+    writer.StartArray();
+
+    int num_threads = next_tid < TRACE_MAX_THREADS ? (int)next_tid : TRACE_MAX_THREADS;
+    for (int tid=1; tid<num_threads; tid++) {
+        char name[32];
+        if (thread_names[tid] == NULL) snprintf(name, sizeof(name), "thread %d", tid);
+        writer.StartObject();
+        writer.Key("name"); writer.String("thread_name");
+        writer.Key("ph"); writer.String("M");
+        writer.Key("pid"); writer.Int(1);
+        writer.Key("tid"); writer.Int(tid);
+        writer.Key("args");
+        writer.StartObject();
+        writer.Key("name"); writer.String(thread_names[tid] ? thread_names[tid] : name);
+        writer.EndObject();
+        writer.EndObject();
+    }
+
+    int n = num_events < TRACE_MAX_EVENTS ? (int)num_events : TRACE_MAX_EVENTS;
+    for (int i=0; events && i<n; i++) {
+        const TraceEvent& e = events[i];
+        if (!e.ready) continue;
+        // a complete event, or a begin/end pair of nestable async events
+        for (int part = 0; part < (e.async_id ? 2 : 1); part++) {
+            writer.StartObject();
+            writer.Key("name"); writer.String(e.name);
+            writer.Key("ph"); writer.String(e.async_id == 0 ? "X" : part == 0 ? "b" : "e");
+            writer.Key("ts"); writer.Int64(part == 0 ? e.ts_us : e.ts_us + e.dur_us);
+            if (e.async_id == 0) {
+                writer.Key("dur"); writer.Int64(e.dur_us);
+            } else {
+                writer.Key("cat"); writer.String("http");
+                writer.Key("id"); writer.Int(e.async_id);
+            }
+            writer.Key("pid"); writer.Int(1);
+            writer.Key("tid"); writer.Int(e.tid);
+            if (e.status != -1 && part == 0) {
+                writer.Key("args");
+                writer.StartObject();
+                writer.Key(e.status >= 0 ? "status" : "curl_error");
+                writer.Int(e.status >= 0 ? e.status : -e.status);
+                writer.EndObject();
+            }
+            writer.EndObject();
+        }
+    }
+    writer.EndArray();
+    writer.EndObject();
+    stream.Flush();
+    bool ok = ferror(fp) == 0;
+    fclose(fp);
+    if (!ok && error) error->set("Write error while exporting the trace");
+    return ok;
+}
+
+
+void profileFrameBegin()
+{
+    static bool first_frame = true;
+    if (first_frame) {
+        for (int i=0; i<PHASE_COUNT; i++)
+            for (int j=0; j<PROFILE_FRAMES; j++) phase_ms[i][j] = -1.0f;
+        for (int j=0; j<PROFILE_FRAMES; j++) frame_ms[j] = -1.0f;
+        first_frame = false;
+    }
+    frame_start_us = profileNowUs();
+    frame_start_allocs = pg::alloc_counters;
+    for (int i=0; i<PHASE_COUNT; i++) {
+        phase_total_us[i] = 0;
+        phase_ran[i] = false;
+    }
+}
+
+void profileFrameEnd()
+{
+    int64_t now = profileNowUs();
+    traceSpan("frame", frame_start_us, now);
+    frame_ms[frame_index] = (float)(now - frame_start_us) / 1000.0f;
+    frame_allocs[frame_index] = (float)(pg::alloc_counters.count - frame_start_allocs.count);
+    frame_alloc_bytes[frame_index] = pg::alloc_counters.bytes - frame_start_allocs.bytes;
+    for (int i=0; i<PHASE_COUNT; i++)
+        phase_ms[i][frame_index] = phase_ran[i] ? (float)phase_total_us[i] / 1000.0f : -1.0f;
+    frame_index = (frame_index + 1) % PROFILE_FRAMES;
+}
+
+void profileBegin(int phase)
+{
+    phase_start_us[phase] = profileNowUs();
+}
+
+void profileEnd(int phase)
+{
+    int64_t now = profileNowUs();
+    phase_total_us[phase] += now - phase_start_us[phase];
+    phase_ran[phase] = true;
+    traceSpan(ProfilePhaseToString(phase), phase_start_us[phase], now);
+}
+
+
+static int compareFloat(const void* a, const void* b)
+{
+    float x = *(const float*)a, y = *(const float*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Sorted values of the frames where the phase ran, returns how many
+static int sortedSamples(const float* samples, float* sorted)
+{
+    int n = 0;
+    for (int i=0; i<PROFILE_FRAMES; i++)
+        if (samples[i] >= 0.0f) sorted[n++] = samples[i];
+    qsort(sorted, (size_t)n, sizeof(float), compareFloat);
+    return n;
+}
+
+static float percentile(const float* sorted, int n, float p)
+{
+    return n ? sorted[(int)(p * (float)(n - 1) + 0.5f)] : 0.0f;
+}
+
+void profilerWindow(bool* open)
+{
+    static int graph_phase = -1;    // -1 graphs the whole frame
+    static char trace_path[512] = "postgirl_trace.json";
+    static pg::String trace_message;
+
+    ImGui::Begin("Frame Profiler", open);
+    float sorted[PROFILE_FRAMES];
+    int n = sortedSamples(frame_ms, sorted);
+    const float* graph = frame_ms;
+    float graph_values[PROFILE_FRAMES];
+    if (graph_phase >= 0) {
+        for (int i=0; i<PROFILE_FRAMES; i++)
+            graph_values[i] = phase_ms[graph_phase][i] > 0.0f ? phase_ms[graph_phase][i] : 0.0f;
+        graph = graph_values;
+    }
+    char overlay[96];
+    snprintf(overlay, sizeof(overlay), "%s: p50 %.2f ms, max %.2f ms",
+             graph_phase >= 0 ? ProfilePhaseToString(graph_phase) : "frame (without sleep)",
+             percentile(sorted, n, 0.5f), n ? sorted[n-1] : 0.0f);
+    ImGui::PlotLines("##graph", graph, PROFILE_FRAMES, frame_index, overlay, 0.0f, FLT_MAX, ImVec2(-1.0f, 80.0f));
+
+    int last = (frame_index + PROFILE_FRAMES - 1) % PROFILE_FRAMES;
+    if (ImGui::BeginTable("##phases", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Phase (ms)");
+        ImGui::TableSetupColumn("Last");
+        ImGui::TableSetupColumn("p50");
+        ImGui::TableSetupColumn("p95");
+        ImGui::TableSetupColumn("p99");
+        ImGui::TableSetupColumn("Max");
+        ImGui::TableHeadersRow();
+        for (int phase=-1; phase<PHASE_COUNT; phase++) {
+            const float* samples = phase < 0 ? frame_ms : phase_ms[phase];
+            n = sortedSamples(samples, sorted);
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::PushID(phase);
+            if (ImGui::Selectable(phase < 0 ? "frame" : ProfilePhaseToString(phase), graph_phase == phase))
+                graph_phase = phase;
+            ImGui::PopID();
+            ImGui::TableNextColumn();
+            if (samples[last] >= 0.0f) ImGui::Text("%.2f", samples[last]);
+            ImGui::TableNextColumn(); ImGui::Text("%.2f", percentile(sorted, n, 0.5f));
+            ImGui::TableNextColumn(); ImGui::Text("%.2f", percentile(sorted, n, 0.95f));
+            ImGui::TableNextColumn(); ImGui::Text("%.2f", percentile(sorted, n, 0.99f));
+            ImGui::TableNextColumn(); ImGui::Text("%.2f", n ? sorted[n-1] : 0.0f);
+        }
+        ImGui::EndTable();
+    }
+
+    // The steady state frame should not allocate at all, see main.cpp
+    int allocating_frames = 0;
+    float max_allocs = 0.0f;
+    for (int i=0; i<PROFILE_FRAMES; i++) {
+        if (frame_allocs[i] > 0.0f) allocating_frames++;
+        if (frame_allocs[i] > max_allocs) max_allocs = frame_allocs[i];
+    }
+    ImGui::Separator();
+    ImGui::Text("Heap allocations on the UI thread: %d (%.1f KB) last frame, max %d, %d of %d frames allocated",
+                (int)frame_allocs[last], frame_alloc_bytes[last] / 1024.0, (int)max_allocs, allocating_frames, PROFILE_FRAMES);
+    ImGui::PlotHistogram("##allocs", frame_allocs, PROFILE_FRAMES, frame_index, "allocations per frame", 0.0f, FLT_MAX, ImVec2(-1.0f, 40.0f));
+
+    ImGui::Separator();
+    int recorded = num_events < TRACE_MAX_EVENTS ? (int)num_events : TRACE_MAX_EVENTS;
+    if (recording) {
+        if (ImGui::Button("Stop recording")) traceStop();
+    } else if (ImGui::Button("Record trace")) {
+        traceStart();
+        trace_message.set("");
+    }
+    ImGui::SameLine();
+    ImGui::Text("%d events%s", recorded, recorded >= TRACE_MAX_EVENTS ? " (buffer full)" : "");
+    ImGui::InputText("##trace_path", trace_path, sizeof(trace_path));
+    ImGui::SameLine();
+    if (ImGui::Button("Export trace")) {
+        traceStop();
+        if (traceExport(trace_path, &trace_message)) {
+            trace_message.set("Saved, open it in chrome://tracing or ui.perfetto.dev");
+        }
+    }
+    if (trace_message.buf_[0] != '\0') ImGui::TextWrapped("%s", trace_message.buf_);
+    ImGui::End();
+}
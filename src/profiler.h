@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+#include <curl/curl.h>
+#include "pgstring.h"
+
+// Frame profiler for the UI loop. PROFILE_SCOPE(phase) times a main loop phase
+// (nested phases are inclusive), the last PROFILE_FRAMES frames are kept per
+// phase for the overlay graphs and percentiles.
+//
+// While recording, phases and the spans traced from worker threads
+// (TRACE_SCOPE, traceTransfer) are also appended to a fixed size event buffer,
+// exported in the Chrome trace_event format (chrome://tracing, Perfetto).
+// Event names must be string literals, they are stored as pointers.
+
+#define PROFILE_FRAMES 240
+#define TRACE_MAX_EVENTS (1 << 18)
+
+typedef enum ProfilePhase {
+    PHASE_POLL = 0,         // glfwPollEvents and collection loading
+    PHASE_SIDEBAR,          // history list
+    PHASE_SEARCH,           // history search, inside the sidebar
+    PHASE_JSON_CHECK,       // input JSON validation
+    PHASE_RESULT,           // result box
+    PHASE_RENDER,           // ImGui::Render and draw calls
+    PHASE_SWAP,             // glfwSwapBuffers
+    PHASE_SAVE,             // saving after a request finished
+    PHASE_COUNT
+} ProfilePhase;
+
+const char* ProfilePhaseToString(int phase);
+
+int64_t profileNowUs();
+
+void profileFrameBegin();
+void profileFrameEnd();
+
+// UI thread only
+void profileBegin(int phase);
+void profileEnd(int phase);
+
+typedef struct ProfileScope {
+    ProfileScope(int phase) : phase_(phase) { profileBegin(phase); }
+    ~ProfileScope()                         { profileEnd(phase_); }
+    int phase_;
+} ProfileScope;
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(phase) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(phase)
+
+// Any thread. Cheap no-ops unless a trace is being recorded.
+bool traceRecording();
+void traceSetThreadName(const char* name);
+void traceSpan(const char* name, int64_t start_us, int64_t end_us, int status=-1);
+
+// Adds the finished transfer with its DNS, connect, TLS, wait and download parts
+void traceTransfer(CURL* curl, const char* name, CURLcode result);
+
+typedef struct TraceScope {
+    TraceScope(const char* name) : name_(name) { start_ = traceRecording() ? profileNowUs() : -1; }
+    ~TraceScope() { if (start_ >= 0) traceSpan(name_, start_, profileNowUs()); }
+    const char* name_;
+    int64_t start_;
+} TraceScope;
+
+#define TRACE_SCOPE(name) TraceScope PROFILE_CONCAT(trace_scope_, __LINE__)(name)
+
+void traceStart();
+void traceStop();
+bool traceExport(const char* filename, pg::String* error);
+
+// Frame time graph, per phase percentiles and trace recording controls
+void profilerWindow(bool* open);
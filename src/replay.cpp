@@ -0,0 +1,488 @@
+#include <stdio.h>
+#include <sys/time.h>
+#include "replay.h"
+#include "mmapfile.h"
+#include "profiler.h"
+#include "rapidjson/reader.h"
+#include "rapidjson/memorystream.h"
+#include "imgui.h"
+
+#ifdef _WINDOWS
+#define strcasecmp _stricmp
+#endif
+
+#define REPLAY_MAX_DEPTH 32
+#define REPLAY_MAX_KEY 64
+
+
+static int64_t nowUs()
+{
+    struct timeval timecheck;
+    gettimeofday(&timecheck, NULL);
+    return (int64_t)timecheck.tv_sec * 1000000 + (int64_t)timecheck.tv_usec;
+}
+
+static void assign(pg::String& dst, const char* str, int len)
+{
+    if (len + 1 > dst.capacity_) dst.realloc(len + 1);
+    memcpy(dst.buf_, str, (size_t)len);
+    dst.buf_[len] = '\0';
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date
+static int64_t daysFromCivil(int y, int m, int d)
+{
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int yoe = (int)(y - era * 400);
+    int doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// 2023-11-14T22:13:20.123Z or with a +hh:mm offset, returns false if it does not parse
+static bool parseIsoTime(const char* str, int64_t& time_us)
+{
+    int y, mo, d, h, mi, s;
+    int used = 0;
+    if (sscanf(str, "%4d-%2d-%2dT%2d:%2d:%2d%n", &y, &mo, &d, &h, &mi, &s, &used) != 6)
+        return false;
+    const char* p = str + used;
+    int64_t frac_us = 0;
+    if (*p == '.') {
+        int64_t scale = 100000;
+        for (p++; *p >= '0' && *p <= '9'; p++) {
+            frac_us += (*p - '0') * scale;
+            scale /= 10;
+        }
+    }
+    int64_t offset_s = 0;
+    if (*p == '+' || *p == '-') {
+        int oh = 0, om = 0;
+        sscanf(p + 1, "%2d:%2d", &oh, &om);
+        offset_s = (oh * 3600 + om * 60) * (*p == '+' ? 1 : -1);
+    }
+    int64_t secs = daysFromCivil(y, mo, d) * 86400 + h * 3600 + mi * 60 + s - offset_s;
+    time_us = secs * 1000000 + frac_us;
+    return true;
+}
+
+
+typedef struct ReplayRecord {
+    char method[16];
+    pg::String url;
+    pg::Vector<Argument> headers;   // resized to 0 between records, the strings are reused
+    int num_headers;
+    pg::String body;
+    int body_len;
+    int64_t time_us;
+    bool has_time;
+} ReplayRecord;
+
+static void clearRecord(ReplayRecord& rec)
+{
+    rec.method[0] = '\0';
+    rec.url.buf_[0] = '\0';
+    rec.num_headers = 0;
+    rec.body_len = 0;
+    rec.has_time = false;
+}
+
+// Picks request fields out of the token stream. Tracks the key of every open
+// object so a value is identified by its path inside the record, with HAR's
+// "request." prefix dropped: "method", "headers[].name", "postData.text"...
+struct CaptureHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, CaptureHandler> {
+    char keys[REPLAY_MAX_DEPTH][REPLAY_MAX_KEY];
+    bool is_array[REPLAY_MAX_DEPTH];
+    int depth;
+    int record_level;       // level of the record objects: 0 for JSONL, 3 for HAR
+    bool in_record;
+    bool done;
+    ReplayRecord* rec;
+
+    void init(bool har) { depth = 0; record_level = har ? 3 : 0; in_record = false; done = false; rec = NULL; }
+
+    bool isRecordStart() const
+    {
+        if (record_level == 0) return depth == 0;
+        return depth == 3 && !is_array[0] && strcmp(keys[0], "log") == 0 &&
+               !is_array[1] && strcmp(keys[1], "entries") == 0 && is_array[2];
+    }
+
+    // Path of the current value relative to the record, false if it is too long
+    bool path(char* out, int out_size) const
+    {
+        int len = 0;
+        out[0] = '\0';
+        for (int level = record_level; level < depth; level++) {
+            const char* part = is_array[level] ? "[]" : keys[level];
+            if (level == record_level && strcmp(part, "request") == 0) continue;
+            int part_len = (int)strlen(part);
+            bool dot = len > 0 && !is_array[level];
+            if (len + part_len + 2 > out_size) return false;
+            if (dot) out[len++] = '.';
+            memcpy(out + len, part, (size_t)part_len + 1);
+            len += part_len;
+        }
+        return true;
+    }
+
+    void value(const char* str, rapidjson::SizeType len)
+    {
+        char p[256];
+        if (!in_record || !path(p, sizeof(p))) return;
+        if (strcmp(p, "method") == 0) {
+            int n = len < sizeof(rec->method) - 1 ? (int)len : (int)sizeof(rec->method) - 1;
+            memcpy(rec->method, str, (size_t)n);
+            rec->method[n] = '\0';
+        } else if (strcmp(p, "url") == 0) {
+            assign(rec->url, str, (int)len);
+        } else if (strcmp(p, "body") == 0 || strcmp(p, "postData.text") == 0) {
+            assign(rec->body, str, (int)len);
+            rec->body_len = (int)len;
+        } else if (strcmp(p, "startedDateTime") == 0) {
+            rec->has_time = parseIsoTime(str, rec->time_us);
+        } else if (rec->num_headers > 0 && strcmp(p, "headers[].name") == 0) {
+            assign(rec->headers[rec->num_headers-1].name, str, (int)len);
+        } else if (rec->num_headers > 0 && strcmp(p, "headers[].value") == 0) {
+            assign(rec->headers[rec->num_headers-1].value, str, (int)len);
+        } else if (strncmp(p, "headers.", 8) == 0 && strchr(p + 8, '.') == NULL) {
+            Argument& header = addHeader();
+            assign(header.name, p + 8, (int)strlen(p + 8));
+            assign(header.value, str, (int)len);
+        }
+    }
+
+    void number(double v)
+    {
+        char p[256];
+        if (!in_record || !path(p, sizeof(p))) return;
+        if (strcmp(p, "timestamp") == 0) {
+            rec->time_us = (int64_t)(v * 1e6);
+            rec->has_time = true;
+        }
+    }
+
+    Argument& addHeader()
+    {
+        if (rec->num_headers == rec->headers.size()) {
+            Argument arg;
+            arg.arg_type = 0;
+            rec->headers.push_back(arg);
+        }
+        Argument& header = rec->headers[rec->num_headers++];
+        header.name.buf_[0] = '\0';
+        header.value.buf_[0] = '\0';
+        return header;
+    }
+
+    bool push(bool array)
+    {
+        if (depth >= REPLAY_MAX_DEPTH) return false;
+        is_array[depth] = array;
+        keys[depth][0] = '\0';
+        depth++;
+        return true;
+    }
+
+    bool StartObject()
+    {
+        if (isRecordStart()) {
+            in_record = true;
+            clearRecord(*rec);
+        } else if (in_record) {
+            char p[256];
+            if (path(p, sizeof(p)) && strcmp(p, "headers[]") == 0) addHeader();
+        }
+        return push(false);
+    }
+    bool EndObject(rapidjson::SizeType)
+    {
+        depth--;
+        if (in_record && depth == record_level) {
+            in_record = false;
+            done = true;
+        }
+        return true;
+    }
+    bool StartArray()                               { return push(true); }
+    bool EndArray(rapidjson::SizeType)              { depth--; return true; }
+    bool Key(const char* str, rapidjson::SizeType len, bool)
+    {
+        int n = len < REPLAY_MAX_KEY - 1 ? (int)len : REPLAY_MAX_KEY - 1;
+        memcpy(keys[depth-1], str, (size_t)n);
+        keys[depth-1][n] = '\0';
+        return true;
+    }
+    bool String(const char* str, rapidjson::SizeType len, bool)   { value(str, len); return true; }
+    bool Int(int v)                                 { number(v); return true; }
+    bool Uint(unsigned v)                           { number(v); return true; }
+    bool Int64(int64_t v)                           { number((double)v); return true; }
+    bool Uint64(uint64_t v)                         { number((double)v); return true; }
+    bool Double(double v)                           { number(v); return true; }
+    bool Default()                                  { return true; }
+};
+
+typedef struct CaptureReader {
+    rapidjson::Reader reader;
+    rapidjson::MemoryStream* stream;
+    CaptureHandler handler;
+    bool har;
+    bool need_init;
+    int bad_records;
+} CaptureReader;
+
+static const unsigned CAPTURE_FLAGS = rapidjson::kParseStopWhenDoneFlag;
+
+static void skipToNextLine(rapidjson::MemoryStream& stream)
+{
+    while (stream.Peek() != '\0' && stream.Take() != '\n') {}
+}
+
+// Parses tokens until the next complete record, false at the end of the capture
+static bool nextRecord(CaptureReader& capture, ReplayRecord& rec)
+{
+    rapidjson::MemoryStream& stream = *capture.stream;
+    capture.handler.rec = &rec;
+    capture.handler.done = false;
+    while (true) {
+        if (capture.need_init) {
+            while (stream.Peek() == ' ' || stream.Peek() == '\n' || stream.Peek() == '\r' || stream.Peek() == '\t')
+                stream.Take();
+            if (stream.Peek() == '\0') return false;
+            capture.reader.IterativeParseInit();
+            capture.handler.depth = 0;
+            capture.handler.in_record = false;
+            capture.need_init = false;
+        }
+        if (capture.reader.IterativeParseComplete()) {
+            if (capture.har) return false;
+            capture.need_init = true;
+            continue;
+        }
+        capture.reader.IterativeParseNext<CAPTURE_FLAGS>(stream, capture.handler);
+        if (capture.reader.HasParseError()) {
+            capture.bad_records++;
+            if (capture.har) return false;
+            // a broken line only loses itself
+            skipToNextLine(stream);
+            capture.need_init = true;
+            continue;
+        }
+        if (capture.handler.done) return true;
+    }
+}
+
+
+typedef struct ReplaySlot {
+    CURL* curl;
+    struct curl_slist* header_list;
+    ReplayRecord rec;
+} ReplaySlot;
+
+static size_t discardResponse(void*, size_t size, size_t nmemb, void*)
+{
+    return size * nmemb;
+}
+
+static bool skipHeader(const pg::String& name)
+{
+    // set by curl from the url and body, or HTTP/2 pseudo headers
+    return name.buf_[0] == ':' || strcasecmp(name.buf_, "Content-Length") == 0 ||
+           strcasecmp(name.buf_, "Host") == 0;
+}
+
+static bool setupTransfer(ReplaySlot& slot)
+{
+    ReplayRecord& rec = slot.rec;
+    if (rec.url.buf_[0] == '\0' || rec.method[0] == '\0')
+        return false;
+    if (slot.header_list) curl_slist_free_all(slot.header_list);
+    slot.header_list = NULL;
+
+    CURL* curl = slot.curl;
+    curl_easy_reset(curl);  // keeps the connection cache
+    curl_easy_setopt(curl, CURLOPT_URL, rec.url.buf_);
+    if (strcmp(rec.method, "GET") == 0) curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    else if (strcmp(rec.method, "HEAD") == 0) curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    else curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, rec.method);
+    if (rec.body_len > 0) {
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, rec.body.buf_);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)rec.body_len);
+    }
+    for (int i=0; i<rec.num_headers; i++) {
+        if (skipHeader(rec.headers[i].name)) continue;
+        pg::String line(rec.headers[i].name);
+        line.append(": ");
+        line.append(rec.headers[i].value.buf_);
+        slot.header_list = curl_slist_append(slot.header_list, line.buf_);
+    }
+    if (slot.header_list) curl_easy_setopt(curl, CURLOPT_HTTPHEADER, slot.header_list);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, discardResponse);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, (void*)&slot);
+    return true;
+}
+
+void threadReplay(Replay& replay)
+{
+    traceSetThreadName("replay");
+    LoadTestStats& stats = replay.stats;
+    MappedFile file;
+    if (!mapFile(file, replay.path, true)) {
+        snprintf(replay.error, sizeof(replay.error), "Could not open %s", replay.path);
+        replay.status = FINISHED;
+        return;
+    }
+    replay.file_size = (int64_t)file.size;
+
+    rapidjson::MemoryStream stream(file.data, file.size);
+    CaptureReader capture;
+    capture.stream = &stream;
+    const char* ext = strrchr(replay.path, '.');
+    capture.har = ext && strcmp(ext, ".har") == 0;
+    capture.handler.init(capture.har);
+    capture.need_init = true;
+    capture.bad_records = 0;
+
+    double speed = replay.timing == REPLAY_SCALED && replay.speed > 0.0f ? replay.speed : 1.0;
+    int num_slots = replay.concurrency < 1 ? 1 : replay.concurrency;
+    ReplaySlot* slots = new ReplaySlot[num_slots];
+    ReplaySlot** free_slots = new ReplaySlot*[num_slots];
+    int num_free = 0;
+    for (int i=0; i<num_slots; i++) {
+        slots[i].curl = curl_easy_init();
+        slots[i].header_list = NULL;
+        free_slots[num_free++] = &slots[i];
+    }
+
+    CURLM* multi = curl_multi_init();
+    enableMultiplexing(multi);
+    int64_t start = nowUs();
+    int64_t first_time_us = 0;
+    bool have_first = false;
+    ReplaySlot* pending = NULL;     // parsed, waiting for its time
+    int64_t pending_due = 0;
+    bool eof = false;
+    int in_flight = 0;
+
+    while (true) {
+        if (pending == NULL && !eof && !replay.cancel && num_free > 0) {
+            ReplaySlot* slot = free_slots[--num_free];
+            if (nextRecord(capture, slot->rec)) {
+                pending = slot;
+                ReplayRecord& rec = slot->rec;
+                pending_due = nowUs();
+                if (replay.timing != REPLAY_FAST && rec.has_time) {
+                    if (!have_first) {
+                        first_time_us = rec.time_us;
+                        have_first = true;
+                    }
+                    pending_due = start + (int64_t)((rec.time_us - first_time_us) / speed);
+                }
+            } else {
+                free_slots[num_free++] = slot;
+                eof = true;
+            }
+            replay.bytes_read = (int64_t)stream.Tell();
+            replay.skipped = capture.bad_records;
+        }
+
+        int64_t now = nowUs();
+        int timeout_ms = 100;
+        if (pending && replay.cancel) {
+            free_slots[num_free++] = pending;
+            pending = NULL;
+        } else if (pending && now >= pending_due) {
+            if (setupTransfer(*pending)) {
+                int64_t lag = now - pending_due;
+                if (lag > replay.max_lag_us) replay.max_lag_us = lag;
+                curl_multi_add_handle(multi, pending->curl);
+                stats.started++;
+                in_flight++;
+            } else {
+                capture.bad_records++;
+                replay.skipped = capture.bad_records;
+                free_slots[num_free++] = pending;
+            }
+            pending = NULL;
+            continue;
+        } else if (pending) {
+            int64_t wait_ms = (pending_due - now) / 1000;
+            if (wait_ms < timeout_ms) timeout_ms = (int)wait_ms;
+        }
+
+        if (in_flight == 0 && pending == NULL && (eof || replay.cancel))
+            break;
+        if (in_flight == 0 && pending == NULL)
+            continue;   // parse the next record right away
+
+        int running;
+        curl_multi_perform(multi, &running);
+        CURLMsg* msg;
+        int msgs_left;
+        while ((msg = curl_multi_info_read(multi, &msgs_left))) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            CURL* curl = msg->easy_handle;
+            recordTransfer(stats, curl, msg->data.result);
+            curl_multi_remove_handle(multi, curl);
+            ReplaySlot* slot;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**)&slot);
+            free_slots[num_free++] = slot;
+            in_flight--;
+        }
+        stats.elapsed_us = nowUs() - start;
+        // with a free slot and nothing pending, go parse instead of waiting
+        if (pending != NULL || num_free == 0 || eof || replay.cancel)
+            curl_multi_poll(multi, NULL, 0, timeout_ms > 0 ? timeout_ms : 0, NULL);
+    }
+
+    for (int i=0; i<num_slots; i++) {
+        if (slots[i].header_list) curl_slist_free_all(slots[i].header_list);
+        curl_easy_cleanup(slots[i].curl);
+    }
+    delete [] slots;
+    delete [] free_slots;
+    curl_multi_cleanup(multi);
+    unmapFile(file);
+    stats.elapsed_us = nowUs() - start;
+    replay.skipped = capture.bad_records;
+    if (capture.har && capture.reader.HasParseError())
+        snprintf(replay.error, sizeof(replay.error), "Invalid HAR at offset %d", (int)capture.reader.GetErrorOffset());
+    replay.status = FINISHED;
+}
+
+bool replayWindow(bool* open, Replay& replay)
+{
+    bool start = false;
+    ImGui::Begin("Replay Capture", open);
+    bool running = replay.status == RUNNING;
+
+    ImGui::InputText("Capture (.har/.jsonl)", replay.path, sizeof(replay.path));
+    ImGui::PushItemWidth(ImGui::GetFontSize() * 12);
+    const char* timings[] = { "Original timing", "As fast as possible", "Speed multiplier" };
+    ImGui::Combo("Timing", &replay.timing, timings, IM_ARRAYSIZE(timings));
+    if (replay.timing == REPLAY_SCALED)
+        ImGui::InputFloat("Speed", &replay.speed, 0.5f, 2.0f, "%.2fx");
+    ImGui::InputInt("Concurrency", &replay.concurrency);
+    ImGui::PopItemWidth();
+    if (replay.concurrency < 1) replay.concurrency = 1;
+    if (replay.speed < 0.01f) replay.speed = 0.01f;
+
+    if (running) {
+        if (ImGui::Button("Stop")) replay.cancel = true;
+    } else if (ImGui::Button("Start replay")) {
+        start = true;
+    }
+
+    int64_t file_size = replay.file_size;
+    float progress = file_size > 0 ? (float)((double)replay.bytes_read / (double)file_size) : 0.0f;
+    char overlay[64];
+    snprintf(overlay, sizeof(overlay), "%.1f / %.1f MB", replay.bytes_read / 1048576.0, file_size / 1048576.0);
+    ImGui::ProgressBar(progress, ImVec2(-1.0f, 0.0f), overlay);
+    drawLoadTestStats(replay.stats);
+    ImGui::Text("Skipped records: %d  Max lag behind capture: %.1f ms", (int)replay.skipped, replay.max_lag_us / 1000.0);
+    if (!running && replay.error[0] != '\0')
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", replay.error);
+    ImGui::End();
+    return start;
+}
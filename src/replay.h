@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include "requests.h"
+#include "loadtest.h"
+
+// Replays a traffic capture: a HAR file (.har) or JSON Lines with one request
+// per line. The file is memory mapped and parsed token by token with the
+// rapidjson pull reader, only as far as there are free transfer slots, so a
+// capture of any size runs in constant memory. A JSONL record looks like
+//
+//   {"method": "POST", "url": "http://...", "headers": {"Name": "value"},
+//    "body": "...", "timestamp": 1700000000.25}
+//
+// headers can also be a HAR style [{"name", "value"}] array, and
+// "startedDateTime" (ISO 8601) can be used instead of "timestamp". HAR
+// entries are read from log.entries[].request and startedDateTime.
+
+typedef enum ReplayTiming {
+    REPLAY_ORIGINAL = 0,    // same spacing as the capture
+    REPLAY_FAST,            // as fast as the concurrency allows
+    REPLAY_SCALED,          // original spacing divided by speed
+} ReplayTiming;
+
+typedef struct Replay {
+    Replay() {
+        path[0] = '\0'; timing = REPLAY_ORIGINAL; speed = 2.0f; concurrency = 16;
+        cancel = false; status = IDLE; reset();
+    }
+    void reset() {
+        stats.reset(); bytes_read = 0; file_size = 0; skipped = 0; max_lag_us = 0; error[0] = '\0';
+    }
+
+    char path[1024];
+    int timing;             // ReplayTiming
+    float speed;
+    int concurrency;
+    std::atomic<bool> cancel;
+    std::atomic<ThreadStatus> status;
+
+    LoadTestStats stats;
+    std::atomic<int64_t> bytes_read;
+    std::atomic<int64_t> file_size;
+    std::atomic<int> skipped;           // records that could not be parsed or sent
+    std::atomic<int64_t> max_lag_us;    // worst delay behind the capture timing
+    char error[1024 + 64];              // fits a message with the path, written before status turns FINISHED
+} Replay;
+
+void threadReplay(Replay& replay);
+
+// Draws the replay window, returns true when the user asked to start
+bool replayWindow(bool* open, Replay& replay);
@@ -1,12 +1,11 @@
+#include <mutex>
 #include "requests.h"
+#include "httpcache.h"
+#include "pghash.h"
+#include "profiler.h"
 
 
 
-struct WriteThis {
-  const char *readptr;
-  size_t sizeleft;
-};
- 
 static size_t read_callback(void *dest, size_t size, size_t nmemb, void *userp)
 {
   struct WriteThis *wt = (struct WriteThis *)userp;
@@ -26,23 +25,23 @@ static size_t read_callback(void *dest, size_t size, size_t nmemb, void *userp)
  
   return 0; /* no more data left to deliver */ 
 }
-
-typedef struct MemoryStruct {
-    MemoryStruct() { memory = (char*)malloc(1); size=0; };
-    
-    char *memory;
-    size_t size;
-} MemoryStruct;
  
 static size_t
 WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp)
 {
     size_t realsize = size * nmemb;
     struct MemoryStruct *mem = (struct MemoryStruct *)userp;
-    mem->memory = (char*)realloc(mem->memory, mem->size + realsize + 1);
-    if(mem->memory == NULL) {
-        /* out of memory! */
-        return 0;
+    if (mem->size + realsize + 1 > mem->capacity) {
+        // grow geometrically, a reused buffer stops reallocating after a few requests
+        size_t capacity = mem->capacity * 2;
+        if (capacity < mem->size + realsize + 1) capacity = mem->size + realsize + 1;
+        char* memory = (char*)realloc(mem->memory, capacity);
+        if(memory == NULL) {
+            /* out of memory! */
+            return 0;
+        }
+        mem->memory = memory;
+        mem->capacity = capacity;
     }
 
     memcpy(&(mem->memory[mem->size]), contents, realsize);
@@ -53,205 +52,403 @@ WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp)
 }
 
 
-void threadRequestGetDelete(std::atomic<ThreadStatus>& thread_status, RequestType reqType, pg::String url,
-        pg::Vector<Argument> args, pg::Vector<Argument> headers, 
-                      ContentType contentTypeEnum, pg::String& thread_result, int& response_code) 
-{ 
-    CURLcode res;
-    CURL* curl;
-    curl = curl_easy_init();
+static void clearResponseHeaders(ResponseHeaders& headers)
+{
+    headers.etag[0] = headers.last_modified[0] = headers.expires[0] = '\0';
+    headers.cache_control[0] = headers.vary[0] = '\0';
+}
 
+// Copies the value of "Name: value\r\n" if the name matches, without the line end
+static bool copyHeader(const char* line, size_t len, const char* name, char* out, size_t out_size)
+{
+    size_t name_len = strlen(name);
+    if (len <= name_len || line[name_len] != ':' || !curl_strnequal(line, name, name_len))
+        return false;
+    const char* value = line + name_len + 1;
+    const char* end = line + len;
+    while (value < end && (*value == ' ' || *value == '\t')) value++;
+    while (end > value && (end[-1] == '\r' || end[-1] == '\n' || end[-1] == ' ')) end--;
+    size_t n = (size_t)(end - value) < out_size - 1 ? (size_t)(end - value) : out_size - 1;
+    memcpy(out, value, n);
+    out[n] = '\0';
+    return true;
+}
 
-    pg::String contentType = ContentTypeToString(contentTypeEnum); 
+static size_t HeaderCallback(char* buffer, size_t size, size_t nitems, void* userp)
+{
+    size_t len = size * nitems;
+    ResponseHeaders& headers = *(ResponseHeaders*)userp;
+    if (len > 5 && strncmp(buffer, "HTTP/", 5) == 0) {
+        clearResponseHeaders(headers);     // status line of the next response
+        return len;
+    }
+    copyHeader(buffer, len, "ETag", headers.etag, sizeof(headers.etag)) ||
+    copyHeader(buffer, len, "Last-Modified", headers.last_modified, sizeof(headers.last_modified)) ||
+    copyHeader(buffer, len, "Expires", headers.expires, sizeof(headers.expires)) ||
+    copyHeader(buffer, len, "Cache-Control", headers.cache_control, sizeof(headers.cache_control)) ||
+    copyHeader(buffer, len, "Vary", headers.vary, sizeof(headers.vary));
+    return len;
+}
 
-    MemoryStruct chunk;
-    if (reqType == GET) {
-        curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
-    } else {
-        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE");
+
+static void appendEscaped(CURL* curl, pg::String& url, const pg::String& str)
+{
+    char* escaped = curl_easy_escape(curl, str.buf_, str.length());
+    if (escaped) {
+        url.append(escaped);
+        curl_free(escaped);
     }
-    
-    if (args.size() > 0) url.append("?");
-    for (int i=0; i<(int)args.size(); i++) {
-        char* escaped_name = curl_easy_escape(curl , args[i].name.buf_, args[i].name.length());
-        url.append(escaped_name);
-        url.append("=");
-        char* escaped_value = curl_easy_escape(curl , args[i].value.buf_, args[i].value.length());
-        url.append(escaped_value);
-        if (i < (int)args.size()-1) url.append("&");
+}
+
+static void clearPreparedRequest(PreparedRequest& req)
+{
+    if (req.header_list) curl_slist_free_all(req.header_list);
+    if (req.form) curl_mime_free(req.form);
+    if (req.body_pinned) req.body.unpin();
+    unmapFile(req.body_map);
+    req.header_list = NULL;
+    req.form = NULL;
+    req.body_pinned = false;
+    req.body = pg::Body();
+    req.body_file_hash = 0;
+    req.valid = false;
+}
+
+
+void initPreparedRequest(PreparedRequest& req)
+{
+    req.curl = NULL;
+    req.header_list = NULL;
+    req.form = NULL;
+    req.signature = 0;
+    req.valid = false;
+    req.body_pinned = false;
+    req.body_reader.readptr = NULL;
+    req.body_reader.sizeleft = 0;
+    req.body_file_hash = 0;
+    clearResponseHeaders(req.response_headers);
+}
+
+void freePreparedRequest(PreparedRequest& req)
+{
+    clearPreparedRequest(req);
+    if (req.curl) curl_easy_cleanup(req.curl);
+    req.curl = NULL;
+}
+
+void internArguments(pg::Vector<HistoryArgument>& out, const pg::Vector<Argument>& args)
+{
+    out.resize(args.size());
+    for (int i=0; i<args.size(); i++) {
+        out[i].name = pg::Atom(args[i].name);
+        out[i].value = pg::Atom(args[i].value);
+        out[i].arg_type = args[i].arg_type;
     }
+}
+
+void copyArguments(pg::Vector<Argument>& out, const pg::Vector<HistoryArgument>& args)
+{
+    out.resize(args.size());
+    for (int i=0; i<args.size(); i++) {
+        out[i].name = pg::String(args[i].name.buf());
+        out[i].value = pg::String(args[i].value.buf());
+        out[i].arg_type = args[i].arg_type;
+    }
+}
+
+void historyRequest(Request& out, const History& hist)
+{
+    out.url.set(hist.url.buf());
+    copyArguments(out.args, hist.args);
+    copyArguments(out.headers, hist.headers);
+    out.input_json = hist.input_json;
+    out.body_file = hist.body_file;
+    out.req_type = hist.req_type;
+    out.content_type = hist.content_type;
+    out.http_version = hist.http_version;
+}
 
-    struct curl_slist *header_chunk = NULL;
-    if (contentType.length() > 0) {
+uint64_t requestSignature(const Request& hist)
+{
+    uint64_t h = pg::hash64(hist.url.buf_, hist.url.length(), hist.body_file.hash() +
+                            ((uint64_t)hist.req_type * 31 + (uint64_t)hist.content_type) * 31 + (uint64_t)hist.http_version);
+    for (int i=0; i<hist.args.size(); i++) {
+        h = pg::hash64(hist.args[i].name.buf_, hist.args[i].name.length(), h);
+        h = pg::hash64(hist.args[i].value.buf_, hist.args[i].value.length(), h + (uint64_t)hist.args[i].arg_type);
+    }
+    h ^= 0x9e3779b97f4a7c15ULL;
+    for (int i=0; i<hist.headers.size(); i++) {
+        h = pg::hash64(hist.headers[i].name.buf_, hist.headers[i].name.length(), h);
+        h = pg::hash64(hist.headers[i].value.buf_, hist.headers[i].value.length(), h);
+    }
+    return h ^ hist.input_json.hash();
+}
+
+bool prepareRequest(PreparedRequest& req, const Request& hist)
+{
+    // a body file is mapped again on every send, it may have been rewritten
+    uint64_t signature = requestSignature(hist);
+    if (req.valid && req.signature == signature && hist.body_file.length() == 0)
+        return false;
+
+    clearPreparedRequest(req);
+    if (req.curl == NULL) req.curl = curl_easy_init();
+    else curl_easy_reset(req.curl);
+    req.signature = signature;
+    req.req_type = hist.req_type;
+
+    CURL* curl = req.curl;
+    bool has_body = hist.req_type == POST || hist.req_type == PATCH || hist.req_type == PUT;
+
+    // streamed from the page cache, never copied into memory of our own
+    if (has_body && hist.body_file.length() > 0 && !mapFile(req.body_map, hist.body_file.buf(), true))
+        return true;
+
+    // GET and DELETE send every argument on the query string, the others
+    // send file arguments as multipart parts and the rest on the query string
+    req.url = hist.url;
+    int num_query = 0;
+    for (int i=0; i<hist.args.size(); i++) {
+        if (has_body && hist.args[i].arg_type == 1) {
+            if (req.form == NULL) req.form = curl_mime_init(curl);
+            curl_mimepart* field = curl_mime_addpart(req.form);
+            curl_mime_name(field, hist.args[i].name.buf_);
+            curl_mime_filedata(field, hist.args[i].value.buf_);
+            continue;
+        }
+        req.url.append(num_query == 0 ? "?" : "&");
+        appendEscaped(curl, req.url, hist.args[i].name);
+        req.url.append("=");
+        appendEscaped(curl, req.url, hist.args[i].value);
+        num_query++;
+    }
+
+    if (hist.content_type == MULTIPART_FORMDATA || hist.content_type == APPLICATION_JSON) {
         pg::String aux("Content-Type: ");
-        aux.append(contentType);
-        header_chunk = curl_slist_append(header_chunk, aux.buf_);
+        aux.append(ContentTypeToString(hist.content_type));
+        req.header_list = curl_slist_append(req.header_list, aux.buf_);
     }
-    for (int i=0; i<(int)headers.size(); i++) {
-        pg::String header(headers[i].name);
-        if (headers[i].name.length() > 0) header.append(": ");
-        header.append(headers[i].value);
-        header_chunk = curl_slist_append(header_chunk, header.buf_);
+    for (int i=0; i<(int)hist.headers.size(); i++) {
+        pg::String header(hist.headers[i].name);
+        if (hist.headers[i].name.length() > 0) header.append(": ");
+        header.append(hist.headers[i].value.buf_);
+        req.header_list = curl_slist_append(req.header_list, header.buf_);
     }
-    if (header_chunk) {
-        res = curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_chunk);
-        if (res != CURLE_OK) {
-            thread_result = "Problem setting header!";
-            thread_status = FINISHED;
-            curl_easy_cleanup(curl);
-            return;
+    if (req.header_list && curl_easy_setopt(curl, CURLOPT_HTTPHEADER, req.header_list) != CURLE_OK)
+        return true;
+
+    curl_easy_setopt(curl, CURLOPT_URL, req.url.buf_);
+    switch (hist.req_type) {
+        case GET:       curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L); break;
+        case DELETE:    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE"); break;
+        case POST:      curl_easy_setopt(curl, CURLOPT_POST, 1L); break;
+        case PATCH:     curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PATCH"); break;
+        case PUT:       curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT"); break;
+        // perform only does the upgrade, frames go through curl_ws_recv/curl_ws_send
+        case WEBSOCKET: curl_easy_setopt(curl, CURLOPT_CONNECT_ONLY, 2L); break;
+    }
+
+    if (has_body) {
+        curl_off_t body_size = 0;
+        if (hist.body_file.length() > 0) {
+            body_size = (curl_off_t)req.body_map.size;
+        } else if (hist.content_type == APPLICATION_JSON) {
+            req.body = hist.input_json;
+            req.body.pin();
+            req.body_pinned = true;
+            body_size = (curl_off_t)req.body.length();
         }
+        curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_callback);
+        curl_easy_setopt(curl, CURLOPT_READDATA, &req.body_reader);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, body_size);
+        if (req.form != NULL)
+            curl_easy_setopt(curl, CURLOPT_MIMEPOST, req.form);
     }
-    
-    curl_easy_setopt(curl, CURLOPT_URL, url.buf_);
     curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)&chunk);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)&req.response);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, (void*)&req.response_headers);
     curl_easy_setopt(curl, CURLOPT_USERAGENT, "libcurl-agent/1.0");
 
-    res = curl_easy_perform(curl);
-    pg::String response_body;
-    long resp_code;
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &resp_code);
-    response_code = (int)resp_code;
-    if(res != CURLE_OK) {
-        thread_result = pg::String(curl_easy_strerror(res));
-        if(chunk.size > 0) thread_result = pg::String(chunk.memory); 
+    switch (hist.http_version) {
+        case HTTP_DEFAULT:              break;
+        case HTTP_1_1:                  curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_1_1); break;
+        case HTTP_2:                    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2_0); break;
+        case HTTP_2_PRIOR_KNOWLEDGE:    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE); break;
+    }
+
+    req.valid = true;
+    return true;
+}
+
+void resetPreparedRequest(PreparedRequest& req)
+{
+    req.response.size = 0;
+    if (req.response.memory) req.response.memory[0] = '\0';
+    clearResponseHeaders(req.response_headers);
+    if (req.body_map.size > 0) {
+        req.body_reader.readptr = req.body_map.data;
+        req.body_reader.sizeleft = req.body_map.size;
     } else {
-        thread_result = pg::String("All ok");
-        if(chunk.size > 0) thread_result = prettify(chunk.memory); 
+        req.body_reader.readptr = req.body.buf(); // resident, prepareRequest pinned it
+        req.body_reader.sizeleft = (size_t)req.body.length();
     }
-    thread_status = FINISHED;
-    curl_easy_cleanup(curl);
 }
 
+CURLcode performPreparedRequest(PreparedRequest& req, int& response_code)
+{
+    resetPreparedRequest(req);
+    CURLcode res = curl_easy_perform(req.curl);
+    traceTransfer(req.curl, "transfer", res);
+    long resp_code = 0;
+    curl_easy_getinfo(req.curl, CURLINFO_RESPONSE_CODE, &resp_code);
+    response_code = (int)resp_code;
+    return res;
+}
 
-void threadRequestPostPatchPut(std::atomic<ThreadStatus>& thread_status, RequestType reqType,
-                      pg::String url, pg::Vector<Argument> args, pg::Vector<Argument> headers, 
-                      ContentType contentTypeEnum, const pg::String& inputJson, 
-                      pg::String& thread_result, int& response_code) 
-{ 
-    CURL *curl;
-    CURLcode res;
-    MemoryStruct chunk;
-    
-    pg::String contentType = ContentTypeToString(contentTypeEnum); 
+int negotiatedHttpVersion(CURL* curl)
+{
+    long version = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &version) != CURLE_OK)
+        return 0;
+    switch (version) {
+        case CURL_HTTP_VERSION_1_0: return 10;
+        case CURL_HTTP_VERSION_1_1: return 11;
+        case CURL_HTTP_VERSION_2_0: return 20;
+#if LIBCURL_VERSION_NUM >= 0x074200
+        case CURL_HTTP_VERSION_3:   return 30;
+#endif
+    }
+    return 0;
+}
+
+void enableMultiplexing(CURLM* multi)
+{
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+}
+
+void waitForMultiplexing(PreparedRequest& req, const Request& hist)
+{
+    // by default curl only negotiates h2 over TLS, waiting on a plaintext
+    // origin would serialize every transfer on one HTTP/1.1 connection
+    bool h2 = hist.http_version == HTTP_2 || hist.http_version == HTTP_2_PRIOR_KNOWLEDGE ||
+              (hist.http_version == HTTP_DEFAULT && strncmp(hist.url.buf_, "https://", 8) == 0);
+    if (req.curl && h2)
+        curl_easy_setopt(req.curl, CURLOPT_PIPEWAIT, 1L);
+}
+
+struct ConnectionShare {
+    CURLSH* share;
+    std::mutex locks[CURL_LOCK_DATA_LAST];
+};
+
+static void lockShare(CURL*, curl_lock_data data, curl_lock_access, void* userp)
+{
+    ((ConnectionShare*)userp)->locks[data].lock();
+}
 
-    if (args.size() == 0 && inputJson.length() == 0) {
-        thread_result = "No argument passed for POST";
+static void unlockShare(CURL*, curl_lock_data data, void* userp)
+{
+    ((ConnectionShare*)userp)->locks[data].unlock();
+}
+
+ConnectionShare* createConnectionShare()
+{
+    ConnectionShare* share = new ConnectionShare;
+    share->share = curl_share_init();
+    curl_share_setopt(share->share, CURLSHOPT_LOCKFUNC, lockShare);
+    curl_share_setopt(share->share, CURLSHOPT_UNLOCKFUNC, unlockShare);
+    curl_share_setopt(share->share, CURLSHOPT_USERDATA, (void*)share);
+    curl_share_setopt(share->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    curl_share_setopt(share->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    return share;
+}
+
+// Every handle using it must have been cleaned up
+void freeConnectionShare(ConnectionShare* share)
+{
+    if (share == NULL) return;
+    curl_share_cleanup(share->share);
+    delete share;
+}
+
+void attachConnectionShare(PreparedRequest& req, ConnectionShare* share)
+{
+    if (req.curl && share) curl_easy_setopt(req.curl, CURLOPT_SHARE, share->share);
+}
+
+
+void threadRequest(std::atomic<ThreadStatus>& thread_status, PreparedRequest& prepared, 
+                   Request hist, pg::Body& thread_result, int& response_code, int64_t& duration_us,
+                   int& response_version, HttpCache* cache)
+{
+    traceSetThreadName("request");
+    TRACE_SCOPE("request");
+    bool has_body = hist.req_type == POST || hist.req_type == PATCH || hist.req_type == PUT;
+    if (has_body && hist.args.size() == 0 && hist.input_json.length() == 0 && hist.body_file.length() == 0) {
+        thread_result = pg::Body("No argument passed for POST");
         thread_status = FINISHED;
         return;
     }
 
-    struct WriteThis wt;
-    if (contentTypeEnum == APPLICATION_JSON) {
-        wt.readptr = inputJson.buf_;
-        wt.sizeleft = inputJson.length();
-    } 
-
-    /* In windows, this will init the winsock stuff */ 
-    res = curl_global_init(CURL_GLOBAL_DEFAULT);
-    /* Check for errors */ 
-    if(res != CURLE_OK) {
-        thread_result = curl_easy_strerror(res);
+    HttpCacheEntry cached;
+    bool use_cache = cache && cache->enabled && hist.req_type == GET;
+    bool have_cached = use_cache && httpCacheLookup(*cache, hist, cached);
+    if (have_cached && cached.fresh_until > time(NULL)) {
+        thread_result = cached.body;
+        response_code = cached.status;
+        cache->hits++;
+        cache->bytes_saved += cached.body.length();
         thread_status = FINISHED;
         return;
     }
+    if (have_cached)
+        httpCacheAddValidators(cached, hist);
 
-    curl_mime *form = NULL;
-    curl_mimepart *field = NULL;
-
-    /* get a curl handle */ 
-    curl = curl_easy_init();
-    if(curl) {
-        pg::Vector<int> files_idx;
-        pg::Vector<int> args_idx;
-        for (int i=0; i<args.size(); i++) {
-            if (args[i].arg_type == 1) {
-                files_idx.push_back(i);
-            } else {
-                args_idx.push_back(i);
-            }
-        }
-
-        for (int i=0; i<files_idx.size(); i++) {
-            if (form == NULL) {
-                /* Create the form */ 
-                form = curl_mime_init(curl);
-            }
-         
-            /* Fill in the file upload field */ 
-            field = curl_mime_addpart(form);
-            curl_mime_name(field, args[files_idx[i]].name.buf_);
-            curl_mime_filedata(field, args[files_idx[i]].value.buf_);
-        }
-
-        if (args_idx.size() > 0) url.append("?");
-        for (int i=0; i<args_idx.size(); i++) {
-            int curr_idx = args_idx[i];
-            char* escaped_name = curl_easy_escape(curl , args[curr_idx].name.buf_, args[curr_idx].name.length());
-            url.append(escaped_name);
-            url.append("=");
-            char* escaped_value = curl_easy_escape(curl , args[curr_idx].value.buf_, args[curr_idx].value.length());
-            url.append(escaped_value);
-            if (i < (int)args_idx.size()-1) url.append("&");
-        }
-     
-        struct curl_slist *header_chunk = NULL;
-        if (contentType.length() > 0) {
-            pg::String aux("Content-Type: ");
-            aux.append(contentType);
-            header_chunk = curl_slist_append(header_chunk, aux.buf_);
-        }
-        for (int i=0; i<(int)headers.size(); i++) {
-            pg::String header(headers[i].name);
-            if (headers[i].name.length() > 0) header.append(": ");
-            header.append(headers[i].value);
-            header_chunk = curl_slist_append(header_chunk, header.buf_);
-        }
-        if (header_chunk) {
-            res = curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_chunk);
-            if (res != CURLE_OK) {
-                thread_result = "Problem setting header!";
-                thread_status = FINISHED;
-                curl_easy_cleanup(curl);
-                return;
-            }
-        }
-        curl_easy_setopt(curl, CURLOPT_URL, url.buf_);
-
+    {
+        TRACE_SCOPE("prepare");
+        prepareRequest(prepared, hist);
+    }
+    if (!prepared.valid) {
+        thread_result = pg::Body(prepared.body_map.data == NULL && hist.body_file.length() > 0 ?
+                                 "Could not open the body file" : "Problem setting header!");
+        thread_status = FINISHED;
+        return;
+    }
+    if (prepared.body_map.size > 0) {
+        TRACE_SCOPE("hash body file");
+        prepared.body_file_hash = pg::hash64(prepared.body_map.data, prepared.body_map.size);
+    }
 
-        if (reqType == POST) {
-            curl_easy_setopt(curl, CURLOPT_POST, 1L);
-        } else if (reqType == PATCH) {
-            curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PATCH");
-        } else {
-            curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
-        }
-        curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_callback);
-        curl_easy_setopt(curl, CURLOPT_READDATA, &wt);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)&chunk);
-        curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
-        if (form != NULL) {
-            curl_easy_setopt(curl, CURLOPT_MIMEPOST, form);
+    CURLcode res = performPreparedRequest(prepared, response_code);
+    curl_off_t total_us = 0;
+    if (curl_easy_getinfo(prepared.curl, CURLINFO_TOTAL_TIME_T, &total_us) == CURLE_OK)
+        duration_us = (int64_t)total_us;
+    response_version = negotiatedHttpVersion(prepared.curl);
+    MemoryStruct& chunk = prepared.response;
+    if(res != CURLE_OK) {
+        thread_result = pg::Body(curl_easy_strerror(res));
+        if(chunk.size > 0) thread_result = pg::Body(chunk.memory, (int)chunk.size);
+    } else if (have_cached && response_code == 304) {
+        // not modified: the stored body stands in for the one not sent
+        thread_result = cached.body;
+        httpCacheRefresh(*cache, cached, prepared.response_headers);
+        cache->revalidated++;
+        cache->bytes_saved += cached.body.length();
+    } else {
+        thread_result = pg::Body("All ok");
+        if (chunk.size > 0 && (bodyIsBinary(chunk.memory, (int)chunk.size) || memchr(chunk.memory, 0, chunk.size))) {
+            // kept byte for byte, the viewer shows it as hex
+            thread_result = pg::Body(chunk.memory, (int)chunk.size);
+        } else if (chunk.size > 0) {
+            TRACE_SCOPE("prettify");
+            thread_result = pg::Body(prettify(pg::String(chunk.memory, (int)chunk.size)));
         }
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)wt.sizeleft);
-
-        res = curl_easy_perform(curl);
-        long resp_code;
-        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &resp_code);
-        response_code = (int)resp_code;
-
-        if(res != CURLE_OK) {
-            thread_result = pg::String(curl_easy_strerror(res));
-            if(chunk.size > 0) thread_result = prettify(chunk.memory); 
-        } else {
-            thread_result = pg::String("All ok");
-            if(chunk.size > 0) thread_result = prettify(chunk.memory); 
+        if (use_cache) {
+            cache->misses++;
+            httpCacheStore(*cache, hist, response_code, prepared.response_headers, thread_result);
         }
-        /* always cleanup */ 
-        curl_easy_cleanup(curl);
-        if (form != NULL) curl_mime_free(form);
     }
     thread_status = FINISHED;
 }
@@ -265,6 +462,7 @@ pg::String RequestTypeToString(RequestType req) {
         case DELETE:    return pg::String("DELETE");
         case PATCH:     return pg::String("PATCH");
         case PUT:       return pg::String("PUT");
+        case WEBSOCKET: return pg::String("WS");
     }
     return pg::String("UNDEFINED");
 }
@@ -278,6 +476,26 @@ pg::String ContentTypeToString(ContentType ct) {
     return pg::String("<NONE>");
 }
 
+const char* HttpVersionToString(HttpVersion version) {
+    switch(version) {
+        case HTTP_DEFAULT:              return "Default";
+        case HTTP_1_1:                  return "HTTP/1.1";
+        case HTTP_2:                    return "HTTP/2";
+        case HTTP_2_PRIOR_KNOWLEDGE:    return "HTTP/2 (h2c)";
+    }
+    return "Default";
+}
+
+const char* ResponseVersionToString(int version) {
+    switch(version) {
+        case 10:    return "HTTP/1.0";
+        case 11:    return "HTTP/1.1";
+        case 20:    return "HTTP/2";
+        case 30:    return "HTTP/3";
+    }
+    return "";
+}
+
 
 pg::String prettify(pg::String input) {
     rapidjson::Document document;
@@ -1,9 +1,13 @@
 #pragma once 
 
 #include <atomic>
+#include <time.h>
 #include <curl/curl.h>
 #include "pgstring.h"
 #include "pgvector.h"
+#include "bodystore.h"
+#include "strtable.h"
+#include "mmapfile.h"
 #include "rapidjson/document.h"
 #include "rapidjson/prettywriter.h"
 #include "rapidjson/stringbuffer.h"
@@ -20,7 +24,8 @@ typedef enum RequestType {
     POST    = 1,
     DELETE  = 2,
     PATCH   = 3,
-    PUT     = 4
+    PUT     = 4,
+    WEBSOCKET = 5   // ws:// or wss:// session, see websocket.h
 } RequestType;
 
 typedef enum ContentType {
@@ -28,44 +33,198 @@ typedef enum ContentType {
     APPLICATION_JSON    = 1
 } ContentType;
 
+// Protocol asked for, stored with the History. HTTP_2 negotiates h2 with ALPN
+// over TLS (and tries an h2c upgrade over plaintext), HTTP_2_PRIOR_KNOWLEDGE
+// speaks h2c right away, for local plaintext services that support it.
+typedef enum HttpVersion {
+    HTTP_DEFAULT            = 0,
+    HTTP_1_1                = 1,
+    HTTP_2                  = 2,
+    HTTP_2_PRIOR_KNOWLEDGE  = 3
+} HttpVersion;
+
 typedef struct Argument { 
     pg::String name;
     pg::String value;
     int arg_type; // TODO: transform this to an ENUM soon!!!!
 } Argument; 
 
+// Argument as a History keeps it: interned, 12 bytes instead of two 4KB
+// strings. Argument stays the editable form (editors, environment, variables).
+typedef struct HistoryArgument {
+    pg::Atom name;
+    pg::Atom value;
+    int arg_type;
+} HistoryArgument;
+
+void internArguments(pg::Vector<HistoryArgument>& out, const pg::Vector<Argument>& args);
+void copyArguments(pg::Vector<Argument>& out, const pg::Vector<HistoryArgument>& args);
+
 
 typedef struct History {
+    pg::Atom url;
+    pg::Vector<HistoryArgument> args;
+    pg::Vector<HistoryArgument> headers;
+    pg::Vector<HistoryArgument> extract;   // name: variable, value: JSON Pointer into the response
+    pg::Vector<HistoryArgument> assertions;// checked on batch runs, arg_type is an AssertionType
+    pg::Body input_json;
+    pg::Body body_file;     // path of a file streamed as the body instead of input_json
+    uint64_t body_file_hash;// content hash of that file when sent, 0 when unknown
+    int64_t body_file_size;
+    pg::Body result;
+    RequestType req_type;
+    ContentType content_type;
+    HttpVersion http_version;
+    pg::Atom process_time;
+    time_t timestamp; // 0 for entries saved before it was recorded
+    int response_code;
+    int64_t duration_us; // curl total time, 0 when unknown
+    int response_version; // negotiated, 11 for HTTP/1.1, 20 for HTTP/2, 0 when unknown
+} History;
+
+// What is sent: a History (or the editor fields) with plain strings. Rendered
+// templates and cache validators only live in this form, they differ on every
+// send and the string table never frees.
+typedef struct Request {
     pg::String url;
     pg::Vector<Argument> args;
     pg::Vector<Argument> headers;
-    pg::String input_json;
-    pg::String result;
+    pg::Body input_json;
+    pg::Body body_file;
     RequestType req_type;
     ContentType content_type;
-    pg::String process_time;
-    int response_code;
-} History;
+    HttpVersion http_version;
+} Request;
+
+void historyRequest(Request& out, const History& hist);
+
+
+// Limits applied to a collection history after every request, 0 disables a rule.
+// max_entries and max_age_days drop whole entries, the other two only move
+// bodies to the cold store so the entry itself stays listed and searchable.
+typedef struct RetentionPolicy {
+    RetentionPolicy() { max_entries = 0; max_age_days = 0; max_body_kb = 0; memory_budget_mb = 0; }
+
+    int max_entries;
+    int max_age_days;
+    int max_body_kb;        // bodies bigger than this are evicted right away
+    int memory_budget_mb;   // resident body bytes, oldest entries are evicted first
+} RetentionPolicy;
 
 
 typedef struct Collection {
+    Collection() { dropped = 0; }
     pg::String name;
     pg::Vector<History> hist;
+    RetentionPolicy retention;
+    pg::Vector<Argument> environment;   // {{name}} values, see template.h
+    int64_t dropped;                    // entries retention removed from the front so far
 } Collection;
 
 
-void threadRequestGetDelete(std::atomic<ThreadStatus>& thread_status, RequestType reqType,  
-                      pg::String url, pg::Vector<Argument> args, pg::Vector<Argument> headers, 
-                      ContentType contentType, pg::String& thread_result, int& response_code);
+struct WriteThis {
+    const char *readptr;
+    size_t sizeleft;
+};
+
+typedef struct MemoryStruct {
+    MemoryStruct() { memory = (char*)malloc(1); memory[0] = '\0'; size = 0; capacity = 1; }
+    ~MemoryStruct() { free(memory); }
+
+    char *memory;
+    size_t size;
+    size_t capacity;
+} MemoryStruct;
+
+
+// The response headers the HTTP cache needs, from the last response of a
+// transfer (redirects reset them). Longer values are truncated.
+typedef struct ResponseHeaders {
+    char etag[256];
+    char last_modified[64];
+    char expires[64];
+    char cache_control[256];
+    char vary[256];
+} ResponseHeaders;
+
 
-void threadRequestPostPatchPut(std::atomic<ThreadStatus>& thread_status, RequestType reqType,
-                      pg::String url, pg::Vector<Argument> args, pg::Vector<Argument> headers, 
-                      ContentType contentType, const pg::String& inputJson, 
-                      pg::String& thread_result, int& response_code) ;
+// A Request compiled into a ready to perform curl handle: escaped URL, header
+// list, multipart form and options. prepareRequest only rebuilds it when the
+// Request fields it was built from change, so re-sending the same request (or
+// sending it in a loop) reuses everything, including the connection.
+struct PreparedRequest;
+void initPreparedRequest(PreparedRequest& req);
+void freePreparedRequest(PreparedRequest& req);
+
+typedef struct PreparedRequest {
+    PreparedRequest()   { initPreparedRequest(*this); }
+    ~PreparedRequest()  { freePreparedRequest(*this); }
+
+    CURL* curl;
+    struct curl_slist* header_list;
+    curl_mime* form;
+    pg::String url;
+    RequestType req_type;
+    uint64_t signature;         // requestSignature() of the Request it was built from
+    bool valid;
+    pg::Body body;              // request body, pinned while prepared
+    bool body_pinned;
+    MappedFile body_map;        // Request::body_file, streamed instead of body
+    uint64_t body_file_hash;    // filled in by threadRequest
+    WriteThis body_reader;
+    MemoryStruct response;      // reused between performs, only grows
+    ResponseHeaders response_headers;
+
+    // owns a curl handle, never copied (keep them in arrays, not pg::Vector)
+    PreparedRequest(const PreparedRequest&) = delete;
+    PreparedRequest& operator=(const PreparedRequest&) = delete;
+} PreparedRequest;
+
+uint64_t requestSignature(const Request& hist);
+
+// Returns true if the request had to be (re)built
+bool prepareRequest(PreparedRequest& req, const Request& hist);
+
+// Rewinds the request body and empties the response buffer, for callers driving
+// the handle themselves (curl multi)
+void resetPreparedRequest(PreparedRequest& req);
+
+CURLcode performPreparedRequest(PreparedRequest& req, int& response_code);
+
+// HTTP version of the last transfer of the handle: 10, 11, 20, 30 or 0
+int negotiatedHttpVersion(CURL* curl);
+
+// Lets the handles of a multi handle multiplex over one HTTP/2 connection per origin
+void enableMultiplexing(CURLM* multi);
+
+// For handles added to a multi handle together: when the Request may get
+// HTTP/2, a transfer waits for the connection being set up to its origin and
+// multiplexes on it instead of opening its own. Not for curl_easy_perform.
+void waitForMultiplexing(PreparedRequest& req, const Request& hist);
+
+// Connection cache, DNS cache and TLS sessions shared by easy handles performed
+// from several threads: a handle reuses a connection another one left idle
+// instead of opening its own. Attach after prepareRequest, which resets the handle.
+struct ConnectionShare;
+ConnectionShare* createConnectionShare();
+void freeConnectionShare(ConnectionShare* share);
+void attachConnectionShare(PreparedRequest& req, ConnectionShare* share);
+
+// Sends hist from the editor. With an enabled cache, GET responses are stored
+// and revalidated, see httpcache.h.
+struct HttpCache;
+void threadRequest(std::atomic<ThreadStatus>& thread_status, PreparedRequest& prepared, 
+                   Request hist, pg::Body& thread_result, int& response_code, int64_t& duration_us,
+                   int& response_version, HttpCache* cache);
 
 pg::String RequestTypeToString(RequestType req);
 
 pg::String ContentTypeToString(ContentType ct);
 
+const char* HttpVersionToString(HttpVersion version);
+
+// "HTTP/2" for 20, "HTTP/1.1" for 11, "" for 0
+const char* ResponseVersionToString(int version);
+
 pg::String prettify(pg::String input);
 
@@ -0,0 +1,74 @@
+#include "retention.h"
+
+
+static size_t residentBytes(const History& hist)
+{
+    size_t bytes = 0;
+    if (hist.input_json.resident()) bytes += (size_t)hist.input_json.length();
+    if (hist.result.resident()) bytes += (size_t)hist.result.length();
+    return bytes;
+}
+
+size_t collectionResidentBytes(const Collection& collection)
+{
+    size_t bytes = 0;
+    for (int i=0; i<collection.hist.size(); i++)
+        bytes += residentBytes(collection.hist[i]);
+    return bytes;
+}
+
+int applyRetention(Collection& collection, time_t now)
+{
+    const RetentionPolicy& policy = collection.retention;
+    pg::Vector<History>& hist = collection.hist;
+    int dropped = 0;
+
+    // History is in insertion order, so everything too old sits at the front
+    if (policy.max_age_days > 0) {
+        time_t oldest = now - (time_t)policy.max_age_days * 24 * 60 * 60;
+        int count = 0;
+        while (count < hist.size() && hist[count].timestamp != 0 && hist[count].timestamp < oldest)
+            count++;
+        if (count > 0) {
+            hist.erase(hist.begin(), hist.begin() + count);
+            dropped += count;
+        }
+    }
+
+    if (policy.max_entries > 0 && hist.size() > policy.max_entries) {
+        int count = hist.size() - policy.max_entries;
+        hist.erase(hist.begin(), hist.begin() + count);
+        dropped += count;
+    }
+
+    collection.dropped += dropped;
+
+    if (policy.max_body_kb > 0) {
+        int max_bytes = policy.max_body_kb * 1024;
+        for (int i=0; i<hist.size(); i++) {
+            if (hist[i].input_json.resident() && hist[i].input_json.length() > max_bytes)
+                bodyEvict(hist[i].input_json);
+            if (hist[i].result.resident() && hist[i].result.length() > max_bytes)
+                bodyEvict(hist[i].result);
+        }
+    }
+
+    if (policy.memory_budget_mb > 0) {
+        size_t budget = (size_t)policy.memory_budget_mb * 1024 * 1024;
+        size_t bytes = collectionResidentBytes(collection);
+        // never evict the newest entry, it is the one the user is looking at
+        for (int i=0; i<hist.size()-1 && bytes > budget; i++) {
+            size_t entry_bytes = residentBytes(hist[i]);
+            if (entry_bytes == 0) continue;
+            bool shared = (hist[i].input_json.entry_ && hist[i].input_json.entry_->refcount > 1) ||
+                          (hist[i].result.entry_ && hist[i].result.entry_->refcount > 1);
+            bodyEvict(hist[i].input_json);
+            bodyEvict(hist[i].result);
+            // a shared body also went cold for every other entry using it
+            if (shared) bytes = collectionResidentBytes(collection);
+            else bytes -= entry_bytes - residentBytes(hist[i]);
+        }
+    }
+
+    return dropped;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <time.h>
+#include "requests.h"
+
+
+// Applies collection.retention to its history. Must only run while no request
+// is in flight for this collection. Returns how many entries were dropped from
+// the front of the history, so callers can fix up indices into it.
+int applyRetention(Collection& collection, time_t now);
+
+// Bytes held in memory by the bodies this collection references. Bodies shared
+// between entries are counted once per entry, like the budget does.
+size_t collectionResidentBytes(const Collection& collection);
@@ -0,0 +1,280 @@
+#include <sys/time.h>
+#include "runner.h"
+#include "template.h"
+#include "profiler.h"
+#include "rapidjson/pointer.h"
+#include "rapidjson/writer.h"
+#include "imgui.h"
+
+
+static int64_t nowUs()
+{
+    struct timeval timecheck;
+    gettimeofday(&timecheck, NULL);
+    return (int64_t)timecheck.tv_sec * 1000000 + (int64_t)timecheck.tv_usec;
+}
+
+static void collectNames(const char* text, pg::Vector<pg::String>& names)
+{
+    const char* name;
+    int name_len;
+    const char* p = text;
+    while ((p = findPlaceholder(p, &name, &name_len))) {
+        names.push_back(pg::String(name, name_len));
+        p = name + name_len + 2;
+    }
+}
+
+void findVariables(const History& hist, pg::Vector<pg::String>& names)
+{
+    collectNames(hist.url.buf(), names);
+    for (int i=0; i<hist.args.size(); i++)
+        collectNames(hist.args[i].value.buf(), names);
+    for (int i=0; i<hist.headers.size(); i++)
+        collectNames(hist.headers[i].value.buf(), names);
+    collectNames(hist.input_json.buf(), names);
+}
+
+static void valueToString(const rapidjson::Value& value, pg::String& out)
+{
+    if (value.IsString()) {
+        out = pg::String(value.GetString(), (int)value.GetStringLength());
+        return;
+    }
+    rapidjson::StringBuffer sb;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+    value.Accept(writer);
+    out = pg::String(sb.GetString(), (int)sb.GetSize());
+}
+
+static void extractVariables(RunStep& step, const History& hist, const MemoryStruct& response)
+{
+    if (hist.extract.size() == 0) return;
+    rapidjson::Document document;
+    if (document.Parse(response.memory, response.size).HasParseError()) {
+        step.failed = true;
+        step.error = "Response is not JSON, nothing to extract";
+        return;
+    }
+    for (int i=0; i<hist.extract.size(); i++) {
+        const rapidjson::Value* value = rapidjson::Pointer(hist.extract[i].value.buf()).Get(document);
+        if (value == NULL) {
+            step.failed = true;
+            step.error = pg::String("Not found: ");
+            step.error.append(hist.extract[i].value.buf());
+            continue;
+        }
+        Argument var;
+        var.name = pg::String(hist.extract[i].name.buf());
+        var.arg_type = 0;
+        valueToString(*value, var.value);
+        step.variables.push_back(var);
+    }
+}
+
+static void runStep(void* data)
+{
+    TRACE_SCOPE("runner step");
+    RunStep& step = *(RunStep*)data;
+    CollectionRun& run = *step.run;
+    const History& hist = run.hist[step.index];
+
+    // extracted variables override the environment, rendering searches from the back
+    pg::Vector<Argument> vars = run.environment;
+    bool skip = run.cancel;
+    for (int i=0; i<step.depends.size(); i++) {
+        const RunStep& dep = run.steps[step.depends[i]];
+        if (dep.failed) skip = true;
+        for (int k=0; k<dep.variables.size(); k++)
+            vars.push_back(dep.variables[k]);
+    }
+
+    step.start_us = nowUs() - run.start_us;
+    if (skip) {
+        step.failed = true;
+        step.error = run.cancel ? "Cancelled" : "Skipped, a dependency failed";
+    } else {
+        TemplateContext ctx;
+        ctx.environment = &vars;
+        ctx.sequence = step.index;
+        PreparedRequest prepared;
+        prepareRequest(prepared, renderRequest(hist, ctx));
+        attachConnectionShare(prepared, run.share);
+        CURLcode res = prepared.valid ? performPreparedRequest(prepared, step.response_code) : CURLE_BAD_FUNCTION_ARGUMENT;
+        if (res != CURLE_OK) {
+            step.failed = true;
+            step.error = pg::String(curl_easy_strerror(res));
+        } else {
+            curl_off_t latency_us = 0;
+            curl_easy_getinfo(prepared.curl, CURLINFO_TOTAL_TIME_T, &latency_us);
+            step.checks_failed = checkAssertions(step.checks, step.response_code, prepared.response.memory,
+                                                 prepared.response.size, (int64_t)latency_us, &run.checks, &step.check_failure);
+            extractVariables(step, hist, prepared.response);
+        }
+    }
+    step.end_us = nowUs() - run.start_us;
+
+    for (int i=0; i<step.dependents.size(); i++) {
+        RunStep& next = run.steps[step.dependents[i]];
+        if (--next.unresolved == 0) {
+            next.ready_us = nowUs() - run.start_us;
+            jobPoolSubmit(run.pool, runStep, &next);
+        }
+    }
+    if (--run.remaining == 0)
+        run.status = FINISHED;
+}
+
+bool startCollectionRun(CollectionRun& run, const Collection& collection)
+{
+    if (run.status != IDLE || collection.hist.size() == 0)
+        return false;
+
+    if (run.steps) delete [] run.steps;
+    run.hist = collection.hist;
+    run.environment = collection.environment;
+    run.num_steps = run.hist.size();
+    run.steps = new RunStep[run.num_steps];
+    run.cancel = false;
+    run.total_us = run.serial_us = run.critical_us = 0;
+    run.checks.reset();
+
+    // The latest earlier step extracting a variable is the one a later step waits for
+    pg::Vector<pg::String> names;
+    for (int i=0; i<run.num_steps; i++) {
+        RunStep& step = run.steps[i];
+        step.run = &run;
+        step.index = i;
+        step.response_code = 0;
+        step.failed = false;
+        step.critical = false;
+        step.ready_us = step.start_us = step.end_us = 0;
+        step.checks = compileAssertions(run.hist[i].assertions);
+
+        names.clear();
+        findVariables(run.hist[i], names);
+        for (int n=0; n<names.size(); n++) {
+            for (int j=i-1; j>=0; j--) {
+                bool produces = false;
+                for (int k=0; k<run.hist[j].extract.size() && !produces; k++)
+                    produces = strcmp(run.hist[j].extract[k].name.buf(), names[n].buf_) == 0;
+                if (!produces) continue;
+                if (!step.depends.contains(j)) {
+                    step.depends.push_back(j);
+                    run.steps[j].dependents.push_back(i);
+                }
+                break;
+            }
+        }
+        step.unresolved = step.depends.size();
+    }
+
+    run.remaining = run.num_steps;
+    run.status = RUNNING;
+    run.pool = jobPoolCreate(run.num_threads);
+    run.share = createConnectionShare();
+    run.start_us = nowUs();
+    for (int i=0; i<run.num_steps; i++) {
+        if (run.steps[i].depends.size() == 0)
+            jobPoolSubmit(run.pool, runStep, &run.steps[i]);
+    }
+    return true;
+}
+
+void updateCollectionRun(CollectionRun& run)
+{
+    if (run.status != FINISHED) return;
+    jobPoolDestroy(run.pool);
+    run.pool = NULL;
+    freeConnectionShare(run.share);
+    run.share = NULL;
+
+    // Steps only depend on earlier ones, so walking backwards from the step that
+    // ended last through the dependency that ended last gives the critical path
+    int last = 0;
+    for (int i=0; i<run.num_steps; i++) {
+        RunStep& step = run.steps[i];
+        run.serial_us += step.end_us - step.start_us;
+        if (step.end_us > run.steps[last].end_us) last = i;
+        if (step.end_us > run.total_us) run.total_us = step.end_us;
+    }
+    int curr = last;
+    while (curr >= 0) {
+        RunStep& step = run.steps[curr];
+        step.critical = true;
+        run.critical_us += step.end_us - step.start_us;
+        int gate = -1;
+        for (int i=0; i<step.depends.size(); i++) {
+            if (gate < 0 || run.steps[step.depends[i]].end_us > run.steps[gate].end_us)
+                gate = step.depends[i];
+        }
+        curr = gate;
+    }
+    run.status = IDLE;
+}
+
+bool collectionRunWindow(bool* open, CollectionRun& run)
+{
+    bool start = false;
+    ImGui::Begin("Collection Runner", open);
+    bool running = run.status != IDLE;
+
+    ImGui::PushItemWidth(ImGui::GetFontSize() * 8);
+    ImGui::InputInt("Parallel requests", &run.num_threads);
+    ImGui::PopItemWidth();
+    if (run.num_threads < 1) run.num_threads = 1;
+
+    if (running) {
+        if (ImGui::Button("Stop")) run.cancel = true;
+        ImGui::SameLine();
+        ImGui::ProgressBar(1.0f - (float)run.remaining / (float)run.num_steps, ImVec2(-1.0f, 0.0f));
+    } else {
+        start = ImGui::Button("Run current collection");
+        if (run.num_steps > 0) {
+            ImGui::Text("Wall time %.1f ms, serial %.1f ms, critical path %.1f ms (speedup %.2fx)",
+                        run.total_us / 1000.0, run.serial_us / 1000.0, run.critical_us / 1000.0,
+                        run.total_us > 0 ? (double)run.serial_us / run.total_us : 0.0);
+            if (run.checks.passed + run.checks.failed > 0)
+                ImGui::Text("Checks: %d requests passed, %d failed", (int)run.checks.passed, (int)run.checks.failed);
+        }
+    }
+
+    if (!running && run.num_steps > 0 && ImGui::BeginTable("##steps", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable)) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn("#");
+        ImGui::TableSetupColumn("Request");
+        ImGui::TableSetupColumn("Depends on");
+        ImGui::TableSetupColumn("Wait (ms)");
+        ImGui::TableSetupColumn("Duration (ms)");
+        ImGui::TableSetupColumn("Result");
+        ImGui::TableHeadersRow();
+
+        ImGuiListClipper clipper;
+        clipper.Begin(run.num_steps);
+        while (clipper.Step()) {
+            for (int i=clipper.DisplayStart; i<clipper.DisplayEnd; i++) {
+                const RunStep& step = run.steps[i];
+                ImGui::TableNextRow();
+                if (step.critical)
+                    ImGui::TableSetBgColor(ImGuiTableBgTarget_RowBg1, IM_COL32(100,0,255,60));
+                ImGui::TableNextColumn(); ImGui::Text("%d%s", i, step.critical ? " *" : "");
+                ImGui::TableNextColumn(); ImGui::TextUnformatted(run.hist[i].url.buf());
+                ImGui::TableNextColumn();
+                for (int d=0; d<step.depends.size(); d++) {
+                    if (d > 0) ImGui::SameLine(0, 0);
+                    ImGui::Text(d > 0 ? ", %d" : "%d", step.depends[d]);
+                }
+                ImGui::TableNextColumn(); ImGui::Text("%.1f", (step.start_us - step.ready_us) / 1000.0);
+                ImGui::TableNextColumn(); ImGui::Text("%.1f", (step.end_us - step.start_us) / 1000.0);
+                ImGui::TableNextColumn();
+                if (step.failed) ImGui::TextUnformatted(step.error.buf_);
+                else if (step.checks_failed) ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%d, %d checks failed: %s",
+                                                                step.response_code, step.checks_failed, step.check_failure.buf_);
+                else ImGui::Text("%d", step.response_code);
+            }
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+    return start;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include "requests.h"
+#include "jobs.h"
+#include "assertions.h"
+
+// Collection runner: replays every History of a collection as one workflow.
+// A request that uses a {{variable}} extracted (History::extract) from an
+// earlier response depends on that request, everything else is independent.
+// Ready requests run in parallel on a dedicated work-stealing pool; when one
+// finishes, it submits the dependents it unblocked from its own worker. Steps
+// share one connection cache, a step reuses the connection an earlier one to
+// the same origin left idle.
+
+struct CollectionRun;
+
+typedef struct RunStep {
+    RunStep()   { checks = NULL; checks_failed = 0; }
+    ~RunStep()  { freeAssertions(checks); }
+
+    CollectionRun* run;
+    int index;
+    pg::Vector<int> depends;        // steps whose variables this one uses
+    pg::Vector<int> dependents;
+    std::atomic<int> unresolved;
+    pg::Vector<Argument> variables; // extracted from this step's response
+    int64_t ready_us;               // times relative to the start of the run
+    int64_t start_us;
+    int64_t end_us;
+    int response_code;
+    bool failed;
+    pg::String error;
+    bool critical;                  // on the critical path of the run
+    AssertionSet* checks;           // compiled History::assertions
+    int checks_failed;
+    pg::String check_failure;       // first failed check
+} RunStep;
+
+typedef struct CollectionRun {
+    CollectionRun() { steps = NULL; num_steps = 0; pool = NULL; share = NULL; status = IDLE; cancel = false; num_threads = 8; }
+    ~CollectionRun() { if (steps) delete [] steps; }
+
+    pg::Vector<History> hist;       // snapshot of the collection being run
+    pg::Vector<Argument> environment;
+    RunStep* steps;
+    int num_steps;
+    int num_threads;
+    JobPool* pool;
+    ConnectionShare* share;
+    std::atomic<int> remaining;
+    std::atomic<ThreadStatus> status;
+    std::atomic<bool> cancel;
+    int64_t start_us;
+    AssertionStats checks;
+
+    // filled in by updateCollectionRun
+    int64_t total_us;               // wall clock
+    int64_t serial_us;              // sum of every step duration
+    int64_t critical_us;            // sum of the durations on the critical path
+} CollectionRun;
+
+// Extracts the {{names}} used by a History, in order of appearance
+void findVariables(const History& hist, pg::Vector<pg::String>& names);
+
+bool startCollectionRun(CollectionRun& run, const Collection& collection);
+
+// Call every frame: once the run is FINISHED it builds the report and releases the pool
+void updateCollectionRun(CollectionRun& run);
+
+// Draws the runner window, returns true when the user asked to run the current collection
+bool collectionRunWindow(bool* open, CollectionRun& run);
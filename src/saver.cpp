@@ -0,0 +1,190 @@
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include "saver.h"
+#include "utils.h"
+#include "pghash.h"
+
+
+// A changed collection as the saver receives it: all of it, or only what
+// changed since the previous snapshot of the same collection, which is the
+// usual case of a request appended and retention dropping from the front
+typedef struct SaveSnapshot {
+    int index;
+    bool full;
+    int dropped;                // from the front of the mirror, when not full
+    Collection collection;      // hist only holds the appended entries when not full
+} SaveSnapshot;
+
+// What the saver was last sent of a collection, to tell an append from an edit
+typedef struct SaveTrack {
+    int entries;                // 0 when nothing was sent yet
+    int64_t dropped;            // Collection::dropped at that time
+    uint64_t last;              // fingerprint of the last entry sent
+} SaveTrack;
+
+static std::mutex save_mutex;
+static std::condition_variable save_cv;
+static std::thread* save_thread = NULL;
+static pg::String save_filename;
+static bool save_quit = false;
+static bool save_writing = false;
+
+// Guarded by save_mutex: snapshots not yet applied to the mirror
+static pg::Vector<SaveSnapshot> pending;
+static int pending_num_collections = -1;
+static std::chrono::steady_clock::time_point last_request;
+
+// UI thread only: how many collections the saver knows about
+static int known_collections = 0;
+static pg::Vector<SaveTrack> tracks;
+
+// Saver thread only
+static pg::Vector<Collection> mirror;
+
+
+static void saverLoop()
+{
+    std::unique_lock<std::mutex> lock(save_mutex);
+    for (;;) {
+        while (pending_num_collections < 0 && !save_quit)
+            save_cv.wait(lock);
+        if (pending_num_collections < 0)
+            return;
+
+        // debounce: wait until requests stop coming for a while
+        while (!save_quit) {
+            std::chrono::steady_clock::time_point deadline = last_request + std::chrono::milliseconds(SAVE_DEBOUNCE_MS);
+            if (save_cv.wait_until(lock, deadline) == std::cv_status::timeout &&
+                std::chrono::steady_clock::now() >= last_request + std::chrono::milliseconds(SAVE_DEBOUNCE_MS))
+                break;
+        }
+
+        pg::Vector<SaveSnapshot> snapshots;
+        snapshots.swap(pending);
+        int num_collections = pending_num_collections;
+        pending_num_collections = -1;
+        save_writing = true;
+        lock.unlock();
+
+        if (mirror.size() < num_collections)
+            mirror.resize(num_collections);
+        else if (mirror.size() > num_collections)
+            mirror.erase(mirror.begin() + num_collections, mirror.end());
+        for (int i=0; i<snapshots.size(); i++) {
+            SaveSnapshot& snapshot = snapshots[i];
+            Collection& target = mirror[snapshot.index];
+            if (snapshot.full) {
+                target = snapshot.collection;
+                continue;
+            }
+            target.name = snapshot.collection.name;
+            target.retention = snapshot.collection.retention;
+            target.environment = snapshot.collection.environment;
+            target.dropped = snapshot.collection.dropped;
+            if (snapshot.dropped > 0)
+                target.hist.erase(target.hist.begin(), target.hist.begin() + snapshot.dropped);
+            for (int j=0; j<snapshot.collection.hist.size(); j++)
+                target.hist.push_back(snapshot.collection.hist[j]);
+        }
+        snapshots.clear();
+
+        if (!saveCollection(mirror, save_filename))
+            fprintf(stderr, "Could not save %s\n", save_filename.buf_);
+        else
+            bodySweepColdStore();   // the mirror still holds every body it saved
+
+        lock.lock();
+        save_writing = false;
+    }
+}
+
+void saverInit(const pg::String& filename)
+{
+    save_filename = filename;
+    save_quit = false;
+    known_collections = 0;
+    tracks.clear();
+    save_thread = new std::thread(saverLoop);
+}
+
+void saverShutdown()
+{
+    if (save_thread == NULL) return;
+    {
+        std::lock_guard<std::mutex> lock(save_mutex);
+        save_quit = true;
+    }
+    save_cv.notify_all();
+    save_thread->join();
+    delete save_thread;
+    save_thread = NULL;
+    mirror.clear();
+}
+
+static uint64_t entryFingerprint(const History& hist)
+{
+    uint64_t fields[4] = {hist.input_json.hash(), hist.result.hash(), hist.url.id(), (uint64_t)hist.response_code};
+    return pg::hash64(fields, sizeof(fields), (uint64_t)hist.timestamp);
+}
+
+// Fills in the snapshot of collection, only the appended entries when the
+// history changed by appending and dropping from the front since the last one
+static void takeSnapshot(SaveSnapshot& snapshot, const Collection& collection, SaveTrack& track)
+{
+    const pg::Vector<History>& hist = collection.hist;
+    int64_t dropped = collection.dropped - track.dropped;
+    int kept = track.entries - (int)dropped;
+    snapshot.full = track.entries == 0 || dropped < 0 || kept < 1 || kept > hist.size() ||
+                    entryFingerprint(hist[kept-1]) != track.last;
+    snapshot.dropped = snapshot.full ? 0 : (int)dropped;
+    snapshot.collection.name = collection.name;
+    snapshot.collection.retention = collection.retention;
+    snapshot.collection.environment = collection.environment;
+    snapshot.collection.dropped = collection.dropped;
+    if (snapshot.full) {
+        snapshot.collection.hist = hist;
+    } else {
+        snapshot.collection.hist.reserve(hist.size() - kept);
+        for (int j=kept; j<hist.size(); j++)
+            snapshot.collection.hist.push_back(hist[j]);
+    }
+    track.entries = hist.size();
+    track.dropped = collection.dropped;
+    track.last = hist.size() > 0 ? entryFingerprint(hist.back()) : 0;
+}
+
+void saveCollectionAsync(const pg::Vector<Collection>& collection, int changed)
+{
+    std::lock_guard<std::mutex> lock(save_mutex);
+    if (changed < 0 || tracks.size() != collection.size()) {
+        // a collection that is new to the saver, in another place or just
+        // loaded is sent whole
+        tracks.resize(collection.size());
+        for (int i=0; i<tracks.size(); i++) tracks[i].entries = 0;
+    }
+    for (int i=0; i<collection.size(); i++) {
+        if (changed >= 0 && i != changed && i < known_collections)
+            continue;
+        pending.resize(pending.size()+1);
+        SaveSnapshot& snapshot = pending.back();
+        snapshot.index = i;
+        takeSnapshot(snapshot, collection[i], tracks[i]);
+        if (snapshot.full) {
+            // replaces whatever is still queued for it
+            for (int p=pending.size()-2; p>=0; p--)
+                if (pending[p].index == i) pending.erase(pending.begin() + p);
+        }
+    }
+    known_collections = collection.size();
+    pending_num_collections = collection.size();
+    last_request = std::chrono::steady_clock::now();
+    save_cv.notify_all();
+}
+
+bool saverBusy()
+{
+    std::lock_guard<std::mutex> lock(save_mutex);
+    return save_writing || pending_num_collections >= 0;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "requests.h"
+
+// Background saving of the collections file. The UI thread only snapshots the
+// collections that changed, a saver thread keeps a mirror of all of them and
+// writes it out with saveCollection. Requests arriving within SAVE_DEBOUNCE_MS
+// of each other are coalesced into a single write.
+
+#define SAVE_DEBOUNCE_MS 500
+
+void saverInit(const pg::String& filename);
+
+// Writes whatever is still pending, then stops the saver thread
+void saverShutdown();
+
+// Queues a save after collection[changed] was modified, -1 when they all were
+void saveCollectionAsync(const pg::Vector<Collection>& collection, int changed);
+
+bool saverBusy();
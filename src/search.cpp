@@ -0,0 +1,390 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <atomic>
+#include "search.h"
+#include "assertions.h"
+#include "jobs.h"
+#include "pghash.h"
+#include "profiler.h"
+#include "mmapfile.h"
+#include "rapidjson/internal/regex.h"
+
+typedef struct SearchEntry {
+    int collection;
+    int index;
+    pg::Atom url;       // interned, safe to read from the jobs
+    int input, result;  // in SearchRun::bodies, -1 when empty
+    bool known;         // a hit from the cache, not tested again
+} SearchEntry;
+
+// What the run covers of one collection, written to its cache once it finished
+typedef struct SearchScope {
+    int collection;
+    int cache;          // in HistorySearch::cache
+    int entries;
+    uint64_t first, last;
+} SearchScope;
+
+typedef struct SearchSlice {
+    SearchRun* run;
+    int begin, end;                 // entries
+    pg::Vector<SearchHit> hits;     // written by the job until done
+    std::atomic<bool> done;
+} SearchSlice;
+
+struct SearchRun {
+    SearchRun() { cancel = false; regex = NULL; body_state = NULL; slices = NULL; num_slices = 0; next_slice = 0; start_us = 0; }
+    ~SearchRun() { delete regex; delete [] body_state; delete [] slices; }
+
+    std::atomic<bool> cancel;
+    JobGroup group;
+    rapidjson::internal::Regex* regex;  // NULL for a plain query
+    pg::Vector<char> needle;            // plain query, lower case
+    pg::String query;                   // as the caches keep it
+    bool is_regex;
+    pg::Vector<SearchScope> scopes;     // by collection, from the first searched
+
+    // snapshot, read only while the jobs run
+    pg::Vector<SearchEntry> entries;
+    pg::Vector<pg::Body> bodies;        // distinct
+    pg::Vector<char> body_cold;         // read from the cold store file, never made resident
+    std::atomic<char>* body_state;      // 0 not searched yet, 1 match, 2 no match, 3 unreadable
+
+    SearchSlice* slices;
+    int num_slices;
+    int next_slice;                     // UI thread, first slice whose hits were not taken yet
+    int64_t start_us;
+};
+
+// Feeds a sized buffer to the regex, which stops at the first '\0'
+typedef struct BoundedStream {
+    typedef char Ch;
+    BoundedStream(const char* begin, const char* end) : p(begin), e(end), b(begin) {}
+    Ch Peek() const { return p < e ? *p : '\0'; }
+    Ch Take() { return p < e ? *p++ : '\0'; }
+    size_t Tell() const { return (size_t)(p - b); }
+    const char* p;
+    const char* e;
+    const char* b;
+} BoundedStream;
+
+
+static int64_t nowUs()
+{
+    struct timeval timecheck;
+    gettimeofday(&timecheck, NULL);
+    return (int64_t)timecheck.tv_sec * 1000000 + (int64_t)timecheck.tv_usec;
+}
+
+static inline char lowerAscii(char c)
+{
+    return c >= 'A' && c <= 'Z' ? (char)(c + ('a' - 'A')) : c;
+}
+
+// Case insensitive (ASCII) substring search, needle in lower case. Candidates
+// for the first byte are found with memchr for both of its cases, each
+// position is only scanned once per case.
+static bool containsFolded(const char* hay, int size, const char* needle, int len)
+{
+    if (len == 0) return true;
+    if (size < len) return false;
+    const char* last = hay + size - len;
+    const char lo = needle[0];
+    const char up = lo >= 'a' && lo <= 'z' ? (char)(lo - ('a' - 'A')) : lo;
+    const char* next_lo = (const char*)memchr(hay, lo, (size_t)(last - hay) + 1);
+    const char* next_up = up != lo ? (const char*)memchr(hay, up, (size_t)(last - hay) + 1) : NULL;
+    while (next_lo || next_up) {
+        const char* p = !next_up || (next_lo && next_lo < next_up) ? next_lo : next_up;
+        int i = 1;
+        while (i < len && lowerAscii(p[i]) == needle[i]) i++;
+        if (i == len) return true;
+        if (p == last) return false;
+        if (p == next_lo) next_lo = (const char*)memchr(p + 1, lo, (size_t)(last - p));
+        else next_up = (const char*)memchr(p + 1, up, (size_t)(last - p));
+    }
+    return false;
+}
+
+static bool textMatches(SearchRun& run, rapidjson::internal::RegexSearch* regex, const char* text, int size)
+{
+    if (regex) {
+        BoundedStream stream(text, text + size);
+        return regex->Search(stream);
+    }
+    return containsFolded(text, size, run.needle.begin(), run.needle.size());
+}
+
+static bool bodyMatches(SearchRun& run, rapidjson::internal::RegexSearch* regex, int b)
+{
+    char state = run.body_state[b].load(std::memory_order_relaxed);
+    if (state) return state == 1;
+    state = 2;
+    // two jobs may search the same body at once, they agree on the answer
+    const pg::Body& body = run.bodies[b];
+    bool match = false;
+    if (run.body_cold[b]) {
+        // mapped and dropped again, a search over gigabytes of cold bodies must
+        // not pull them back into memory. The snapshot handle keeps the file.
+        char path[256];
+        bodyColdPath(body.hash(), path, sizeof(path));
+        MappedFile file;
+        if (!body.missing() && mapFile(file, path, true) && file.size == (size_t)body.length())
+            match = textMatches(run, regex, file.data, (int)file.size);
+        else
+            state = 3;
+        unmapFile(file);
+    } else {
+        const char* data = body.pin();
+        match = textMatches(run, regex, data, body.length());
+        body.unpin();
+    }
+    run.body_state[b].store(match ? 1 : state, std::memory_order_relaxed);
+    return match;
+}
+
+static void searchSlice(void* data)
+{
+    SearchSlice& slice = *(SearchSlice*)data;
+    SearchRun& run = *slice.run;
+    TRACE_SCOPE("search");
+    rapidjson::internal::RegexSearch* regex = run.regex ? new rapidjson::internal::RegexSearch(*run.regex) : NULL;
+    for (int e=slice.begin; e<slice.end; e++) {
+        if (run.cancel.load(std::memory_order_relaxed)) break;
+        const SearchEntry& entry = run.entries[e];
+        if (entry.known ||
+            textMatches(run, regex, entry.url.buf(), entry.url.length()) ||
+            (entry.input >= 0 && bodyMatches(run, regex, entry.input)) ||
+            (entry.result >= 0 && bodyMatches(run, regex, entry.result)))
+        {
+            SearchHit hit;
+            hit.collection = entry.collection;
+            hit.index = entry.index;
+            slice.hits.push_back(hit);
+        }
+    }
+    delete regex;
+    slice.done.store(true, std::memory_order_release);
+}
+
+
+// Index of the body in run.bodies, added on first sight. table maps the
+// content hash to index + 1 and is grown to stay at most half full.
+static int snapshotBody(SearchRun& run, pg::Vector<int>& table, const pg::Body& body)
+{
+    // a missing body reads as empty, it is kept to be counted as not searched
+    if (body.length() == 0 && !body.missing()) return -1;
+    if ((run.bodies.size() + 1) * 2 > table.size()) {
+        int size = table.size() ? table.size() * 2 : 1024;
+        table.clear();
+        table.resize(size, 0);
+        for (int i=0; i<run.bodies.size(); i++) {
+            int slot = (int)(run.bodies[i].hash() & (uint64_t)(size-1));
+            while (table[slot] != 0) slot = (slot + 1) & (size-1);
+            table[slot] = i + 1;
+        }
+    }
+    int mask = table.size() - 1;
+    int slot = (int)(body.hash() & (uint64_t)mask);
+    for (; table[slot] != 0; slot = (slot + 1) & mask) {
+        if (run.bodies[table[slot] - 1] == body) return table[slot] - 1;
+    }
+    table[slot] = run.bodies.size() + 1;
+    run.bodies.push_back(body);
+    run.body_cold.push_back(body.resident() ? 0 : 1);
+    return run.bodies.size() - 1;
+}
+
+static void addEntry(SearchRun& run, pg::Vector<int>& table, const History& hist, int c, int i, bool known)
+{
+    SearchEntry entry;
+    entry.collection = c;
+    entry.index = i;
+    entry.known = known;
+    entry.url = hist.url;
+    entry.input = known ? -1 : snapshotBody(run, table, hist.input_json);
+    entry.result = known ? -1 : snapshotBody(run, table, hist.result);
+    run.entries.push_back(entry);
+}
+
+static uint64_t entryFingerprint(const History& hist)
+{
+    uint64_t fields[3] = {hist.input_json.hash(), hist.result.hash(), hist.url.id()};
+    return pg::hash64(fields, sizeof(fields), (uint64_t)hist.timestamp);
+}
+
+static int findCache(HistorySearch& search, int collection)
+{
+    for (int i=0; i<search.cache.size(); i++)
+        if (search.cache[i].collection == collection) return i;
+    SearchCache cache;
+    cache.collection = collection;
+    cache.regex = false;
+    cache.entries = 0;
+    cache.first = cache.last = 0;
+    search.cache.push_back(cache);
+    return search.cache.size() - 1;
+}
+
+static void retire(HistorySearch& search)
+{
+    if (search.run == NULL) return;
+    search.run->cancel = true;
+    search.retired.push_back(search.run);
+    search.run = NULL;
+}
+
+// Every hit is in search.hits, they become the caches of the searched collections
+static void finishRun(HistorySearch& search)
+{
+    SearchRun* run = search.run;
+    for (int s=0; s<run->scopes.size(); s++) {
+        const SearchScope& scope = run->scopes[s];
+        SearchCache& cache = search.cache[scope.cache];
+        cache.query = run->query;
+        cache.regex = run->is_regex;
+        cache.entries = scope.entries;
+        cache.first = scope.first;
+        cache.last = scope.last;
+        cache.hits.resize(0);
+    }
+    // hits come grouped by collection, in scope order
+    int first = run->scopes[0].collection;
+    for (int h=0; h<search.hits.size(); h++)
+        search.cache[run->scopes[search.hits[h].collection - first].cache].hits.push_back(search.hits[h].index);
+    // the snapshot would otherwise keep deleted bodies alive
+    search.elapsed_us = nowUs() - run->start_us;
+    search.not_searched = 0;
+    for (int b=0; b<run->bodies.size(); b++)
+        if (run->body_state && run->body_state[b].load() == 3) search.not_searched++;
+    retire(search);
+}
+
+void startHistorySearch(HistorySearch& search, const pg::Vector<Collection>& collection, int only,
+                        const char* query, bool regex)
+{
+    PROFILE_SCOPE(PHASE_SEARCH);
+    cancelHistorySearch(search);
+
+    SearchRun* run = new SearchRun();
+    run->start_us = nowUs();
+    if (regex) {
+        if (regexGroupsBalanced(query)) run->regex = new rapidjson::internal::Regex(query);
+        if (run->regex == NULL || !run->regex->IsValid()) {
+            snprintf(search.error, sizeof(search.error), "Invalid regex");
+            delete run;
+            return;
+        }
+        run->query = pg::String(query);
+    } else {
+        for (const char* c = query; *c; c++) run->needle.push_back(lowerAscii(*c));
+        run->query = pg::String(query);
+        for (char* c = run->query.buf_; *c; c++) *c = lowerAscii(*c);
+    }
+    run->is_regex = regex;
+
+    int first = only < 0 ? 0 : only;
+    int last = only < 0 ? collection.size() - 1 : only;
+    int total = 0;
+    for (int c=first; c<=last; c++) total += collection[c].hist.size();
+    run->entries.reserve(total);
+    pg::Vector<int> table;
+    search.tested = 0;
+    for (int c=first; c<=last; c++) {
+        const pg::Vector<History>& hist = collection[c].hist;
+        SearchScope scope;
+        scope.collection = c;
+        scope.cache = findCache(search, c);
+        scope.entries = hist.size();
+        scope.first = hist.size() > 0 ? entryFingerprint(hist[0]) : 0;
+        scope.last = hist.size() > 0 ? entryFingerprint(hist.back()) : 0;
+        run->scopes.push_back(scope);
+
+        const SearchCache& cache = search.cache[scope.cache];
+        bool valid = cache.entries <= hist.size() && (cache.entries == 0 ||
+                     (entryFingerprint(hist[0]) == cache.first && entryFingerprint(hist[cache.entries-1]) == cache.last));
+        bool same = valid && cache.regex == regex && strcmp(cache.query.buf_, run->query.buf_) == 0;
+        // every hit of a longer plain query is a hit of the cached one
+        bool refine = valid && !regex && !cache.regex && cache.query.length() > 0 &&
+                      containsFolded(run->query.buf_, run->query.length(), cache.query.buf_, cache.query.length());
+        int from = same || refine ? cache.entries : 0;
+        for (int i=hist.size()-1; i>=from; i--)
+            addEntry(*run, table, hist[i], c, i, false);
+        if (same || refine) {
+            for (int h=0; h<cache.hits.size(); h++)
+                addEntry(*run, table, hist[cache.hits[h]], c, cache.hits[h], same);
+        }
+        search.tested += hist.size() - from + (refine && !same ? cache.hits.size() : 0);
+    }
+    search.run = run;
+    if (search.tested == 0) {
+        // all known, no job to wait for
+        for (int e=0; e<run->entries.size(); e++) {
+            SearchHit hit = {run->entries[e].collection, run->entries[e].index};
+            search.hits.push_back(hit);
+        }
+        finishRun(search);
+        return;
+    }
+
+    run->body_state = new std::atomic<char>[run->bodies.size() > 0 ? run->bodies.size() : 1];
+    for (int b=0; b<run->bodies.size(); b++) run->body_state[b] = 0;
+    run->num_slices = (run->entries.size() + SEARCH_SLICE_ENTRIES - 1) / SEARCH_SLICE_ENTRIES;
+    run->slices = new SearchSlice[run->num_slices > 0 ? run->num_slices : 1];
+    for (int s=0; s<run->num_slices; s++) {
+        SearchSlice& slice = run->slices[s];
+        slice.run = run;
+        slice.begin = s * SEARCH_SLICE_ENTRIES;
+        slice.end = slice.begin + SEARCH_SLICE_ENTRIES < run->entries.size() ? slice.begin + SEARCH_SLICE_ENTRIES : run->entries.size();
+        slice.done = false;
+    }
+    for (int s=0; s<run->num_slices; s++)
+        jobsSubmit(searchSlice, &run->slices[s], &run->group);
+}
+
+void clearHistorySearchCache(HistorySearch& search)
+{
+    // a running search writes the caches it looked up when it finishes
+    cancelHistorySearch(search);
+    search.cache.clear();
+}
+
+void cancelHistorySearch(HistorySearch& search)
+{
+    retire(search);
+    search.hits.resize(0);
+    search.elapsed_us = 0;
+    search.not_searched = 0;
+    search.error[0] = '\0';
+}
+
+bool updateHistorySearch(HistorySearch& search)
+{
+    for (int r=search.retired.size()-1; r>=0; r--) {
+        if (search.retired[r]->group.pending.load() == 0) {
+            delete search.retired[r];
+            search.retired.erase(search.retired.begin() + r);
+        }
+    }
+    SearchRun* run = search.run;
+    if (run == NULL) return false;
+    while (run->next_slice < run->num_slices && run->slices[run->next_slice].done.load(std::memory_order_acquire)) {
+        SearchSlice& slice = run->slices[run->next_slice];
+        for (int h=0; h<slice.hits.size(); h++) search.hits.push_back(slice.hits[h]);
+        slice.hits.clear();
+        run->next_slice++;
+    }
+    if (run->next_slice < run->num_slices) return true;
+    finishRun(search);
+    return false;
+}
+
+void stopHistorySearch(HistorySearch& search)
+{
+    retire(search);
+    for (int r=0; r<search.retired.size(); r++) {
+        jobsWait(&search.retired[r]->group);
+        delete search.retired[r];
+    }
+    search.retired.clear();
+}
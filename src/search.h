@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+#include "requests.h"
+
+// History search on the job pool. Starting a search takes a snapshot of the
+// searched collections on the UI thread (the interned URLs and a handle to
+// every distinct body), then the entries are cut in slices of
+// SEARCH_SLICE_ENTRIES, one job each. Cold bodies are searched by mapping
+// their file in the cold store, they are not made resident again.
+// A body shared by many entries is only searched once, and see SearchCache
+// for the entries that are not searched at all.
+//
+// Queries are a case insensitive substring, or a regex (rapidjson syntax, case
+// sensitive) compiled once and shared by the jobs. Hits stream into
+// HistorySearch::hits in snapshot order, newest entry first in each
+// collection, as the slices finish. Starting another search cancels the
+// running one: its jobs stop at their next entry and it is freed once they
+// all returned, the UI thread never waits for them.
+
+#define SEARCH_SLICE_ENTRIES 2048
+
+typedef struct SearchHit {
+    int collection;
+    int index;          // into collection.hist
+} SearchHit;
+
+typedef struct SearchRun SearchRun;
+
+// Hits of the last search that finished over a collection. Searching it again
+// only tests what the cache cannot answer: nothing but the entries appended
+// since for the same query, the cached hits (and the new entries) for a plain
+// query that contains the cached one. The cache is dropped when the entries it
+// covered changed, checked on the first and last of them like the endpoint
+// index does.
+typedef struct SearchCache {
+    int collection;             // index, names need not be unique
+    pg::String query;           // lower case for plain queries
+    bool regex;
+    int entries;                // history entries covered
+    uint64_t first, last;       // fingerprints of entries 0 and entries-1
+    pg::Vector<int> hits;       // newest first
+} SearchCache;
+
+typedef struct HistorySearch {
+    HistorySearch() { run = NULL; elapsed_us = 0; tested = 0; not_searched = 0; error[0] = '\0'; }
+
+    SearchRun* run;                 // current search, NULL when there is none
+    pg::Vector<SearchRun*> retired; // cancelled, some of their jobs may still run
+    pg::Vector<SearchHit> hits;
+    int64_t elapsed_us;             // once the current search finished
+    int tested;                     // entries the current search had to test
+    int not_searched;               // bodies missing from the cold store, once finished
+    char error[128];                // the regex did not compile
+    pg::Vector<SearchCache> cache;  // one per collection searched
+} HistorySearch;
+
+// Cancels the current search and starts one for query over collection[only],
+// or over every collection when only < 0
+void startHistorySearch(HistorySearch& search, const pg::Vector<Collection>& collection, int only,
+                        const char* query, bool regex);
+
+// Cancels the current search, its hits so far are cleared
+void cancelHistorySearch(HistorySearch& search);
+
+// Moves the hits of the slices finished since the last call into search.hits
+// and frees the retired searches that are done. Returns true while the
+// current search is still running.
+bool updateHistorySearch(HistorySearch& search);
+
+// Drops the caches, for when collections are (re)loaded and indices change meaning
+void clearHistorySearchCache(HistorySearch& search);
+
+// Cancels everything and waits for the jobs, before the job pool shuts down
+void stopHistorySearch(HistorySearch& search);
@@ -0,0 +1,131 @@
+#include <atomic>
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+#include "strtable.h"
+#include "pghash.h"
+
+#define STR_PAGE_BITS 12
+#define STR_PAGE_SIZE (1 << STR_PAGE_BITS)
+#define STR_MAX_PAGES (1 << 16)         // 268M distinct strings
+#define STR_BLOCK_SIZE (256*1024)       // small strings are packed in blocks this big
+
+typedef struct StrEntry {
+    const char* str;
+    int length;
+    uint64_t hash;
+} StrEntry;
+
+// Entries live in pages that never move, id i at pages[i >> STR_PAGE_BITS].
+// A page is published before any id in it is handed out, readers only load
+// the page pointer. The hash table of ids and everything else is only
+// touched under table_mutex.
+static std::atomic<StrEntry*> pages[STR_MAX_PAGES];
+static std::mutex table_mutex;
+static uint32_t* table = NULL;          // open addressing, 0 for an empty slot
+static int table_size = 0;
+static std::atomic<int> num_strings(1); // id 0 is the empty string, it has no entry
+static size_t num_bytes = 0;
+static char* block = NULL;
+static int block_used = STR_BLOCK_SIZE;
+
+
+static inline const StrEntry& entry(uint32_t id)
+{
+    return pages[id >> STR_PAGE_BITS].load(std::memory_order_acquire)[id & (STR_PAGE_SIZE-1)];
+}
+
+static void growTable()
+{
+    int new_size = table_size ? table_size * 2 : 4096;
+    uint32_t* new_table = (uint32_t*)calloc((size_t)new_size, sizeof(uint32_t));
+    for (int i=0; i<table_size; i++) {
+        if (table[i] == 0) continue;
+        int slot = (int)(entry(table[i]).hash & (uint64_t)(new_size-1));
+        while (new_table[slot] != 0) slot = (slot + 1) & (new_size-1);
+        new_table[slot] = table[i];
+    }
+    if (table) free(table);
+    table = new_table;
+    table_size = new_size;
+}
+
+static const char* copyString(const char* str, int len)
+{
+    char* copy;
+    if (len + 1 > STR_BLOCK_SIZE / 4) {
+        copy = (char*)pg::countedMalloc((size_t)len + 1);
+    } else {
+        if (block_used + len + 1 > STR_BLOCK_SIZE) {
+            block = (char*)pg::countedMalloc(STR_BLOCK_SIZE);
+            block_used = 0;
+        }
+        copy = block + block_used;
+        block_used += len + 1;
+    }
+    memcpy(copy, str, (size_t)len);
+    copy[len] = '\0';
+    num_bytes += (size_t)len + 1;
+    return copy;
+}
+
+static uint32_t intern(const char* str, int len)
+{
+    if (len <= 0) return 0;
+    uint64_t hash = pg::hash64(str, (size_t)len);
+
+    std::lock_guard<std::mutex> lock(table_mutex);
+    int count = num_strings.load(std::memory_order_relaxed);
+    if ((count + 1) * 2 > table_size) growTable();
+    int slot = (int)(hash & (uint64_t)(table_size-1));
+    for (; table[slot] != 0; slot = (slot + 1) & (table_size-1)) {
+        const StrEntry& e = entry(table[slot]);
+        if (e.hash == hash && e.length == len && memcmp(e.str, str, (size_t)len) == 0)
+            return table[slot];
+    }
+
+    uint32_t id = (uint32_t)count;
+    if ((id >> STR_PAGE_BITS) >= STR_MAX_PAGES) abort();
+    StrEntry* page = pages[id >> STR_PAGE_BITS].load(std::memory_order_relaxed);
+    if (page == NULL) {
+        page = (StrEntry*)pg::countedMalloc(sizeof(StrEntry) * STR_PAGE_SIZE);
+        pages[id >> STR_PAGE_BITS].store(page, std::memory_order_release);
+    }
+    StrEntry& e = page[id & (STR_PAGE_SIZE-1)];
+    e.str = copyString(str, len);
+    e.length = len;
+    e.hash = hash;
+    table[slot] = id;
+    num_strings.store(count + 1, std::memory_order_release);
+    return id;
+}
+
+
+namespace pg {
+
+Atom::Atom(const char* str)             : id_(intern(str, (int)strlen(str))) {}
+Atom::Atom(const char* str, int len)    : id_(intern(str, len)) {}
+Atom::Atom(const String& str)           : id_(intern(str.buf_, (int)strlen(str.buf_))) {}
+
+const char* Atom::buf() const
+{
+    return id_ == 0 ? "" : entry(id_).str;
+}
+
+int Atom::length() const
+{
+    return id_ == 0 ? 0 : entry(id_).length;
+}
+
+}
+
+int strTableCount()
+{
+    return num_strings.load() - 1;
+}
+
+size_t strTableBytes()
+{
+    std::lock_guard<std::mutex> lock(table_mutex);
+    return num_bytes + (size_t)table_size * sizeof(uint32_t);
+}
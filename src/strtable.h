@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "pgstring.h"
+
+// Interned strings for what History entries repeat endlessly: URLs, header
+// names and values (the same bearer token on every request), query
+// arguments. Every distinct string is stored once in a global table and a
+// pg::Atom is only its 32-bit id, so two atoms are equal when their ids are.
+//
+// The table only grows: nothing is ever freed, which is what makes an atom
+// safe to read from any thread without a lock (the text of an id never moves
+// or changes). Interning takes a lock. Strings that are only used once, like
+// rendered templates or response headers, stay in pg::String.
+//
+// Ids are dense, 0 is the empty string, and only mean something in this
+// process: collections are saved with a table of the strings themselves.
+
+namespace pg {
+
+class Atom {
+public:
+    inline Atom() : id_(0) {}
+    explicit Atom(const char* str);
+    Atom(const char* str, int len);
+    explicit Atom(const String& str);
+
+    // NUL terminated, valid for the life of the process
+    const char*         buf() const;
+    int                 length() const;
+    inline const char*  end() const                     { return buf() + length(); }
+    inline uint32_t     id() const                      { return id_; }
+    inline bool         operator==(const Atom& b) const { return id_ == b.id_; }
+    inline bool         operator!=(const Atom& b) const { return id_ != b.id_; }
+
+    uint32_t id_;
+};
+
+}
+
+// Distinct strings interned so far, and the bytes they use, for the stats display
+int strTableCount();
+size_t strTableBytes();
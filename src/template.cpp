@@ -0,0 +1,514 @@
+#include <time.h>
+#include "template.h"
+#include "utils.h"
+#include "imgui.h"
+
+
+const char* findPlaceholder(const char* text, const char** name, int* name_len)
+{
+    const char* open = strstr(text, "{{");
+    while (open) {
+        const char* close = strstr(open + 2, "}}");
+        if (close == NULL) return NULL;
+        *name = open + 2;
+        *name_len = (int)(close - *name);
+        if (*name_len > 0) return open;
+        open = strstr(close + 2, "{{");
+    }
+    return NULL;
+}
+
+
+static bool nameIs(const char* name, int name_len, const char* str)
+{
+    return (int)strlen(str) == name_len && strncmp(name, str, name_len) == 0;
+}
+
+static bool resolveVariable(const char* name, int name_len, const pg::Vector<Argument>* environment,
+                            const DataFile* data, TemplateSegment& seg)
+{
+    seg.offset = 0;
+    seg.length = 0;
+    seg.index = 0;
+    if (name[0] == '$') {
+        if (nameIs(name, name_len, "$seq"))             seg.source = TEMPLATE_SEQUENCE;
+        else if (nameIs(name, name_len, "$uuid"))       seg.source = TEMPLATE_UUID;
+        else if (nameIs(name, name_len, "$timestamp"))  seg.source = TEMPLATE_TIMESTAMP;
+        else if (nameIs(name, name_len, "$random"))     seg.source = TEMPLATE_RANDOM;
+        else return false;
+        return true;
+    }
+    if (data) {
+        for (int i=0; i<data->columns.size(); i++) {
+            if (nameIs(name, name_len, data->columns[i].buf_)) {
+                seg.source = TEMPLATE_DATA;
+                seg.index = i;
+                return true;
+            }
+        }
+    }
+    if (environment) {
+        for (int i=environment->size()-1; i>=0; i--) {
+            if (nameIs(name, name_len, (*environment)[i].name.buf_)) {
+                seg.source = TEMPLATE_ENVIRONMENT;
+                seg.index = i;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+static void addLiteral(Template& tpl, int begin, int end)
+{
+    if (end <= begin) return;
+    TemplateSegment seg;
+    seg.source = TEMPLATE_LITERAL;
+    seg.offset = begin;
+    seg.length = end - begin;
+    seg.index = 0;
+    tpl.segments.push_back(seg);
+}
+
+void compileTemplate(Template& tpl, const char* text, const pg::Vector<Argument>* environment, const DataFile* data)
+{
+    tpl.text.set(text);
+    tpl.segments.clear();
+    tpl.dynamic = false;
+
+    // unresolved placeholders stay part of the surrounding literal
+    int literal_start = 0;
+    const char* p = text;
+    const char* open;
+    const char* name;
+    int name_len;
+    while ((open = findPlaceholder(p, &name, &name_len))) {
+        p = name + name_len + 2;
+        TemplateSegment seg;
+        if (!resolveVariable(name, name_len, environment, data, seg))
+            continue;
+        addLiteral(tpl, literal_start, (int)(open - text));
+        tpl.segments.push_back(seg);
+        tpl.dynamic = true;
+        literal_start = (int)(p - text);
+    }
+    addLiteral(tpl, literal_start, (int)strlen(text));
+}
+
+
+static inline void put(pg::String& out, int& len, const char* str, int size)
+{
+    if (len + size + 1 > out.capacity_) out.realloc((len + size + 1) * 2);
+    memcpy(out.buf_ + len, str, (size_t)size);
+    len += size;
+}
+
+// Same encoding as curl_easy_escape: everything but RFC 3986 unreserved characters
+static void putEscaped(pg::String& out, int& len, const char* str, int size)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    for (int i=0; i<size; i++) {
+        unsigned char c = (unsigned char)str[i];
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+            c == '-' || c == '.' || c == '_' || c == '~') {
+            put(out, len, (const char*)&c, 1);
+        } else {
+            char enc[3] = { '%', hex[c >> 4], hex[c & 15] };
+            put(out, len, enc, 3);
+        }
+    }
+}
+
+static uint64_t nextRandom(TemplateContext& ctx)
+{
+    // xorshift64*
+    uint64_t x = ctx.random_state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    ctx.random_state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static int formatUuid(TemplateContext& ctx, char* out)
+{
+    static const char hex[] = "0123456789abcdef";
+    uint64_t hi = nextRandom(ctx);
+    uint64_t lo = nextRandom(ctx);
+    hi = (hi & ~0xF000ULL) | 0x4000ULL;                         // version 4
+    lo = (lo & ~(3ULL << 62)) | (2ULL << 62);                   // RFC 4122 variant
+    int len = 0;
+    for (int i=0; i<32; i++) {
+        if (i == 8 || i == 12 || i == 16 || i == 20) out[len++] = '-';
+        uint64_t word = i < 16 ? hi : lo;
+        out[len++] = hex[(word >> (60 - 4*(i & 15))) & 15];
+    }
+    return len;
+}
+
+static void renderSegments(const Template& tpl, TemplateContext& ctx, pg::String& out, int& len, bool escape)
+{
+    char scratch[40];
+    for (int i=0; i<tpl.segments.size(); i++) {
+        const TemplateSegment& seg = tpl.segments[i];
+        const char* str = scratch;
+        int size = 0;
+        switch (seg.source) {
+            case TEMPLATE_LITERAL:
+                // literals were escaped when compiled, if needed
+                put(out, len, tpl.text.buf_ + seg.offset, seg.length);
+                continue;
+            case TEMPLATE_ENVIRONMENT:
+                str = (*ctx.environment)[seg.index].value.buf_;
+                size = (int)strlen(str);
+                break;
+            case TEMPLATE_DATA:
+                if (ctx.data->num_rows > 0) {
+                    int cell = (int)(ctx.sequence % ctx.data->num_rows) * ctx.data->columns.size() + seg.index;
+                    str = &ctx.data->text[ctx.data->offset[cell]];
+                    size = ctx.data->length[cell];
+                }
+                break;
+            case TEMPLATE_SEQUENCE:
+                size = snprintf(scratch, sizeof(scratch), "%lld", (long long)ctx.sequence);
+                break;
+            case TEMPLATE_UUID:
+                size = formatUuid(ctx, scratch);
+                break;
+            case TEMPLATE_TIMESTAMP:
+                size = snprintf(scratch, sizeof(scratch), "%lld", (long long)time(NULL));
+                break;
+            case TEMPLATE_RANDOM:
+                size = snprintf(scratch, sizeof(scratch), "%d", (int)(nextRandom(ctx) >> 33));
+                break;
+        }
+        if (escape) putEscaped(out, len, str, size);
+        else put(out, len, str, size);
+    }
+}
+
+void renderTemplate(const Template& tpl, TemplateContext& ctx, pg::String& out)
+{
+    int len = 0;
+    renderSegments(tpl, ctx, out, len, false);
+    put(out, len, "", 0);
+    out.buf_[len] = '\0';
+}
+
+
+void compileRequestTemplate(RequestTemplate& tpl, const History& hist,
+                            const pg::Vector<Argument>* environment, const DataFile* data)
+{
+    bool has_body = hist.req_type == POST || hist.req_type == PATCH || hist.req_type == PUT;
+    tpl.req_type = hist.req_type;
+    tpl.content_type = hist.content_type;
+    tpl.query_names.clear();
+    tpl.query_values.clear();
+    tpl.header_names.clear();
+    tpl.header_values.clear();
+
+    compileTemplate(tpl.url, hist.url.buf(), environment, data);
+    tpl.dynamic = tpl.url.dynamic;
+
+    // Query values are escaped when rendered, so escape their literal parts now
+    for (int i=0; i<hist.args.size(); i++) {
+        if (has_body && hist.args[i].arg_type == 1)
+            continue;
+        int len = 0;
+        pg::String name;
+        putEscaped(name, len, hist.args[i].name.buf(), hist.args[i].name.length());
+        name.buf_[len] = '\0';
+        tpl.query_names.push_back(name);
+
+        Template value;
+        compileTemplate(value, hist.args[i].value.buf(), environment, data);
+        pg::String escaped;
+        int escaped_len = 0;
+        for (int k=0; k<value.segments.size(); k++) {
+            TemplateSegment& seg = value.segments[k];
+            if (seg.source != TEMPLATE_LITERAL) continue;
+            int start = escaped_len;
+            putEscaped(escaped, escaped_len, value.text.buf_ + seg.offset, seg.length);
+            seg.offset = start;
+            seg.length = escaped_len - start;
+        }
+        escaped.buf_[escaped_len] = '\0';
+        value.text = escaped;
+        tpl.query_values.push_back(value);
+        tpl.dynamic |= value.dynamic;
+    }
+
+    Template empty;
+    compileTemplate(empty, "", NULL, NULL);
+    if (hist.content_type == MULTIPART_FORMDATA || hist.content_type == APPLICATION_JSON) {
+        pg::String line("Content-Type: ");
+        line.append(ContentTypeToString(hist.content_type));
+        tpl.header_names.push_back(line);
+        tpl.header_values.push_back(empty);
+    }
+    for (int i=0; i<hist.headers.size(); i++) {
+        pg::String name(hist.headers[i].name.buf());
+        if (hist.headers[i].name.length() > 0) name.append(": ");
+        tpl.header_names.push_back(name);
+        Template value;
+        compileTemplate(value, hist.headers[i].value.buf(), environment, data);
+        tpl.header_values.push_back(value);
+        tpl.dynamic |= value.dynamic;
+    }
+
+    tpl.body_from_file = hist.body_file.length() > 0;
+    if (has_body && hist.content_type == APPLICATION_JSON && !tpl.body_from_file)
+        compileTemplate(tpl.body, hist.input_json.buf(), environment, data);
+    else
+        compileTemplate(tpl.body, "", NULL, NULL);
+    tpl.dynamic |= tpl.body.dynamic;
+}
+
+void applyRequestTemplate(const RequestTemplate& tpl, TemplateContext& ctx,
+                          RenderedRequest& out, PreparedRequest& prepared)
+{
+    int len = 0;
+    renderSegments(tpl.url, ctx, out.url, len, false);
+    for (int i=0; i<tpl.query_names.size(); i++) {
+        put(out.url, len, i == 0 ? "?" : "&", 1);
+        put(out.url, len, tpl.query_names[i].buf_, (int)strlen(tpl.query_names[i].buf_));
+        put(out.url, len, "=", 1);
+        renderSegments(tpl.query_values[i], ctx, out.url, len, true);
+    }
+    out.url.buf_[len] = '\0';
+    curl_easy_setopt(prepared.curl, CURLOPT_URL, out.url.buf_);
+
+    int num_headers = tpl.header_names.size();
+    if (num_headers > 0) {
+        if (out.num_nodes != num_headers) {
+            if (out.nodes) delete [] out.nodes;
+            out.nodes = new curl_slist[num_headers];
+            out.num_nodes = num_headers;
+            out.header_lines.resize(num_headers);
+        }
+        for (int i=0; i<num_headers; i++) {
+            len = 0;
+            put(out.header_lines[i], len, tpl.header_names[i].buf_, (int)strlen(tpl.header_names[i].buf_));
+            renderSegments(tpl.header_values[i], ctx, out.header_lines[i], len, false);
+            out.header_lines[i].buf_[len] = '\0';
+            // the buffer may have moved while growing
+            out.nodes[i].data = out.header_lines[i].buf_;
+            out.nodes[i].next = i+1 < num_headers ? &out.nodes[i+1] : NULL;
+        }
+        curl_easy_setopt(prepared.curl, CURLOPT_HTTPHEADER, out.nodes);
+    }
+
+    bool has_body = tpl.req_type == POST || tpl.req_type == PATCH || tpl.req_type == PUT;
+    if (has_body && tpl.content_type == APPLICATION_JSON && !tpl.body_from_file) {
+        len = 0;
+        renderSegments(tpl.body, ctx, out.body, len, false);
+        out.body.buf_[len] = '\0';
+        prepared.body_reader.readptr = out.body.buf_;
+        prepared.body_reader.sizeleft = (size_t)len;
+        curl_easy_setopt(prepared.curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)len);
+    }
+}
+
+
+Request renderRequest(const History& hist, TemplateContext& ctx)
+{
+    Request out;
+    historyRequest(out, hist);
+    Template tpl;
+    compileTemplate(tpl, hist.url.buf(), ctx.environment, ctx.data);
+    if (tpl.dynamic)
+        renderTemplate(tpl, ctx, out.url);
+    for (int i=0; i<hist.args.size(); i++) {
+        compileTemplate(tpl, hist.args[i].value.buf(), ctx.environment, ctx.data);
+        if (tpl.dynamic)
+            renderTemplate(tpl, ctx, out.args[i].value);
+    }
+    for (int i=0; i<hist.headers.size(); i++) {
+        compileTemplate(tpl, hist.headers[i].value.buf(), ctx.environment, ctx.data);
+        if (tpl.dynamic)
+            renderTemplate(tpl, ctx, out.headers[i].value);
+    }
+    if (hist.input_json.length() > 0) {
+        compileTemplate(tpl, hist.input_json.buf(), ctx.environment, ctx.data);
+        if (tpl.dynamic) {
+            pg::String body;
+            renderTemplate(tpl, ctx, body);
+            out.input_json = pg::Body(body);
+        }
+    }
+    return out;
+}
+
+
+static void addCell(DataFile& data, const char* str, int size)
+{
+    data.offset.push_back(data.text.size());
+    data.length.push_back(size);
+    for (int i=0; i<size; i++)
+        data.text.push_back(str[i]);
+    data.text.push_back('\0');
+}
+
+// Reads one CSV field starting at p, unquoting it into field. Returns the
+// position after the field, at the separator or line end.
+static const char* readCsvField(const char* p, pg::Vector<char>& field)
+{
+    field.resize(0);
+    if (*p != '"') {
+        while (*p && *p != ',' && *p != '\n' && *p != '\r')
+            field.push_back(*p++);
+        return p;
+    }
+    p++;
+    while (*p) {
+        if (*p == '"') {
+            if (p[1] != '"') { p++; break; }
+            p++;
+        }
+        field.push_back(*p++);
+    }
+    while (*p && *p != ',' && *p != '\n' && *p != '\r') p++;
+    return p;
+}
+
+static void loadCsv(DataFile& data, const char* p)
+{
+    pg::Vector<char> field;
+    int row_cells = 0;
+    bool header = true;
+    while (*p) {
+        if (*p == '\n' || *p == '\r') { p++; continue; }  // blank line
+        row_cells = 0;
+        while (true) {
+            p = readCsvField(p, field);
+            if (header) {
+                data.columns.push_back(pg::String(field.Data ? field.Data : "", field.size()));
+            } else if (row_cells < data.columns.size()) {
+                addCell(data, field.Data, field.size());
+            }
+            row_cells++;
+            if (*p != ',') break;
+            p++;
+        }
+        if (!header) {
+            for (; row_cells < data.columns.size(); row_cells++)
+                addCell(data, "", 0);
+            data.num_rows++;
+        }
+        header = false;
+    }
+}
+
+static void loadJsonLines(DataFile& data, char* p)
+{
+    // columns come from the first object, other keys are ignored
+    bool first = true;
+    while (*p) {
+        char* line_end = strchr(p, '\n');
+        if (line_end) *line_end = '\0';
+        rapidjson::Document document;
+        if (!document.ParseInsitu(p).HasParseError() && document.IsObject()) {
+            if (first) {
+                for (rapidjson::Value::ConstMemberIterator it = document.MemberBegin(); it != document.MemberEnd(); ++it)
+                    data.columns.push_back(pg::String(it->name.GetString()));
+                first = false;
+            }
+            for (int i=0; i<data.columns.size(); i++) {
+                rapidjson::Value::ConstMemberIterator it = document.FindMember(data.columns[i].buf_);
+                if (it == document.MemberEnd()) {
+                    addCell(data, "", 0);
+                } else if (it->value.IsString()) {
+                    addCell(data, it->value.GetString(), (int)it->value.GetStringLength());
+                } else {
+                    rapidjson::StringBuffer sb;
+                    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+                    it->value.Accept(writer);
+                    addCell(data, sb.GetString(), (int)sb.GetSize());
+                }
+            }
+            data.num_rows++;
+        }
+        if (line_end == NULL) break;
+        p = line_end + 1;
+    }
+}
+
+bool loadDataFile(DataFile& data, const char* filename)
+{
+    data.columns.clear();
+    data.text.clear();
+    data.offset.clear();
+    data.length.clear();
+    data.num_rows = 0;
+    data.path.set(filename);
+
+    char* content = readFile(filename);
+    if (content == NULL)
+        return false;
+    const char* ext = strrchr(filename, '.');
+    if (ext && (strcmp(ext, ".jsonl") == 0 || strcmp(ext, ".ndjson") == 0))
+        loadJsonLines(data, content);
+    else
+        loadCsv(data, content);
+    free(content);
+    return true;
+}
+
+
+bool environmentWindow(bool* open, Collection& collection, DataFile& data, bool data_locked)
+{
+    bool changed = false;
+    ImGui::Begin("Environment", open);
+    ImGui::Text("Variables of collection '%s'", collection.name.buf_);
+    ImGui::SameLine();
+    Help("Use {{name}} in the url, arguments, headers or body. Generators: {{$seq}}, {{$uuid}}, {{$timestamp}}, {{$random}}. Data file columns take precedence over the environment.");
+
+    pg::Vector<Argument>& env = collection.environment;
+    int delete_idx = -1;
+    for (int i=0; i<env.size(); i++) {
+        char label[32];
+        ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x*0.3);
+        sprintf(label, "##env name%d", i);
+        changed |= ImGui::InputText(label, &env[i].name[0], env[i].name.capacity());
+        ImGui::SameLine();
+        ImGui::PushItemWidth(ImGui::GetContentRegionAvail().x*0.8);
+        sprintf(label, "##env value%d", i);
+        changed |= ImGui::InputText(label, &env[i].value[0], env[i].value.capacity());
+        ImGui::PopItemWidth();
+        ImGui::PopItemWidth();
+        ImGui::SameLine();
+        sprintf(label, "Delete##env delete%d", i);
+        if (ImGui::Button(label)) delete_idx = i;
+    }
+    if (delete_idx >= 0) {
+        env.erase(env.begin() + delete_idx);
+        changed = true;
+    }
+    if (ImGui::Button("Add variable")) {
+        Argument arg;
+        arg.name = pg::String("");
+        arg.value = pg::String("");
+        arg.arg_type = 0;
+        env.push_back(arg);
+        changed = true;
+    }
+
+    ImGui::Separator();
+    static char data_path[1024] = "";
+    ImGui::InputText("Data file (.csv/.jsonl)", data_path, sizeof(data_path));
+    ImGui::SameLine();
+    if (data_locked) {
+        ImGui::TextDisabled("Load");
+    } else if (ImGui::Button("Load") && !loadDataFile(data, data_path)) {
+        data.path.set("");
+    }
+    if (data.num_rows > 0) {
+        ImGui::Text("%s: %d rows, request n uses row n %% %d", data.path.buf_, data.num_rows, data.num_rows);
+        for (int i=0; i<data.columns.size(); i++) {
+            if (i > 0) ImGui::SameLine();
+            ImGui::Text("{{%s}}", data.columns[i].buf_);
+        }
+    }
+    ImGui::End();
+    return changed;
+}
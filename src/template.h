@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stdint.h>
+#include "requests.h"
+
+// Variable templating: {{name}} placeholders in the url, argument values, header
+// values and body of a request. A name is looked up in the data file columns,
+// then in the collection environment; names starting with '$' are generators:
+//
+//   {{$seq}}        sequence number of the request (0, 1, 2...)
+//   {{$uuid}}       random version 4 UUID
+//   {{$timestamp}}  unix time in seconds
+//   {{$random}}     random integer in [0, 2^31)
+//
+// Unknown names are sent as written. A template is compiled once into literal
+// and variable segments, rendering it only copies bytes into a reused buffer,
+// so a load test can send millions of distinct requests without parsing or
+// allocating in its send loop.
+
+typedef enum TemplateSource {
+    TEMPLATE_LITERAL = 0,
+    TEMPLATE_ENVIRONMENT,
+    TEMPLATE_DATA,
+    TEMPLATE_SEQUENCE,
+    TEMPLATE_UUID,
+    TEMPLATE_TIMESTAMP,
+    TEMPLATE_RANDOM,
+} TemplateSource;
+
+typedef struct TemplateSegment {
+    TemplateSource source;
+    int offset;     // literal: range of Template::text
+    int length;
+    int index;      // environment entry or data column
+} TemplateSegment;
+
+typedef struct Template {
+    pg::String text;
+    pg::Vector<TemplateSegment> segments;
+    bool dynamic;   // has at least one variable segment
+} Template;
+
+
+// CSV (first line names the columns) or JSONL (one object per line) rows. The
+// cells live in one block, row r column c starts at text[offset[r*num_columns+c]].
+typedef struct DataFile {
+    DataFile() { num_rows = 0; }
+    pg::String path;
+    pg::Vector<pg::String> columns;
+    pg::Vector<char> text;
+    pg::Vector<int> offset;
+    pg::Vector<int> length;
+    int num_rows;
+} DataFile;
+
+// Returns false if the file could not be read, format is picked by the extension
+bool loadDataFile(DataFile& data, const char* filename);
+
+
+// Everything a render can read. Each thread rendering templates needs its own.
+typedef struct TemplateContext {
+    TemplateContext() { environment = NULL; data = NULL; sequence = 0; random_state = 0x9e3779b97f4a7c15ULL; }
+    const pg::Vector<Argument>* environment;
+    const DataFile* data;
+    int64_t sequence;       // also picks the data row, wrapping around
+    uint64_t random_state;
+} TemplateContext;
+
+// Finds the next {{name}} at or after text. Returns a pointer to the "{{" or NULL.
+const char* findPlaceholder(const char* text, const char** name, int* name_len);
+
+// environment and data must be the ones of the context the template is rendered with
+void compileTemplate(Template& tpl, const char* text, const pg::Vector<Argument>* environment, const DataFile* data);
+
+// Replaces the contents of out, its buffer only grows
+void renderTemplate(const Template& tpl, TemplateContext& ctx, pg::String& out);
+
+
+// A History compiled for repeated sending. File arguments are not templated in
+// this form, they are part of the multipart form built by prepareRequest.
+typedef struct RequestTemplate {
+    RequestType req_type;
+    ContentType content_type;
+    Template url;
+    pg::Vector<pg::String> query_names;     // already escaped
+    pg::Vector<Template> query_values;
+    pg::Vector<pg::String> header_names;
+    pg::Vector<Template> header_values;
+    Template body;
+    bool body_from_file;                    // streamed as prepared, never templated
+    bool dynamic;
+} RequestTemplate;
+
+// Buffers of one in-flight request, reused by every render
+typedef struct RenderedRequest {
+    RenderedRequest()   { nodes = NULL; num_nodes = 0; }
+    ~RenderedRequest()  { if (nodes) delete [] nodes; }
+
+    pg::String url;
+    pg::String body;
+    pg::Vector<pg::String> header_lines;
+    struct curl_slist* nodes;   // our own list nodes pointing into header_lines
+    int num_nodes;
+
+    RenderedRequest(const RenderedRequest&) = delete;
+    RenderedRequest& operator=(const RenderedRequest&) = delete;
+} RenderedRequest;
+
+void compileRequestTemplate(RequestTemplate& tpl, const History& hist,
+                            const pg::Vector<Argument>* environment, const DataFile* data);
+
+// Renders the request and points the prepared handle (built by prepareRequest
+// from the same History) at the result. Call after resetPreparedRequest.
+void applyRequestTemplate(const RequestTemplate& tpl, TemplateContext& ctx,
+                          RenderedRequest& out, PreparedRequest& prepared);
+
+// hist with every template rendered, for one-off sends. Repeated sends use a
+// RequestTemplate instead.
+Request renderRequest(const History& hist, TemplateContext& ctx);
+
+// Draws the environment editor of a collection and the data file picker.
+// Returns true when the environment changed and should be saved.
+bool environmentWindow(bool* open, Collection& collection, DataFile& data, bool data_locked);
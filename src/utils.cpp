@@ -1,4 +1,13 @@
 #include "utils.h"
+#include "rapidjson/filewritestream.h"
+
+#ifdef _WINDOWS
+#include <windows.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#endif
 
 void readIntFromIni(int& res, FILE* fid) {
     if (fscanf(fid, "\%*s %d", &res) != 1) {
@@ -17,23 +26,27 @@ void readStringFromIni(char* buffer, FILE* fid) {
     buffer[str_len] = '\0';
 }
 
-void printArg(const Argument& arg) {
-    printf("name: %s\nvalue: %s\narg_type: %d\n\n", arg.name.buf_, arg.value.buf_, arg.arg_type);
+void printArg(const HistoryArgument& arg) {
+    printf("name: %s\nvalue: %s\narg_type: %d\n\n", arg.name.buf(), arg.value.buf(), arg.arg_type);
 }
 
 void printHistory(const History& hist) {
-    printf("url: %s\ninput_json: %s\nresult: %s\n", hist.url.buf_, hist.input_json.buf_, hist.result.buf_);
+    printf("url: %s\ninput_json: %s\nresult: %s\n", hist.url.buf(), hist.input_json.buf(), hist.result.buf());
     printf("req_type: %d\ncontent_type: %d\nresponse_code: %d\n", (int)hist.req_type, (int)hist.content_type, hist.response_code);
-    printf("process_time: %s\n", hist.process_time.buf_);
+    printf("process_time: %s\n", hist.process_time.buf());
     for (int i=0; i<hist.args.size(); i++)
         printArg(hist.args[i]);
     for (int i=0; i<hist.headers.size(); i++)
         printArg(hist.headers[i]);
+    for (int i=0; i<hist.extract.size(); i++)
+        printArg(hist.extract[i]);
+    for (int i=0; i<hist.assertions.size(); i++)
+        printArg(hist.assertions[i]);
     printf("----------------------------------------------------------\n\n");
 }
 
 // Thanks lfzawacki: https://stackoverflow.com/questions/3463426/in-c-how-should-i-read-a-text-file-and-print-all-strings/3464656#3464656 
-char* readFile(char *filename)
+char* readFile(const char *filename)
 {
    char *buffer = NULL;
    int string_size, read_size;
@@ -74,55 +87,216 @@ char* readFile(char *filename)
 }
 
 
+static void hashToHex(uint64_t hash, char* hex)
+{
+    snprintf(hex, 17, "%016llx", (unsigned long long)hash);
+}
+
+// Reads a body either from its "<name>_hash" reference into the bodies table or,
+// for files saved before the table existed, from the inline "<name>" string.
+static pg::Body readBody(const rapidjson::Value& hist, const char* name)
+{
+    char key[64];
+    snprintf(key, sizeof(key), "%s_hash", name);
+    if (hist.HasMember(key)) {
+        uint64_t hash = strtoull(hist[key].GetString(), NULL, 16);
+        return bodyFindByHash(hash);
+    }
+    if (hist.HasMember(name)) {
+        const rapidjson::Value& data = hist[name];
+        if (strcmp(name, "result") == 0)
+            return pg::Body(prettify(pg::String(data.GetString(), (int)data.GetStringLength())));
+        return pg::Body(data.GetString(), (int)data.GetStringLength());
+    }
+    return pg::Body();
+}
+
+static int compareBodyEntry(const void* A, const void* B)
+{
+    const BodyEntry* a = (*(const pg::Body**)A)->entry_;
+    const BodyEntry* b = (*(const pg::Body**)B)->entry_;
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+static const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// out must hold 4*((size+2)/3) chars, returns the encoded length
+static int base64Encode(const unsigned char* data, int size, char* out)
+{
+    char* o = out;
+    int i = 0;
+    for (; i + 2 < size; i += 3) {
+        uint32_t v = (uint32_t)data[i] << 16 | (uint32_t)data[i+1] << 8 | data[i+2];
+        *o++ = base64_chars[v >> 18];
+        *o++ = base64_chars[(v >> 12) & 63];
+        *o++ = base64_chars[(v >> 6) & 63];
+        *o++ = base64_chars[v & 63];
+    }
+    if (i < size) {
+        uint32_t v = (uint32_t)data[i] << 16 | (i + 1 < size ? (uint32_t)data[i+1] << 8 : 0);
+        *o++ = base64_chars[v >> 18];
+        *o++ = base64_chars[(v >> 12) & 63];
+        *o++ = i + 1 < size ? base64_chars[(v >> 6) & 63] : '=';
+        *o++ = '=';
+    }
+    return (int)(o - out);
+}
+
+// out must hold 3*(len/4) bytes, returns the decoded length, stops at padding
+// or the first character outside the alphabet
+static int base64Decode(const char* in, int len, unsigned char* out)
+{
+    unsigned char* o = out;
+    uint32_t v = 0;
+    int bits = 0;
+    for (int i=0; i<len; i++) {
+        char c = in[i];
+        int d = c >= 'A' && c <= 'Z' ? c - 'A' : c >= 'a' && c <= 'z' ? c - 'a' + 26 :
+                c >= '0' && c <= '9' ? c - '0' + 52 : c == '+' ? 62 : c == '/' ? 63 : -1;
+        if (d < 0) break;
+        v = v << 6 | (uint32_t)d;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            *o++ = (unsigned char)(v >> bits);
+        }
+    }
+    return (int)(o - out);
+}
+
+pg::Body parseBody(const rapidjson::Value& body)
+{
+    if (body.HasMember("cold")) {
+        uint64_t hash = strtoull(body["hash"].GetString(), NULL, 16);
+        return bodyFromColdStore(hash, body["size"].GetInt());
+    }
+    if (body.HasMember("base64")) {
+        const rapidjson::Value& encoded = body["base64"];
+        int len = (int)encoded.GetStringLength();
+        unsigned char* data = (unsigned char*)malloc((size_t)(len / 4 + 1) * 3);
+        int size = base64Decode(encoded.GetString(), len, data);
+        pg::Body decoded((const char*)data, size);
+        free(data);
+        return decoded;
+    }
+    const rapidjson::Value& data = body["data"];
+    return pg::Body(data.GetString(), (int)data.GetStringLength());
+}
+
+static void parseArguments(const rapidjson::Value& array, pg::Vector<Argument>& args)
+{
+    for (rapidjson::SizeType k = 0; k < array.Size(); k++) {
+        Argument arg;
+        arg.name  = pg::String(array[k]["name"].GetString());
+        arg.value = pg::String(array[k]["value"].GetString());
+        arg.arg_type = array[k]["argument_type"].GetInt();
+        args.push_back(arg);
+    }
+}
+
+// Interned strings of a History are saved once in a top level "strings" table
+// and referenced by index. A plain string is still accepted in their place,
+// as written before the table existed.
+void parseStrings(const rapidjson::Value& document, pg::Vector<pg::Atom>& strings)
+{
+    strings.clear();
+    if (!document.HasMember("strings")) return;
+    const rapidjson::Value& array = document["strings"];
+    strings.resize((int)array.Size());
+    for (rapidjson::SizeType i = 0; i < array.Size(); i++)
+        strings[(int)i] = pg::Atom(array[i].GetString(), (int)array[i].GetStringLength());
+}
+
+static pg::Atom readString(const rapidjson::Value& value, const pg::Vector<pg::Atom>* strings)
+{
+    if (value.IsString())
+        return pg::Atom(value.GetString(), (int)value.GetStringLength());
+    int index = value.IsInt() ? value.GetInt() : -1;
+    return strings && index >= 0 && index < strings->size() ? (*strings)[index] : pg::Atom();
+}
+
+static void parseHistoryArguments(const rapidjson::Value& array, pg::Vector<HistoryArgument>& args,
+                                  const pg::Vector<pg::Atom>* strings)
+{
+    args.resize((int)array.Size());
+    for (rapidjson::SizeType k = 0; k < array.Size(); k++) {
+        args[(int)k].name = readString(array[k]["name"], strings);
+        args[(int)k].value = readString(array[k]["value"], strings);
+        args[(int)k].arg_type = array[k]["argument_type"].GetInt();
+    }
+}
+
+void parseCollectionHeader(const rapidjson::Value& value, Collection& collection)
+{
+    collection.name = pg::String(value["name"].GetString());
+    if (value.HasMember("retention")) {
+        const rapidjson::Value& retention = value["retention"];
+        collection.retention.max_entries = retention["max_entries"].GetInt();
+        collection.retention.max_age_days = retention["max_age_days"].GetInt();
+        collection.retention.max_body_kb = retention["max_body_kb"].GetInt();
+        collection.retention.memory_budget_mb = retention["memory_budget_mb"].GetInt();
+    }
+    if (value.HasMember("environment"))
+        parseArguments(value["environment"], collection.environment);
+}
+
+History parseHistory(const rapidjson::Value& value, const pg::Vector<pg::Atom>* strings)
+{
+    History hist;
+    hist.url = readString(value["url"], strings);
+    hist.input_json = readBody(value, "input_json");
+    hist.body_file = value.HasMember("body_file") ? pg::Body(value["body_file"].GetString()) : pg::Body();
+    hist.body_file_hash = value.HasMember("body_file_hash") ? strtoull(value["body_file_hash"].GetString(), NULL, 16) : 0;
+    hist.body_file_size = value.HasMember("body_file_size") ? value["body_file_size"].GetInt64() : 0;
+    hist.req_type = (RequestType)value["request_type"].GetInt();
+    hist.content_type = (ContentType)value["content_type"].GetInt();
+    hist.http_version = value.HasMember("http_version") ? (HttpVersion)value["http_version"].GetInt() : HTTP_DEFAULT;
+    hist.process_time = readString(value["process_time"], strings);
+    hist.timestamp = value.HasMember("timestamp") ? (time_t)value["timestamp"].GetInt64() : 0;
+    hist.result = readBody(value, "result");
+    hist.response_code = value["response_code"].GetInt();
+    hist.duration_us = value.HasMember("duration_us") ? value["duration_us"].GetInt64() : 0;
+    hist.response_version = value.HasMember("response_version") ? value["response_version"].GetInt() : 0;
+    
+    parseHistoryArguments(value["headers"], hist.headers, strings);
+    parseHistoryArguments(value["arguments"], hist.args, strings);
+    if (value.HasMember("extract"))
+        parseHistoryArguments(value["extract"], hist.extract, strings);
+    if (value.HasMember("assertions"))
+        parseHistoryArguments(value["assertions"], hist.assertions, strings);
+    return hist;
+}
+
 pg::Vector<Collection> loadCollection(const pg::String& filename) 
 {
     pg::Vector<Collection> collection_vec;
     rapidjson::Document document;
     char* json = readFile(filename.buf_);
-    if (json == NULL || document.Parse(json).HasParseError()) {
+    if (json == NULL)
         return collection_vec;
-    }
-    document.Parse(json);
-    if (document.HasMember("collections") == false) {
+    if (document.ParseInsitu(json).HasParseError() || document.HasMember("collections") == false) {
         free(json);
         return collection_vec;
     }
 
+    // Bodies are stored once in a top level table and referenced by hash.
+    // Keep a handle to each of them until the histories have taken theirs.
+    pg::Vector<pg::Body> bodies;
+    if (document.HasMember("bodies")) {
+        const rapidjson::Value& body_array = document["bodies"];
+        for (rapidjson::SizeType i = 0; i < body_array.Size(); i++)
+            bodies.push_back(parseBody(body_array[i]));
+    }
+    pg::Vector<pg::Atom> strings;
+    parseStrings(document, strings);
+
     const rapidjson::Value& collections = document["collections"];
     for (rapidjson::SizeType i = 0; i < collections.Size(); i++) { 
         Collection curr_collection;
-        curr_collection.name = pg::String(collections[i]["name"].GetString());
+        parseCollectionHeader(collections[i], curr_collection);
         const rapidjson::Value& histories = collections[i]["histories"];
         for (rapidjson::SizeType j = 0; j < histories.Size(); j++) {
-            History hist;
-            hist.url = pg::String(histories[j]["url"].GetString());
-            hist.input_json = pg::String(histories[j]["input_json"].GetString());
-            hist.req_type = (RequestType)histories[j]["request_type"].GetInt();
-            hist.content_type = (ContentType)histories[j]["content_type"].GetInt();
-            hist.process_time = pg::String(histories[j]["process_time"].GetString());
-            hist.result = prettify(pg::String(histories[j]["result"].GetString()));
-            hist.response_code = histories[j]["response_code"].GetInt();
-            
-            const rapidjson::Value& headers = histories[j]["headers"];
-            const rapidjson::Value& arguments = histories[j]["arguments"];
-
-            for (rapidjson::SizeType k = 0; k < headers.Size(); k++) {
-                Argument header;
-                header.name  = pg::String(headers[k]["name"].GetString());
-                header.value = pg::String(headers[k]["value"].GetString());
-                header.arg_type = headers[k]["argument_type"].GetInt();
-                hist.headers.push_back(header);
-            }
-
-            for (rapidjson::SizeType k = 0; k < arguments.Size(); k++) {
-                Argument arg;
-                arg.name  = pg::String(arguments[k]["name"].GetString());
-                arg.value = pg::String(arguments[k]["value"].GetString());
-                arg.arg_type = arguments[k]["argument_type"].GetInt();
-                hist.args.push_back(arg);
-            }
-            // printHistory(hist);
-            curr_collection.hist.push_back(hist);
+            curr_collection.hist.push_back(parseHistory(histories[j], &strings));
         }
         collection_vec.push_back(curr_collection);
     }
@@ -131,96 +305,241 @@ pg::Vector<Collection> loadCollection(const pg::String& filename)
     return collection_vec;
 }
 
-void saveCollection(const pg::Vector<Collection>& collection, const pg::String& filename) 
+static void writeArguments(rapidjson::Writer<rapidjson::FileWriteStream>& writer, const pg::Vector<Argument>& args)
 {
-	rapidjson::Document document;
-	document.SetObject();
-	rapidjson::Value collection_array(rapidjson::kArrayType);
- 
-	// must pass an allocator when the object may need to allocate memory
-	rapidjson::Document::AllocatorType& allocator = document.GetAllocator();
+    writer.StartArray();
+    for (int k=0; k<args.size(); k++) {
+        writer.StartObject();
+        writer.Key("name");
+        writer.String(args[k].name.buf_);
+        writer.Key("value");
+        writer.String(args[k].value.buf_);
+        writer.Key("argument_type");
+        writer.Int(args[k].arg_type);
+        writer.EndObject();
+    }
+    writer.EndArray();
+}
 
-    for (int i=0; i<collection.size(); i++) {
-        rapidjson::Value curr_collection(rapidjson::kObjectType);
-        rapidjson::Value name_str;
-        name_str.SetString(collection[i].name.buf_, allocator);
-        curr_collection.AddMember("name", name_str, allocator);
+// Index in the saved "strings" table of every atom written, in first seen order
+typedef struct StringIndex {
+    pg::Vector<int> index;          // by atom id, -1 when not written yet
+    pg::Vector<pg::Atom> strings;
+} StringIndex;
 
+static void writeString(rapidjson::Writer<rapidjson::FileWriteStream>& writer, StringIndex& table, pg::Atom atom)
+{
+    int id = (int)atom.id();
+    if (id >= table.index.size()) table.index.resize(id + 1024, -1);
+    if (table.index[id] < 0) {
+        table.index[id] = table.strings.size();
+        table.strings.push_back(atom);
+    }
+    writer.Int(table.index[id]);
+}
 
-        rapidjson::Value history_array(rapidjson::kArrayType);
+static void writeHistoryArguments(rapidjson::Writer<rapidjson::FileWriteStream>& writer, StringIndex& table,
+                                  const pg::Vector<HistoryArgument>& args)
+{
+    writer.StartArray();
+    for (int k=0; k<args.size(); k++) {
+        writer.StartObject();
+        writer.Key("name");
+        writeString(writer, table, args[k].name);
+        writer.Key("value");
+        writeString(writer, table, args[k].value);
+        writer.Key("argument_type");
+        writer.Int(args[k].arg_type);
+        writer.EndObject();
+    }
+    writer.EndArray();
+}
+
+static void writeCollections(rapidjson::Writer<rapidjson::FileWriteStream>& writer, const pg::Vector<Collection>& collection)
+{
+    char hex[17];
+    StringIndex table;
+    writer.StartObject();
+    writer.Key("collections");
+    writer.StartArray();
+    for (int i=0; i<collection.size(); i++) {
+        writer.StartObject();
+        writer.Key("name");
+        writer.String(collection[i].name.buf_);
+
+        writer.Key("retention");
+        writer.StartObject();
+        writer.Key("max_entries");          writer.Int(collection[i].retention.max_entries);
+        writer.Key("max_age_days");         writer.Int(collection[i].retention.max_age_days);
+        writer.Key("max_body_kb");          writer.Int(collection[i].retention.max_body_kb);
+        writer.Key("memory_budget_mb");     writer.Int(collection[i].retention.memory_budget_mb);
+        writer.EndObject();
+
+        writer.Key("environment");
+        writeArguments(writer, collection[i].environment);
+
+        writer.Key("histories");
+        writer.StartArray();
         for (int j=0; j<collection[i].hist.size(); j++) {
-            rapidjson::Value curr_history(rapidjson::kObjectType);
-            rapidjson::Value url_str;
-            url_str.SetString(collection[i].hist[j].url.buf_, allocator);
-            curr_history.AddMember("url", url_str, allocator);
-            
-            rapidjson::Value input_json_str;
-            input_json_str.SetString(collection[i].hist[j].input_json.buf_, allocator);
-            curr_history.AddMember("input_json", input_json_str, allocator);
-
-            curr_history.AddMember("request_type", collection[i].hist[j].req_type, allocator);
-            curr_history.AddMember("content_type", collection[i].hist[j].content_type, allocator);
-            
-            rapidjson::Value process_time_str;
-            process_time_str.SetString(collection[i].hist[j].process_time.buf_, allocator);
-            curr_history.AddMember("process_time", process_time_str, allocator);
-            
-            rapidjson::Value result_str;
-            result_str.SetString(collection[i].hist[j].result.buf_, allocator);
-            curr_history.AddMember("result", result_str, allocator);
-            
-            curr_history.AddMember("response_code", collection[i].hist[j].response_code, allocator);
-
-
-            rapidjson::Value args_array(rapidjson::kArrayType);
-            for (int k=0; k<collection[i].hist[j].args.size(); k++) {
-                rapidjson::Value curr_arg(rapidjson::kObjectType);
-                rapidjson::Value name_str;
-                name_str.SetString(collection[i].hist[j].args[k].name.buf_, allocator);
-                curr_arg.AddMember("name", name_str, allocator);
-
-                rapidjson::Value value_str;
-                value_str.SetString(collection[i].hist[j].args[k].value.buf_, allocator);
-                curr_arg.AddMember("value", value_str, allocator);
-
-                curr_arg.AddMember("argument_type", collection[i].hist[j].args[k].arg_type, allocator);
-                args_array.PushBack(curr_arg, allocator);
+            const History& hist = collection[i].hist[j];
+            writer.StartObject();
+            writer.Key("url");
+            writeString(writer, table, hist.url);
+            hashToHex(hist.input_json.hash(), hex);
+            writer.Key("input_json_hash");
+            writer.String(hex);
+            if (hist.body_file.length() > 0) {
+                // only the path and what was sent, never the content
+                writer.Key("body_file");
+                writer.String(hist.body_file.buf(), (rapidjson::SizeType)hist.body_file.length());
+                hashToHex(hist.body_file_hash, hex);
+                writer.Key("body_file_hash");
+                writer.String(hex);
+                writer.Key("body_file_size");
+                writer.Int64(hist.body_file_size);
             }
-            curr_history.AddMember("arguments", args_array, allocator);
-
-            rapidjson::Value headers_array(rapidjson::kArrayType);
-            for (int k=0; k<collection[i].hist[j].headers.size(); k++) {
-                rapidjson::Value curr_header(rapidjson::kObjectType);
-                rapidjson::Value name_str;
-                name_str.SetString(collection[i].hist[j].headers[k].name.buf_, allocator);
-                curr_header.AddMember("name", name_str, allocator);
-
-                rapidjson::Value value_str;
-                value_str.SetString(collection[i].hist[j].headers[k].value.buf_, allocator);
-                curr_header.AddMember("value", value_str, allocator);
-
-                curr_header.AddMember("argument_type", collection[i].hist[j].headers[k].arg_type, allocator);
-                headers_array.PushBack(curr_header, allocator);
+            writer.Key("request_type");
+            writer.Int(hist.req_type);
+            writer.Key("content_type");
+            writer.Int(hist.content_type);
+            writer.Key("http_version");
+            writer.Int(hist.http_version);
+            writer.Key("process_time");
+            writeString(writer, table, hist.process_time);
+            writer.Key("timestamp");
+            writer.Int64((int64_t)hist.timestamp);
+            hashToHex(hist.result.hash(), hex);
+            writer.Key("result_hash");
+            writer.String(hex);
+            writer.Key("response_code");
+            writer.Int(hist.response_code);
+            writer.Key("duration_us");
+            writer.Int64(hist.duration_us);
+            writer.Key("response_version");
+            writer.Int(hist.response_version);
+            writer.Key("arguments");
+            writeHistoryArguments(writer, table, hist.args);
+            writer.Key("headers");
+            writeHistoryArguments(writer, table, hist.headers);
+            if (hist.extract.size() > 0) {
+                writer.Key("extract");
+                writeHistoryArguments(writer, table, hist.extract);
+            }
+            if (hist.assertions.size() > 0) {
+                writer.Key("assertions");
+                writeHistoryArguments(writer, table, hist.assertions);
             }
-            curr_history.AddMember("headers", headers_array, allocator);
+            writer.EndObject();
+        }
+        writer.EndArray();
+        writer.EndObject();
+    }
+    writer.EndArray();
 
-            history_array.PushBack(curr_history, allocator);
+    // Every distinct body referenced by any history is written exactly once
+    pg::Vector<const pg::Body*> bodies;
+    for (int i=0; i<collection.size(); i++) {
+        for (int j=0; j<collection[i].hist.size(); j++) {
+            if (collection[i].hist[j].input_json.entry_) bodies.push_back(&collection[i].hist[j].input_json);
+            if (collection[i].hist[j].result.entry_) bodies.push_back(&collection[i].hist[j].result);
         }
-        curr_collection.AddMember("histories", history_array, allocator);
-        collection_array.PushBack(curr_collection, allocator);
     }
-    document.AddMember("collections", collection_array, allocator);
- 
-    rapidjson::StringBuffer strbuf;
-	rapidjson::Writer<rapidjson::StringBuffer> writer(strbuf);
-	document.Accept(writer);
-
-    FILE *fp = fopen(filename.buf_, "wb");
-    if (fp != NULL)
-    {
-        fputs(strbuf.GetString(), fp);
-        fclose(fp);
+    qsort(bodies.begin(), bodies.size(), sizeof(*bodies.begin()), compareBodyEntry);
+
+    writer.Key("bodies");
+    writer.StartArray();
+    for (int i=0; i<bodies.size(); i++) {
+        if (i > 0 && *bodies[i] == *bodies[i-1]) continue;
+        writer.StartObject();
+        hashToHex(bodies[i]->hash(), hex);
+        writer.Key("hash");
+        writer.String(hex);
+
+        // cold bodies already live on disk, only their size is kept here. A
+        // missing one keeps the size of its content, not the 0 it reads as.
+        if (!bodies[i]->resident()) {
+            writer.Key("size");
+            writer.Int(bodies[i]->entry_->size);
+            writer.Key("cold");
+            writer.Bool(true);
+        } else {
+            // may run off the UI thread, keep the body from being evicted meanwhile
+            const char* data = bodies[i]->pin();
+            int size = bodies[i]->length();
+            if (bodyIsBinary(data, size)) {
+                // keeps the file valid UTF-8 JSON whatever the bytes are
+                char* encoded = (char*)malloc((size_t)(size + 2) / 3 * 4 + 1);
+                int len = base64Encode((const unsigned char*)data, size, encoded);
+                writer.Key("base64");
+                writer.String(encoded, (rapidjson::SizeType)len);
+                free(encoded);
+            } else {
+                writer.Key("data");
+                writer.String(data, (rapidjson::SizeType)size);
+            }
+            bodies[i]->unpin();
+        }
+        writer.EndObject();
     }
+    writer.EndArray();
+
+    writer.Key("strings");
+    writer.StartArray();
+    for (int i=0; i<table.strings.size(); i++)
+        writer.String(table.strings[i].buf(), (rapidjson::SizeType)table.strings[i].length());
+    writer.EndArray();
+    writer.EndObject();
+}
+
+// Streams the collections straight to a temporary file next to filename, then
+// syncs it and renames it over filename, so a crash or a full disk halfway
+// through never leaves a truncated collections file behind. The directory is
+// synced after the rename too, or a crash could still bring back the old file.
+bool saveCollection(const pg::Vector<Collection>& collection, const pg::String& filename) 
+{
+    pg::String tmp_filename(filename);
+    tmp_filename.append(".tmp");
+
+    FILE* fp = fopen(tmp_filename.buf_, "wb");
+    if (fp == NULL)
+        return false;
+
+    char buffer[65536];
+    rapidjson::FileWriteStream stream(fp, buffer, sizeof(buffer));
+    rapidjson::Writer<rapidjson::FileWriteStream> writer(stream);
+    writeCollections(writer, collection);
+    stream.Flush();
+
+    bool ok = writer.IsComplete() && ferror(fp) == 0 && fflush(fp) == 0;
+#ifdef _WINDOWS
+    ok = ok && _commit(_fileno(fp)) == 0;
+#else
+    ok = ok && fsync(fileno(fp)) == 0;
+#endif
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok) {
+        remove(tmp_filename.buf_);
+        return false;
+    }
+
+#ifdef _WINDOWS
+    return MoveFileExA(tmp_filename.buf_, filename.buf_, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    if (rename(tmp_filename.buf_, filename.buf_) != 0)
+        return false;
+    pg::String dir(filename);
+    int slash = dir.length() - 1;
+    while (slash >= 0 && dir.buf_[slash] != '/') slash--;
+    if (slash < 0) dir = ".";
+    else if (slash == 0) dir = "/";
+    else dir.buf_[slash] = 0;
+    int dir_fd = open(dir.buf_, O_RDONLY);
+    if (dir_fd < 0)
+        return false;
+    ok = fsync(dir_fd) == 0;
+    close(dir_fd);
+    return ok;
+#endif
 }
 
 const char* Stristr(const char* haystack, const char* haystack_end, const char* needle, const char* needle_end)
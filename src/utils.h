@@ -12,15 +12,23 @@ void readIntFromIni(int& res, FILE* fid);
 
 void readStringFromIni(char* buffer, FILE* fid);
 
-void printArg(const Argument& arg);
+void printArg(const HistoryArgument& arg);
 
 void printHistory(const History& hist);
 
 History readHistory(FILE* fid);
 
+char* readFile(const char *filename);
+
+// Pieces of collections.json, shared by loadCollection and the async loader
+pg::Body parseBody(const rapidjson::Value& body);
+void parseCollectionHeader(const rapidjson::Value& value, Collection& collection);
+void parseStrings(const rapidjson::Value& document, pg::Vector<pg::Atom>& strings);
+History parseHistory(const rapidjson::Value& value, const pg::Vector<pg::Atom>* strings);
+
 pg::Vector<Collection> loadCollection(const pg::String& filename);
 
-void saveCollection(const pg::Vector<Collection>& collection, const pg::String& filename);
+bool saveCollection(const pg::Vector<Collection>& collection, const pg::String& filename);
 
 const char* Stristr(const char* haystack, const char* haystack_end, const char* needle, const char* needle_end);
 
@@ -0,0 +1,413 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <float.h>
+#include "websocket.h"
+#include "profiler.h"
+#include "imgui.h"
+
+#ifndef _WINDOWS
+#include <sys/select.h>
+#endif
+
+#define WS_RECV_BUFFER (64*1024)
+#define WS_POLL_MS 100
+#define WS_SUMMARY_MESSAGES 50
+#define WS_PREVIEW_CHARS 160
+#define WS_GAP_BINS 24      // powers of two of microseconds, 1us to 8s
+
+#if LIBCURL_VERSION_NUM >= 0x075600
+#define HAVE_CURL_WEBSOCKETS
+#endif
+
+
+static int64_t nowUs()
+{
+    struct timeval timecheck;
+    gettimeofday(&timecheck, NULL);
+    return (int64_t)timecheck.tv_sec * 1000000 + (int64_t)timecheck.tv_usec;
+}
+
+WebSocketSession::~WebSocketSession()
+{
+    free(messages);
+    free(payload);
+}
+
+void WebSocketSession::reset()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    num_messages = 0;
+    payload_end = 0;
+    outbox.clear();
+    received = 0;
+    sent = 0;
+    bytes_received = 0;
+    connected_us = 0;
+    last_arrival_us = 0;
+    gaps.reset();
+    for (int i=0; i<WS_RATE_SECONDS; i++) rate[i] = 0;
+    rate_second = 0;
+    error[0] = '\0';
+}
+
+// Appends a complete message to the ring, data is at most WS_MAX_MESSAGE_BYTES
+static void recordMessage(WebSocketSession& session, const char* data, int stored, int length, int flags, int64_t now)
+{
+    std::lock_guard<std::mutex> lock(session.mutex);
+    WsMessage& msg = session.messages[session.num_messages % WS_RING_MESSAGES];
+    msg.timestamp_us = now;
+    msg.position = session.payload_end;
+    msg.length = length;
+    msg.stored = stored;
+    msg.flags = flags | (stored < length ? WS_MESSAGE_TRUNCATED : 0);
+    int64_t offset = session.payload_end % WS_RING_BYTES;
+    int first = stored < WS_RING_BYTES - offset ? stored : (int)(WS_RING_BYTES - offset);
+    memcpy(session.payload + offset, data, (size_t)first);
+    memcpy(session.payload, data + first, (size_t)(stored - first));
+    session.payload_end += stored;
+    session.num_messages++;
+}
+
+static void countArrival(WebSocketSession& session, int length, int64_t now)
+{
+    if (session.last_arrival_us > 0) {
+        int64_t gap = now - session.last_arrival_us;
+        session.gaps.counts[latencyBucket(gap)].fetch_add(1, std::memory_order_relaxed);
+    }
+    session.last_arrival_us = now;
+
+    int64_t second = now / 1000000;
+    int64_t last = session.rate_second;
+    if (second != last) {
+        // clear the seconds nothing arrived in, at most the whole window
+        int64_t from = second - last > WS_RATE_SECONDS ? second - WS_RATE_SECONDS + 1 : last + 1;
+        for (int64_t s = from; s <= second; s++) session.rate[s % WS_RATE_SECONDS] = 0;
+        session.rate_second = second;
+    }
+    session.rate[second % WS_RATE_SECONDS]++;
+    session.received++;
+    session.bytes_received += length;
+}
+
+// Bytes of message i still in the ring, 0 once overwritten. Call with session.mutex held.
+static int storedBytes(const WebSocketSession& session, const WsMessage& msg)
+{
+    if (msg.position < session.payload_end - WS_RING_BYTES) return 0;
+    return msg.stored;
+}
+
+// Copies up to size bytes of a message out of the ring. Call with session.mutex held.
+static int copyMessage(const WebSocketSession& session, const WsMessage& msg, char* out, int size)
+{
+    int n = storedBytes(session, msg);
+    if (n > size) n = size;
+    for (int i=0; i<n; i++)
+        out[i] = session.payload[(msg.position + i) % WS_RING_BYTES];
+    return n;
+}
+
+#ifdef HAVE_CURL_WEBSOCKETS
+
+// curl_ws_recv returns a const frame since 8.x, picked by overloading on its
+// type. Inline, the overload the installed curl does not match is never used.
+typedef CURLcode (*WsRecvConst)(CURL*, void*, size_t, size_t*, const struct curl_ws_frame**);
+typedef CURLcode (*WsRecvMutable)(CURL*, void*, size_t, size_t*, struct curl_ws_frame**);
+
+static inline CURLcode wsRecv(WsRecvConst recv, CURL* curl, void* buffer, size_t size, size_t* n, const struct curl_ws_frame** meta)
+{
+    return recv(curl, buffer, size, n, meta);
+}
+
+static inline CURLcode wsRecv(WsRecvMutable recv, CURL* curl, void* buffer, size_t size, size_t* n, const struct curl_ws_frame** meta)
+{
+    struct curl_ws_frame* frame = NULL;
+    CURLcode res = recv(curl, buffer, size, n, &frame);
+    *meta = frame;
+    return res;
+}
+
+static bool waitSocket(CURL* curl, int timeout_ms, bool write)
+{
+    curl_socket_t sock = CURL_SOCKET_BAD;
+    if (curl_easy_getinfo(curl, CURLINFO_ACTIVESOCKET, &sock) != CURLE_OK || sock == CURL_SOCKET_BAD)
+        return false;
+    fd_set ready;
+    FD_ZERO(&ready);
+    FD_SET(sock, &ready);
+    struct timeval timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+    return select((int)sock + 1, write ? NULL : &ready, write ? &ready : NULL, NULL, &timeout) >= 0;
+}
+
+static bool waitReadable(CURL* curl, int timeout_ms) { return waitSocket(curl, timeout_ms, false); }
+static bool waitWritable(CURL* curl, int timeout_ms) { return waitSocket(curl, timeout_ms, true); }
+
+static CURLcode sendText(WebSocketSession& session, CURL* curl, const char* data, int length)
+{
+    size_t offset = 0;
+    while (offset < (size_t)length) {
+        size_t sent = 0;
+        CURLcode res = curl_ws_send(curl, data + offset, (size_t)length - offset, &sent, 0, CURLWS_TEXT);
+        if (res == CURLE_AGAIN) {
+            // the socket buffer is full, wait until it drains
+            if (!waitWritable(curl, WS_POLL_MS)) return CURLE_SEND_ERROR;
+            continue;
+        }
+        if (res != CURLE_OK) return res;
+        offset += sent;
+    }
+    recordMessage(session, data, length < WS_MAX_MESSAGE_BYTES ? length : WS_MAX_MESSAGE_BYTES, length,
+                  WS_MESSAGE_TEXT | WS_MESSAGE_SENT, nowUs());
+    session.sent++;
+    return CURLE_OK;
+}
+
+static CURLcode sendOutbox(WebSocketSession& session, CURL* curl)
+{
+    pg::Vector<pg::Body> outbox;
+    {
+        std::lock_guard<std::mutex> lock(session.mutex);
+        if (session.outbox.size() == 0) return CURLE_OK;
+        outbox = session.outbox;
+        session.outbox.clear();
+    }
+    for (int i=0; i<outbox.size(); i++) {
+        CURLcode res = sendText(session, curl, outbox[i].buf(), outbox[i].length());
+        if (res != CURLE_OK) return res;
+    }
+    return CURLE_OK;
+}
+
+// Receives until the server closes, an error or cancel. Fragments of a message
+// are joined in message, which keeps its first WS_MAX_MESSAGE_BYTES.
+static CURLcode receiveLoop(WebSocketSession& session, CURL* curl)
+{
+    char* buffer = (char*)malloc(WS_RECV_BUFFER);
+    char* message = (char*)malloc(WS_MAX_MESSAGE_BYTES);
+    int stored = 0, length = 0, flags = 0;
+    CURLcode res = CURLE_OK;
+    while (!session.cancel) {
+        res = sendOutbox(session, curl);
+        if (res != CURLE_OK) break;
+
+        size_t n = 0;
+        const struct curl_ws_frame* meta = NULL;
+        res = wsRecv(curl_ws_recv, curl, buffer, WS_RECV_BUFFER, &n, &meta);
+        if (res == CURLE_AGAIN) {
+            if (!waitReadable(curl, WS_POLL_MS)) break;
+            continue;
+        }
+        if (res != CURLE_OK || meta == NULL) break;
+        if (meta->flags & CURLWS_CLOSE) break;
+        if (!(meta->flags & (CURLWS_TEXT | CURLWS_BINARY))) continue;  // ping, pong
+
+        if (length == 0) flags = meta->flags & CURLWS_BINARY ? WS_MESSAGE_BINARY : WS_MESSAGE_TEXT;
+        int keep = (int)n < WS_MAX_MESSAGE_BYTES - stored ? (int)n : WS_MAX_MESSAGE_BYTES - stored;
+        memcpy(message + stored, buffer, (size_t)keep);
+        stored += keep;
+        length += (int)n;
+        if (meta->bytesleft == 0 && !(meta->flags & CURLWS_CONT)) {
+            int64_t now = nowUs();
+            recordMessage(session, message, stored, length, flags, now);
+            countArrival(session, length, now);
+            stored = 0;
+            length = 0;
+        }
+    }
+    free(buffer);
+    free(message);
+    return res == CURLE_AGAIN ? CURLE_OK : res;
+}
+
+#endif
+
+// A line per message, oldest first, for the History result
+static void summarize(WebSocketSession& session, pg::String& out, int64_t duration_us)
+{
+    char line[WS_PREVIEW_CHARS + 64];
+    snprintf(line, sizeof(line), "%lld received (%.1f KB), %lld sent in %.1fs\n\n",
+             (long long)session.received, session.bytes_received / 1024.0, (long long)session.sent, duration_us / 1e6);
+    out.set(line);
+    std::lock_guard<std::mutex> lock(session.mutex);
+    int64_t first = session.num_messages - WS_SUMMARY_MESSAGES;
+    if (first < 0) first = 0;
+    for (int64_t i = first; i < session.num_messages; i++) {
+        const WsMessage& msg = session.messages[i % WS_RING_MESSAGES];
+        char text[WS_PREVIEW_CHARS + 1];
+        int n = copyMessage(session, msg, text, WS_PREVIEW_CHARS);
+        for (int k=0; k<n; k++)
+            if ((unsigned char)text[k] < 0x20 || (msg.flags & WS_MESSAGE_BINARY)) text[k] = '.';
+        text[n] = '\0';
+        snprintf(line, sizeof(line), "%s %s%s\n", msg.flags & WS_MESSAGE_SENT ? ">" : "<", text,
+                 msg.length > n ? "..." : "");
+        out.append(line);
+    }
+}
+
+void threadWebSocket(std::atomic<ThreadStatus>& thread_status, WebSocketSession& session, Request hist,
+                     pg::Body& result, int& response_code, int64_t& duration_us)
+{
+    traceSetThreadName("websocket");
+    TRACE_SCOPE("websocket");
+    session.status = RUNNING;
+    if (session.messages == NULL) {
+        session.messages = (WsMessage*)malloc(sizeof(WsMessage) * WS_RING_MESSAGES);
+        session.payload = (char*)malloc(WS_RING_BYTES);
+    }
+    int64_t start = nowUs();
+
+#ifdef HAVE_CURL_WEBSOCKETS
+    bool supported = false;
+    const curl_version_info_data* info = curl_version_info(CURLVERSION_NOW);
+    for (const char* const* p = info->protocols; p && *p; p++)
+        if (strcmp(*p, "ws") == 0) supported = true;
+
+    PreparedRequest prepared;
+    if (!supported) {
+        snprintf(session.error, sizeof(session.error), "libcurl %s was built without WebSocket support", info->version);
+    } else {
+        prepareRequest(prepared, hist);
+        if (!prepared.valid) {
+            snprintf(session.error, sizeof(session.error), "Problem setting header!");
+        } else {
+            CURLcode res = performPreparedRequest(prepared, response_code);
+            if (res == CURLE_OK) {
+                session.connected_us = nowUs();
+                if (hist.input_json.length() > 0)
+                    res = sendText(session, prepared.curl, hist.input_json.buf(), hist.input_json.length());
+                if (res == CURLE_OK)
+                    res = receiveLoop(session, prepared.curl);
+            }
+            if (res != CURLE_OK)
+                snprintf(session.error, sizeof(session.error), "%s", curl_easy_strerror(res));
+        }
+    }
+#else
+    snprintf(session.error, sizeof(session.error), "WebSocket sessions need libcurl 7.86 or later");
+#endif
+
+    duration_us = nowUs() - start;
+    pg::String summary;
+    if (session.error[0] != '\0') {
+        summary.set(session.error);
+        summary.append("\n");
+    }
+    pg::String messages;
+    summarize(session, messages, duration_us);
+    summary.append(messages.buf_);
+    result = pg::Body(summary);
+    {
+        std::lock_guard<std::mutex> lock(session.mutex);
+        session.outbox.clear();
+    }
+    session.status = FINISHED;
+    thread_status = FINISHED;
+}
+
+bool webSocketSend(WebSocketSession& session, const char* text, int length)
+{
+    if (session.status != RUNNING || session.connected_us == 0 || length <= 0) return false;
+    std::lock_guard<std::mutex> lock(session.mutex);
+    session.outbox.push_back(pg::Body(text, length));
+    return true;
+}
+
+void webSocketWindow(bool* open, WebSocketSession& session)
+{
+    ImGui::Begin("WebSocket", open);
+    bool running = session.status == RUNNING;
+    int64_t now = nowUs();
+    if (running && session.connected_us > 0) {
+        ImGui::Text("Connected for %.1fs", (now - session.connected_us) / 1e6);
+        ImGui::SameLine();
+        if (ImGui::Button("Close")) session.cancel = true;
+    } else if (running) {
+        ImGui::TextDisabled("Connecting...");
+    } else {
+        ImGui::TextDisabled("Send a WS request from the editor to open a session");
+        if (session.error[0] != '\0') ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", session.error);
+    }
+
+    // rate over the last minute, seconds nothing arrived in read as 0
+    float rate[WS_RATE_SECONDS];
+    int64_t second = now / 1000000;
+    int64_t newest = session.rate_second;
+    for (int k=0; k<WS_RATE_SECONDS; k++) {
+        int64_t s = second - (WS_RATE_SECONDS - 1) + k;
+        rate[k] = s <= newest && s > newest - WS_RATE_SECONDS ? (float)session.rate[s % WS_RATE_SECONDS] : 0.0f;
+    }
+    ImGui::Text("Received %lld (%.1f KB)  Sent %lld  Rate %.0f msg/s",
+                (long long)session.received, session.bytes_received / 1024.0, (long long)session.sent,
+                rate[WS_RATE_SECONDS-2]);
+    ImGui::PlotHistogram("##rate", rate, WS_RATE_SECONDS, 0, "messages per second", 0.0f, FLT_MAX, ImVec2(-1.0f, 50.0f));
+
+    // inter-arrival times, folded into powers of two
+    float bins[WS_GAP_BINS];
+    for (int b=0; b<WS_GAP_BINS; b++) bins[b] = 0.0f;
+    for (int i=0; i<LATENCY_BUCKETS; i++) {
+        int64_t count = session.gaps.counts[i].load(std::memory_order_relaxed);
+        if (count == 0) continue;
+        int64_t value = latencyBucketValue(i);
+        int b = 0;
+        while (b < WS_GAP_BINS-1 && (value >> (b+1)) > 0) b++;
+        bins[b] += (float)count;
+    }
+    ImGui::Text("Inter-arrival (ms)  p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f",
+                latencyPercentile(session.gaps, 50.0) / 1000.0, latencyPercentile(session.gaps, 90.0) / 1000.0,
+                latencyPercentile(session.gaps, 99.0) / 1000.0, latencyPercentile(session.gaps, 99.9) / 1000.0);
+    ImGui::PlotHistogram("##gaps", bins, WS_GAP_BINS, 0, "gap, 1us to 8s (log2)", 0.0f, FLT_MAX, ImVec2(-1.0f, 50.0f));
+
+    static char outgoing[4096] = "";
+    ImGui::PushItemWidth(-ImGui::GetFontSize() * 4);
+    bool send = ImGui::InputText("##ws_send", outgoing, sizeof(outgoing), ImGuiInputTextFlags_EnterReturnsTrue);
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    send |= ImGui::Button("Send");
+    if (send && webSocketSend(session, outgoing, (int)strlen(outgoing)))
+        outgoing[0] = '\0';
+
+    static bool follow = true;
+    ImGui::Checkbox("Follow", &follow);
+    ImGui::BeginChild("##ws_messages", ImVec2(0, 0), true);
+    {
+        std::lock_guard<std::mutex> lock(session.mutex);
+        int64_t first = session.num_messages > WS_RING_MESSAGES ? session.num_messages - WS_RING_MESSAGES : 0;
+        int rows = (int)(session.num_messages - first);
+        int64_t start_us = session.connected_us;
+        ImGuiListClipper clipper;
+        clipper.Begin(rows);
+        while (clipper.Step()) {
+            for (int r=clipper.DisplayStart; r<clipper.DisplayEnd; r++) {
+                const WsMessage& msg = session.messages[(first + r) % WS_RING_MESSAGES];
+                char text[WS_PREVIEW_CHARS + 1];
+                int n = copyMessage(session, msg, text, WS_PREVIEW_CHARS);
+                if (msg.flags & WS_MESSAGE_BINARY) {
+                    // first bytes as hex
+                    int shown = n < WS_PREVIEW_CHARS/3 ? n : WS_PREVIEW_CHARS/3;
+                    for (int k=shown-1; k>=0; k--) {
+                        static const char digits[] = "0123456789abcdef";
+                        unsigned char c = (unsigned char)text[k];
+                        text[k*3] = digits[c >> 4];
+                        text[k*3+1] = digits[c & 15];
+                        text[k*3+2] = ' ';
+                    }
+                    n = shown*3;
+                } else {
+                    for (int k=0; k<n; k++)
+                        if ((unsigned char)text[k] < 0x20) text[k] = ' ';
+                }
+                text[n] = '\0';
+                ImGui::TextDisabled("%10.3f %s %7d", (msg.timestamp_us - start_us) / 1e6,
+                                    msg.flags & WS_MESSAGE_SENT ? ">" : "<", msg.length);
+                ImGui::SameLine();
+                if (n == 0 && msg.length > 0) ImGui::TextDisabled("(dropped from the ring)");
+                else ImGui::TextUnformatted(text);
+            }
+        }
+    }
+    if (follow && running) ImGui::SetScrollHereY(1.0f);
+    ImGui::EndChild();
+    ImGui::End();
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include "requests.h"
+#include "loadtest.h"
+
+// WebSocket sessions (RequestType WEBSOCKET, ws:// and wss:// URLs) on top of
+// libcurl's WebSocket API: prepareRequest sets up the upgrade as a connect
+// only transfer, then frames go through curl_ws_recv and curl_ws_send on the
+// request thread. The body of the request, if any, is sent as the first text
+// message; more can be queued from the WebSocket window while connected.
+//
+// Messages are kept in a bounded ring: the last WS_RING_MESSAGES messages and
+// the last WS_RING_BYTES bytes of payload, whichever runs out first. Each one
+// is timestamped when its last fragment arrives. The receive loop only copies
+// into the ring under a short lock, the window lists the ring with a clipper
+// and reads the counters, so a push service sending thousands of messages per
+// second never holds up either side. Needs libcurl 7.86 or later built with
+// WebSocket support.
+
+#define WS_RING_MESSAGES 65536
+#define WS_RING_BYTES (16*1024*1024)
+#define WS_MAX_MESSAGE_BYTES (1024*1024)  // larger messages are kept truncated
+#define WS_RATE_SECONDS 60
+
+typedef enum WsMessageFlags {
+    WS_MESSAGE_TEXT     = 1,
+    WS_MESSAGE_BINARY   = 2,
+    WS_MESSAGE_SENT     = 4,
+    WS_MESSAGE_TRUNCATED= 8,
+} WsMessageFlags;
+
+typedef struct WsMessage {
+    int64_t timestamp_us;
+    int64_t position;       // in the payload stream, see WebSocketSession::payload
+    int length;             // as received
+    int stored;             // bytes kept in the payload ring
+    int flags;              // WsMessageFlags
+} WsMessage;
+
+typedef struct WebSocketSession {
+    WebSocketSession() { messages = NULL; payload = NULL; status = IDLE; cancel = false; reset(); }
+    ~WebSocketSession();
+    void reset();
+
+    std::atomic<ThreadStatus> status;
+    std::atomic<bool> cancel;
+
+    std::mutex mutex;               // ring and outbox
+    WsMessage* messages;            // WS_RING_MESSAGES, allocated on the first session
+    char* payload;                  // WS_RING_BYTES, byte p of the stream lives at p % WS_RING_BYTES
+    int64_t num_messages;           // ever recorded, message i is at i % WS_RING_MESSAGES
+    int64_t payload_end;            // stream position of the next byte
+    pg::Vector<pg::Body> outbox;    // queued by the window, sent by the request thread
+
+    std::atomic<int64_t> received;
+    std::atomic<int64_t> sent;
+    std::atomic<int64_t> bytes_received;
+    std::atomic<int64_t> connected_us;  // 0 until the upgrade succeeded
+    int64_t last_arrival_us;            // request thread only
+    LatencyHistogram gaps;              // inter-arrival times of received messages
+    std::atomic<int> rate[WS_RATE_SECONDS];     // received per second, slot second % WS_RATE_SECONDS
+    std::atomic<int64_t> rate_second;           // unix second of the newest slot
+    char error[256];                            // written before status turns FINISHED
+} WebSocketSession;
+
+// Runs a WebSocket session for hist until the server closes it or
+// session.cancel is set. result gets a summary and the last messages.
+void threadWebSocket(std::atomic<ThreadStatus>& thread_status, WebSocketSession& session, Request hist,
+                     pg::Body& result, int& response_code, int64_t& duration_us);
+
+// Queues a text message, false when there is no open session
+bool webSocketSend(WebSocketSession& session, const char* text, int length);
+
+// Draws the WebSocket window: rate, inter-arrival histogram, message list and
+// a box to send messages on the open session
+void webSocketWindow(bool* open, WebSocketSession& session);